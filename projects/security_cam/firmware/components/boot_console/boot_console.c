@@ -15,21 +15,38 @@
  * for usb_serial_jtag_is_connected() before starting the countdown, so the
  * user always gets a full 5-second window after the banner appears.
  *
+ * Fast boot
+ * ─────────
+ * After a watchdog, panic, brownout or software reset nobody is at the
+ * terminal, and every second spent here is a second the camera is blind —
+ * the window is skipped. With 'fastboot on' (NVS) it is skipped on
+ * power-on and EN resets too. A reset from the host over USB (idf.py
+ * monitor) always opens it, which is the way back in.
+ *
  * Menu commands (type then Enter)
  * ────────────────────────────────
  *   info      — chip, cores, RAM, flash, free heap
  *   ls        — list files on /sdcard
  *   rm <name> — delete /sdcard/<name>
+ *   repair    — rebuild the index of clips cut short by a reset
+ *   sdbench [MB] — SD throughput/latency in the clip writer's pattern
+ *   top [s]   — per-task CPU %, stack margin, heap (sampled over s seconds)
+ *   trace     — latency histograms, incl. the window before the last reset
  *   format    — FAT32-format the SD card (type YES)
  *   nvs       — erase NVS (type YES)
+ *   fastboot [on|off] — skip this window on power-on
  *   boot      — exit console, continue boot
  *   ?/help    — this list
  */
 
 #include "boot_console.h"
 #include "sdcard.h"
+#include "clip_writer.h"
+#include "sys_monitor.h"
+#include "trace.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <dirent.h>
@@ -44,7 +61,9 @@
 #include "esp_chip_info.h"
 #include "esp_flash.h"
 #include "esp_heap_caps.h"
+#include "esp_system.h"
 #include "nvs_flash.h"
+#include "nvs.h"
 #include "driver/usb_serial_jtag.h"
 #include "driver/usb_serial_jtag_vfs.h"
 
@@ -52,6 +71,8 @@ static const char *TAG = "boot_console";
 
 #define LINE_BUF_LEN    128
 #define MOUNT_POINT     "/sdcard"
+#define NVS_NAMESPACE   "boot_con"
+#define NVS_KEY_FAST    "fast"
 
 /* Queue of characters from the blocking reader task */
 static QueueHandle_t s_char_q;
@@ -95,13 +116,13 @@ static int read_char(TickType_t ticks)
 }
 
 static const char *s_commands[] = {
-    "boot", "format", "help", "info", "ls", "nvs", "rm", NULL
+    "boot", "fastboot", "format", "help", "info", "ls", "nvs", "repair", "rm", "sdbench", "top", "trace", NULL
 };
 
 static void tab_complete(char *buf, size_t *pos, size_t len)
 {
     /* Find all commands that start with the current buffer contents */
-    const char *matches[8];
+    const char *matches[sizeof(s_commands) / sizeof(s_commands[0])];
     int n = 0;
     for (int i = 0; s_commands[i]; i++) {
         if (strncmp(buf, s_commands[i], *pos) == 0) {
@@ -169,8 +190,13 @@ static void cmd_help(void)
            "  info          chip model, cores, RAM, flash, free heap\n"
            "  ls            list files on SD card\n"
            "  rm <name>     delete /sdcard/<name>\n"
+           "  repair        rebuild the index of interrupted clips\n"
+           "  sdbench [MB]  SD write/read/small-file benchmark (default 8 MB)\n"
+           "  top [s]       task CPU %, stack free, heap over s seconds (default 2)\n"
+           "  trace         hot-path latency histograms (previous boot and now)\n"
            "  format        FAT32-format the SD card\n"
            "  nvs           erase NVS partition\n"
+           "  fastboot [on|off]  skip the console window on power-on\n"
            "  boot          exit console, continue normal boot\n"
            "  ?/help        this help\n"
            "\n");
@@ -250,6 +276,65 @@ static void cmd_rm(const char *filename)
     printf("%s\n", unlink(path) == 0 ? "  Deleted." : "  Failed.");
 }
 
+static void cmd_repair(void)
+{
+    if (!ensure_sd_mounted()) return;
+    int n = clip_writer_repair_all(MOUNT_POINT, NULL, NULL);
+    printf("  %d clip(s) repaired (see log for details).\n", n);
+}
+
+/* Pass marks come from the recording config: every frame at the slot
+ * size, no stall longer than the writer queue covers, and upload reads at
+ * the rate they are allowed while recording. */
+static void cmd_sdbench(const char *args)
+{
+    if (!ensure_sd_mounted()) return;
+    uint32_t mb = (args && *args) ? (uint32_t)strtoul(args, NULL, 10) : 8;
+    if (mb == 0 || mb > 256) { printf("  Usage: sdbench [1..256 MB]\n"); return; }
+
+    printf("  Benchmarking %lu MB… ", (unsigned long)mb); fflush(stdout);
+    sdcard_bench_result_t r;
+    esp_err_t err = sdcard_bench(mb * 1024, &r);
+    if (err != ESP_OK) { printf("FAILED (%s)\n", esp_err_to_name(err)); return; }
+    printf("done.\n");
+
+    uint32_t need_kbps  = CONFIG_CLIP_WRITER_SLOT_KB * CONFIG_RECORD_FPS;
+    uint32_t frames     = CONFIG_CLIP_WRITER_QUEUE_FRAMES ? CONFIG_CLIP_WRITER_QUEUE_FRAMES : 1;
+    uint32_t stall_ms   = frames * 1000 / CONFIG_RECORD_FPS;
+    bool w_ok = r.write_kbps   >= need_kbps;
+    bool s_ok = r.write_max_ms <  stall_ms;
+    bool r_ok = r.read_kbps    >= CONFIG_UPLOAD_RECORDING_RATE_KBPS;
+    printf("\n"
+           "  Bus:           %lu-bit @ %lu kHz\n"
+           "  Preallocate:   %lu ms\n"
+           "  Seq write:     %5lu KB/s  (need %lu)  %s\n"
+           "  Write stall:   %5lu ms    (queue %lu ms)  %s\n"
+           "  Seq read:      %5lu KB/s  (need %d), max %lu ms  %s\n"
+           "  Small file:    %lu ms avg, %lu ms max\n"
+           "  Verdict:       %s\n"
+           "\n",
+           (unsigned long)r.bus_width, (unsigned long)r.bus_khz,
+           (unsigned long)r.prealloc_ms,
+           (unsigned long)r.write_kbps, (unsigned long)need_kbps, w_ok ? "OK" : "FAIL",
+           (unsigned long)r.write_max_ms, (unsigned long)stall_ms, s_ok ? "OK" : "FAIL",
+           (unsigned long)r.read_kbps, CONFIG_UPLOAD_RECORDING_RATE_KBPS,
+           (unsigned long)r.read_max_ms, r_ok ? "OK" : "FAIL",
+           (unsigned long)r.small_avg_ms, (unsigned long)r.small_max_ms,
+           (w_ok && s_ok && r_ok) ? "PASS" : "FAIL — not fit for recording");
+}
+
+static void cmd_top(const char *args)
+{
+    int seconds = (args && *args) ? atoi(args) : 2;
+    if (seconds < 1 || seconds > 60) {
+        printf("  Usage: top [1-60 s]\n");
+        return;
+    }
+    printf("  Sampling %d s…\n", seconds); fflush(stdout);
+    esp_err_t err = sys_monitor_print((uint32_t)seconds * 1000);
+    if (err != ESP_OK) { printf("  Failed: %s\n", esp_err_to_name(err)); }
+}
+
 static void cmd_format(void)
 {
     printf("\n  WARNING: This will erase ALL data on the SD card!\n"
@@ -277,10 +362,67 @@ static void cmd_nvs_erase(void)
     else               { printf("  Failed: %s\n", esp_err_to_name(err)); }
 }
 
+static bool fast_boot_flag(void)
+{
+    nvs_handle_t h;
+    uint8_t fast = 0;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &h) == ESP_OK) {
+        nvs_get_u8(h, NVS_KEY_FAST, &fast);
+        nvs_close(h);
+    }
+    return fast != 0;
+}
+
+static void cmd_fastboot(const char *args)
+{
+    if (args && (!strcmp(args, "on") || !strcmp(args, "off"))) {
+        nvs_handle_t h;
+        esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &h);
+        if (err == ESP_OK) {
+            err = nvs_set_u8(h, NVS_KEY_FAST, !strcmp(args, "on"));
+            if (err == ESP_OK) {
+                err = nvs_commit(h);
+            }
+            nvs_close(h);
+        }
+        if (err != ESP_OK) { printf("  Failed: %s\n", esp_err_to_name(err)); return; }
+    } else if (args && *args) {
+        printf("  Usage: fastboot [on|off]\n");
+        return;
+    }
+    printf("  Fast boot %s — console window %s on power-on\n",
+           fast_boot_flag() ? "on" : "off", fast_boot_flag() ? "skipped" : "shown");
+}
+
+/* Unattended resets skip the window; a host-requested one never does */
+static bool skip_window(esp_reset_reason_t reason)
+{
+    switch (reason) {
+    case ESP_RST_PANIC:
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+    case ESP_RST_BROWNOUT:
+    case ESP_RST_SW:
+        return true;
+    case ESP_RST_USB:
+    case ESP_RST_JTAG:
+        return false;
+    default:
+        return fast_boot_flag();
+    }
+}
+
 /* ── main entry point ─────────────────────────────────────────────────────── */
 
 void boot_console_run(void)
 {
+    esp_reset_reason_t reason = esp_reset_reason();
+    if (skip_window(reason)) {
+        ESP_LOGI(TAG, "Skipped (reset reason %d)", (int)reason);
+        return;
+    }
+
     /* Step 1: Install USB JTAG driver and switch VFS to blocking mode */
     setup_usb_driver();
 
@@ -344,8 +486,13 @@ void boot_console_run(void)
         } else if (!strcmp(cmd,"info"))                     { cmd_info();
         } else if (!strcmp(cmd,"ls") || !strcmp(cmd,"dir")) { cmd_ls();
         } else if (!strcmp(cmd,"rm") || !strcmp(cmd,"del")) { cmd_rm(args);
+        } else if (!strcmp(cmd,"repair"))                   { cmd_repair();
+        } else if (!strcmp(cmd,"sdbench"))                  { cmd_sdbench(args);
+        } else if (!strcmp(cmd,"top"))                      { cmd_top(args);
+        } else if (!strcmp(cmd,"trace"))                    { trace_print();
         } else if (!strcmp(cmd,"format"))                   { cmd_format();
         } else if (!strcmp(cmd,"nvs"))                      { cmd_nvs_erase();
+        } else if (!strcmp(cmd,"fastboot"))                 { cmd_fastboot(args);
         } else { printf("  Unknown command '%s'. Type 'help'.\n", cmd); }
     }
 }
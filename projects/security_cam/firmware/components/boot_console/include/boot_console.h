@@ -1,11 +1,16 @@
 /*
- * boot_console.h — Interactive boot-time console with 3-second auto-continue
+ * boot_console.h — Interactive boot-time console with 5-second auto-continue
  *
  * Call boot_console_run() immediately after NVS init and before any hardware
- * init.  It prints a prompt, waits up to 3 seconds for Enter, then either:
+ * init.  It prints a prompt, waits up to 5 seconds for Enter, then either:
  *   • returns immediately (user did nothing → normal boot continues), or
  *   • enters an interactive menu loop until the user types "boot".
  *
+ * The window is skipped after an unattended reset (watchdog, panic,
+ * brownout, esp_restart) and, with the NVS flag set by 'fastboot on',
+ * after power-on and EN resets as well — the camera comes up without the
+ * wait. A reset from the host over USB always opens it.
+ *
  * The SD card does NOT need to be mounted when boot_console_run() is called.
  * Commands that touch the SD card will mount it on demand.
  */
@@ -18,7 +23,8 @@ extern "C" {
 
 /**
  * @brief  Run the boot console.
- *         Blocks for up to 3 s waiting for a keypress.
+ *         Blocks for up to 5 s waiting for a keypress, unless the reset
+ *         reason or the fast-boot flag skips the window.
  *         If Enter (or any key) is received within the timeout, enters the
  *         interactive menu.  Otherwise returns immediately.
  */
@@ -168,7 +168,7 @@ esp_err_t button_adc_init(void)
 #endif
     ESP_LOGI(TAG, "ADC calibration: %s", g_cali_ok ? "OK" : "fallback");
 
-    xTaskCreate(poll_task, "btn_adc", 2048, NULL, 4, NULL);
+    xTaskCreatePinnedToCore(poll_task, "btn_adc", 2048, NULL, 4, NULL, CONFIG_TASK_NET_CORE);
 
     ESP_LOGI(TAG, "ready");
     return ESP_OK;
@@ -1,31 +1,151 @@
 /*
- * camera_hal_p4.c — ESP32-P4 camera HAL stub (Phase 2)
+ * camera_hal_p4.c — ESP32-P4 camera HAL: MIPI-CSI → ISP → hardware H.264
  *
- * Hardware: MIPI-CSI camera + hardware ISP + hardware H.264 encoder.
- * Driver: esp_cam_ctlr_csi + esp_driver_isp (IDF native, no legacy component).
+ * Hardware: MIPI-CSI sensor (RAW8, 2 lanes, 1080p) on the ESP32-P4
+ * Function EV board, hardware ISP, hardware H.264 encoder.
+ * Drivers: esp_cam_sensor (SCCB detect + format), esp_cam_ctlr_csi,
+ * esp_driver_isp, esp_h264.
  *
- * This file is a compile-clean stub. Real implementation added in Phase 2.
- * The stub allows `idf.py set-target esp32p4 && idf.py build` to succeed
- * from day 1, confirming the build system structure is correct.
+ * Pipeline (one sensor stream for every mode — switching is free):
  *
- * Reference: $IDF_PATH/examples/peripherals/camera/camera_dsi/
+ *   sensor ─RAW8─▶ CSI ─▶ ISP (demosaic, RAW8 → YUV420) ─DMA─▶ frame buffer
+ *
+ *   MOTION  the Y plane is point-sampled to MOTION_WIDTH × MOTION_HEIGHT
+ *           GRAY8 (HAL-owned buffer) and the frame buffer goes straight
+ *           back to the CSI driver.
+ *   DUAL    the YUV420 frame buffer itself is delivered, zero-copy;
+ *           camera_hal_get_luma() samples LUMA_WIDTH × LUMA_HEIGHT out of it.
+ *   RECORD  the frame buffer goes through the hardware H.264 encoder and the
+ *           access unit (SPS/PPS + IDR, or P) is delivered in one of
+ *           BITSTREAM_BUFS reference-counted bitstream buffers, zero-copy.
+ *           The YUV frame stays held until the access unit's last release
+ *           or the next get_frame, whichever comes first, so
+ *           camera_hal_get_luma() works on RECORD frames too — the GRAY8
+ *           side output never needs a mode switch.
+ *
+ * YUV420 is the ISP's packed O_UYY_E_VYY layout (odd lines U Y Y, even
+ * lines V Y Y, 3 bytes per pixel pair), which is also the encoder's input
+ * format, so nothing is converted between ISP and encoder. Luma of pixel x
+ * on any line is at byte (x / 2) * 3 + 1 + (x & 1).
+ *
+ * Thumbnails: camera_hal_make_thumbnail() downsamples the held YUV frame
+ * of a RECORD access unit to RGB888 and runs it through the hardware JPEG
+ * encoder (esp_driver_jpeg) — cheap enough for the recording loop.
+ *
+ * The encoder needs a 16-aligned height: frame buffers are ENC_HEIGHT
+ * (1088) lines, the 8 below the sensor image filled black once at init.
+ *
+ * Frame buffers: FRAME_BUFS in PSRAM. At any time one is at the consumer,
+ * one is being filled by DMA, and the rest are free or finished. When the
+ * driver asks for a buffer and none is free, the oldest finished frame is
+ * overwritten — the consumer always gets the latest one (GRAB_LATEST, as
+ * on the S3). Frames are paced to CONFIG_RECORD_FPS here, so every frame
+ * that leaves the encoder can be written; the encoder's reference chain
+ * breaks if one is skipped.
+ *
+ * Bitstream buffers: an access unit can be retained (writer queue, preview)
+ * while the encoder fills another one. Only the bitstream is retained: the
+ * YUV frame behind it goes back at the next get_frame, since the capture
+ * ring cannot spare it longer.
  */
 
 #include "camera_hal.h"
+#include <string.h>
+#include <inttypes.h>
 #include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_cache.h"
+#include "esp_ldo_regulator.h"
+#include "driver/i2c_master.h"
+#include "driver/isp.h"
+#include "driver/jpeg_encode.h"
+#include "esp_cam_ctlr.h"
+#include "esp_cam_ctlr_csi.h"
+#include "esp_cam_sensor.h"
+#include "esp_cam_sensor_detect.h"
+#include "esp_sccb_i2c.h"
+#include "esp_h264_enc_single_hw.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
+#include "freertos/queue.h"
 
 static const char *TAG = "camera_hal_p4";
 
-/* P4 record capabilities — H.264 at 1080p */
 #define MOTION_WIDTH    320
 #define MOTION_HEIGHT   240
 #define RECORD_WIDTH    1920
 #define RECORD_HEIGHT   1080
+#define ENC_HEIGHT      1088            /* encoder macroblock rows */
+#define LUMA_STEP       6               /* 1920×1080 / 6 = 320×180 */
+#define LUMA_WIDTH      (RECORD_WIDTH / LUMA_STEP)
+#define LUMA_HEIGHT     (RECORD_HEIGHT / LUMA_STEP)
+
+#define LINE_BYTES      (RECORD_WIDTH * 3 / 2)
+#define FRAME_BYTES     (LINE_BYTES * ENC_HEIGHT)
+#define FRAME_BUFS      3
+#define BUF_ALIGN       128             /* L2 cache line, DMA and encoder */
+#define BITSTREAM_BYTES (512 * 1024)    /* one access unit; IDR ≈ 100–200 KB */
+#define BITSTREAM_BUFS  6               /* consumer + encoder + writer backlog, 3 MB */
+
+/* camera_hal_make_thumbnail(): 1080 lines → 96 rows (16-line MCUs), 1920
+ * columns → 160; the 6 % vertical squeeze keeps the whole picture */
+#define THUMB_WIDTH     CAM_THUMB_WIDTH
+#define THUMB_HEIGHT    96
+#define THUMB_RGB_BYTES (THUMB_WIDTH * THUMB_HEIGHT * 3)
+#define THUMB_OUT_BYTES (16 * 1024)
+#define THUMB_JPEG_QUALITY 70
+#define THUMB_TIMEOUT_MS   40
+
+/* ESP32-P4 Function EV board camera connector */
+#define SCCB_I2C_PORT   0
+#define SCCB_SDA_PIN    7
+#define SCCB_SCL_PIN    8
+#define SCCB_FREQ_HZ    100000
+#define CSI_LANES       2
+#define MIPI_LDO_CHAN   3               /* powers the MIPI CSI PHY */
+#define MIPI_LDO_MV     2500
+#define ISP_CLOCK_HZ    (80 * 1000 * 1000)
+
+#define FRAME_INTERVAL_US  (1000000LL / CONFIG_RECORD_FPS)
+#define PACE_SLACK_US      5000         /* sensor frame timing jitter */
+
+typedef struct {
+    uint8_t *buf;
+    uint64_t timestamp_us;
+} filled_t;
 
-static bool s_initialized = false;
-static cam_mode_t s_current_mode;
+typedef struct {
+    uint8_t *buf;                       /* encoder output, PSRAM */
+    uint32_t refs;                      /* 0 = free */
+} au_slot_t;
+
+static bool                   s_initialized;
+static cam_mode_t             s_mode;
+static esp_ldo_channel_handle_t s_ldo;
+static i2c_master_bus_handle_t s_i2c;
+static esp_cam_sensor_device_t *s_sensor;
+static esp_cam_ctlr_handle_t  s_cam;
+static isp_proc_handle_t      s_isp;
+static esp_h264_enc_handle_t  s_enc;
+
+static uint8_t               *s_bufs[FRAME_BUFS];
+static QueueHandle_t          s_free_q;         /* uint8_t *, ready for DMA */
+static QueueHandle_t          s_done_q;         /* filled_t, oldest first */
+static uint8_t               *s_held;           /* frame buffer at the consumer */
+static au_slot_t             *s_held_au;        /* its access unit, NULL in DUAL */
+static au_slot_t              s_au[BITSTREAM_BUFS];
+static uint32_t               s_au_held;        /* slots in use */
+static portMUX_TYPE           s_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t               *s_motion;         /* MOTION-mode GRAY8, internal RAM */
+static uint8_t               *s_luma;           /* get_luma() output, internal RAM */
+static jpeg_encoder_handle_t  s_jpeg;           /* thumbnails, created on first use */
+static uint8_t               *s_thumb_rgb;      /* JPEG encoder input */
+static uint8_t               *s_thumb_jpg;      /* JPEG encoder output */
+static size_t                 s_thumb_jpg_cap;
+static uint32_t               s_lane_mbps;
+static int64_t                s_next_us;        /* pacing: earliest next frame */
+static uint32_t               s_encoded;
 
 static const cam_caps_t s_caps = {
     .delivers_jpeg  = false,   /* P4 delivers H.264 in record mode */
@@ -34,32 +154,377 @@ static const cam_caps_t s_caps = {
     .record_height  = RECORD_HEIGHT,
     .motion_width   = MOTION_WIDTH,
     .motion_height  = MOTION_HEIGHT,
+    .supports_dual  = true,    /* luma sampled from the ISP Y plane */
+    .luma_width     = LUMA_WIDTH,
+    .luma_height    = LUMA_HEIGHT,
 };
 
+/* ---------------------------------------------------------------------------
+ * CSI driver callbacks (ISR context)
+ * -------------------------------------------------------------------------*/
+
+static bool IRAM_ATTR on_get_new_trans(esp_cam_ctlr_handle_t handle,
+                                       esp_cam_ctlr_trans_t *trans, void *ctx)
+{
+    BaseType_t woken = pdFALSE;
+    uint8_t *buf = NULL;
+    if (xQueueReceiveFromISR(s_free_q, &buf, &woken) != pdTRUE) {
+        filled_t oldest;
+        if (xQueueReceiveFromISR(s_done_q, &oldest, &woken) == pdTRUE) {
+            buf = oldest.buf;       /* consumer is behind — drop the oldest */
+        }
+    }
+    if (buf) {
+        trans->buffer = buf;
+        trans->buflen = FRAME_BYTES;
+    }
+    return woken == pdTRUE;
+}
+
+static bool IRAM_ATTR on_trans_finished(esp_cam_ctlr_handle_t handle,
+                                        esp_cam_ctlr_trans_t *trans, void *ctx)
+{
+    BaseType_t woken = pdFALSE;
+    filled_t f = { .buf = trans->buffer, .timestamp_us = (uint64_t)esp_timer_get_time() };
+    xQueueSendFromISR(s_done_q, &f, &woken);
+    return woken == pdTRUE;
+}
+
+/* ---------------------------------------------------------------------------
+ * Bring-up
+ * -------------------------------------------------------------------------*/
+
+static esp_err_t sensor_init(uint32_t *lane_mbps)
+{
+    i2c_master_bus_config_t bus_cfg = {
+        .clk_source        = I2C_CLK_SRC_DEFAULT,
+        .i2c_port          = SCCB_I2C_PORT,
+        .scl_io_num        = SCCB_SCL_PIN,
+        .sda_io_num        = SCCB_SDA_PIN,
+        .glitch_ignore_cnt = 7,
+        .flags.enable_internal_pullup = true,
+    };
+    esp_err_t err = i2c_new_master_bus(&bus_cfg, &s_i2c);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    esp_cam_sensor_config_t cam_cfg = {
+        .reset_pin   = -1,
+        .pwdn_pin    = -1,
+        .xclk_pin    = -1,
+        .sensor_port = ESP_CAM_SENSOR_MIPI_CSI,
+    };
+    for (esp_cam_sensor_detect_fn_t *p = &__esp_cam_sensor_detect_fn_array_start;
+         p < &__esp_cam_sensor_detect_fn_array_end && !s_sensor; ++p) {
+        if (p->port != ESP_CAM_SENSOR_MIPI_CSI) {
+            continue;
+        }
+        sccb_i2c_config_t sccb_cfg = {
+            .scl_speed_hz    = SCCB_FREQ_HZ,
+            .device_address  = p->sccb_addr,
+            .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        };
+        if (sccb_new_i2c_io(s_i2c, &sccb_cfg, &cam_cfg.sccb_handle) != ESP_OK) {
+            continue;
+        }
+        s_sensor = p->detect(&cam_cfg);
+        if (!s_sensor) {
+            esp_sccb_del_i2c_io(cam_cfg.sccb_handle);
+        }
+    }
+    if (!s_sensor) {
+        ESP_LOGE(TAG, "No MIPI-CSI sensor answered on SCCB");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* Pick the RAW8 1080p MIPI format */
+    esp_cam_sensor_format_array_t fmts = { 0 };
+    esp_cam_sensor_query_format(s_sensor, &fmts);
+    const esp_cam_sensor_format_t *fmt = NULL;
+    for (uint32_t i = 0; i < fmts.count; i++) {
+        const esp_cam_sensor_format_t *f = &fmts.format_array[i];
+        if (f->port == ESP_CAM_SENSOR_MIPI_CSI && f->format == ESP_CAM_SENSOR_PIXFORMAT_RAW8 &&
+            f->width == RECORD_WIDTH && f->height == RECORD_HEIGHT &&
+            f->mipi_info.lane_num == CSI_LANES) {
+            fmt = f;
+            break;
+        }
+    }
+    if (!fmt) {
+        ESP_LOGE(TAG, "Sensor has no RAW8 %dx%d %d-lane format", RECORD_WIDTH, RECORD_HEIGHT,
+                 CSI_LANES);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    err = esp_cam_sensor_set_format(s_sensor, fmt);
+    if (err != ESP_OK) {
+        return err;
+    }
+    *lane_mbps = fmt->mipi_info.mipi_clk / 1000000;
+    ESP_LOGI(TAG, "Sensor format %s, %"PRIu32" Mbit/s per lane", fmt->name, *lane_mbps);
+    return ESP_OK;
+}
+
+static esp_err_t buffers_init(void)
+{
+    s_free_q = xQueueCreate(FRAME_BUFS, sizeof(uint8_t *));
+    s_done_q = xQueueCreate(FRAME_BUFS, sizeof(filled_t));
+    if (!s_free_q || !s_done_q) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < FRAME_BUFS; i++) {
+        s_bufs[i] = heap_caps_aligned_calloc(BUF_ALIGN, 1, FRAME_BYTES,
+                                             MALLOC_CAP_SPIRAM | MALLOC_CAP_DMA);
+        if (!s_bufs[i]) {
+            return ESP_ERR_NO_MEM;
+        }
+        /* Black padding lines: U/V 128, Y 16. The CSI never writes them. */
+        for (uint8_t *p = s_bufs[i] + LINE_BYTES * RECORD_HEIGHT;
+             p < s_bufs[i] + FRAME_BYTES; p += 3) {
+            p[0] = 128;
+            p[1] = 16;
+            p[2] = 16;
+        }
+        esp_cache_msync(s_bufs[i], FRAME_BYTES, ESP_CACHE_MSYNC_FLAG_DIR_C2M);
+        xQueueSend(s_free_q, &s_bufs[i], 0);
+    }
+
+    for (int i = 0; i < BITSTREAM_BUFS; i++) {
+        uint32_t actual = 0;
+        s_au[i].buf = esp_h264_aligned_calloc(BUF_ALIGN, 1, BITSTREAM_BYTES, &actual,
+                                              MALLOC_CAP_SPIRAM);
+        if (!s_au[i].buf) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    s_motion = heap_caps_aligned_alloc(16, MOTION_WIDTH * MOTION_HEIGHT,
+                                       MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    s_luma   = heap_caps_aligned_alloc(16, LUMA_WIDTH * LUMA_HEIGHT,
+                                       MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    return s_motion && s_luma ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static esp_err_t encoder_init(void)
+{
+    esp_h264_enc_cfg_hw_t cfg = {
+        .pic_type = ESP_H264_RAW_FMT_O_UYY_E_VYY,
+        .gop      = CONFIG_RECORD_FPS * CONFIG_P4_H264_GOP_S,
+        .fps      = CONFIG_RECORD_FPS,
+        .res      = { .width = RECORD_WIDTH, .height = ENC_HEIGHT },
+        .rc       = {
+            .bitrate = CONFIG_P4_H264_BITRATE_KBPS * 1000,
+            .qp_min  = 20,
+            .qp_max  = 40,
+        },
+    };
+    if (esp_h264_enc_hw_new(&cfg, &s_enc) != ESP_H264_ERR_OK ||
+        esp_h264_enc_open(s_enc) != ESP_H264_ERR_OK) {
+        ESP_LOGE(TAG, "H.264 encoder init failed");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
 esp_err_t camera_hal_init(cam_mode_t initial_mode)
 {
-    ESP_LOGI(TAG, "camera_hal_p4 init — STUB (Phase 2 not implemented)");
-    /*
-     * TODO Phase 2:
-     *   - Configure MIPI-CSI interface
-     *   - Initialise ISP pipeline
-     *   - Start H.264 encoder (record mode) or grayscale path (motion mode)
-     *   Reference: esp_cam_ctlr_csi_config_t, esp_cam_new_csi_ctlr()
-     */
-    s_current_mode = initial_mode;
+    esp_ldo_channel_config_t ldo_cfg = { .chan_id = MIPI_LDO_CHAN, .voltage_mv = MIPI_LDO_MV };
+    esp_err_t err = esp_ldo_acquire_channel(&ldo_cfg, &s_ldo);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "MIPI PHY LDO: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    /* Sensor, buffers and encoder survive camera_hal_deinit() */
+    if (!s_sensor) {
+        err = sensor_init(&s_lane_mbps);
+    }
+    if (err == ESP_OK && !s_free_q) {
+        err = buffers_init();
+    }
+    if (err == ESP_OK && !s_enc) {
+        err = encoder_init();
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Camera init failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    esp_cam_ctlr_csi_config_t csi_cfg = {
+        .ctlr_id                = 0,
+        .h_res                  = RECORD_WIDTH,
+        .v_res                  = RECORD_HEIGHT,
+        .lane_bit_rate_mbps     = s_lane_mbps,
+        .input_data_color_type  = CAM_CTLR_COLOR_RAW8,
+        .output_data_color_type = CAM_CTLR_COLOR_YUV420,
+        .data_lane_num          = CSI_LANES,
+        .byte_swap_en           = false,
+        .queue_items            = 1,
+    };
+    err = esp_cam_new_csi_ctlr(&csi_cfg, &s_cam);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "CSI controller: %s", esp_err_to_name(err));
+        return err;
+    }
+    esp_cam_ctlr_evt_cbs_t cbs = {
+        .on_get_new_trans  = on_get_new_trans,
+        .on_trans_finished = on_trans_finished,
+    };
+    ESP_ERROR_CHECK(esp_cam_ctlr_register_event_callbacks(s_cam, &cbs, NULL));
+    ESP_ERROR_CHECK(esp_cam_ctlr_enable(s_cam));
+
+    esp_isp_processor_cfg_t isp_cfg = {
+        .clk_hz                 = ISP_CLOCK_HZ,
+        .input_data_source      = ISP_INPUT_DATA_SOURCE_CSI,
+        .input_data_color_type  = ISP_COLOR_RAW8,
+        .output_data_color_type = ISP_COLOR_YUV420,
+        .has_line_start_packet  = false,
+        .has_line_end_packet    = false,
+        .h_res                  = RECORD_WIDTH,
+        .v_res                  = RECORD_HEIGHT,
+    };
+    err = esp_isp_new_processor(&isp_cfg, &s_isp);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "ISP: %s", esp_err_to_name(err));
+        return err;
+    }
+    ESP_ERROR_CHECK(esp_isp_enable(s_isp));
+
+    ESP_ERROR_CHECK(esp_cam_ctlr_start(s_cam));
+    int on = 1;
+    err = esp_cam_sensor_ioctl(s_sensor, ESP_CAM_SENSOR_IOC_S_STREAM, &on);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Sensor stream on: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    s_mode = initial_mode;
+    s_next_us = 0;
     s_initialized = true;
+    ESP_LOGI(TAG, "MIPI-CSI %dx%d → ISP YUV420 → H.264 %d kbit/s, GOP %d, %d × %u KB buffers, "
+             "%d × %u KB bitstream", RECORD_WIDTH, RECORD_HEIGHT, CONFIG_P4_H264_BITRATE_KBPS,
+             CONFIG_RECORD_FPS * CONFIG_P4_H264_GOP_S, FRAME_BUFS,
+             (unsigned)(FRAME_BYTES >> 10), BITSTREAM_BUFS, (unsigned)(BITSTREAM_BYTES >> 10));
     return ESP_OK;
 }
 
 esp_err_t camera_hal_set_mode(cam_mode_t mode)
 {
-    ESP_LOGI(TAG, "camera_hal_p4 set_mode %d — STUB", mode);
-    /*
-     * TODO Phase 2:
-     *   Switch ISP/encoder configuration between motion and record paths.
-     */
-    s_current_mode = mode;
-    vTaskDelay(pdMS_TO_TICKS(300));
+    if (!s_initialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    /* Same sensor stream in every mode. A new clip must start on an IDR:
+     * reopening the encoder restarts its GOP. */
+    if (mode == CAM_MODE_RECORD && s_mode != CAM_MODE_RECORD) {
+        esp_h264_enc_close(s_enc);
+        if (esp_h264_enc_open(s_enc) != ESP_H264_ERR_OK) {
+            ESP_LOGE(TAG, "H.264 encoder restart failed");
+            return ESP_FAIL;
+        }
+    }
+    s_mode = mode;
+    return ESP_OK;
+}
+
+/* ---------------------------------------------------------------------------
+ * Frames
+ * -------------------------------------------------------------------------*/
+
+static void give_back(uint8_t *buf)
+{
+    xQueueSend(s_free_q, &buf, 0);      /* holds FRAME_BUFS — never full */
+}
+
+/* The consumer's YUV frame, if still held, back to the capture ring */
+static void drop_held(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    uint8_t *buf = s_held;
+    s_held    = NULL;
+    s_held_au = NULL;
+    portEXIT_CRITICAL(&s_lock);
+    if (buf) {
+        give_back(buf);
+    }
+}
+
+/* A second reference to an already-shared access unit costs nothing. A
+ * first extra one keeps the slot out after the consumer moves on: its next
+ * frame needs a free slot to encode into. */
+static bool can_retain(const au_slot_t *slot)
+{
+    return slot->refs > 1 || s_au_held < BITSTREAM_BUFS;
+}
+
+static au_slot_t *au_take(void)
+{
+    au_slot_t *slot = NULL;
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < BITSTREAM_BUFS; i++) {
+        if (s_au[i].refs == 0) {
+            slot       = &s_au[i];
+            slot->refs = 1;
+            s_au_held++;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return slot;
+}
+
+/* Drop one reference; the last one also returns the YUV frame if the
+ * consumer has not moved on yet */
+static void au_release(au_slot_t *slot)
+{
+    uint8_t *buf = NULL;
+    portENTER_CRITICAL(&s_lock);
+    if (slot->refs > 0 && --slot->refs == 0) {
+        s_au_held--;
+        if (s_held_au == slot) {
+            buf       = s_held;
+            s_held    = NULL;
+            s_held_au = NULL;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (buf) {
+        give_back(buf);
+    }
+}
+
+/* Luma of (x, y) in an O_UYY_E_VYY frame */
+static inline uint8_t y_at(const uint8_t *frame, uint32_t x, uint32_t y)
+{
+    return frame[y * LINE_BYTES + (x / 2) * 3 + 1 + (x & 1)];
+}
+
+static void sample_motion(const uint8_t *frame)
+{
+    uint8_t *out = s_motion;
+    for (uint32_t y = 0; y < MOTION_HEIGHT; y++) {
+        uint32_t sy = y * RECORD_HEIGHT / MOTION_HEIGHT;
+        for (uint32_t x = 0; x < MOTION_WIDTH; x++) {
+            *out++ = y_at(frame, x * RECORD_WIDTH / MOTION_WIDTH, sy);
+        }
+    }
+}
+
+static esp_err_t encode(const filled_t *fr, au_slot_t *slot, cam_frame_t *f)
+{
+    esp_h264_enc_in_frame_t in = {
+        .raw_data = { .buffer = fr->buf, .len = FRAME_BYTES },
+        .pts      = (uint32_t)(fr->timestamp_us / 1000),
+    };
+    esp_h264_enc_out_frame_t out = {
+        .raw_data = { .buffer = slot->buf, .len = BITSTREAM_BYTES },
+    };
+    if (esp_h264_enc_process(s_enc, &in, &out) != ESP_H264_ERR_OK) {
+        return ESP_FAIL;
+    }
+    s_encoded++;
+    f->data    = slot->buf;
+    f->len     = out.length;
+    f->fmt     = CAM_PIXFMT_H264_NALU;
+    f->hal_ref = slot;
     return ESP_OK;
 }
 
@@ -68,26 +533,132 @@ esp_err_t camera_hal_get_frame(cam_frame_t *f, uint32_t timeout_ms)
     if (!s_initialized) {
         return ESP_ERR_INVALID_STATE;
     }
-    /* Stub: return a fake 1-byte frame */
-    static uint8_t dummy = 0;
-    f->data         = &dummy;
-    f->len          = 1;
-    f->width        = (s_current_mode == CAM_MODE_MOTION) ? MOTION_WIDTH  : RECORD_WIDTH;
-    f->height       = (s_current_mode == CAM_MODE_MOTION) ? MOTION_HEIGHT : RECORD_HEIGHT;
-    f->fmt          = (s_current_mode == CAM_MODE_MOTION) ? CAM_PIXFMT_GRAY8 : CAM_PIXFMT_H264_NALU;
-    f->timestamp_us = 0;
-    vTaskDelay(pdMS_TO_TICKS(timeout_ms > 100 ? 100 : timeout_ms));
+    f->hal_ref = NULL;              /* RECORD frames get their slot below */
+    /* A retained access unit gives up its YUV frame here; a DUAL frame
+     * should have been released */
+    if (s_held && !s_held_au) {
+        ESP_LOGW(TAG, "get_frame before release — releasing the previous frame");
+    }
+    drop_held();
+
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    filled_t fr;
+    while (1) {
+        int64_t left_us = deadline - esp_timer_get_time();
+        if (left_us <= 0 ||
+            xQueueReceive(s_done_q, &fr, pdMS_TO_TICKS(left_us / 1000) + 1) != pdTRUE) {
+            return ESP_ERR_TIMEOUT;
+        }
+        /* The sensor runs faster than CONFIG_RECORD_FPS */
+        if ((int64_t)fr.timestamp_us + PACE_SLACK_US < s_next_us) {
+            give_back(fr.buf);
+            continue;
+        }
+        s_next_us += FRAME_INTERVAL_US;
+        if (s_next_us < (int64_t)fr.timestamp_us) {
+            s_next_us = (int64_t)fr.timestamp_us + FRAME_INTERVAL_US;
+        }
+        break;
+    }
+
+    /* DMA wrote behind the cache */
+    esp_cache_msync(fr.buf, FRAME_BYTES, ESP_CACHE_MSYNC_FLAG_DIR_M2C);
+    f->timestamp_us = fr.timestamp_us;
+
+    if (s_mode == CAM_MODE_MOTION) {
+        sample_motion(fr.buf);
+        give_back(fr.buf);
+        f->data   = s_motion;
+        f->len    = MOTION_WIDTH * MOTION_HEIGHT;
+        f->width  = MOTION_WIDTH;
+        f->height = MOTION_HEIGHT;
+        f->fmt    = CAM_PIXFMT_GRAY8;
+        return ESP_OK;
+    }
+
+    f->width  = RECORD_WIDTH;
+    f->height = RECORD_HEIGHT;
+    au_slot_t *slot = NULL;
+    if (s_mode == CAM_MODE_RECORD) {
+        /* can_retain() leaves one slot for the consumer's next frame */
+        slot = au_take();
+        if (!slot) {
+            give_back(fr.buf);
+            return ESP_ERR_INVALID_STATE;
+        }
+        if (encode(&fr, slot, f) != ESP_OK) {
+            ESP_LOGW(TAG, "H.264 encode failed");
+            au_release(slot);
+            give_back(fr.buf);
+            return ESP_FAIL;
+        }
+    } else {
+        f->data = fr.buf;
+        f->len  = FRAME_BYTES;
+        f->fmt  = CAM_PIXFMT_YUV420;
+    }
+    portENTER_CRITICAL(&s_lock);
+    s_held    = fr.buf;
+    s_held_au = slot;
+    portEXIT_CRITICAL(&s_lock);
     return ESP_OK;
 }
 
+esp_err_t camera_hal_retain_frame(const cam_frame_t *f)
+{
+    if (!f) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    /* DUAL frames are capture buffers: the ring has none to spare */
+    au_slot_t *slot = f->hal_ref;
+    if (!slot) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    esp_err_t err = ESP_ERR_NO_MEM;
+    portENTER_CRITICAL(&s_lock);
+    if (slot->refs > 0 && can_retain(slot)) {
+        slot->refs++;
+        err = ESP_OK;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return err;
+}
+
 esp_err_t camera_hal_release_frame(cam_frame_t *f)
 {
-    (void)f;
+    if (!f) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (f->hal_ref) {
+        au_release(f->hal_ref);
+    } else if (!s_held_au) {
+        drop_held();                /* DUAL: the frame buffer itself */
+    }
     return ESP_OK;
 }
 
 esp_err_t camera_hal_deinit(void)
 {
+    if (!s_initialized) {
+        return ESP_OK;
+    }
+    int off = 0;
+    esp_cam_sensor_ioctl(s_sensor, ESP_CAM_SENSOR_IOC_S_STREAM, &off);
+    esp_cam_ctlr_stop(s_cam);
+    esp_cam_ctlr_disable(s_cam);
+    esp_cam_ctlr_del(s_cam);
+    esp_isp_disable(s_isp);
+    esp_isp_del_processor(s_isp);
+    esp_ldo_release_channel(s_ldo);
+    ESP_LOGI(TAG, "Deinit after %"PRIu32" encoded frames", s_encoded);
+
+    /* Pending frames go back to the free queue for the next init */
+    filled_t fr;
+    while (xQueueReceive(s_done_q, &fr, 0) == pdTRUE) {
+        give_back(fr.buf);
+    }
+    drop_held();                    /* retained access units stay valid */
     s_initialized = false;
     return ESP_OK;
 }
@@ -96,3 +667,145 @@ const cam_caps_t *camera_hal_get_caps(void)
 {
     return &s_caps;
 }
+
+esp_err_t camera_hal_set_quality(int quality)
+{
+    /* The H.264 encoder has its own rate control (CONFIG_P4_H264_BITRATE_KBPS) */
+    (void)quality;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t camera_hal_encode_jpeg(const cam_frame_t *src, uint8_t *out,
+                                 size_t out_cap, size_t *out_len)
+{
+    /* Only MJPEG clips need it (GRAY8 pre-roll) — not used on the H.264 path */
+    (void)src; (void)out; (void)out_cap; (void)out_len;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+/* DUAL frames are the YUV buffer; RECORD frames still hold theirs
+ * until the next get_frame. NULL for anything else. */
+static const uint8_t *yuv_of(const cam_frame_t *src)
+{
+    if (src->width != RECORD_WIDTH || src->height != RECORD_HEIGHT) {
+        return NULL;
+    }
+    if (src->fmt == CAM_PIXFMT_YUV420) {
+        return src->data;
+    }
+    if (src->fmt == CAM_PIXFMT_H264_NALU && src->hal_ref && src->hal_ref == s_held_au) {
+        return s_held;
+    }
+    return NULL;
+}
+
+static inline uint8_t clamp_u8(int v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : (uint8_t)v;
+}
+
+/* One RGB888 pixel per 2×2 block: its four Y averaged, the U of its first
+ * line and the V of its second (BT.601, studio range) */
+static void sample_thumb(const uint8_t *frame, uint8_t *rgb)
+{
+    for (uint32_t ty = 0; ty < THUMB_HEIGHT; ty++) {
+        const uint8_t *l0 = frame + ((ty * RECORD_HEIGHT / THUMB_HEIGHT) & ~1u) * LINE_BYTES;
+        const uint8_t *l1 = l0 + LINE_BYTES;
+        for (uint32_t tx = 0; tx < THUMB_WIDTH; tx++) {
+            uint32_t o = (tx * RECORD_WIDTH / THUMB_WIDTH / 2) * 3;
+            int c = 298 * ((l0[o + 1] + l0[o + 2] + l1[o + 1] + l1[o + 2]) / 4 - 16);
+            int d = l0[o] - 128;
+            int e = l1[o] - 128;
+            *rgb++ = clamp_u8((c + 409 * e + 128) >> 8);
+            *rgb++ = clamp_u8((c - 100 * d - 208 * e + 128) >> 8);
+            *rgb++ = clamp_u8((c + 516 * d + 128) >> 8);
+        }
+    }
+}
+
+static esp_err_t thumb_init(void)
+{
+    if (!s_thumb_rgb) {
+        jpeg_encode_memory_alloc_cfg_t in_cfg = { .buffer_direction = JPEG_ENC_ALLOC_INPUT_BUFFER };
+        size_t cap = 0;
+        s_thumb_rgb = jpeg_alloc_encoder_mem(THUMB_RGB_BYTES, &in_cfg, &cap);
+    }
+    if (!s_thumb_jpg) {
+        jpeg_encode_memory_alloc_cfg_t out_cfg = { .buffer_direction = JPEG_ENC_ALLOC_OUTPUT_BUFFER };
+        s_thumb_jpg = jpeg_alloc_encoder_mem(THUMB_OUT_BYTES, &out_cfg, &s_thumb_jpg_cap);
+    }
+    if (!s_thumb_rgb || !s_thumb_jpg) {
+        return ESP_ERR_NO_MEM;
+    }
+    jpeg_encode_engine_cfg_t eng_cfg = { .timeout_ms = THUMB_TIMEOUT_MS };
+    return jpeg_new_encoder_engine(&eng_cfg, &s_jpeg);
+}
+
+esp_err_t camera_hal_make_thumbnail(const cam_frame_t *src, uint8_t *out,
+                                    size_t out_cap, size_t *out_len)
+{
+    if (!src || !out || !out_len) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (src->fmt != CAM_PIXFMT_H264_NALU && src->fmt != CAM_PIXFMT_YUV420) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    const uint8_t *frame = yuv_of(src);
+    if (!frame) {
+        return ESP_ERR_INVALID_STATE;   /* a copy, or its YUV frame went back */
+    }
+    if (!s_jpeg) {
+        esp_err_t err = thumb_init();
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "JPEG encoder: %s", esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    sample_thumb(frame, s_thumb_rgb);
+    jpeg_encode_cfg_t cfg = {
+        .width         = THUMB_WIDTH,
+        .height        = THUMB_HEIGHT,
+        .src_type      = JPEG_ENCODE_IN_FORMAT_RGB888,
+        .sub_sample    = JPEG_DOWN_SAMPLING_YUV420,
+        .image_quality = THUMB_JPEG_QUALITY,
+    };
+    uint32_t len = 0;
+    esp_err_t err = jpeg_encoder_process(s_jpeg, &cfg, s_thumb_rgb, THUMB_RGB_BYTES,
+                                         s_thumb_jpg, s_thumb_jpg_cap, &len);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (len > out_cap) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(out, s_thumb_jpg, len);
+    *out_len = len;
+    return ESP_OK;
+}
+
+esp_err_t camera_hal_get_luma(const cam_frame_t *src, cam_frame_t *luma)
+{
+    if (!src || !luma) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const uint8_t *frame = yuv_of(src);
+    if (!frame) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t *out = s_luma;
+    for (uint32_t y = 0; y < LUMA_HEIGHT; y++) {
+        for (uint32_t x = 0; x < LUMA_WIDTH; x++) {
+            *out++ = y_at(frame, x * LUMA_STEP, y * LUMA_STEP);
+        }
+    }
+    luma->data         = s_luma;
+    luma->len          = LUMA_WIDTH * LUMA_HEIGHT;
+    luma->width        = LUMA_WIDTH;
+    luma->height       = LUMA_HEIGHT;
+    luma->fmt          = CAM_PIXFMT_GRAY8;
+    luma->timestamp_us = src->timestamp_us;
+    luma->hal_ref      = NULL;
+    return ESP_OK;
+}
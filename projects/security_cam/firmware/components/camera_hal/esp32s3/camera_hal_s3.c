@@ -3,22 +3,46 @@
  *
  * Hardware: OV2640 image sensor via DVP interface, driven by esp_camera.
  *
- * Two modes:
+ * Three modes:
  *   CAM_MODE_MOTION  → QVGA (320×240) GRAYSCALE — fast readout, minimal CPU
  *   CAM_MODE_RECORD  → VGA (640×480) JPEG — hardware compressed, low CPU
+ *   CAM_MODE_DUAL    → same VGA JPEG stream as RECORD; motion detection reads
+ *                      an 80×60 luma image from camera_hal_get_luma()
+ *                      (DC-only decode, see jpeg_dc.c). DUAL↔RECORD needs no
+ *                      sensor reinit, so recording starts on the next frame.
  *
  * Frame lifecycle:
- *   esp_camera_fb_get() allocates a buffer from the DMA ring (in PSRAM).
- *   We store the original camera_fb_t* in s_current_fb so release_frame()
- *   can call esp_camera_fb_return(). Only one frame is outstanding at a time.
+ *   The DMA ring has CONFIG_CAMERA_FB_COUNT buffers in PSRAM. A capture
+ *   task takes each finished buffer with esp_camera_fb_get() and parks it
+ *   in a one-deep mailbox; a newer frame replaces an untaken one, which
+ *   goes straight back to the ring. camera_hal_get_frame() waits on the
+ *   mailbox with the caller's timeout, so a slow consumer only ever costs
+ *   dropped frames, never a stalled ring.
+ *
+ *   A taken buffer gets a slot in s_slots with a reference count;
+ *   cam_frame_t.hal_ref points at it. retain/release adjust the count
+ *   under s_lock (release is called from the writer task on the other
+ *   core) and the last release returns the buffer with
+ *   esp_camera_fb_return().
+ *
+ *   Ring budget: one buffer is being filled by DMA and one can sit in the
+ *   mailbox, so callers may hold CONFIG_CAMERA_FB_COUNT − 2 at once.
+ *   retain refuses a frame that would push the held count past that once
+ *   the caller takes its next one (see can_retain()).
  */
 
 #include "camera_hal.h"
 #include "esp_camera.h"
+#include "img_converters.h"
+#include "jpeg_dc.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <string.h>
 
 static const char *TAG = "camera_hal_s3";
 
@@ -30,11 +54,56 @@ static const char *TAG = "camera_hal_s3";
 #define RECORD_WIDTH    640
 #define RECORD_HEIGHT   480
 
+/* Software JPEG quality for camera_hal_encode_jpeg() (1–100, higher = better).
+ * Grayscale QVGA at 80 is ~8–12 KB — close to the sensor's own VGA output. */
+#define SW_JPEG_QUALITY 80
+
+/* camera_hal_make_thumbnail(): colour, small enough that q70 is plenty */
+#define THUMB_JPEG_QUALITY 70
+
+/* Sensor JPEG quality at init (0=best, 63=worst) — 12 is good quality.
+ * Changed at runtime by camera_hal_set_quality(). */
+#define JPEG_QUALITY_START 12
+
+/* esp_camera sizes JPEG frame buffers at width × height / 5; a frame
+ * that does not fit is cut off (FB-OVF) */
+#define RECORD_FB_BYTES (RECORD_WIDTH * RECORD_HEIGHT / 5)
+
+/* DUAL mode luma image: one pixel per 8×8 JPEG block of the VGA frame */
+#define LUMA_WIDTH      (RECORD_WIDTH / 8)
+#define LUMA_HEIGHT     (RECORD_HEIGHT / 8)
+
+#define FB_COUNT        CONFIG_CAMERA_FB_COUNT
+#define CAPTURE_STACK   3072
+#define CAPTURE_PRIO    6               /* above the recording loop (4), same core */
+#define HELD_WAIT_MS    2000            /* set_mode: writer queue draining */
+
+typedef struct {
+    camera_fb_t *fb;
+    uint64_t     timestamp_us;
+} captured_t;
+
+typedef struct {
+    camera_fb_t *fb;                    /* NULL = slot free */
+    uint32_t     refs;
+} fb_slot_t;
+
 static cam_mode_t    s_current_mode;
 static bool          s_initialized = false;
-static camera_fb_t  *s_current_fb  = NULL;  /* outstanding frame — returned in release_frame */
 static camera_config_t s_cam_config;         /* saved at init, reused by set_mode reinit */
 
+static fb_slot_t     s_slots[FB_COUNT];
+static uint32_t      s_held;                 /* slots in use */
+static portMUX_TYPE  s_lock = portMUX_INITIALIZER_UNLOCKED;
+static QueueHandle_t s_mailbox;              /* captured_t, depth 1 */
+static SemaphoreHandle_t s_capture_done;     /* given when the capture task exits */
+static volatile bool s_capture_run;
+static uint32_t      s_ring_dropped;         /* frames replaced in the mailbox */
+
+/* camera_hal_get_luma() output. Internal RAM, 16-byte aligned for the
+ * motion kernels; 4.7 KB. Overwritten on every call. */
+static uint8_t s_luma_buf[LUMA_WIDTH * LUMA_HEIGHT] __attribute__((aligned(16)));
+
 static const cam_caps_t s_caps = {
     .delivers_jpeg  = true,
     .delivers_h264  = false,
@@ -42,8 +111,28 @@ static const cam_caps_t s_caps = {
     .record_height  = RECORD_HEIGHT,
     .motion_width   = MOTION_WIDTH,
     .motion_height  = MOTION_HEIGHT,
+    .supports_dual  = true,
+    .luma_width     = LUMA_WIDTH,
+    .luma_height    = LUMA_HEIGHT,
+    .record_frame_max = RECORD_FB_BYTES,
 };
 
+/* RECORD and DUAL share one sensor configuration (VGA JPEG) */
+static bool mode_is_jpeg(cam_mode_t mode)
+{
+    return mode == CAM_MODE_RECORD || mode == CAM_MODE_DUAL;
+}
+
+static const char *mode_name(cam_mode_t mode)
+{
+    switch (mode) {
+    case CAM_MODE_MOTION: return "MOTION";
+    case CAM_MODE_RECORD: return "RECORD";
+    case CAM_MODE_DUAL:   return "DUAL";
+    default:              return "?";
+    }
+}
+
 /* Pin assignments for ESP32-S3-EYE v2.2
  * Source: board schematic + factory firmware */
 #define CAM_PIN_PWDN    (-1)   /* not connected */
@@ -63,6 +152,83 @@ static const cam_caps_t s_caps = {
 #define CAM_PIN_HREF     7
 #define CAM_PIN_PCLK    13
 
+/* ---------------------------------------------------------------------------
+ * Capture task and buffer references
+ * -------------------------------------------------------------------------*/
+
+static void capture_task(void *arg)
+{
+    while (s_capture_run) {
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (!fb) {
+            continue;               /* driver timeout; log comes from esp_camera */
+        }
+        captured_t c = { .fb = fb, .timestamp_us = (uint64_t)esp_timer_get_time() };
+        captured_t old;
+        while (xQueueSend(s_mailbox, &c, 0) != pdTRUE) {
+            if (xQueueReceive(s_mailbox, &old, 0) == pdTRUE) {
+                esp_camera_fb_return(old.fb);
+                s_ring_dropped++;
+            }
+        }
+    }
+    xSemaphoreGive(s_capture_done);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t capture_start(void)
+{
+    if (!s_mailbox) {
+        s_mailbox      = xQueueCreate(1, sizeof(captured_t));
+        s_capture_done = xSemaphoreCreateBinary();
+        if (!s_mailbox || !s_capture_done) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    s_capture_run = true;
+    if (xTaskCreatePinnedToCore(capture_task, "cam_cap", CAPTURE_STACK, NULL, CAPTURE_PRIO, NULL,
+                                CONFIG_TASK_MEDIA_CORE) != pdPASS) {
+        s_capture_run = false;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/* Returns once the task is out of esp_camera_fb_get() — within a frame */
+static void capture_stop(void)
+{
+    if (!s_capture_run) {
+        return;
+    }
+    s_capture_run = false;
+    xSemaphoreTake(s_capture_done, portMAX_DELAY);
+    captured_t c;
+    while (xQueueReceive(s_mailbox, &c, 0) == pdTRUE) {
+        esp_camera_fb_return(c.fb);
+    }
+}
+
+/* Capture stopped: wait for callers to release everything they hold */
+static esp_err_t wait_released(void)
+{
+    for (int ms = 0; s_held > 0; ms += 10) {
+        if (ms >= HELD_WAIT_MS) {
+            ESP_LOGE(TAG, "%"PRIu32" frame(s) still held after %d ms", s_held, HELD_WAIT_MS);
+            return ESP_ERR_TIMEOUT;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return ESP_OK;
+}
+
+/* A second reference to an already-shared buffer costs the ring nothing.
+ * A first extra one keeps the buffer out after the caller moves on to its
+ * next frame: that next frame, the mailbox and DMA each need one more. */
+static bool can_retain(const fb_slot_t *slot)
+{
+    return slot->refs > 1 || s_held + 2 < FB_COUNT;
+}
+
 esp_err_t camera_hal_init(cam_mode_t initial_mode)
 {
     if (s_initialized) {
@@ -92,10 +258,10 @@ esp_err_t camera_hal_init(cam_mode_t initial_mode)
         .ledc_timer     = LEDC_TIMER_0,
         .ledc_channel   = LEDC_CHANNEL_0,
 
-        .pixel_format   = (initial_mode == CAM_MODE_MOTION) ? PIXFORMAT_GRAYSCALE : PIXFORMAT_JPEG,
-        .frame_size     = (initial_mode == CAM_MODE_MOTION) ? FRAMESIZE_QVGA : FRAMESIZE_VGA,
-        .jpeg_quality   = 12,   /* 0=best, 63=worst — 12 is good quality */
-        .fb_count       = 2,
+        .pixel_format   = mode_is_jpeg(initial_mode) ? PIXFORMAT_JPEG : PIXFORMAT_GRAYSCALE,
+        .frame_size     = mode_is_jpeg(initial_mode) ? FRAMESIZE_VGA : FRAMESIZE_QVGA,
+        .jpeg_quality   = JPEG_QUALITY_START,
+        .fb_count       = FB_COUNT,
         .fb_location    = CAMERA_FB_IN_PSRAM,  /* PSRAM DMA mode enabled via CONFIG_CAMERA_PSRAM_DMA */
         .grab_mode      = CAMERA_GRAB_LATEST,
     };
@@ -109,10 +275,16 @@ esp_err_t camera_hal_init(cam_mode_t initial_mode)
         return err;
     }
 
+    err = capture_start();
+    if (err != ESP_OK) {
+        esp_camera_deinit();
+        return err;
+    }
+
     s_current_mode = initial_mode;
     s_initialized  = true;
-    ESP_LOGI(TAG, "OV2640 init OK — mode=%s",
-             initial_mode == CAM_MODE_MOTION ? "MOTION(QVGA/GRAY)" : "RECORD(VGA/JPEG)");
+    ESP_LOGI(TAG, "OV2640 init OK — mode=%s(%s), %d frame buffers", mode_name(initial_mode),
+             mode_is_jpeg(initial_mode) ? "VGA/JPEG" : "QVGA/GRAY", FB_COUNT);
     return ESP_OK;
 }
 
@@ -121,11 +293,17 @@ esp_err_t camera_hal_set_mode(cam_mode_t mode)
     if (!s_initialized) return ESP_ERR_INVALID_STATE;
     if (mode == s_current_mode) return ESP_OK;
 
-    ESP_LOGI(TAG, "Switching mode %s → %s",
-             s_current_mode == CAM_MODE_MOTION ? "MOTION" : "RECORD",
-             mode == CAM_MODE_MOTION ? "MOTION" : "RECORD");
+    /* DUAL↔RECORD: same VGA JPEG stream, only the consumer changes.
+     * No reinit, no frames lost, no AE settling. */
+    if (mode_is_jpeg(mode) && mode_is_jpeg(s_current_mode)) {
+        ESP_LOGD(TAG, "Mode %s → %s (no reinit)", mode_name(s_current_mode), mode_name(mode));
+        s_current_mode = mode;
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "Switching mode %s → %s", mode_name(s_current_mode), mode_name(mode));
 
-    /* Both transitions require full deinit+reinit.
+    /* GRAY↔JPEG transitions require full deinit+reinit.
      *
      * GRAY→JPEG: sensor API set_pixformat() only changes the OV2640 register.
      *   The ESP32-S3 DMA pipeline stays configured for grayscale byte-capture,
@@ -138,13 +316,15 @@ esp_err_t camera_hal_set_mode(cam_mode_t mode)
      * Note: JPEG reinit allocates ~62480-byte frame buffers (640×480÷5 in PSRAM).
      *   OV2640 at quality=12 typically produces 20–40 KB per VGA frame indoors,
      *   so this is sufficient for normal security-camera use. */
-    if (s_current_fb) {
-        esp_camera_fb_return(s_current_fb);
-        s_current_fb = NULL;
+    capture_stop();
+    esp_err_t err = wait_released();
+    if (err != ESP_OK) {
+        capture_start();            /* keep the old mode running */
+        return err;
     }
     esp_camera_deinit();
 
-    if (mode == CAM_MODE_RECORD) {
+    if (mode_is_jpeg(mode)) {
         s_cam_config.pixel_format = PIXFORMAT_JPEG;
         s_cam_config.frame_size   = FRAMESIZE_VGA;
     } else {
@@ -152,7 +332,10 @@ esp_err_t camera_hal_set_mode(cam_mode_t mode)
         s_cam_config.frame_size   = FRAMESIZE_QVGA;
     }
 
-    esp_err_t err = esp_camera_init(&s_cam_config);
+    err = esp_camera_init(&s_cam_config);
+    if (err == ESP_OK) {
+        err = capture_start();
+    }
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Camera reinit failed: %s", esp_err_to_name(err));
         s_initialized = false;
@@ -167,43 +350,96 @@ esp_err_t camera_hal_get_frame(cam_frame_t *f, uint32_t timeout_ms)
 {
     if (!s_initialized) return ESP_ERR_INVALID_STATE;
 
-    /* esp_camera_fb_get() blocks until a frame is ready.
-     * timeout_ms is advisory — we just use it for a brief wait-and-retry. */
-    camera_fb_t *fb = esp_camera_fb_get();
-    if (!fb) {
-        ESP_LOGW(TAG, "esp_camera_fb_get() returned NULL");
+    captured_t c;
+    if (xQueueReceive(s_mailbox, &c, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
         return ESP_ERR_TIMEOUT;
     }
 
-    s_current_fb    = fb;
-    f->data         = fb->buf;
-    f->len          = fb->len;
-    f->width        = fb->width;
-    f->height       = fb->height;
-    f->fmt          = (s_current_mode == CAM_MODE_MOTION) ? CAM_PIXFMT_GRAY8 : CAM_PIXFMT_JPEG;
-    f->timestamp_us = esp_timer_get_time();
+    /* At most FB_COUNT buffers exist, so a free slot always does */
+    fb_slot_t *slot = NULL;
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < FB_COUNT; i++) {
+        if (!s_slots[i].fb) {
+            slot       = &s_slots[i];
+            slot->fb   = c.fb;
+            slot->refs = 1;
+            s_held++;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+    if (!slot) {
+        esp_camera_fb_return(c.fb);
+        return ESP_ERR_INVALID_STATE;
+    }
 
-    (void)timeout_ms;
+    f->data         = c.fb->buf;
+    f->len          = c.fb->len;
+    f->width        = c.fb->width;
+    f->height       = c.fb->height;
+    f->fmt          = mode_is_jpeg(s_current_mode) ? CAM_PIXFMT_JPEG : CAM_PIXFMT_GRAY8;
+    f->timestamp_us = c.timestamp_us;
+    f->hal_ref      = slot;
     return ESP_OK;
 }
 
+esp_err_t camera_hal_retain_frame(const cam_frame_t *f)
+{
+    if (!f) return ESP_ERR_INVALID_ARG;
+    fb_slot_t *slot = f->hal_ref;
+    if (!slot) return ESP_ERR_NOT_SUPPORTED;
+
+    esp_err_t err = ESP_ERR_NO_MEM;
+    portENTER_CRITICAL(&s_lock);
+    if (slot->fb && can_retain(slot)) {
+        slot->refs++;
+        err = ESP_OK;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return err;
+}
+
 esp_err_t camera_hal_release_frame(cam_frame_t *f)
 {
-    (void)f;
-    if (s_current_fb) {
-        esp_camera_fb_return(s_current_fb);
-        s_current_fb = NULL;
+    if (!f || !f->hal_ref) return ESP_ERR_INVALID_ARG;
+    fb_slot_t *slot = f->hal_ref;
+
+    camera_fb_t *done = NULL;
+    portENTER_CRITICAL(&s_lock);
+    if (slot->fb && slot->refs > 0 && --slot->refs == 0) {
+        done     = slot->fb;
+        slot->fb = NULL;
+        s_held--;
     }
+    portEXIT_CRITICAL(&s_lock);
+    if (done) {
+        esp_camera_fb_return(done);
+    }
+    return ESP_OK;
+}
+
+esp_err_t camera_hal_set_quality(int quality)
+{
+    if (quality < CAM_QUALITY_BEST || quality > CAM_QUALITY_WORST) return ESP_ERR_INVALID_ARG;
+    s_cam_config.jpeg_quality = quality;    /* kept by the next reinit */
+    if (!s_initialized || !mode_is_jpeg(s_current_mode)) return ESP_OK;
+
+    /* One register write; the OV2640 applies it from the next frame */
+    sensor_t *sensor = esp_camera_sensor_get();
+    if (!sensor || sensor->set_quality(sensor, quality) != 0) return ESP_FAIL;
     return ESP_OK;
 }
 
 esp_err_t camera_hal_deinit(void)
 {
     if (!s_initialized) return ESP_OK;
-    if (s_current_fb) {
-        esp_camera_fb_return(s_current_fb);
-        s_current_fb = NULL;
+    capture_stop();
+    esp_err_t err = wait_released();
+    if (err != ESP_OK) {
+        capture_start();
+        return err;
     }
+    ESP_LOGI(TAG, "Deinit — %"PRIu32" frames dropped for slow consumers", s_ring_dropped);
     esp_camera_deinit();
     s_initialized = false;
     return ESP_OK;
@@ -213,3 +449,119 @@ const cam_caps_t *camera_hal_get_caps(void)
 {
     return &s_caps;
 }
+
+/* fmt2jpg_cb() output sink — writes into a fixed caller buffer.
+ * Returning 0 aborts the encoder, so overflow is reported instead of
+ * silently truncating the JPEG. */
+typedef struct {
+    uint8_t *buf;
+    size_t   cap;
+    size_t   len;
+    bool     overflow;
+} jpg_sink_t;
+
+static size_t jpg_sink_write(void *arg, size_t index, const void *data, size_t len)
+{
+    jpg_sink_t *sink = arg;
+    if (index + len > sink->cap) {
+        sink->overflow = true;
+        return 0;
+    }
+    memcpy(sink->buf + index, data, len);
+    if (index + len > sink->len) {
+        sink->len = index + len;
+    }
+    return len;
+}
+
+esp_err_t camera_hal_encode_jpeg(const cam_frame_t *src, uint8_t *out,
+                                 size_t out_cap, size_t *out_len)
+{
+    if (!src || !src->data || !out || !out_len) return ESP_ERR_INVALID_ARG;
+    if (src->fmt != CAM_PIXFMT_GRAY8) return ESP_ERR_NOT_SUPPORTED;
+
+    jpg_sink_t sink = { .buf = out, .cap = out_cap };
+    bool ok = fmt2jpg_cb((uint8_t *)src->data, src->len,
+                         (uint16_t)src->width, (uint16_t)src->height,
+                         PIXFORMAT_GRAYSCALE, SW_JPEG_QUALITY,
+                         jpg_sink_write, &sink);
+    if (sink.overflow) return ESP_ERR_INVALID_SIZE;
+    if (!ok)           return ESP_FAIL;
+
+    *out_len = sink.len;
+    return ESP_OK;
+}
+
+/* RGB565 scratch for the scaled decode, PSRAM, allocated on first use */
+static uint8_t *s_thumb_rgb;
+
+esp_err_t camera_hal_make_thumbnail(const cam_frame_t *src, uint8_t *out,
+                                    size_t out_cap, size_t *out_len)
+{
+    if (!src || !src->data || !out || !out_len) return ESP_ERR_INVALID_ARG;
+    if (src->fmt != CAM_PIXFMT_JPEG) return ESP_ERR_NOT_SUPPORTED;
+
+    /* TJpgDec scales inside the IDCT (1/8 is DC only), so decoding at a
+     * reduction costs much less than a full VGA decode plus resize */
+    jpg_scale_t scale;
+    uint32_t div;
+    if (src->width >= CAM_THUMB_WIDTH * 8)      { scale = JPG_SCALE_8X;   div = 8; }
+    else if (src->width >= CAM_THUMB_WIDTH * 4) { scale = JPG_SCALE_4X;   div = 4; }
+    else if (src->width >= CAM_THUMB_WIDTH * 2) { scale = JPG_SCALE_2X;   div = 2; }
+    else                                        { scale = JPG_SCALE_NONE; div = 1; }
+    uint32_t tw = src->width / div, th = src->height / div;
+    if (tw * th > RECORD_WIDTH * RECORD_HEIGHT / 4) return ESP_ERR_INVALID_SIZE;
+
+    if (!s_thumb_rgb) {
+        /* Sized for the largest output the check above lets through */
+        s_thumb_rgb = heap_caps_malloc(RECORD_WIDTH * RECORD_HEIGHT / 4 * 2,
+                                       MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!s_thumb_rgb) return ESP_ERR_NO_MEM;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    if (!jpg2rgb565(src->data, src->len, s_thumb_rgb, scale)) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    jpg_sink_t sink = { .buf = out, .cap = out_cap };
+    bool ok = fmt2jpg_cb(s_thumb_rgb, tw * th * 2, (uint16_t)tw, (uint16_t)th,
+                         PIXFORMAT_RGB565, THUMB_JPEG_QUALITY, jpg_sink_write, &sink);
+    if (sink.overflow) return ESP_ERR_INVALID_SIZE;
+    if (!ok)           return ESP_FAIL;
+
+    ESP_LOGD(TAG, "Thumbnail %"PRIu32"×%"PRIu32": %u → %u B in %lld ms", tw, th,
+             (unsigned)src->len, (unsigned)sink.len, (esp_timer_get_time() - t0) / 1000);
+    *out_len = sink.len;
+    return ESP_OK;
+}
+
+esp_err_t camera_hal_get_luma(const cam_frame_t *src, cam_frame_t *luma)
+{
+    if (!src || !src->data || !luma) return ESP_ERR_INVALID_ARG;
+    if (src->fmt != CAM_PIXFMT_JPEG) return ESP_ERR_NOT_SUPPORTED;
+
+    /* ~2–3 ms for a 30 KB VGA frame at 240 MHz — Huffman walk only */
+    uint32_t bw = 0, bh = 0;
+    esp_err_t err = jpeg_dc_decode(src->data, src->len, s_luma_buf,
+                                   LUMA_WIDTH, LUMA_HEIGHT, &bw, &bh);
+    if (err != ESP_OK) {
+        ESP_LOGD(TAG, "Luma decode failed (%u B): %s",
+                 (unsigned)src->len, esp_err_to_name(err));
+        return err;
+    }
+    if (bw != LUMA_WIDTH || bh != LUMA_HEIGHT) {
+        /* Sensor delivered an unexpected size — output would be partial */
+        ESP_LOGW(TAG, "Luma grid %"PRIu32"×%"PRIu32", expected %d×%d",
+                 bw, bh, LUMA_WIDTH, LUMA_HEIGHT);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    luma->data         = s_luma_buf;
+    luma->len          = sizeof(s_luma_buf);
+    luma->width        = LUMA_WIDTH;
+    luma->height       = LUMA_HEIGHT;
+    luma->fmt          = CAM_PIXFMT_GRAY8;
+    luma->timestamp_us = src->timestamp_us;
+    luma->hal_ref      = NULL;
+    return ESP_OK;
+}
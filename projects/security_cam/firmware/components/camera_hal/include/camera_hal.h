@@ -3,7 +3,7 @@
  *
  * This is the hardware contract. The same API is implemented by:
  *   esp32s3/camera_hal_s3.c  — OV2640 via DVP (esp_camera)
- *   esp32p4/camera_hal_p4.c  — MIPI-CSI + ISP (Phase 2 stub)
+ *   esp32p4/camera_hal_p4.c  — MIPI-CSI + ISP + hardware H.264
  *
  * main.c and all app code use ONLY this header. Zero target ifdefs outside
  * the HAL implementation files.
@@ -24,19 +24,24 @@ extern "C" {
 typedef enum {
     CAM_PIXFMT_JPEG,       /* JPEG compressed (OV2640 HW JPEG, or ISP JPEG) */
     CAM_PIXFMT_GRAY8,      /* 8-bit grayscale, 1 byte/pixel */
-    CAM_PIXFMT_YUV420,     /* YUV 4:2:0 planar */
-    CAM_PIXFMT_H264_NALU,  /* H.264 Network Abstraction Layer Unit (P4 Phase 2) */
+    CAM_PIXFMT_YUV420,     /* YUV 4:2:0 (P4: ISP packed O_UYY_E_VYY) */
+    CAM_PIXFMT_H264_NALU,  /* H.264 access unit, Annex B NALUs (P4) */
 } cam_pixfmt_t;
 
 /* Camera operating mode */
 typedef enum {
     CAM_MODE_MOTION,   /* Low-resolution grayscale for motion detection */
     CAM_MODE_RECORD,   /* Full-resolution JPEG (or H.264) for recording */
+    CAM_MODE_DUAL,     /* RECORD-format stream; motion runs on camera_hal_get_luma().
+                        * Switching DUAL↔RECORD is free (no sensor reinit). */
 } cam_mode_t;
 
 /* A single captured frame.
  * data points into HAL-managed memory — do not free.
- * Call camera_hal_release_frame() when done. */
+ * Call camera_hal_release_frame() when done; camera_hal_retain_frame()
+ * takes an extra reference so the frame can be passed on (to a queue,
+ * another task) without copying. The struct itself may be copied freely —
+ * every copy names the same reference-counted buffer. */
 typedef struct {
     void    *data;          /* Frame payload */
     size_t   len;           /* Payload length in bytes */
@@ -44,6 +49,7 @@ typedef struct {
     uint32_t height;        /* Frame height in pixels */
     cam_pixfmt_t fmt;       /* Pixel format */
     uint64_t timestamp_us;  /* esp_timer_get_time() at capture */
+    void    *hal_ref;       /* HAL buffer handle; NULL in frames built by callers */
 } cam_frame_t;
 
 /* Capabilities reported by camera_hal_get_caps().
@@ -55,6 +61,11 @@ typedef struct {
     uint32_t record_height;       /* Height in RECORD mode */
     uint32_t motion_width;        /* Width in MOTION mode */
     uint32_t motion_height;       /* Height in MOTION mode */
+    bool     supports_dual;       /* True if CAM_MODE_DUAL + camera_hal_get_luma() work */
+    uint32_t luma_width;          /* Width of camera_hal_get_luma() output (0 if unsupported) */
+    uint32_t luma_height;         /* Height of camera_hal_get_luma() output */
+    uint32_t record_frame_max;    /* Largest RECORD frame a buffer holds; longer
+                                   * JPEGs are truncated (0 = no fixed limit) */
 } cam_caps_t;
 
 /**
@@ -68,25 +79,56 @@ esp_err_t camera_hal_init(cam_mode_t initial_mode);
  * @brief  Switch camera mode.
  *         Blocks for up to ~300ms while the sensor stabilises.
  *         Discards frames until the output matches the new mode.
+ *         A switch that reinitialises the sensor first waits for every
+ *         held frame to be released.
  * @param  mode  New mode.
- * @return ESP_OK on success.
+ * @return ESP_OK on success, ESP_ERR_TIMEOUT if frames stayed held.
  */
 esp_err_t camera_hal_set_mode(cam_mode_t mode);
 
 /**
- * @brief  Get the next available frame.
- * @param  f           Filled on success.
+ * @brief  Get the newest frame, waiting up to timeout_ms for one.
+ *         Frames the caller is too slow to take are dropped by the HAL
+ *         (oldest first); the capture hardware never waits on the caller.
+ *         Earlier frames may still be held (see camera_hal_retain_frame()).
+ * @param  f           Filled on success, holding one reference.
  * @param  timeout_ms  How long to wait for a frame.
  * @return ESP_OK on success, ESP_ERR_TIMEOUT if no frame arrived.
  */
 esp_err_t camera_hal_get_frame(cam_frame_t *f, uint32_t timeout_ms);
 
 /**
- * @brief  Release a frame previously obtained via camera_hal_get_frame().
- *         Must be called before getting the next frame.
+ * @brief  Take another reference to a frame from camera_hal_get_frame().
+ *         Each reference needs its own camera_hal_release_frame(). Any task
+ *         may hold and release references.
+ *         The HAL refuses when one more held buffer would leave the
+ *         capture ring unable to deliver — the caller then copies instead.
+ * @return ESP_OK, ESP_ERR_NO_MEM if too many buffers are held,
+ *         ESP_ERR_NOT_SUPPORTED if f is a caller-built frame or one the
+ *         HAL cannot share (P4 DUAL frames are capture buffers).
+ */
+esp_err_t camera_hal_retain_frame(const cam_frame_t *f);
+
+/**
+ * @brief  Drop one reference. The buffer goes back to the capture ring
+ *         when the last one is released.
  */
 esp_err_t camera_hal_release_frame(cam_frame_t *f);
 
+/* camera_hal_set_quality() scale: sensor JPEG quantisation, lower is better */
+#define CAM_QUALITY_BEST   0
+#define CAM_QUALITY_WORST  63
+
+/**
+ * @brief  Set the JPEG quality of RECORD/DUAL frames. Takes effect within
+ *         a frame or two, without a sensor reinit, and is kept across
+ *         mode switches.
+ * @param  quality  CAM_QUALITY_BEST … CAM_QUALITY_WORST.
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if out of range,
+ *         ESP_ERR_NOT_SUPPORTED if RECORD frames are not sensor JPEG.
+ */
+esp_err_t camera_hal_set_quality(int quality);
+
 /**
  * @brief  De-initialise the camera hardware.
  */
@@ -94,10 +136,68 @@ esp_err_t camera_hal_deinit(void);
 
 /**
  * @brief  Return the static capabilities struct for this hardware.
- *         Valid after camera_hal_init(). Never NULL.
+ *         Compile-time constant — valid even before camera_hal_init(),
+ *         so callers can pick the initial mode from it. Never NULL.
  */
 const cam_caps_t *camera_hal_get_caps(void);
 
+/**
+ * @brief  Encode a GRAY8 frame to JPEG into a caller-owned buffer.
+ *         Turns motion-mode frames into MJPEG.
+ *         Does not allocate an output buffer.
+ * @param  src      GRAY8 frame.
+ * @param  out      Destination buffer.
+ * @param  out_cap  Capacity of out in bytes.
+ * @param  out_len  Encoded length on success.
+ * @return ESP_OK on success, ESP_ERR_INVALID_SIZE if out is too small,
+ *         ESP_ERR_NOT_SUPPORTED if this hardware has no encoder path.
+ */
+esp_err_t camera_hal_encode_jpeg(const cam_frame_t *src, uint8_t *out,
+                                 size_t out_cap, size_t *out_len);
+
+/* Target size of camera_hal_make_thumbnail() output */
+#define CAM_THUMB_WIDTH   160
+#define CAM_THUMB_HEIGHT  120
+
+/**
+ * @brief  Encode a small colour JPEG thumbnail of a RECORD-mode frame,
+ *         about CAM_THUMB_WIDTH × CAM_THUMB_HEIGHT — a few KB.
+ *         S3: the JPEG frame is decoded at a power-of-two reduction and
+ *         re-encoded. Takes tens of ms (software decode + encode): call it
+ *         from a background task.
+ *         P4: the YUV frame behind an H.264 frame is downsampled to
+ *         CAM_THUMB_WIDTH × 96 and hardware-encoded, well under a frame
+ *         interval — but only while that YUV frame is held, i.e. before the
+ *         next camera_hal_get_frame().
+ *         Call it from one task only (the scratch buffers are HAL-owned).
+ * @param  src      JPEG frame (may be a copy, need not still be held), or
+ *                  an H.264 frame from the latest camera_hal_get_frame().
+ * @param  out      Destination buffer.
+ * @param  out_cap  Capacity of out in bytes.
+ * @param  out_len  Encoded length on success.
+ * @return ESP_OK on success, ESP_ERR_INVALID_SIZE if out is too small,
+ *         ESP_ERR_INVALID_RESPONSE if the frame could not be decoded,
+ *         ESP_ERR_INVALID_STATE if an H.264 frame's YUV frame is gone,
+ *         ESP_ERR_NOT_SUPPORTED if this hardware has no path for it.
+ */
+esp_err_t camera_hal_make_thumbnail(const cam_frame_t *src, uint8_t *out,
+                                    size_t out_cap, size_t *out_len);
+
+/**
+ * @brief  Derive a small GRAY8 luma image from a RECORD/DUAL-mode frame.
+ *         For JPEG this is a DC-only decode — one pixel per 8×8 block, no
+ *         IDCT — so a VGA frame becomes caps->luma_width × luma_height.
+ *         luma->data points into a HAL-owned buffer (internal RAM,
+ *         16-byte aligned) that stays valid until the next call. The source
+ *         frame may be released as soon as this returns.
+ * @param  src   Frame from camera_hal_get_frame() in DUAL or RECORD mode.
+ * @param  luma  Filled on success (fmt = CAM_PIXFMT_GRAY8, same timestamp).
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if !caps->supports_dual,
+ *         ESP_ERR_INVALID_RESPONSE if the frame could not be decoded,
+ *         ESP_ERR_INVALID_SIZE if the frame is not the RECORD size.
+ */
+esp_err_t camera_hal_get_luma(const cam_frame_t *src, cam_frame_t *luma);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,458 @@
+/*
+ * jpeg_dc.c — DC-only baseline JPEG decoder (luma thumbnail)
+ *
+ * Cost is dominated by Huffman-decoding the AC symbols we throw away.
+ * An 8-bit lookahead table resolves almost every symbol in one step;
+ * longer codes fall back to the canonical maxcode/valptr walk (ITU T.81
+ * Annex F.2.2.3).
+ *
+ * Decoder state is static — the HAL calls this from one task only.
+ */
+
+#include "jpeg_dc.h"
+#include <string.h>
+#include <stdbool.h>
+
+#define HUFF_LOOKAHEAD  8
+#define MAX_COMPONENTS  4
+
+typedef struct {
+    bool     present;
+    uint8_t  vals[256];
+    int32_t  maxcode[18];       /* maxcode[l] = largest code of length l, -1 if none */
+    int32_t  valoff[17];        /* vals index = code + valoff[l] */
+    uint8_t  look_len[1 << HUFF_LOOKAHEAD];  /* 0 = code longer than lookahead */
+    uint8_t  look_val[1 << HUFF_LOOKAHEAD];
+} huff_t;
+
+typedef struct {
+    uint8_t  id;
+    uint8_t  h, v;              /* sampling factors */
+    uint8_t  tq;                /* quant table index */
+    uint8_t  td, ta;            /* DC / AC Huffman table index (from SOS) */
+    int32_t  pred;              /* DC predictor */
+} comp_t;
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint32_t acc;               /* MSB-aligned bit accumulator */
+    int      nbits;
+    bool     marker;            /* hit a marker — feeding zeros */
+    uint32_t overrun;           /* zero bytes fed past end of data */
+} bitreader_t;
+
+static struct {
+    huff_t   dc[4];
+    huff_t   ac[4];
+    uint16_t qdc[4];            /* DC quantiser per table */
+    comp_t   comp[MAX_COMPONENTS];
+    int      ncomp;
+    uint32_t width, height;
+    uint32_t restart_interval;
+} s_dec;
+
+/* ── Standard Huffman tables (ITU T.81 Annex K.3) ───────────────────────── */
+
+static const uint8_t k_dc_lum_bits[16] = { 0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0 };
+static const uint8_t k_dc_chr_bits[16] = { 0,3,1,1,1,1,1,1,1,1,1,0,0,0,0,0 };
+static const uint8_t k_dc_vals[12]     = { 0,1,2,3,4,5,6,7,8,9,10,11 };
+
+static const uint8_t k_ac_lum_bits[16] = { 0,2,1,3,3,2,4,3,5,5,4,4,0,0,1,0x7d };
+static const uint8_t k_ac_lum_vals[162] = {
+    0x01,0x02,0x03,0x00,0x04,0x11,0x05,0x12,0x21,0x31,0x41,0x06,0x13,0x51,0x61,0x07,
+    0x22,0x71,0x14,0x32,0x81,0x91,0xa1,0x08,0x23,0x42,0xb1,0xc1,0x15,0x52,0xd1,0xf0,
+    0x24,0x33,0x62,0x72,0x82,0x09,0x0a,0x16,0x17,0x18,0x19,0x1a,0x25,0x26,0x27,0x28,
+    0x29,0x2a,0x34,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,0x49,
+    0x4a,0x53,0x54,0x55,0x56,0x57,0x58,0x59,0x5a,0x63,0x64,0x65,0x66,0x67,0x68,0x69,
+    0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x83,0x84,0x85,0x86,0x87,0x88,0x89,
+    0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,0xa6,0xa7,
+    0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,0xb5,0xb6,0xb7,0xb8,0xb9,0xba,0xc2,0xc3,0xc4,0xc5,
+    0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,0xe1,0xe2,
+    0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf1,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,
+    0xf9,0xfa,
+};
+
+static const uint8_t k_ac_chr_bits[16] = { 0,2,1,2,4,4,3,4,7,5,4,4,0,1,2,0x77 };
+static const uint8_t k_ac_chr_vals[162] = {
+    0x00,0x01,0x02,0x03,0x11,0x04,0x05,0x21,0x31,0x06,0x12,0x41,0x51,0x07,0x61,0x71,
+    0x13,0x22,0x32,0x81,0x08,0x14,0x42,0x91,0xa1,0xb1,0xc1,0x09,0x23,0x33,0x52,0xf0,
+    0x15,0x62,0x72,0xd1,0x0a,0x16,0x24,0x34,0xe1,0x25,0xf1,0x17,0x18,0x19,0x1a,0x26,
+    0x27,0x28,0x29,0x2a,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,
+    0x49,0x4a,0x53,0x54,0x55,0x56,0x57,0x58,0x59,0x5a,0x63,0x64,0x65,0x66,0x67,0x68,
+    0x69,0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x82,0x83,0x84,0x85,0x86,0x87,
+    0x88,0x89,0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,
+    0xa6,0xa7,0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,0xb5,0xb6,0xb7,0xb8,0xb9,0xba,0xc2,0xc3,
+    0xc4,0xc5,0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,
+    0xe2,0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,
+    0xf9,0xfa,
+};
+
+/* ── Huffman table construction ─────────────────────────────────────────── */
+
+static bool huff_build(huff_t *h, const uint8_t bits[16], const uint8_t *vals, size_t nvals)
+{
+    size_t total = 0;
+    for (int l = 0; l < 16; l++) total += bits[l];
+    if (total > 256 || total > nvals) return false;
+
+    memcpy(h->vals, vals, total);
+    memset(h->look_len, 0, sizeof(h->look_len));
+
+    int32_t code = 0;
+    int32_t k = 0;
+    for (int l = 1; l <= 16; l++) {
+        int n = bits[l - 1];
+        h->valoff[l] = k - code;
+        if (n) {
+            if (l <= HUFF_LOOKAHEAD) {
+                for (int i = 0; i < n; i++) {
+                    int32_t c     = code + i;
+                    int     shift = HUFF_LOOKAHEAD - l;
+                    for (int j = 0; j < (1 << shift); j++) {
+                        h->look_len[(c << shift) | j] = (uint8_t)l;
+                        h->look_val[(c << shift) | j] = vals[k + i];
+                    }
+                }
+            }
+            code += n;
+            k    += n;
+            h->maxcode[l] = code - 1;
+        } else {
+            h->maxcode[l] = -1;
+        }
+        if (code > (1 << l)) return false;   /* over-subscribed table */
+        code <<= 1;
+    }
+    h->maxcode[17] = 0x7FFFFFFF;             /* sentinel */
+    h->present = true;
+    return true;
+}
+
+/* ── Bit reader (handles 0xFF00 stuffing and stops at markers) ──────────── */
+
+static inline void br_fill(bitreader_t *b)
+{
+    while (b->nbits <= 24) {
+        uint32_t byte = 0;
+        if (!b->marker && b->p < b->end) {
+            byte = *b->p++;
+            if (byte == 0xFF) {
+                uint8_t next = (b->p < b->end) ? *b->p : 0xD9;
+                if (next == 0x00) {
+                    b->p++;                  /* stuffed byte */
+                } else {
+                    b->marker = true;        /* leave p on the 0xFF */
+                    b->p--;
+                    byte = 0;
+                }
+            }
+        } else {
+            b->overrun++;
+        }
+        b->acc   |= byte << (24 - b->nbits);
+        b->nbits += 8;
+    }
+}
+
+static inline uint32_t br_get(bitreader_t *b, int n)
+{
+    br_fill(b);
+    uint32_t v = b->acc >> (32 - n);
+    b->acc   <<= n;
+    b->nbits  -= n;
+    return v;
+}
+
+/* Read n bits and sign-extend per T.81 F.2.2.1 (EXTEND) */
+static inline int32_t br_receive_extend(bitreader_t *b, int n)
+{
+    if (n == 0) return 0;
+    int32_t v = (int32_t)br_get(b, n);
+    if (v < (1 << (n - 1))) v += (int32_t)(-1u << n) + 1;
+    return v;
+}
+
+static inline int huff_decode(bitreader_t *b, const huff_t *h)
+{
+    br_fill(b);
+    uint32_t look = b->acc >> (32 - HUFF_LOOKAHEAD);
+    int len = h->look_len[look];
+    if (len) {
+        b->acc  <<= len;
+        b->nbits -= len;
+        return h->look_val[look];
+    }
+    for (int l = HUFF_LOOKAHEAD + 1; l <= 16; l++) {
+        int32_t code = (int32_t)(b->acc >> (32 - l));
+        if (code <= h->maxcode[l]) {
+            b->acc  <<= l;
+            b->nbits -= l;
+            return h->vals[code + h->valoff[l]];
+        }
+    }
+    return -1;
+}
+
+/* Skip to the RSTn marker after a restart interval and reset the reader */
+static bool br_restart(bitreader_t *b)
+{
+    b->acc   = 0;
+    b->nbits = 0;
+    b->marker = false;
+    while (b->p + 1 < b->end) {
+        if (b->p[0] == 0xFF && b->p[1] >= 0xD0 && b->p[1] <= 0xD7) {
+            b->p += 2;
+            return true;
+        }
+        b->p++;
+    }
+    return false;
+}
+
+/* ── Marker segment parsing ─────────────────────────────────────────────── */
+
+static inline uint16_t be16(const uint8_t *p) { return (uint16_t)((p[0] << 8) | p[1]); }
+
+static bool parse_dqt(const uint8_t *p, size_t n)
+{
+    while (n > 0) {
+        uint8_t pq = p[0] >> 4, tq = p[0] & 0x0F;
+        size_t  tbl = pq ? 128 : 64;
+        if (tq > 3 || n < 1 + tbl) return false;
+        s_dec.qdc[tq] = pq ? be16(p + 1) : p[1];
+        p += 1 + tbl;
+        n -= 1 + tbl;
+    }
+    return true;
+}
+
+static bool parse_dht(const uint8_t *p, size_t n)
+{
+    while (n > 0) {
+        if (n < 17) return false;
+        uint8_t tc = p[0] >> 4, th = p[0] & 0x0F;
+        if (tc > 1 || th > 3) return false;
+        size_t total = 0;
+        for (int i = 0; i < 16; i++) total += p[1 + i];
+        if (n < 17 + total) return false;
+        huff_t *h = tc ? &s_dec.ac[th] : &s_dec.dc[th];
+        if (!huff_build(h, p + 1, p + 17, total)) return false;
+        p += 17 + total;
+        n -= 17 + total;
+    }
+    return true;
+}
+
+static bool parse_sof(const uint8_t *p, size_t n)
+{
+    if (n < 6 || p[0] != 8) return false;        /* 8-bit precision only */
+    s_dec.height = be16(p + 1);
+    s_dec.width  = be16(p + 3);
+    s_dec.ncomp  = p[5];
+    if (s_dec.ncomp < 1 || s_dec.ncomp > MAX_COMPONENTS ||
+        n < 6 + 3u * s_dec.ncomp || s_dec.width == 0 || s_dec.height == 0) {
+        return false;
+    }
+    for (int i = 0; i < s_dec.ncomp; i++) {
+        const uint8_t *c = p + 6 + 3 * i;
+        s_dec.comp[i].id = c[0];
+        s_dec.comp[i].h  = c[1] >> 4;
+        s_dec.comp[i].v  = c[1] & 0x0F;
+        s_dec.comp[i].tq = c[2] & 0x03;
+        if (s_dec.comp[i].h < 1 || s_dec.comp[i].h > 4 ||
+            s_dec.comp[i].v < 1 || s_dec.comp[i].v > 4) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void load_default_tables(void)
+{
+    if (!s_dec.dc[0].present) huff_build(&s_dec.dc[0], k_dc_lum_bits, k_dc_vals, sizeof(k_dc_vals));
+    if (!s_dec.dc[1].present) huff_build(&s_dec.dc[1], k_dc_chr_bits, k_dc_vals, sizeof(k_dc_vals));
+    if (!s_dec.ac[0].present) huff_build(&s_dec.ac[0], k_ac_lum_bits, k_ac_lum_vals, sizeof(k_ac_lum_vals));
+    if (!s_dec.ac[1].present) huff_build(&s_dec.ac[1], k_ac_chr_bits, k_ac_chr_vals, sizeof(k_ac_chr_vals));
+}
+
+/* ── Entropy-coded segment ──────────────────────────────────────────────── */
+
+/* Skip the 63 AC coefficients of one block */
+static inline bool skip_ac(bitreader_t *b, const huff_t *ac)
+{
+    for (int k = 1; k < 64; ) {
+        int rs = huff_decode(b, ac);
+        if (rs < 0) return false;
+        int r = rs >> 4, s = rs & 0x0F;
+        if (s == 0) {
+            if (r != 15) break;                  /* EOB */
+            k += 16;                             /* ZRL */
+        } else {
+            br_get(b, s);
+            k += r + 1;
+        }
+    }
+    return true;
+}
+
+static esp_err_t decode_scan(bitreader_t *b, comp_t **scan, int ns,
+                             uint8_t *out, uint32_t out_w, uint32_t out_h)
+{
+    int hmax = 1, vmax = 1;
+    for (int i = 0; i < s_dec.ncomp; i++) {
+        if (s_dec.comp[i].h > hmax) hmax = s_dec.comp[i].h;
+        if (s_dec.comp[i].v > vmax) vmax = s_dec.comp[i].v;
+    }
+
+    /* Interleaved scan: MCU = hmax×vmax 8-pixel units.
+     * Single-component scan: MCU = one block of that component. */
+    uint32_t mcus_x, mcus_y;
+    if (ns == 1) {
+        uint32_t cw = (s_dec.width  * scan[0]->h + hmax - 1) / hmax;
+        uint32_t ch = (s_dec.height * scan[0]->v + vmax - 1) / vmax;
+        mcus_x = (cw + 7) / 8;
+        mcus_y = (ch + 7) / 8;
+    } else {
+        mcus_x = (s_dec.width  + 8 * hmax - 1) / (8 * hmax);
+        mcus_y = (s_dec.height + 8 * vmax - 1) / (8 * vmax);
+    }
+
+    for (int i = 0; i < ns; i++) {
+        scan[i]->pred = 0;
+        if (!s_dec.dc[scan[i]->td].present || !s_dec.ac[scan[i]->ta].present) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+
+    uint32_t mcus_left = s_dec.restart_interval;
+    for (uint32_t my = 0; my < mcus_y; my++) {
+        for (uint32_t mx = 0; mx < mcus_x; mx++) {
+            if (s_dec.restart_interval) {
+                if (mcus_left == 0) {
+                    if (!br_restart(b)) return ESP_ERR_INVALID_RESPONSE;
+                    for (int i = 0; i < ns; i++) scan[i]->pred = 0;
+                    mcus_left = s_dec.restart_interval;
+                }
+                mcus_left--;
+            }
+
+            for (int i = 0; i < ns; i++) {
+                comp_t *c = scan[i];
+                int bh = (ns == 1) ? 1 : c->h;
+                int bv = (ns == 1) ? 1 : c->v;
+                const huff_t *dc = &s_dec.dc[c->td];
+                const huff_t *ac = &s_dec.ac[c->ta];
+                bool is_luma = (c == &s_dec.comp[0]);
+
+                for (int v = 0; v < bv; v++) {
+                    for (int h = 0; h < bh; h++) {
+                        int t = huff_decode(b, dc);
+                        if (t < 0 || t > 11) return ESP_ERR_INVALID_RESPONSE;
+                        c->pred += br_receive_extend(b, t);
+                        if (!skip_ac(b, ac)) return ESP_ERR_INVALID_RESPONSE;
+
+                        if (is_luma) {
+                            uint32_t bx = mx * bh + h;
+                            uint32_t by = my * bv + v;
+                            if (bx < out_w && by < out_h) {
+                                /* DC = 8 × block mean (level-shifted) */
+                                int32_t mean = ((c->pred * (int32_t)s_dec.qdc[c->tq]) >> 3) + 128;
+                                out[by * out_w + bx] = (uint8_t)(mean < 0 ? 0 : mean > 255 ? 255 : mean);
+                            }
+                        }
+                    }
+                }
+            }
+            /* A handful of zero bytes past the end is normal (the last
+             * symbols sit in the final partial byte); more means truncation. */
+            if (b->overrun > 8) return ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+    return ESP_OK;
+}
+
+/* ── Public API ─────────────────────────────────────────────────────────── */
+
+esp_err_t jpeg_dc_decode(const uint8_t *jpg, size_t len,
+                         uint8_t *out, uint32_t out_w, uint32_t out_h,
+                         uint32_t *img_w, uint32_t *img_h)
+{
+    if (!jpg || !out || len < 4 || jpg[0] != 0xFF || jpg[1] != 0xD8) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(&s_dec, 0, sizeof(s_dec));
+    bool have_sof = false;
+
+    const uint8_t *p   = jpg + 2;
+    const uint8_t *end = jpg + len;
+    while (p + 4 <= end) {
+        if (p[0] != 0xFF) return ESP_ERR_INVALID_RESPONSE;
+        uint8_t m = p[1];
+        if (m == 0xFF) { p++; continue; }         /* fill byte */
+        if (m == 0xD8 || (m >= 0xD0 && m <= 0xD7)) { p += 2; continue; }
+        if (m == 0xD9) break;                     /* EOI before SOS */
+
+        size_t seg = be16(p + 2);
+        if (seg < 2 || p + 2 + seg > end) return ESP_ERR_INVALID_RESPONSE;
+        const uint8_t *d = p + 4;
+        size_t         n = seg - 2;
+
+        switch (m) {
+        case 0xC0: case 0xC1:                     /* baseline / extended Huffman */
+            if (!parse_sof(d, n)) return ESP_ERR_INVALID_RESPONSE;
+            have_sof = true;
+            break;
+        case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+        case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+            return ESP_ERR_NOT_SUPPORTED;         /* progressive / lossless / arithmetic */
+        case 0xC4:
+            if (!parse_dht(d, n)) return ESP_ERR_INVALID_RESPONSE;
+            break;
+        case 0xDB:
+            if (!parse_dqt(d, n)) return ESP_ERR_INVALID_RESPONSE;
+            break;
+        case 0xDD:
+            if (n < 2) return ESP_ERR_INVALID_RESPONSE;
+            s_dec.restart_interval = be16(d);
+            break;
+        case 0xDA: {
+            if (!have_sof || n < 1) return ESP_ERR_INVALID_RESPONSE;
+            int ns = d[0];
+            if (ns < 1 || ns > s_dec.ncomp || n < 1 + 2u * ns + 3) return ESP_ERR_INVALID_RESPONSE;
+
+            comp_t *scan[MAX_COMPONENTS];
+            bool has_luma = false;
+            for (int i = 0; i < ns; i++) {
+                uint8_t id = d[1 + 2 * i];
+                scan[i] = NULL;
+                for (int c = 0; c < s_dec.ncomp; c++) {
+                    if (s_dec.comp[c].id == id) scan[i] = &s_dec.comp[c];
+                }
+                if (!scan[i]) return ESP_ERR_INVALID_RESPONSE;
+                scan[i]->td = (d[2 + 2 * i] >> 4) & 0x03;
+                scan[i]->ta = d[2 + 2 * i] & 0x03;
+                if (scan[i] == &s_dec.comp[0]) has_luma = true;
+            }
+            if (!has_luma) {
+                return ESP_ERR_INVALID_RESPONSE;  /* luma always comes first in baseline */
+            }
+
+            load_default_tables();
+
+            uint32_t bw = (s_dec.width  + 7) / 8;
+            uint32_t bh = (s_dec.height + 7) / 8;
+            if (img_w) *img_w = bw;
+            if (img_h) *img_h = bh;
+
+            bitreader_t b = { .p = p + 2 + seg, .end = end };
+            return decode_scan(&b, scan, ns, out, out_w, out_h);
+        }
+        default:
+            break;                                /* APPn, COM, … */
+        }
+        p += 2 + seg;
+    }
+    return ESP_ERR_INVALID_RESPONSE;
+}
@@ -0,0 +1,46 @@
+/*
+ * jpeg_dc.h — DC-only baseline JPEG decoder (luma thumbnail)
+ *
+ * Internal to camera_hal component. Target-independent.
+ *
+ * Produces one output pixel per 8×8 luma block: the block mean, taken
+ * straight from the dequantised DC coefficient. AC coefficients are
+ * Huffman-decoded only to skip over them — no IDCT, no colour conversion,
+ * no chroma output. A VGA frame yields an 80×60 GRAY8 image.
+ *
+ * Supports baseline sequential Huffman JPEG (SOF0/SOF1), any sampling
+ * factors, restart intervals, and JPEGs without DHT (standard Annex K
+ * tables are assumed, as for abbreviated MJPEG streams).
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief  Decode the luma DC plane of a baseline JPEG.
+ * @param  jpg     JPEG data (starting at SOI).
+ * @param  len     JPEG length in bytes.
+ * @param  out     Output buffer, out_w × out_h bytes, row-major.
+ * @param  out_w   Output width in blocks. Blocks beyond the image are left
+ *                 unchanged; blocks beyond out_w are discarded.
+ * @param  out_h   Output height in blocks.
+ * @param  img_w   If non-NULL, receives the image width in blocks.
+ * @param  img_h   If non-NULL, receives the image height in blocks.
+ * @return ESP_OK on success,
+ *         ESP_ERR_NOT_SUPPORTED for progressive/arithmetic JPEG,
+ *         ESP_ERR_INVALID_RESPONSE for a malformed or truncated stream.
+ */
+esp_err_t jpeg_dc_decode(const uint8_t *jpg, size_t len,
+                         uint8_t *out, uint32_t out_w, uint32_t out_h,
+                         uint32_t *img_w, uint32_t *img_h);
+
+#ifdef __cplusplus
+}
+#endif
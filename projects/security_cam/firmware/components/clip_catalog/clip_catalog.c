@@ -0,0 +1,149 @@
+/*
+ * clip_catalog.c — Cached SD free space and clip counts
+ *
+ * The card is only read in clip_catalog_rebuild(). Everything else is
+ * arithmetic on the cached numbers under a mutex — the 64-bit counters
+ * are not atomic on Xtensa.
+ */
+
+#include "clip_catalog.h"
+#include "sdcard.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include "esp_log.h"
+#include "esp_vfs_fat.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "clip_catalog";
+
+static SemaphoreHandle_t    s_lock;
+static clip_catalog_stats_t s_stats;
+static clip_catalog_change_cb_t s_change_cb;
+static void                *s_change_ctx;
+
+static void changed(void)
+{
+    if (s_change_cb) {
+        s_change_cb(s_change_ctx);
+    }
+}
+
+void clip_catalog_set_change_cb(clip_catalog_change_cb_t cb, void *ctx)
+{
+    s_change_ctx = ctx;
+    s_change_cb  = cb;
+}
+
+/* Clusters a file of this size takes */
+static uint64_t on_disk(uint64_t bytes)
+{
+    return (bytes + SDCARD_ALLOC_UNIT_SIZE - 1) & ~(uint64_t)(SDCARD_ALLOC_UNIT_SIZE - 1);
+}
+
+bool clip_catalog_is_clip(const char *name)
+{
+    size_t len = strlen(name);
+    return (len > 4 && (strcmp(name + len - 4, ".avi") == 0 ||
+                        strcmp(name + len - 4, ".mp4") == 0)) ||
+           (len > 5 && strcmp(name + len - 5, ".h264") == 0);
+}
+
+esp_err_t clip_catalog_rebuild(const char *dir, clip_catalog_scan_cb_t cb, void *ctx)
+{
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_lock) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    uint64_t total = 0, free_bytes = 0;
+    esp_err_t err = esp_vfs_fat_info(dir, &total, &free_bytes);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "esp_vfs_fat_info(%s): %s", dir, esp_err_to_name(err));
+    }
+
+    DIR *d = opendir(dir);
+    if (!d) {
+        ESP_LOGW(TAG, "Cannot open %s", dir);
+        return ESP_FAIL;
+    }
+    uint32_t clips = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (!clip_catalog_is_clip(e->d_name)) {
+            continue;
+        }
+        if (cb && !cb(e->d_name, ctx)) {
+            continue;
+        }
+        clips++;
+    }
+    closedir(d);
+
+    /* A callback that deleted clips freed space after f_getfree ran — that
+     * is picked up at the next rebuild, not worth a second FAT walk */
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (err == ESP_OK) {
+        s_stats.total_bytes = total;
+        s_stats.free_bytes  = free_bytes;
+    }
+    s_stats.pending = clips;
+    s_stats.valid   = err == ESP_OK;
+    xSemaphoreGive(s_lock);
+    changed();
+
+    ESP_LOGI(TAG, "%"PRIu32" clip(s), %llu MB free of %llu MB", clips,
+             (unsigned long long)(free_bytes >> 20), (unsigned long long)(total >> 20));
+    return ESP_OK;
+}
+
+void clip_catalog_clip_added(const char *clip_file, uint64_t bytes)
+{
+    if (!s_lock || !clip_catalog_is_clip(clip_file)) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint64_t used = on_disk(bytes);
+    s_stats.free_bytes = s_stats.free_bytes > used ? s_stats.free_bytes - used : 0;
+    s_stats.pending++;
+    xSemaphoreGive(s_lock);
+    changed();
+}
+
+void clip_catalog_clip_removed(const char *clip_file, uint64_t bytes, bool uploaded)
+{
+    if (!s_lock) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.free_bytes += on_disk(bytes);
+    if (s_stats.free_bytes > s_stats.total_bytes) {
+        s_stats.free_bytes = s_stats.total_bytes;
+    }
+    if (clip_catalog_is_clip(clip_file) && s_stats.pending > 0) {
+        s_stats.pending--;
+    }
+    if (uploaded) {
+        s_stats.uploaded++;
+    }
+    xSemaphoreGive(s_lock);
+    changed();
+}
+
+void clip_catalog_get(clip_catalog_stats_t *out)
+{
+    if (!out) {
+        return;
+    }
+    if (!s_lock) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,80 @@
+/*
+ * clip_catalog.h — Cached SD free space and clip counts
+ *
+ * One esp_vfs_fat_info() (f_getfree, which walks the whole FAT and can
+ * take seconds) and one readdir of the card happen at rebuild. After that
+ * the writers keep the numbers current: clip_writer_end() reports each
+ * finished clip, the upload path each clip it deletes. Readers (LCD,
+ * upload scheduling) get a copy without touching the card or the FAT lock.
+ *
+ * Free space is tracked in whole SDCARD_ALLOC_UNIT_SIZE clusters and
+ * drifts by whatever else is written (thumbnails, journals, the manifest)
+ * until the next rebuild.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    bool     valid;             /* false until the first rebuild */
+    uint64_t total_bytes;
+    uint64_t free_bytes;
+    uint32_t pending;           /* .avi / .mp4 clips on the card */
+    uint32_t uploaded;          /* clips uploaded and deleted since boot */
+} clip_catalog_stats_t;
+
+/* Called for each clip found by a rebuild. Return false if the callback
+ * deleted it, so it is not counted. */
+typedef bool (*clip_catalog_scan_cb_t)(const char *clip_file, void *ctx);
+
+/**
+ * @brief  Recount free space and clips from the card.
+ *         Call once after mount, and when the card may have changed
+ *         behind the firmware's back.
+ * @param  dir  Mount point, e.g. "/sdcard".
+ * @param  cb   Optional: called per clip during the same directory pass.
+ * @return ESP_OK, ESP_ERR_NO_MEM, or ESP_FAIL if dir cannot be read.
+ */
+esp_err_t clip_catalog_rebuild(const char *dir, clip_catalog_scan_cb_t cb, void *ctx);
+
+/**
+ * @brief  True for names the catalog counts as clips (.avi, .mp4, .h264).
+ */
+bool clip_catalog_is_clip(const char *name);
+
+/**
+ * @brief  A clip was finished on the card.
+ * @param  bytes  Final file size.
+ */
+void clip_catalog_clip_added(const char *clip_file, uint64_t bytes);
+
+/**
+ * @brief  A clip was deleted from the card.
+ * @param  bytes     Clip file size (side files are not tracked).
+ * @param  uploaded  Deleted after a successful upload.
+ */
+void clip_catalog_clip_removed(const char *clip_file, uint64_t bytes, bool uploaded);
+
+/**
+ * @brief  Copy the current numbers. Never touches the card.
+ */
+void clip_catalog_get(clip_catalog_stats_t *out);
+
+/* Numbers changed. Runs on the task that changed them — must not block. */
+typedef void (*clip_catalog_change_cb_t)(void *ctx);
+
+/**
+ * @brief  Register the one change callback (the LCD wakes on it).
+ */
+void clip_catalog_set_change_cb(clip_catalog_change_cb_t cb, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
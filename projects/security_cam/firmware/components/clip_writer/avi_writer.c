@@ -1,34 +1,65 @@
 /*
- * avi_writer.c — MJPEG-in-AVI (RIFF AVI) writer
+ * avi_writer.c — MJPEG-in-AVI (RIFF AVI + OpenDML index) writer
  *
- * AVI structure written on disk:
+ * AVI structure written on disk (S = AVI_INDEX_SLOTS = 128):
  *
  *   Offset  Size  Field
  *   ------  ----  -----
  *   0       12    RIFF <riff_size> AVI
- *   12      200   LIST <192> hdrl
+ *   12      2548  LIST <2540> hdrl
  *     24    64      avih <56>  avi_main_header_t    ← avih_offset = 32
- *     88    124     LIST <116> strl
+ *     88    2204    LIST <2196> strl
  *       100 64        strh <56>  avi_stream_header_t ← strh_offset = 108
  *       164 48        strf <40>  bitmapinfoheader_t
- *   212     12    LIST <movi_cb> movi               ← movi_start_offset = 212
- *   224     ...   [00dc chunks — one per JPEG frame]
- *   ---     ...   idx1 [avi_idx1_entry_t × frame_count]
+ *       212 2080      indx <2072> super index, S slots ← indx_offset = 220
+ *     2292  268     LIST <260> odml
+ *       2304 256      dmlh <248> dwTotalFrames       ← dmlh_offset = 2312
+ *   2560    12    LIST <movi_cb> movi               ← movi_start_offset = 2560
+ *   2572    ...   [00dc chunks — one per JPEG frame]
+ *                 [ix00 chunk after every checkpoint_frames frames]
+ *   ---     ...   idx1 [avi_idx1_entry_t × frame_count]  (close only)
  *
- * Header total: 224 bytes (fixed). Placeholder sizes patched at close:
- *   offset 4  : RIFF size = file_size - 8
- *   offset 216: movi LIST cb = movi_end - movi_start_offset - 8
- *   avih_offset+12: dwFlags |= AVIF_HASINDEX
- *   avih_offset+16: dwTotalFrames
- *   strh_offset+32: dwLength
+ * Checkpoints:
+ *   Every checkpoint_frames frames an ix00 standard index covering the
+ *   frames since the previous one is appended to movi, everything staged
+ *   is written out, and the header is patched so the file is a complete
+ *   OpenDML AVI up to that point:
+ *     offset 4        : RIFF size = file_size - 8
+ *     movi + 4        : movi LIST cb
+ *     avih + 16       : dwTotalFrames (frames covered by ix00 chunks)
+ *     strh + 32       : dwLength
+ *     dmlh            : dwTotalFrames
+ *     indx            : nEntriesInUse + the new slot
+ *   then fsync() commits data and directory entry. A reset loses at most
+ *   the frames since the last checkpoint, and avi_writer_repair() recovers
+ *   those too.
+ *
+ * Close:
+ *   A final ix00 covers the tail, then idx1 is rebuilt by reading the ix00
+ *   chunks back from the file — no whole-clip index in RAM, so clip length
+ *   is not bounded by a pre-allocated buffer. AVIF_HASINDEX marks a file as
+ *   finalised; repair skips files that have it.
  *
  * idx1.dwChunkOffset values are relative to movi_start_offset (the 'LIST'
  * fourcc), per the MSDN AVI spec: "offset from the start of the movi LIST".
+ * ix00 uses qwBaseOffset = movi_start_offset and dwOffset pointing at the
+ * chunk data (8 bytes past the '00dc' fourcc), so idx1 = dwOffset - 8.
+ *
+ * Write path:
+ *   Everything up to idx1 goes through clip_stage (cluster-aligned PSRAM
+ *   staging, see clip_stage.h). A checkpoint is a clip_stage_commit() with
+ *   fsync, so it keeps flushes on cluster boundaries.
+ *
+ *   With cfg.preallocated the file was already sized by sdcard_preallocate(),
+ *   so these writes land in clusters that are linked in the FAT — no
+ *   allocation during recording. Close truncates to the real length.
  */
 
 #include "avi_writer.h"
+#include "clip_stage.h"
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "esp_log.h"
 #include "esp_heap_caps.h"
 
@@ -67,7 +98,7 @@ typedef struct __attribute__((packed)) {
     uint32_t dwScale;           /* offset 20 */
     uint32_t dwRate;            /* offset 24 */
     uint32_t dwStart;           /* offset 28 */
-    uint32_t dwLength;          /* offset 32 — patched at close */
+    uint32_t dwLength;          /* offset 32 — patched at checkpoint/close */
     uint32_t dwSuggestedBufferSize; /* offset 36 */
     uint32_t dwQuality;         /* offset 40 */
     uint32_t dwSampleSize;      /* offset 44 */
@@ -97,100 +128,259 @@ typedef struct __attribute__((packed)) {
     uint32_t dwChunkLength;
 } avi_idx1_entry_t;
 
-#define AVIF_HASINDEX   0x00000010u
-#define AVIIF_KEYFRAME  0x00000010u
+/* OpenDML index header — shared by indx (super) and ix00 (standard), 24 bytes */
+typedef struct __attribute__((packed)) {
+    uint16_t wLongsPerEntry;
+    uint8_t  bIndexSubType;
+    uint8_t  bIndexType;
+    uint32_t nEntriesInUse;
+    uint32_t dwChunkId;
+    uint32_t dwReserved[3];     /* ix00: qwBaseOffset (lo, hi) + dwReserved */
+} odml_index_header_t;
+
+/* indx entry (16 bytes) */
+typedef struct __attribute__((packed)) {
+    uint64_t qwOffset;          /* file offset of the ix00 fourcc */
+    uint32_t dwSize;            /* whole ix00 chunk including its header */
+    uint32_t dwDuration;        /* frames it covers */
+} odml_super_entry_t;
+
+/* ix00 entry (8 bytes) */
+typedef struct __attribute__((packed)) {
+    uint32_t dwOffset;          /* chunk data offset from qwBaseOffset */
+    uint32_t dwSize;            /* bit 31 set = not a key frame */
+} odml_std_entry_t;
+
+#define AVIF_HASINDEX           0x00000010u
+#define AVIIF_KEYFRAME          0x00000010u
+#define AVI_INDEX_OF_INDEXES    0x00
+#define AVI_INDEX_OF_CHUNKS     0x01
+
+#define AVI_INDEX_SLOTS     128     /* super index entries reserved in the header */
+#define DMLH_BYTES          248     /* dwTotalFrames + reserved, as VirtualDub/ffmpeg */
+#define INDX_BYTES          (sizeof(odml_index_header_t) + AVI_INDEX_SLOTS * sizeof(odml_super_entry_t))
+#define STRL_CB             (4 + 8 + sizeof(avi_stream_header_t) + 8 + sizeof(bitmapinfoheader_t) + 8 + INDX_BYTES)
+#define ODML_CB             (4 + 8 + DMLH_BYTES)
+#define HDRL_CB             (4 + 8 + sizeof(avi_main_header_t) + 8 + STRL_CB + 8 + ODML_CB)
+#define HEADER_BYTES        (12 + 8 + HDRL_CB + 12)
+
+#define STAGING_DEFAULT     (128 * 1024)
+#define PENDING_DEFAULT     256     /* ix00 entries before the first grow */
+#define READBACK_BATCH      64      /* ix00 entries per fread when building idx1 */
 
 /* ---------------------------------------------------------------------------
  * Internal state
  * -------------------------------------------------------------------------*/
 
 struct avi_writer_t {
-    FILE             *fp;
     uint32_t          width;
     uint32_t          height;
     uint32_t          fps;
-    uint32_t          frame_count;
-    uint32_t          max_frames;
+    uint32_t          frame_count;       /* frames staged */
+    uint32_t          indexed_frames;    /* frames covered by written ix00 chunks */
+    uint32_t          checkpoint_frames; /* 0 = index only at close */
     uint32_t          movi_start_offset; /* file offset of 'LIST' movi fourcc */
-    avi_idx1_entry_t *idx1_buf;          /* pre-allocated in PSRAM */
-    long              avih_offset;       /* file position of avih chunk data */
-    long              strh_offset;       /* file position of strh chunk data */
+    uint32_t          avih_offset;       /* file offsets of chunk data */
+    uint32_t          strh_offset;
+    uint32_t          indx_offset;
+    uint32_t          dmlh_offset;
+
+    /* ix00 entries since the last index chunk */
+    odml_std_entry_t *pending;
+    uint32_t          pending_count;
+    uint32_t          pending_cap;
+
+    odml_super_entry_t super[AVI_INDEX_SLOTS];
+    uint32_t          super_count;
+
+    clip_stage_t      st;
 };
 
 /* ---------------------------------------------------------------------------
  * Helpers
  * -------------------------------------------------------------------------*/
 
-static void write_u32(FILE *fp, uint32_t v)    { fwrite(&v, 4, 1, fp); }
-static void write_fourcc(FILE *fp, uint32_t v) { fwrite(&v, 4, 1, fp); }
+static esp_err_t stage_put(avi_writer_t *w, const void *data, size_t len)
+{
+    return clip_stage_put(&w->st, data, len);
+}
+
+static esp_err_t stage_u32(avi_writer_t *w, uint32_t v) { return stage_put(w, &v, 4); }
+
+static void patch(avi_writer_t *w, uint32_t off, const void *data, size_t len)
+{
+    clip_stage_patch(&w->st, off, data, len);
+}
+
+static void patch_u32(avi_writer_t *w, uint32_t off, uint32_t v) { patch(w, off, &v, 4); }
+
+/* Stage an ix00 chunk for the pending entries and record it in the super
+ * index. Returns false if no slot is free (entries stay pending). */
+static bool stage_std_index(avi_writer_t *w, bool final)
+{
+    if (w->pending_count == 0) {
+        return true;
+    }
+    /* Keep the last slot for the closing chunk */
+    uint32_t limit = final ? AVI_INDEX_SLOTS : AVI_INDEX_SLOTS - 1;
+    if (w->super_count >= limit) {
+        return false;
+    }
+
+    uint32_t entries_bytes = w->pending_count * (uint32_t)sizeof(odml_std_entry_t);
+    odml_index_header_t ih = {
+        .wLongsPerEntry = 2,
+        .bIndexSubType  = 0,
+        .bIndexType     = AVI_INDEX_OF_CHUNKS,
+        .nEntriesInUse  = w->pending_count,
+        .dwChunkId      = FOURCC('0','0','d','c'),
+        .dwReserved     = { w->movi_start_offset, 0, 0 },  /* qwBaseOffset */
+    };
+    odml_super_entry_t *se = &w->super[w->super_count];
+    se->qwOffset   = w->st.pos;
+    se->dwSize     = 8 + (uint32_t)sizeof(ih) + entries_bytes;
+    se->dwDuration = w->pending_count;
+
+    if (stage_u32(w, FOURCC('i','x','0','0')) != ESP_OK ||
+        stage_u32(w, (uint32_t)sizeof(ih) + entries_bytes) != ESP_OK ||
+        stage_put(w, &ih, sizeof(ih)) != ESP_OK ||
+        stage_put(w, w->pending, entries_bytes) != ESP_OK) {
+        return false;
+    }
+    w->super_count++;
+    w->indexed_frames += w->pending_count;
+    w->pending_count   = 0;
+    return true;
+}
+
+/* Write everything out and patch the header to describe it */
+static esp_err_t checkpoint(avi_writer_t *w, bool final)
+{
+    stage_std_index(w, final);
+    if (clip_stage_commit(&w->st, false) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    uint32_t movi_end = w->st.pos;
+    patch_u32(w, 4, movi_end - 8);
+    patch_u32(w, w->movi_start_offset + 4, movi_end - w->movi_start_offset - 8);
+    patch_u32(w, w->avih_offset + 16, w->indexed_frames);
+    patch_u32(w, w->strh_offset + 32, w->indexed_frames);
+    patch_u32(w, w->dmlh_offset, w->indexed_frames);
+    patch_u32(w, w->indx_offset + 4, w->super_count);
+    if (w->super_count > 0) {
+        uint32_t slot = w->super_count - 1;
+        patch(w, w->indx_offset + (uint32_t)sizeof(odml_index_header_t) +
+                 slot * (uint32_t)sizeof(odml_super_entry_t),
+              &w->super[slot], sizeof(w->super[slot]));
+    }
+
+    return clip_stage_commit(&w->st, true);
+}
+
+/* Append idx1 built from the ix00 chunks already on disk */
+static esp_err_t stage_idx1_from_ix00(avi_writer_t *w)
+{
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < w->super_count; i++) {
+        total += w->super[i].dwDuration;
+    }
+    if (stage_u32(w, FOURCC('i','d','x','1')) != ESP_OK ||
+        stage_u32(w, total * (uint32_t)sizeof(avi_idx1_entry_t)) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    odml_std_entry_t batch[READBACK_BATCH];
+    for (uint32_t i = 0; i < w->super_count; i++) {
+        long     at   = (long)w->super[i].qwOffset + 8 + (long)sizeof(odml_index_header_t);
+        uint32_t left = w->super[i].dwDuration;
+        while (left > 0) {
+            uint32_t n = left < READBACK_BATCH ? left : READBACK_BATCH;
+            if (clip_stage_read(&w->st, (uint32_t)at, batch, n * sizeof(batch[0])) != ESP_OK) {
+                ESP_LOGE(TAG, "Cannot read back ix00 #%"PRIu32, i);
+                return ESP_FAIL;
+            }
+            for (uint32_t k = 0; k < n; k++) {
+                avi_idx1_entry_t e = {
+                    .ckid          = FOURCC('0','0','d','c'),
+                    .dwFlags       = AVIIF_KEYFRAME,
+                    .dwChunkOffset = batch[k].dwOffset - 8,
+                    .dwChunkLength = batch[k].dwSize & 0x7FFFFFFFu,
+                };
+                if (stage_put(w, &e, sizeof(e)) != ESP_OK) {
+                    return ESP_FAIL;
+                }
+            }
+            at   += (long)(n * sizeof(batch[0]));
+            left -= n;
+        }
+    }
+    return ESP_OK;
+}
 
 /* ---------------------------------------------------------------------------
  * Public API
  * -------------------------------------------------------------------------*/
 
-avi_writer_t *avi_writer_open(const char *path, uint32_t width, uint32_t height,
-                              uint32_t fps, uint32_t max_frames)
+avi_writer_t *avi_writer_open(const avi_writer_config_t *cfg)
 {
+    if (!cfg || !cfg->path) {
+        return NULL;
+    }
+    const uint32_t width  = cfg->width;
+    const uint32_t height = cfg->height;
+
     avi_writer_t *w = calloc(1, sizeof(*w));
     if (!w) {
         ESP_LOGE(TAG, "Out of heap for writer struct");
         return NULL;
     }
 
-    w->fp = fopen(path, "wb");
-    if (!w->fp) {
-        ESP_LOGE(TAG, "Cannot open %s for writing", path);
+    /* Pending ix00 entries — grows if checkpoints are off or slots run out */
+    w->pending_cap = cfg->checkpoint_frames ? cfg->checkpoint_frames : PENDING_DEFAULT;
+    w->pending = heap_caps_malloc(w->pending_cap * sizeof(odml_std_entry_t),
+                                  MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    size_t stage_size = cfg->staging_size ? cfg->staging_size : STAGING_DEFAULT;
+    if (!w->pending ||
+        clip_stage_open(&w->st, cfg->path, stage_size, cfg->preallocated) != ESP_OK) {
+        ESP_LOGE(TAG, "avi_writer_open failed for %s", cfg->path);
+        heap_caps_free(w->pending);
         free(w);
         return NULL;
     }
 
-    w->width       = width;
-    w->height      = height;
-    w->fps         = (fps > 0) ? fps : 10;
-    w->max_frames  = max_frames;
-    w->frame_count = 0;
-
-    /* Pre-allocate idx1 in PSRAM (60s × 10fps × 16 bytes ≈ 9.6 KB) */
-    w->idx1_buf = heap_caps_malloc(max_frames * sizeof(avi_idx1_entry_t),
-                                   MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!w->idx1_buf) {
-        ESP_LOGW(TAG, "PSRAM idx1 alloc failed, trying DRAM");
-        w->idx1_buf = malloc(max_frames * sizeof(avi_idx1_entry_t));
-    }
-    if (!w->idx1_buf) {
-        ESP_LOGE(TAG, "Cannot allocate idx1 buffer (%"PRIu32" entries)", max_frames);
-        fclose(w->fp);
-        free(w);
-        return NULL;
-    }
+    w->width             = width;
+    w->height            = height;
+    w->fps               = (cfg->fps > 0) ? cfg->fps : 10;
+    w->checkpoint_frames = cfg->checkpoint_frames;
 
     uint32_t usec_per_frame = 1000000u / w->fps;
 
     /* -----------------------------------------------------------------------
-     * Write RIFF AVI header (224 bytes, fixed layout — see file header comment)
+     * Write RIFF AVI header (fixed layout — see file header comment)
      * -----------------------------------------------------------------------*/
 
     /* RIFF AVI */
-    write_fourcc(w->fp, FOURCC('R','I','F','F'));
-    write_u32   (w->fp, 0);                 /* riff_size — patched at close */
-    write_fourcc(w->fp, FOURCC('A','V','I',' '));
+    stage_u32(w, FOURCC('R','I','F','F'));
+    stage_u32(w, 0);                 /* riff_size — patched at checkpoint */
+    stage_u32(w, FOURCC('A','V','I',' '));
 
-    /* LIST hdrl (cb = 192 — fixed) */
-    write_fourcc(w->fp, FOURCC('L','I','S','T'));
-    write_u32   (w->fp, 192);
-    write_fourcc(w->fp, FOURCC('h','d','r','l'));
+    /* LIST hdrl */
+    stage_u32(w, FOURCC('L','I','S','T'));
+    stage_u32(w, HDRL_CB);
+    stage_u32(w, FOURCC('h','d','r','l'));
 
     /* avih chunk */
-    write_fourcc(w->fp, FOURCC('a','v','i','h'));
-    write_u32   (w->fp, 56);
-    w->avih_offset = ftell(w->fp);          /* position of avih data = 32 */
+    stage_u32(w, FOURCC('a','v','i','h'));
+    stage_u32(w, 56);
+    w->avih_offset = w->st.pos;
     {
         avi_main_header_t avih = {
             .dwMicroSecPerFrame    = usec_per_frame,
             .dwMaxBytesPerSec      = 0,     /* patched at close */
             .dwPaddingGranularity  = 0,
             .dwFlags               = 0,     /* AVIF_HASINDEX set at close */
-            .dwTotalFrames         = 0,     /* patched at close */
+            .dwTotalFrames         = 0,     /* patched at checkpoint */
             .dwInitialFrames       = 0,
             .dwStreams             = 1,
             .dwSuggestedBufferSize = width * height * 3 / 2,
@@ -198,18 +388,18 @@ avi_writer_t *avi_writer_open(const char *path, uint32_t width, uint32_t height,
             .dwHeight              = height,
             .dwReserved            = {0, 0, 0, 0},
         };
-        fwrite(&avih, sizeof(avih), 1, w->fp);
+        stage_put(w, &avih, sizeof(avih));
     }
 
-    /* LIST strl (cb = 116 — fixed) */
-    write_fourcc(w->fp, FOURCC('L','I','S','T'));
-    write_u32   (w->fp, 116);
-    write_fourcc(w->fp, FOURCC('s','t','r','l'));
+    /* LIST strl */
+    stage_u32(w, FOURCC('L','I','S','T'));
+    stage_u32(w, STRL_CB);
+    stage_u32(w, FOURCC('s','t','r','l'));
 
     /* strh chunk */
-    write_fourcc(w->fp, FOURCC('s','t','r','h'));
-    write_u32   (w->fp, 56);
-    w->strh_offset = ftell(w->fp);          /* position of strh data = 108 */
+    stage_u32(w, FOURCC('s','t','r','h'));
+    stage_u32(w, 56);
+    w->strh_offset = w->st.pos;
     {
         avi_stream_header_t strh = {
             .fccType             = FOURCC('v','i','d','s'),
@@ -221,18 +411,18 @@ avi_writer_t *avi_writer_open(const char *path, uint32_t width, uint32_t height,
             .dwScale             = 1,
             .dwRate              = w->fps,
             .dwStart             = 0,
-            .dwLength            = 0,       /* patched at close */
+            .dwLength            = 0,       /* patched at checkpoint */
             .dwSuggestedBufferSize = width * height * 3 / 2,
             .dwQuality           = 0xFFFFFFFFu,
             .dwSampleSize        = 0,
             .rcFrame             = {0, 0, (int16_t)width, (int16_t)height},
         };
-        fwrite(&strh, sizeof(strh), 1, w->fp);
+        stage_put(w, &strh, sizeof(strh));
     }
 
     /* strf chunk (BITMAPINFOHEADER) */
-    write_fourcc(w->fp, FOURCC('s','t','r','f'));
-    write_u32   (w->fp, 40);
+    stage_u32(w, FOURCC('s','t','r','f'));
+    stage_u32(w, 40);
     {
         bitmapinfoheader_t strf = {
             .biSize          = 40,
@@ -247,54 +437,95 @@ avi_writer_t *avi_writer_open(const char *path, uint32_t width, uint32_t height,
             .biClrUsed       = 0,
             .biClrImportant  = 0,
         };
-        fwrite(&strf, sizeof(strf), 1, w->fp);
+        stage_put(w, &strf, sizeof(strf));
+    }
+
+    /* indx chunk — empty super index, slots filled at checkpoints */
+    stage_u32(w, FOURCC('i','n','d','x'));
+    stage_u32(w, INDX_BYTES);
+    w->indx_offset = w->st.pos;
+    {
+        odml_index_header_t ih = {
+            .wLongsPerEntry = 4,
+            .bIndexSubType  = 0,
+            .bIndexType     = AVI_INDEX_OF_INDEXES,
+            .nEntriesInUse  = 0,
+            .dwChunkId      = FOURCC('0','0','d','c'),
+        };
+        stage_put(w, &ih, sizeof(ih));
+        stage_put(w, w->super, sizeof(w->super));   /* zeroed by calloc */
     }
 
-    /* LIST movi — size is a placeholder, patched at close */
-    w->movi_start_offset = (uint32_t)ftell(w->fp); /* = 212, position of 'LIST' */
-    write_fourcc(w->fp, FOURCC('L','I','S','T'));
-    write_u32   (w->fp, 0);                 /* movi cb — patched at close */
-    write_fourcc(w->fp, FOURCC('m','o','v','i'));
-    /* Frame data starts here at offset 224 */
+    /* LIST odml / dmlh */
+    stage_u32(w, FOURCC('L','I','S','T'));
+    stage_u32(w, ODML_CB);
+    stage_u32(w, FOURCC('o','d','m','l'));
+    stage_u32(w, FOURCC('d','m','l','h'));
+    stage_u32(w, DMLH_BYTES);
+    w->dmlh_offset = w->st.pos;
+    {
+        static const uint8_t zero[DMLH_BYTES];
+        stage_put(w, zero, sizeof(zero));
+    }
 
-    ESP_LOGI(TAG, "avi_writer_open: %s (%"PRIu32"x%"PRIu32" @ %"PRIu32" fps)",
-             path, width, height, fps);
+    /* LIST movi — size is a placeholder, patched at checkpoint */
+    w->movi_start_offset = w->st.pos;
+    stage_u32(w, FOURCC('L','I','S','T'));
+    stage_u32(w, 0);                 /* movi cb — patched at checkpoint */
+    stage_u32(w, FOURCC('m','o','v','i'));
+    /* Frame data starts here. Header stays staged — the first flush
+     * happens at the first checkpoint or when the buffer fills. */
+    if (w->st.pos != HEADER_BYTES) {
+        ESP_LOGE(TAG, "Header layout mismatch (%"PRIu32" bytes)", w->st.pos);
+    }
+
+    ESP_LOGI(TAG, "avi_writer_open: %s (%"PRIu32"x%"PRIu32" @ %"PRIu32" fps, %u KB staging, "
+             "checkpoint every %"PRIu32" frames)",
+             cfg->path, width, height, w->fps, (unsigned)(w->st.size >> 10),
+             w->checkpoint_frames);
     return w;
 }
 
 esp_err_t avi_writer_write_frame(avi_writer_t *w, const void *jpeg, size_t len)
 {
-    if (!w || !w->fp) {
+    if (!w || !w->st.fp || w->st.io_error) {
         return ESP_ERR_INVALID_STATE;
     }
-    if (w->frame_count >= w->max_frames) {
-        ESP_LOGW(TAG, "Frame count exceeds pre-allocated idx1 capacity (%"PRIu32")",
-                 w->max_frames);
-        return ESP_ERR_NO_MEM;
+    if (w->pending_count == w->pending_cap) {
+        uint32_t cap = w->pending_cap * 2;
+        odml_std_entry_t *p = heap_caps_realloc(w->pending, cap * sizeof(*p),
+                                                MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!p) {
+            ESP_LOGW(TAG, "Cannot grow index to %"PRIu32" entries — frame dropped", cap);
+            return ESP_ERR_NO_MEM;
+        }
+        w->pending     = p;
+        w->pending_cap = cap;
     }
 
-    /* Offset of this '00dc' chunk from the 'LIST' movi start (MSDN spec) */
-    uint32_t chunk_offset = (uint32_t)ftell(w->fp) - w->movi_start_offset;
+    /* Chunk data offset from the 'LIST' movi start (ix00 qwBaseOffset) */
+    uint32_t data_offset = w->st.pos + 8 - w->movi_start_offset;
 
-    /* Write '00dc' chunk header + JPEG data (padded to even length) */
-    write_fourcc(w->fp, FOURCC('0','0','d','c'));
-    write_u32   (w->fp, (uint32_t)len);
-    if (fwrite(jpeg, 1, len, w->fp) != len) {
+    /* Stage '00dc' chunk header + JPEG data (padded to even length) */
+    uint32_t ck[2] = { FOURCC('0','0','d','c'), (uint32_t)len };
+    static const uint8_t pad = 0;
+    if (stage_put(w, ck, sizeof(ck)) != ESP_OK ||
+        stage_put(w, jpeg, len) != ESP_OK ||
+        ((len & 1u) && stage_put(w, &pad, 1) != ESP_OK)) {
         ESP_LOGE(TAG, "Frame write failed at frame %"PRIu32, w->frame_count);
         return ESP_FAIL;
     }
-    if (len & 1u) {
-        uint8_t pad = 0;
-        fwrite(&pad, 1, 1, w->fp);
-    }
-
-    /* Record idx1 entry */
-    w->idx1_buf[w->frame_count].ckid          = FOURCC('0','0','d','c');
-    w->idx1_buf[w->frame_count].dwFlags       = AVIIF_KEYFRAME;
-    w->idx1_buf[w->frame_count].dwChunkOffset = chunk_offset;
-    w->idx1_buf[w->frame_count].dwChunkLength = (uint32_t)len;
 
+    w->pending[w->pending_count].dwOffset = data_offset;
+    w->pending[w->pending_count].dwSize   = (uint32_t)len;   /* every MJPEG frame is a key frame */
+    w->pending_count++;
     w->frame_count++;
+
+    /* Once the super index is full the rest is indexed at close */
+    if (w->checkpoint_frames > 0 && w->pending_count >= w->checkpoint_frames &&
+        w->super_count < AVI_INDEX_SLOTS - 1) {
+        return checkpoint(w, false);
+    }
     return ESP_OK;
 }
 
@@ -304,51 +535,228 @@ esp_err_t avi_writer_close(avi_writer_t *w)
         return ESP_ERR_INVALID_ARG;
     }
 
-    uint32_t frame_count = w->frame_count;
+    /* Final ix00 + header patches; movi ends here */
+    checkpoint(w, true);
+    uint32_t movi_end    = w->st.pos;
+    uint32_t frame_count = w->indexed_frames;
+    if (w->pending_count > 0) {
+        ESP_LOGE(TAG, "%"PRIu32" frames left unindexed", w->pending_count);
+    }
+
+    /* Legacy idx1 for players without OpenDML support */
+    esp_err_t err = stage_idx1_from_ix00(w);
+    uint32_t file_end = w->st.pos;
+
+    /* RIFF size now covers idx1 */
+    patch_u32(w, 4, file_end - 8);
+
+    /* Patch avih: dwFlags + dwMaxBytesPerSec (header is on the card since
+     * the final checkpoint) */
+    avi_main_header_t avih;
+    if (clip_stage_read(&w->st, w->avih_offset, &avih, sizeof(avih)) == ESP_OK) {
+        if (err == ESP_OK) {
+            avih.dwFlags |= AVIF_HASINDEX;
+        }
+        if (frame_count > 0 && w->fps > 0) {
+            uint32_t video_bytes = movi_end - w->movi_start_offset - 12;
+            uint32_t dur_ms      = frame_count * 1000u / w->fps;
+            avih.dwMaxBytesPerSec = (dur_ms > 0) ? (uint32_t)((uint64_t)video_bytes * 1000u / dur_ms) : 0;
+        }
+        patch(w, w->avih_offset, &avih, sizeof(avih));
+    }
+
+    uint32_t flushes = w->st.flushes;
+    if (clip_stage_close(&w->st) != ESP_OK) {
+        err = ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "avi_writer_close: %"PRIu32" frames, %"PRIu32" KB in %"PRIu32" writes, "
+             "%"PRIu32" index chunks%s",
+             frame_count, file_end >> 10, flushes, w->super_count,
+             err == ESP_OK ? ", AVI complete" : " — I/O ERROR");
+
+    heap_caps_free(w->pending);
+    free(w);
+    return err;
+}
 
-    /* End of movi data — record position before writing idx1 */
-    long movi_end = ftell(w->fp);
+/* ---------------------------------------------------------------------------
+ * Repair
+ * -------------------------------------------------------------------------*/
+
+typedef struct {
+    uint32_t avih;              /* chunk data offsets, 0 = absent */
+    uint32_t strh;
+    uint32_t indx;
+    uint32_t dmlh;
+    uint32_t movi;              /* offset of the movi 'LIST' fourcc */
+} avi_layout_t;
+
+static bool read_at(FILE *fp, uint32_t off, void *buf, size_t len)
+{
+    return fseek(fp, (long)off, SEEK_SET) == 0 && fread(buf, 1, len, fp) == len;
+}
 
-    /* Append idx1 chunk */
-    write_fourcc(w->fp, FOURCC('i','d','x','1'));
-    write_u32   (w->fp, frame_count * (uint32_t)sizeof(avi_idx1_entry_t));
-    fwrite(w->idx1_buf, sizeof(avi_idx1_entry_t), frame_count, w->fp);
+/* Walk the chunks in [start, end), descending into hdrl/strl/odml */
+static void find_chunks(FILE *fp, uint32_t start, uint32_t end, avi_layout_t *lay)
+{
+    uint32_t pos = start;
+    while (pos + 8 <= end && !lay->movi) {
+        uint32_t ck[3];
+        if (!read_at(fp, pos, ck, 8)) {
+            return;
+        }
+        uint32_t next = pos + 8 + ck[1] + (ck[1] & 1u);
+        if (ck[0] == FOURCC('L','I','S','T') && read_at(fp, pos + 8, &ck[2], 4)) {
+            if (ck[2] == FOURCC('m','o','v','i')) {
+                lay->movi = pos;
+                return;
+            }
+            if (ck[2] == FOURCC('h','d','r','l') || ck[2] == FOURCC('s','t','r','l') ||
+                ck[2] == FOURCC('o','d','m','l')) {
+                find_chunks(fp, pos + 12, next < end ? next : end, lay);
+            }
+        } else if (ck[0] == FOURCC('a','v','i','h') && !lay->avih) {
+            lay->avih = pos + 8;
+        } else if (ck[0] == FOURCC('s','t','r','h') && !lay->strh) {
+            lay->strh = pos + 8;
+        } else if (ck[0] == FOURCC('i','n','d','x') && !lay->indx) {
+            lay->indx = pos + 8;
+        } else if (ck[0] == FOURCC('d','m','l','h') && !lay->dmlh) {
+            lay->dmlh = pos + 8;
+        }
+        if (next <= pos) {
+            return;
+        }
+        pos = next;
+    }
+}
 
-    long file_end = ftell(w->fp);
+static void write_u32_at(FILE *fp, uint32_t off, uint32_t v)
+{
+    fseek(fp, (long)off, SEEK_SET);
+    fwrite(&v, 4, 1, fp);
+}
 
-    /* Patch RIFF size at offset 4 */
-    fseek(w->fp, 4, SEEK_SET);
-    write_u32(w->fp, (uint32_t)(file_end - 8));
+esp_err_t avi_writer_repair(const char *path, bool *repaired)
+{
+    if (repaired) {
+        *repaired = false;
+    }
+    FILE *fp = fopen(path, "r+b");
+    if (!fp) {
+        return ESP_FAIL;
+    }
+    setvbuf(fp, NULL, _IONBF, 0);
 
-    /* Patch movi LIST cb at movi_start_offset + 4
-     * cb = bytes from 'movi' fourcc to end of movi data
-     *    = movi_end - (movi_start_offset + 8)               */
-    uint32_t movi_cb = (uint32_t)(movi_end - w->movi_start_offset) - 8;
-    fseek(w->fp, (long)w->movi_start_offset + 4, SEEK_SET);
-    write_u32(w->fp, movi_cb);
+    fseek(fp, 0, SEEK_END);
+    long size_l = ftell(fp);
+    uint32_t file_size = size_l > 0 ? (uint32_t)size_l : 0;
 
-    /* Patch avih: read back, update dwFlags + dwTotalFrames + dwMaxBytesPerSec */
-    fseek(w->fp, w->avih_offset, SEEK_SET);
+    uint32_t riff[3];
+    avi_layout_t lay = {0};
     avi_main_header_t avih;
-    fread(&avih, sizeof(avih), 1, w->fp);
-    avih.dwFlags      |= AVIF_HASINDEX;
-    avih.dwTotalFrames = frame_count;
-    if (frame_count > 0 && w->fps > 0) {
-        uint32_t video_bytes = (uint32_t)(movi_end - w->movi_start_offset - 12);
-        uint32_t dur_ms      = frame_count * 1000u / w->fps;
-        avih.dwMaxBytesPerSec = (dur_ms > 0) ? (video_bytes * 1000u / dur_ms) : 0;
-    }
-    fseek(w->fp, w->avih_offset, SEEK_SET);
-    fwrite(&avih, sizeof(avih), 1, w->fp);
-
-    /* Patch strh.dwLength (at strh_offset + 32) */
-    fseek(w->fp, w->strh_offset + 32, SEEK_SET);
-    write_u32(w->fp, frame_count);
-
-    fclose(w->fp);
-    free(w->idx1_buf);
-    free(w);
+    if (!read_at(fp, 0, riff, sizeof(riff)) ||
+        riff[0] != FOURCC('R','I','F','F') || riff[2] != FOURCC('A','V','I',' ')) {
+        fclose(fp);
+        ESP_LOGW(TAG, "repair: %s has no AVI header", path);
+        return ESP_ERR_NOT_FOUND;
+    }
+    find_chunks(fp, 12, file_size, &lay);
+    if (!lay.avih || !lay.movi || !read_at(fp, lay.avih, &avih, sizeof(avih))) {
+        fclose(fp);
+        ESP_LOGW(TAG, "repair: %s has a truncated header", path);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (avih.dwFlags & AVIF_HASINDEX) {
+        fclose(fp);                 /* closed cleanly */
+        return ESP_OK;
+    }
 
-    ESP_LOGI(TAG, "avi_writer_close: %"PRIu32" frames, AVI complete", frame_count);
-    return ESP_OK;
+    /* Scan movi for complete 00dc chunks. Stops at the first chunk that is
+     * truncated or isn't ours — stale data in a pre-sized file included. */
+    avi_idx1_entry_t *idx = NULL;
+    uint32_t n = 0, cap = 0;
+    uint32_t pos = lay.movi + 12;
+    while (pos + 8 <= file_size) {
+        uint32_t ck[2];
+        uint8_t soi[2];
+        if (!read_at(fp, pos, ck, sizeof(ck))) {
+            break;
+        }
+        uint32_t next = pos + 8 + ck[1] + (ck[1] & 1u);
+        if (next > file_size || next <= pos) {
+            break;
+        }
+        if (ck[0] == FOURCC('0','0','d','c')) {
+            if (ck[1] < 2 || !read_at(fp, pos + 8, soi, 2) || soi[0] != 0xFF || soi[1] != 0xD8) {
+                break;
+            }
+            if (n == cap) {
+                cap = cap ? cap * 2 : 1024;
+                avi_idx1_entry_t *p = heap_caps_realloc(idx, cap * sizeof(*p),
+                                                        MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+                if (!p) {
+                    break;          /* keep what we have */
+                }
+                idx = p;
+            }
+            idx[n++] = (avi_idx1_entry_t) {
+                .ckid          = FOURCC('0','0','d','c'),
+                .dwFlags       = AVIIF_KEYFRAME,
+                .dwChunkOffset = pos - lay.movi,
+                .dwChunkLength = ck[1],
+            };
+        } else if (ck[0] != FOURCC('i','x','0','0') && ck[0] != FOURCC('J','U','N','K')) {
+            break;
+        }
+        pos = next;
+    }
+
+    if (n == 0) {
+        heap_caps_free(idx);
+        fclose(fp);
+        ESP_LOGW(TAG, "repair: %s has no complete frames", path);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* idx1 goes where movi now ends, over any partial frame */
+    uint32_t movi_end = pos;
+    uint32_t hdr[2] = { FOURCC('i','d','x','1'), n * (uint32_t)sizeof(avi_idx1_entry_t) };
+    bool ok = fseek(fp, (long)movi_end, SEEK_SET) == 0 &&
+              fwrite(hdr, sizeof(hdr), 1, fp) == 1 &&
+              fwrite(idx, sizeof(*idx), n, fp) == n;
+    heap_caps_free(idx);
+    uint32_t file_end = movi_end + 8 + n * (uint32_t)sizeof(avi_idx1_entry_t);
+
+    write_u32_at(fp, 4, file_end - 8);
+    write_u32_at(fp, lay.movi + 4, movi_end - lay.movi - 8);
+    if (lay.strh) {
+        write_u32_at(fp, lay.strh + 32, n);
+    }
+    if (lay.dmlh) {
+        write_u32_at(fp, lay.dmlh, n);
+    }
+    if (lay.indx) {
+        /* The super index misses frames after the last checkpoint, and
+         * players prefer it over idx1 — drop it */
+        write_u32_at(fp, lay.indx + 4, 0);
+    }
+    avih.dwTotalFrames = n;
+    avih.dwFlags      |= ok ? AVIF_HASINDEX : 0;
+    fseek(fp, (long)lay.avih, SEEK_SET);
+    fwrite(&avih, sizeof(avih), 1, fp);
+
+    if (ftruncate(fileno(fp), (off_t)file_end) != 0) {
+        ok = false;
+    }
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+
+    ESP_LOGW(TAG, "repair: %s — %"PRIu32" frames recovered, %"PRIu32" KB%s",
+             path, n, file_end >> 10, ok ? "" : " (write FAILED)");
+    if (repaired) {
+        *repaired = ok;
+    }
+    return ok ? ESP_OK : ESP_FAIL;
 }
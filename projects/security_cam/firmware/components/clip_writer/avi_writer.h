@@ -11,25 +11,35 @@
  *       LIST strl {
  *         strh  (stream header)
  *         strf  (BITMAPINFOHEADER for MJPEG)
+ *         indx  (OpenDML super index — one slot per checkpoint)
  *       }
+ *       LIST odml { dmlh }
  *     }
  *     LIST movi {
  *       00dc  (frame 0)
  *       00dc  (frame 1)
  *       ...
+ *       ix00  (standard index for the frames since the last checkpoint)
+ *       ...
  *     }
- *     idx1    (index of all frames — patched at close)
+ *     idx1    (index of all frames — rebuilt from the ix00 chunks at close)
  *   }
  *
- * The AVI header is written with placeholder values at open.
- * At close, the file is seeked back to patch frame count and size fields.
- * idx1 is pre-allocated in PSRAM and written in one fwrite() at close.
+ * The AVI header is written with placeholder values at open. At every
+ * checkpoint the header is patched and the file synced, so after a reset
+ * the clip plays up to its last checkpoint; avi_writer_repair() recovers
+ * the rest. Only the entries since the last checkpoint are held in RAM.
+ *
+ * All sequential writes go through a PSRAM staging buffer sized in whole
+ * SD allocation units (SDCARD_ALLOC_UNIT_SIZE), so the card sees a few
+ * large cluster-aligned writes per clip instead of three small ones per frame.
  */
 
 #pragma once
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
@@ -38,35 +48,64 @@ extern "C" {
 
 typedef struct avi_writer_t avi_writer_t;
 
+typedef struct {
+    const char *path;         /* Full path including .avi extension */
+    uint32_t    width;        /* Frame width (must match all frames written) */
+    uint32_t    height;       /* Frame height */
+    uint32_t    fps;          /* Target frame rate (used in stream header) */
+    uint32_t    checkpoint_frames; /* Index + header sync interval in frames.
+                               * 0 = index written at close only */
+    size_t      staging_size; /* Write staging buffer in bytes, rounded up to
+                               * SDCARD_ALLOC_UNIT_SIZE. 0 = 128 KB */
+    bool        preallocated; /* path already exists at its expected size
+                               * (sdcard_preallocate()): write in place and
+                               * truncate to the real length at close */
+} avi_writer_config_t;
+
 /**
  * @brief  Open an AVI file for writing.
- * @param  path     Full path including .avi extension.
- * @param  width    Frame width (must match all frames written).
- * @param  height   Frame height.
- * @param  fps      Target frame rate (used in stream header).
- * @param  max_frames  Pre-allocate idx1 for this many frames (e.g. 60s * fps).
+ *         Allocates the staging buffer and checkpoint index in PSRAM.
+ * @param  cfg  Writer configuration (copied; path only used during the call).
  * @return Handle on success, NULL on error.
  */
-avi_writer_t *avi_writer_open(const char *path, uint32_t width, uint32_t height,
-                              uint32_t fps, uint32_t max_frames);
+avi_writer_t *avi_writer_open(const avi_writer_config_t *cfg);
 
 /**
  * @brief  Append one JPEG frame to the AVI file.
+ *         Usually only copies into the staging buffer; a card write happens
+ *         when the buffer fills or a checkpoint is due.
  * @param  w       Writer handle.
  * @param  jpeg    JPEG data.
  * @param  len     JPEG data length in bytes.
- * @return ESP_OK on success.
+ * @return ESP_OK on success. ESP_ERR_INVALID_STATE after a failed flush
+ *         (the clip is still closed by avi_writer_close()).
  */
 esp_err_t avi_writer_write_frame(avi_writer_t *w, const void *jpeg, size_t len);
 
 /**
  * @brief  Finalise and close the AVI file.
- *         Seeks back to patch the AVI header and appends the idx1 chunk.
- *         Frees w.
- * @return ESP_OK on success.
+ *         Writes the last ix00 chunk and idx1, flushes the staging buffer,
+ *         then patches the AVI header and sets AVIF_HASINDEX. Frees w.
+ * @return ESP_OK on success, ESP_FAIL if any write failed.
  */
 esp_err_t avi_writer_close(avi_writer_t *w);
 
+/**
+ * @brief  Make an AVI left open by a reset playable.
+ *         Files that were closed cleanly (AVIF_HASINDEX) are only read —
+ *         a few hundred bytes. Otherwise the movi list is scanned for
+ *         complete 00dc chunks, idx1 is written after the last one, the
+ *         header sizes and counts are patched and the file truncated.
+ *         The super index is cleared (it may miss the tail), leaving idx1.
+ *         Must not be called on a file that is still being written.
+ * @param  path        Full path of the .avi file.
+ * @param  repaired    Optional: set true if the file was rewritten.
+ * @return ESP_OK if the file is (now) complete,
+ *         ESP_ERR_NOT_FOUND if nothing is recoverable (caller should delete),
+ *         ESP_FAIL on an I/O error.
+ */
+esp_err_t avi_writer_repair(const char *path, bool *repaired);
+
 #ifdef __cplusplus
 }
 #endif
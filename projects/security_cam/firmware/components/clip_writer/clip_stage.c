@@ -0,0 +1,154 @@
+/*
+ * clip_stage.c — Cluster-aligned write staging (see clip_stage.h)
+ */
+
+#include "clip_stage.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "sdcard.h"
+
+static const char *TAG = "clip_stage";
+
+/* Write the whole buffer at base. With keep_tail the last partial cluster
+ * stays staged and is rewritten by the next flush. */
+static esp_err_t flush(clip_stage_t *s, bool keep_tail)
+{
+    if (s->len == 0) {
+        return ESP_OK;
+    }
+    size_t n = 0;
+    if (fseek(s->fp, (long)s->base, SEEK_SET) == 0) {
+        n = fwrite(s->buf, 1, s->len, s->fp);
+    }
+    if (n != s->len) {
+        ESP_LOGE(TAG, "Staging flush failed (%u/%u B at %"PRIu32")",
+                 (unsigned)n, (unsigned)s->len, s->base);
+        s->io_error = true;
+        return ESP_FAIL;
+    }
+    s->flushes++;
+
+    size_t tail = keep_tail ? (s->len & (SDCARD_ALLOC_UNIT_SIZE - 1)) : 0;
+    size_t done = s->len - tail;
+    if (tail > 0 && done > 0) {
+        memmove(s->buf, s->buf + done, tail);
+    }
+    s->base += done;
+    s->len   = tail;
+    return ESP_OK;
+}
+
+esp_err_t clip_stage_open(clip_stage_t *s, const char *path, size_t size, bool preallocated)
+{
+    memset(s, 0, sizeof(*s));
+    size = (size + SDCARD_ALLOC_UNIT_SIZE - 1) & ~(size_t)(SDCARD_ALLOC_UNIT_SIZE - 1);
+    s->buf = heap_caps_aligned_alloc(64, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!s->buf) {
+        ESP_LOGE(TAG, "Cannot allocate %u KB staging buffer", (unsigned)(size >> 10));
+        return ESP_ERR_NO_MEM;
+    }
+    s->size = size;
+
+    /* Read access: containers read back index data before closing */
+    s->fp = fopen(path, preallocated ? "r+b" : "w+b");
+    if (!s->fp) {
+        ESP_LOGE(TAG, "Cannot open %s for writing", path);
+        heap_caps_free(s->buf);
+        s->buf = NULL;
+        return ESP_FAIL;
+    }
+    setvbuf(s->fp, NULL, _IONBF, 0);
+    s->preallocated = preallocated;
+    return ESP_OK;
+}
+
+esp_err_t clip_stage_put(clip_stage_t *s, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    while (len > 0) {
+        size_t room = s->size - s->len;
+        size_t n    = len < room ? len : room;
+        if (p) {
+            memcpy(s->buf + s->len, p, n);
+            p += n;
+        } else {
+            memset(s->buf + s->len, 0, n);
+        }
+        s->len += n;
+        s->pos += n;
+        len    -= n;
+        if (s->len == s->size && flush(s, false) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t clip_stage_zero(clip_stage_t *s, size_t len)
+{
+    return clip_stage_put(s, NULL, len);
+}
+
+void clip_stage_patch(clip_stage_t *s, uint32_t off, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    /* Part before base is on the card */
+    if (off < s->base) {
+        size_t n = (off + len <= s->base) ? len : (size_t)(s->base - off);
+        if (fseek(s->fp, (long)off, SEEK_SET) != 0 || fwrite(p, 1, n, s->fp) != n) {
+            s->io_error = true;
+        }
+        off += n;
+        p   += n;
+        len -= n;
+    }
+    /* The rest is staged — update the buffer; the next flush writes it */
+    if (len > 0 && off + len <= s->base + s->len) {
+        memcpy(s->buf + (off - s->base), p, len);
+    }
+}
+
+esp_err_t clip_stage_read(clip_stage_t *s, uint32_t off, void *data, size_t len)
+{
+    if (fseek(s->fp, (long)off, SEEK_SET) != 0 || fread(data, 1, len, s->fp) != len) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t clip_stage_commit(clip_stage_t *s, bool sync)
+{
+    if (flush(s, true) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    /* fsync commits data clusters and the directory entry size */
+    if (sync && fsync(fileno(s->fp)) != 0) {
+        s->io_error = true;
+    }
+    return s->io_error ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t clip_stage_close(clip_stage_t *s)
+{
+    if (!s->fp) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    flush(s, false);
+
+    /* Drop the unused tail of a pre-sized file */
+    if (s->preallocated && ftruncate(fileno(s->fp), (off_t)s->pos) != 0) {
+        ESP_LOGE(TAG, "ftruncate to %"PRIu32" B failed", s->pos);
+        s->io_error = true;
+    }
+    if (fclose(s->fp) != 0) {
+        s->io_error = true;
+    }
+    s->fp = NULL;
+    heap_caps_free(s->buf);
+    s->buf = NULL;
+    return s->io_error ? ESP_FAIL : ESP_OK;
+}
@@ -0,0 +1,83 @@
+/*
+ * clip_stage.h — Cluster-aligned write staging for clip containers
+ *
+ * Internal to clip_writer component. Shared by avi_writer, fmp4_writer and
+ * h264_writer.
+ *
+ * Sequential bytes are collected in a PSRAM buffer whose size is a multiple
+ * of SDCARD_ALLOC_UNIT_SIZE and written with one fwrite() each time it
+ * fills. The file starts on a cluster boundary, so every flush covers
+ * whole clusters at a cluster-aligned offset. clip_stage_commit() writes
+ * the partial buffer too but keeps its last partial cluster staged, so the
+ * next flush starts on the same boundary again. Bytes already appended can
+ * be rewritten with clip_stage_patch() wherever they currently live.
+ *
+ * stdio buffering is disabled on the stream (it would only add a copy).
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    FILE     *fp;
+    uint8_t  *buf;              /* staging buffer, PSRAM */
+    size_t    size;
+    size_t    len;              /* bytes in buf */
+    uint32_t  base;             /* file offset of buf[0], cluster aligned */
+    uint32_t  pos;              /* logical file size (written + staged) */
+    uint32_t  flushes;
+    bool      io_error;         /* sticky — a failed write loses data */
+    bool      preallocated;     /* truncate to pos at close */
+} clip_stage_t;
+
+/**
+ * @brief  Open path for writing through a staging buffer.
+ * @param  size          Buffer size, rounded up to SDCARD_ALLOC_UNIT_SIZE.
+ * @param  preallocated  path was sized by sdcard_preallocate(): write in
+ *                       place (keeps its cluster chain), truncate at close.
+ * @return ESP_OK, ESP_ERR_NO_MEM, or ESP_FAIL if the file cannot be opened.
+ */
+esp_err_t clip_stage_open(clip_stage_t *s, const char *path, size_t size, bool preallocated);
+
+/** @brief  Append bytes. Flushes whenever the buffer fills. */
+esp_err_t clip_stage_put(clip_stage_t *s, const void *data, size_t len);
+
+/** @brief  Append len zero bytes (space to be patched later). */
+esp_err_t clip_stage_zero(clip_stage_t *s, size_t len);
+
+/**
+ * @brief  Overwrite previously appended bytes at file offset off.
+ *         The part already on the card is rewritten there; the staged part
+ *         is updated in the buffer.
+ */
+void clip_stage_patch(clip_stage_t *s, uint32_t off, const void *data, size_t len);
+
+/**
+ * @brief  Read back bytes that are already on the card (after a commit).
+ */
+esp_err_t clip_stage_read(clip_stage_t *s, uint32_t off, void *data, size_t len);
+
+/**
+ * @brief  Write everything staged to the card, keeping the last partial
+ *         cluster in the buffer. With sync, fsync() afterwards so data and
+ *         directory entry survive a reset.
+ */
+esp_err_t clip_stage_commit(clip_stage_t *s, bool sync);
+
+/**
+ * @brief  Flush, truncate a pre-sized file to pos, close and free.
+ * @return ESP_OK if every write since open succeeded.
+ */
+esp_err_t clip_stage_close(clip_stage_t *s);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,28 +1,244 @@
 /*
- * clip_writer.c — Dispatch layer between clip_writer.h API and AVI/H.264 backends
+ * clip_writer.c — Dispatch layer between clip_writer.h API and the container backends
  *
- * Uses cam_caps_t at runtime to route to avi_writer or h264_writer.
+ * Uses cam_caps_t at runtime to route to avi_writer or h264_writer, or to
+ * fmp4_writer for either codec when CONFIG_CLIP_CONTAINER_FMP4 is set.
  * No target ifdefs here.
+ *
+ * With CONFIG_CLIP_WRITER_QUEUE_FRAMES > 0 all file writes happen on the
+ * frame_queue writer task: write_frame() queues and returns, begin() queues
+ * the pre-roll flush, end() drains before closing and then queues the
+ * pre-allocation of the next clip's file. Otherwise writes run
+ * synchronously in the caller and clips are not pre-allocated.
  */
 
 #include "clip_writer.h"
 #include "avi_writer.h"
 #include "h264_writer.h"
+#include "fmp4_writer.h"
+#include "preroll.h"
+#include "frame_queue.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 #include "sdcard.h"
+#include "clip_catalog.h"
+#include "esp_timer.h"
+#include "trace.h"
 
 #include <string.h>
 #include <stdio.h>
+#include <stdbool.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 static const char *TAG = "clip_writer";
 
 /* Runtime-selected backend */
-typedef enum { BACKEND_AVI, BACKEND_H264 } backend_t;
+typedef enum { BACKEND_AVI, BACKEND_H264, BACKEND_FMP4 } backend_t;
 
 static backend_t        s_backend;
+static bool             s_mjpeg;            /* camera delivers JPEG (vs H.264) */
 static const cam_caps_t *s_caps;
 static avi_writer_t     *s_avi;
 static h264_writer_t    *s_h264;
+static fmp4_writer_t    *s_fmp4;
+static char              s_open_path[128];  /* clip being written — repair skips it */
+
+static clip_writer_fragment_cb_t s_fragment_cb;
+static void                     *s_fragment_ctx;
+
+/* Pre-roll ring, allocated once in clip_writer_configure(); NULL if
+ * pre-roll is off or the watch stream cannot feed it. */
+static preroll_t        *s_preroll;
+
+#define PREROLL_SLOTS  ((CONFIG_PREROLL_MS * CONFIG_RECORD_FPS + 999) / 1000)
+
+/* Async writer; NULL = synchronous writes */
+static frame_queue_t    *s_queue;
+
+#define WRITER_TASK_PRIO    6       /* above upload (5): SD writes beat HTTP */
+#define DRAIN_WARN_MS       5000
+
+/* Running average frame size (EWMA, 1/8 per frame) used to pre-size
+ * the next clip's spare. Updated and read on whichever task writes frames. */
+static uint32_t         s_avg_frame_bytes;
+
+/* Frame rate of the next clip (clip_writer_set_fps); the pre-roll ring
+ * stays at CONFIG_RECORD_FPS and is thinned to this rate into AVI */
+static uint32_t         s_fps = CONFIG_RECORD_FPS;
+
+/* Backend write time and bytes this clip (writer task), and the sink
+ * throughput they gave over recent clips (KB/s, 0 = none yet) */
+static uint64_t         s_sink_bytes;
+static uint64_t         s_sink_us;
+static uint32_t         s_sink_kbps;
+
+#define AVG_FRAME_SHIFT     3
+#define PREALLOC_MARGIN_PCT 125     /* headroom over the expected size */
+#define AVI_HEADER_BYTES    4096    /* header + ix00 chunk headers, rounded up */
+#define AVI_FRAME_OVERHEAD  33      /* 00dc header + pad + ix00 and idx1 entries */
+                                    /* (MP4 needs less: ~1 KB init, 12 B/sample + moof) */
+#define FMP4_FRAGMENT_FRAMES_MAX 255
+
+/* Only a DUAL watch stream delivers frames a clip can start with: colour
+ * JPEG at the recording size. MOTION watch frames are QVGA GRAY8, and
+ * H.264 (or the P4's DUAL YUV) cannot be pre-rolled into a clip. */
+static bool watch_feeds_preroll(void)
+{
+#if CONFIG_CAMERA_DUAL_STREAM
+    return s_caps->supports_dual && s_caps->delivers_jpeg;
+#else
+    return false;
+#endif
+}
+
+static void preroll_setup(void)
+{
+    if (PREROLL_SLOTS == 0 || s_preroll) {
+        return;
+    }
+    if (!watch_feeds_preroll()) {
+        ESP_LOGI(TAG, "Pre-roll off — watch frames are not recording-format JPEG");
+        return;
+    }
+    s_preroll = preroll_create((size_t)CONFIG_PREROLL_BUDGET_KB * 1024,
+                               PREROLL_SLOTS, CONFIG_RECORD_FPS);
+    if (!s_preroll) {
+        ESP_LOGW(TAG, "Pre-roll disabled (allocation failed)");
+    }
+}
+
+static bool clip_open(void)
+{
+    switch (s_backend) {
+    case BACKEND_AVI:  return s_avi != NULL;
+    case BACKEND_H264: return s_h264 != NULL;
+    case BACKEND_FMP4: return s_fmp4 != NULL;
+    }
+    return false;
+}
+
+/* Write the pre-roll ring into the freshly opened clip, oldest first.
+ * Only MJPEG clips (AVI or MP4) get one — an H.264 stream must start at
+ * an IDR frame. */
+static void preroll_flush(void)
+{
+    uint32_t n = preroll_count(s_preroll);
+    if (n == 0) {
+        return;
+    }
+
+    /* AVI timing is the declared s_fps, so a ring stored at
+     * CONFIG_RECORD_FPS is thinned to it or the pre-roll plays slow.
+     * MP4 samples carry their own timestamps and keep every frame. */
+    uint64_t interval_us = 1000000ull / s_fps;
+    uint64_t due_us = 0;
+    uint32_t written = 0;
+    int64_t t_start = esp_timer_get_time();
+    for (uint32_t i = 0; i < n && s_mjpeg; i++) {
+        cam_frame_t f;
+        if (!preroll_get(s_preroll, i, &f)) {
+            break;
+        }
+        if (s_backend == BACKEND_AVI && s_fps < CONFIG_RECORD_FPS) {
+            if (due_us && f.timestamp_us + interval_us / 8 < due_us) {
+                continue;
+            }
+            /* Step from the last due time so the average rate is s_fps;
+             * restart from this frame after a gap in the ring */
+            due_us = (due_us && f.timestamp_us < due_us + interval_us ? due_us
+                                                                       : f.timestamp_us)
+                     + interval_us;
+        }
+        esp_err_t err = (s_backend == BACKEND_FMP4)
+            ? fmp4_writer_write_frame(s_fmp4, f.data, f.len, f.timestamp_us)
+            : avi_writer_write_frame(s_avi, f.data, f.len);
+        if (err == ESP_OK) {
+            written++;
+        }
+    }
+    preroll_clear(s_preroll);
+
+    ESP_LOGI(TAG, "Pre-roll: %"PRIu32"/%"PRIu32" frames flushed in %lld ms",
+             written, n, (esp_timer_get_time() - t_start) / 1000);
+}
+
+/* Backend write — runs on the writer task when s_queue is set */
+static esp_err_t write_direct(const cam_frame_t *frame, void *ctx)
+{
+    (void)ctx;
+    esp_err_t err;
+    int64_t t0 = esp_timer_get_time();
+    switch (s_backend) {
+    case BACKEND_AVI:
+        if (!s_avi) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        err = avi_writer_write_frame(s_avi, frame->data, frame->len);
+        break;
+    case BACKEND_FMP4:
+        if (!s_fmp4) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        err = fmp4_writer_write_frame(s_fmp4, frame->data, frame->len, frame->timestamp_us);
+        if (err == ESP_ERR_NOT_FOUND) {
+            return ESP_OK;          /* H.264 before the first IDR — counted by fmp4_writer */
+        }
+        break;
+    default:
+        if (!s_h264) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        err = h264_writer_write_nalu(s_h264, frame->data, frame->len);
+        if (err == ESP_ERR_NOT_FOUND) {
+            return ESP_OK;          /* before the first IDR — counted by h264_writer */
+        }
+        break;
+    }
+    if (err == ESP_OK) {
+        uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+        trace_record(TRACE_FRAME_WRITE, us);
+        s_sink_us    += us;
+        s_sink_bytes += frame->len;
+        int32_t diff = (int32_t)frame->len - (int32_t)s_avg_frame_bytes;
+        s_avg_frame_bytes = (uint32_t)((int32_t)s_avg_frame_bytes + (diff >> AVG_FRAME_SHIFT));
+    }
+    return err;
+}
+
+/* fmp4_writer callback — runs on the writing task */
+static void on_fragment(uint32_t committed_bytes, void *ctx)
+{
+    (void)ctx;
+    if (s_fragment_cb) {
+        s_fragment_cb(s_open_path, committed_bytes, s_fragment_ctx);
+    }
+}
+
+static void preroll_flush_job(void *ctx)
+{
+    (void)ctx;
+    preroll_flush();
+}
+
+static void queue_setup(void)
+{
+    if (CONFIG_CLIP_WRITER_QUEUE_FRAMES == 0 || s_queue) {
+        return;
+    }
+    frame_queue_config_t qc = {
+        .slot_count = CONFIG_CLIP_WRITER_QUEUE_FRAMES,
+        .slot_size  = (size_t)CONFIG_CLIP_WRITER_SLOT_KB * 1024,
+        .core       = CONFIG_CLIP_WRITER_CORE,
+        .priority   = WRITER_TASK_PRIO,
+        .sink       = write_direct,
+    };
+    s_queue = frame_queue_create(&qc);
+    if (!s_queue) {
+        ESP_LOGW(TAG, "Async writer unavailable — writing frames synchronously");
+    }
+}
 
 esp_err_t clip_writer_configure(const cam_caps_t *caps)
 {
@@ -30,75 +246,324 @@ esp_err_t clip_writer_configure(const cam_caps_t *caps)
         return ESP_ERR_INVALID_ARG;
     }
     s_caps = caps;
+    if (s_avg_frame_bytes == 0) {
+        /* OV2640 JPEG at the configured quality runs ~1 byte per 10 pixels */
+        s_avg_frame_bytes = caps->record_width * caps->record_height / 10;
+    }
 
-    if (caps->delivers_jpeg) {
-        s_backend = BACKEND_AVI;
-        ESP_LOGI(TAG, "Backend: AVI (MJPEG) — %"PRIu32"x%"PRIu32,
-                 caps->record_width, caps->record_height);
-    } else if (caps->delivers_h264) {
-        s_backend = BACKEND_H264;
-        ESP_LOGI(TAG, "Backend: H.264 — %"PRIu32"x%"PRIu32,
+    if (caps->delivers_jpeg || caps->delivers_h264) {
+        s_mjpeg   = caps->delivers_jpeg;
+#if CONFIG_CLIP_CONTAINER_FMP4
+        s_backend = BACKEND_FMP4;
+#else
+        s_backend = s_mjpeg ? BACKEND_AVI : BACKEND_H264;
+#endif
+        ESP_LOGI(TAG, "Backend: %s (%s) — %"PRIu32"x%"PRIu32,
+                 s_backend == BACKEND_FMP4 ? "fMP4" : s_mjpeg ? "AVI" : "raw",
+                 s_mjpeg ? "MJPEG" : "H.264",
                  caps->record_width, caps->record_height);
     } else {
         ESP_LOGE(TAG, "Camera delivers neither JPEG nor H.264 — cannot configure clip_writer");
         return ESP_ERR_NOT_SUPPORTED;
     }
+
+    preroll_setup();
+    queue_setup();
     return ESP_OK;
 }
 
-esp_err_t clip_writer_begin(const char *clip_name)
+/* Spare clip file, sized for a full-length recording so FATFS does not
+ * allocate clusters mid-clip. Made on the writer task after each close and
+ * renamed into place by the next begin; the suffix keeps repair and the
+ * catalog off it. The catalog does not count it, so its free space reads
+ * high by at most one spare. */
+#define SPARE_PATH  "/sdcard/next_clip.spr"
+
+/* Set on the recording loop when spare_job() is queued, cleared by it */
+static volatile bool    s_spare_busy;
+
+static uint32_t spare_size(void)
+{
+    uint32_t max_frames = (uint32_t)(CONFIG_MAX_CLIP_SECONDS * s_fps);
+    uint64_t per_frame = (uint64_t)s_avg_frame_bytes + AVI_FRAME_OVERHEAD;
+    uint64_t size = AVI_HEADER_BYTES + (uint64_t)max_frames * per_frame;
+    size = size * PREALLOC_MARGIN_PCT / 100;
+    size = (size + SDCARD_ALLOC_UNIT_SIZE - 1) & ~(uint64_t)(SDCARD_ALLOC_UNIT_SIZE - 1);
+    if (size > UINT32_MAX - SDCARD_ALLOC_UNIT_SIZE) {
+        size = UINT32_MAX - SDCARD_ALLOC_UNIT_SIZE + 1;            /* FAT32 file limit */
+    }
+    return (uint32_t)size;
+}
+
+static void make_spare(void)
+{
+    uint32_t size = spare_size();
+    struct stat st;
+    uint64_t have = stat(SPARE_PATH, &st) == 0 ? (uint64_t)st.st_size : 0;
+    if (have >= size) {
+        return;                     /* left over from an earlier run */
+    }
+
+    /* Free space from the catalog: f_getfree() walks the whole FAT */
+    clip_catalog_stats_t cat;
+    clip_catalog_get(&cat);
+    if (!cat.valid || cat.free_bytes + have < size) {
+        ESP_LOGW(TAG, "No room for a %"PRIu32" KB spare — next clip will grow as written",
+                 size >> 10);
+        return;
+    }
+
+    bool contiguous = false;
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t err = sdcard_preallocate(SPARE_PATH, size, &contiguous);
+    uint32_t ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Pre-allocating %"PRIu32" KB failed (%s) — next clip will grow as written",
+                 size >> 10, esp_err_to_name(err));
+        return;
+    }
+    ESP_LOGI(TAG, "Pre-allocated %"PRIu32" KB (%s, avg frame %"PRIu32" B) in %"PRIu32" ms",
+             size >> 10, contiguous ? "contiguous" : "fragmented", s_avg_frame_bytes, ms);
+}
+
+/* Runs behind the closed clip. A clip begun meanwhile (continue after
+ * max length) has its frames queued behind this job: leave it the card. */
+static void spare_job(void *ctx)
+{
+    (void)ctx;
+    if (!clip_open()) {
+        sdcard_io_set_foreground(true);
+        make_spare();
+        sdcard_io_set_foreground(clip_open());
+    }
+    s_spare_busy = false;
+}
+
+static void spare_queue(void)
+{
+    if (!s_queue || s_spare_busy) {
+        return;
+    }
+    s_spare_busy = true;
+    if (frame_queue_run(s_queue, spare_job, NULL) != ESP_OK) {
+        s_spare_busy = false;
+    }
+}
+
+/* Move the spare to path. False if there is none (first clip on a new
+ * card, card too full, or still being made) — write the ordinary way. */
+static bool spare_take(const char *path)
+{
+    if (!s_queue || s_spare_busy) {
+        return false;
+    }
+    return rename(SPARE_PATH, path) == 0;
+}
+
+/* The backend did not open: keep the spare rather than leave clusters of
+ * old data under a clip name */
+static void spare_return(const char *path, bool preallocated)
+{
+    if (preallocated) {
+        rename(path, SPARE_PATH);
+    }
+}
+
+static esp_err_t clip_begin(const char *clip_name)
 {
     char path[128];
+    snprintf(path, sizeof(path), "/sdcard/%s%s", clip_name, clip_writer_get_extension());
+    bool preallocated = spare_take(path);
+    s_sink_bytes = 0;
+    s_sink_us    = 0;
+
+    if (s_backend == BACKEND_FMP4) {
+        uint32_t frag = (uint32_t)(CONFIG_FMP4_FRAGMENT_S * s_fps);
+        fmp4_writer_config_t mp4_cfg = {
+            .path            = path,
+            .width           = s_caps->record_width,
+            .height          = s_caps->record_height,
+            .fps             = s_fps,
+            .codec           = s_mjpeg ? FMP4_CODEC_MJPEG : FMP4_CODEC_H264,
+            .fragment_frames = frag > FMP4_FRAGMENT_FRAMES_MAX ? FMP4_FRAGMENT_FRAMES_MAX : frag,
+            .staging_size    = (size_t)CONFIG_AVI_STAGING_KB * 1024,
+            .preallocated    = preallocated,
+            .on_fragment     = on_fragment,
+        };
+        strlcpy(s_open_path, path, sizeof(s_open_path));
+        s_fmp4 = fmp4_writer_open(&mp4_cfg);
+        if (!s_fmp4) {
+            ESP_LOGE(TAG, "fmp4_writer_open failed: %s", path);
+            spare_return(path, preallocated);
+            s_open_path[0] = '\0';
+            return ESP_FAIL;
+        }
+        ESP_LOGI(TAG, "Recording to %s", path);
+        if (s_queue) {
+            frame_queue_reset_stats(s_queue);
+        }
+        if (!s_mjpeg) {
+            preroll_clear(s_preroll);
+        } else if (s_queue) {
+            frame_queue_run(s_queue, preroll_flush_job, NULL);
+        } else {
+            preroll_flush();
+        }
 
-    if (s_backend == BACKEND_AVI) {
-        snprintf(path, sizeof(path), "/sdcard/%s.avi", clip_name);
-        uint32_t max_frames = (uint32_t)(CONFIG_MAX_CLIP_SECONDS * CONFIG_RECORD_FPS);
-        s_avi = avi_writer_open(path, s_caps->record_width, s_caps->record_height,
-                                CONFIG_RECORD_FPS, max_frames);
+    } else if (s_backend == BACKEND_AVI) {
+        avi_writer_config_t avi_cfg = {
+            .path              = path,
+            .width             = s_caps->record_width,
+            .height            = s_caps->record_height,
+            .fps               = s_fps,
+            .checkpoint_frames = (uint32_t)(CONFIG_AVI_CHECKPOINT_S * s_fps),
+            .staging_size      = (size_t)CONFIG_AVI_STAGING_KB * 1024,
+            .preallocated      = preallocated,
+        };
+        s_avi = avi_writer_open(&avi_cfg);
         if (!s_avi) {
             ESP_LOGE(TAG, "avi_writer_open failed: %s", path);
+            spare_return(path, preallocated);
             return ESP_FAIL;
         }
         ESP_LOGI(TAG, "Recording to %s", path);
+        strlcpy(s_open_path, path, sizeof(s_open_path));
+        if (s_queue) {
+            frame_queue_reset_stats(s_queue);
+            frame_queue_run(s_queue, preroll_flush_job, NULL);
+        } else {
+            preroll_flush();
+        }
 
     } else {
-        snprintf(path, sizeof(path), "/sdcard/%s.h264", clip_name);
-        s_h264 = h264_writer_open(path);
+        h264_writer_config_t h264_cfg = {
+            .path         = path,
+            .fps          = s_fps,
+            .staging_size = (size_t)CONFIG_AVI_STAGING_KB * 1024,
+            .preallocated = preallocated,
+        };
+        s_h264 = h264_writer_open(&h264_cfg);
         if (!s_h264) {
             ESP_LOGE(TAG, "h264_writer_open failed: %s", path);
+            spare_return(path, preallocated);
             return ESP_FAIL;
         }
         ESP_LOGI(TAG, "Recording to %s", path);
+        strlcpy(s_open_path, path, sizeof(s_open_path));
+        if (s_queue) {
+            frame_queue_reset_stats(s_queue);
+        }
+        preroll_clear(s_preroll);
     }
     return ESP_OK;
 }
 
+void clip_writer_preroll_push(const cam_frame_t *frame)
+{
+    if (!s_preroll || !frame) {
+        return;
+    }
+    /* The container declares the recording size and its frames are colour
+     * JPEG: anything else would switch format mid-clip */
+    if (frame->fmt != CAM_PIXFMT_JPEG ||
+        frame->width != s_caps->record_width || frame->height != s_caps->record_height) {
+        return;
+    }
+    preroll_push(s_preroll, frame);
+}
+
+void clip_writer_preroll_reset(void)
+{
+    preroll_clear(s_preroll);
+}
+
 esp_err_t clip_writer_write_frame(const cam_frame_t *frame)
 {
     if (!frame) {
         return ESP_ERR_INVALID_ARG;
     }
-    if (s_backend == BACKEND_AVI) {
-        if (!s_avi) {
-            return ESP_ERR_INVALID_STATE;
-        }
-        return avi_writer_write_frame(s_avi, frame->data, frame->len);
-    } else {
-        if (!s_h264) {
-            return ESP_ERR_INVALID_STATE;
+    if (!clip_open()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_queue) {
+        esp_err_t err = frame_queue_submit(s_queue, frame);
+        if (err == ESP_ERR_NO_MEM || err == ESP_ERR_INVALID_SIZE) {
+            trace_count(TRACE_FRAME_DROP);
         }
-        return h264_writer_write_nalu(s_h264, frame->data, frame->len);
+        frame_queue_stats_t qs;
+        frame_queue_get_stats(s_queue, &qs);
+        sdcard_io_set_backlog(err == ESP_ERR_NO_MEM ? 100 :
+                              qs.depth * 100 / CONFIG_CLIP_WRITER_QUEUE_FRAMES);
+        return err;
     }
+    return write_direct(frame, NULL);
 }
 
-esp_err_t clip_writer_end(void)
+void clip_writer_get_stats(clip_writer_stats_t *out)
+{
+    if (!out) {
+        return;
+    }
+    memset(out, 0, sizeof(*out));
+    out->sink_kbps = s_sink_kbps;
+    if (!s_queue) {
+        return;
+    }
+    frame_queue_stats_t qs;
+    frame_queue_get_stats(s_queue, &qs);
+    out->frames_written   = qs.written;
+    out->frames_zero_copy = qs.zero_copy;
+    out->frames_dropped   = qs.dropped;
+    out->write_errors     = qs.write_errors;
+    out->queue_depth      = qs.depth;
+    out->queue_high_water = qs.depth_high_water;
+    out->queue_capacity   = CONFIG_CLIP_WRITER_QUEUE_FRAMES;
+    out->write_us_max     = qs.write_us_max;
+}
+
+/* Fold this clip's backend write rate into s_sink_kbps. Only writes are
+ * timed, so this is what the card could take — not what it was asked to. */
+static void update_sink_rate(void)
 {
-    if (s_backend == BACKEND_AVI) {
+    if (s_sink_us < 100000) {
+        return;                     /* too little written to tell */
+    }
+    uint32_t kbps = (uint32_t)((s_sink_bytes * 1000000 / s_sink_us) >> 10);
+    s_sink_kbps = s_sink_kbps ? (s_sink_kbps + kbps) / 2 : kbps;
+}
+
+static esp_err_t clip_end(void)
+{
+    if (s_queue) {
+        /* The backend handle must not be closed under the writer task.
+         * An SD stall this long is already fatal to the clip — just wait. */
+        while (frame_queue_drain(s_queue, DRAIN_WARN_MS) == ESP_ERR_TIMEOUT) {
+            ESP_LOGW(TAG, "Writer still draining after %d ms", DRAIN_WARN_MS);
+        }
+        clip_writer_stats_t st;
+        clip_writer_get_stats(&st);
+        ESP_LOGI(TAG, "Writer: %"PRIu32" written (%"PRIu32" zero-copy), %"PRIu32" dropped, "
+                 "%"PRIu32" errors, queue peak %"PRIu32"/%"PRIu32", slowest write %"PRIu32" ms",
+                 st.frames_written, st.frames_zero_copy, st.frames_dropped, st.write_errors,
+                 st.queue_high_water, st.queue_capacity, st.write_us_max / 1000);
+    }
+    update_sink_rate();
+
+    if (s_backend == BACKEND_FMP4) {
+        if (!s_fmp4) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        esp_err_t err = fmp4_writer_close(s_fmp4);
+        s_fmp4 = NULL;
+        s_open_path[0] = '\0';
+        return err;
+    } else if (s_backend == BACKEND_AVI) {
         if (!s_avi) {
             return ESP_ERR_INVALID_STATE;
         }
         esp_err_t err = avi_writer_close(s_avi);
         s_avi = NULL;
+        s_open_path[0] = '\0';
         return err;
     } else {
         if (!s_h264) {
@@ -106,6 +571,132 @@ esp_err_t clip_writer_end(void)
         }
         esp_err_t err = h264_writer_close(s_h264);
         s_h264 = NULL;
+        s_open_path[0] = '\0';
         return err;
     }
 }
+
+esp_err_t clip_writer_begin(const char *clip_name)
+{
+    /* Background uploads yield the card until clip_writer_end() */
+    sdcard_io_set_foreground(true);
+    esp_err_t err = clip_begin(clip_name);
+    if (err != ESP_OK) {
+        sdcard_io_set_foreground(false);
+    }
+    return err;
+}
+
+esp_err_t clip_writer_end(void)
+{
+    char path[sizeof(s_open_path)];
+    strlcpy(path, s_open_path, sizeof(path));   /* clip_end() clears it */
+    esp_err_t err = clip_end();
+    sdcard_io_set_foreground(false);
+
+    struct stat st;
+    if (err == ESP_OK && path[0] && stat(path, &st) == 0) {
+        const char *clip_file = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+        clip_catalog_clip_added(clip_file, (uint64_t)st.st_size);
+    }
+    spare_queue();                  /* after clip_added: free space counts this clip */
+    return err;
+}
+
+const char *clip_writer_get_extension(void)
+{
+    switch (s_backend) {
+    case BACKEND_FMP4: return ".mp4";
+    case BACKEND_H264: return ".h264";
+    default:           return ".avi";
+    }
+}
+
+void clip_writer_set_fps(uint32_t fps)
+{
+    s_fps = fps ? fps : CONFIG_RECORD_FPS;
+}
+
+void clip_writer_set_fragment_cb(clip_writer_fragment_cb_t cb, void *ctx)
+{
+    s_fragment_ctx = ctx;
+    s_fragment_cb  = cb;
+}
+
+static bool has_suffix(const char *name, const char *ext)
+{
+    size_t len = strlen(name), n = strlen(ext);
+    return len > n && strcmp(name + len - n, ext) == 0;
+}
+
+esp_err_t clip_writer_repair(const char *path, bool *repaired)
+{
+    if (repaired) {
+        *repaired = false;
+    }
+    if (!path) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_open_path[0] && strcmp(path, s_open_path) == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (has_suffix(path, ".avi")) {
+        return avi_writer_repair(path, repaired);
+    }
+    if (has_suffix(path, ".mp4")) {
+        return fmp4_writer_repair(path, repaired);
+    }
+    return ESP_OK;                  /* H.264 elementary streams need no index */
+}
+
+esp_err_t clip_writer_remove(const char *path)
+{
+    static const char *const side[] = { "_thumb.jpg", "_trace.json", ".upj" };
+    esp_err_t err = unlink(path) == 0 ? ESP_OK : ESP_ERR_NOT_FOUND;
+
+    char side_path[128];
+    const char *dot = strrchr(path, '.');
+    int base_len = dot ? (int)(dot - path) : (int)strlen(path);
+    for (size_t i = 0; i < sizeof(side) / sizeof(side[0]); i++) {
+        snprintf(side_path, sizeof(side_path), "%.*s%s", base_len, path, side[i]);
+        unlink(side_path);
+    }
+    return err;
+}
+
+int clip_writer_repair_all(const char *dir, clip_writer_repair_cb_t cb, void *ctx)
+{
+    DIR *d = opendir(dir);
+    if (!d) {
+        ESP_LOGW(TAG, "repair: cannot open %s", dir);
+        return 0;
+    }
+    int repaired = 0, checked = 0, removed = 0;
+    int64_t t_start = esp_timer_get_time();
+    struct dirent *e;
+    char path[128];
+    while ((e = readdir(d)) != NULL) {
+        if (!has_suffix(e->d_name, ".avi") && !has_suffix(e->d_name, ".mp4") &&
+            !has_suffix(e->d_name, ".h264")) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        checked++;
+
+        bool was_open = false;
+        esp_err_t err = clip_writer_repair(path, &was_open);
+        if (err == ESP_ERR_NOT_FOUND) {
+            clip_writer_remove(path);
+            removed++;
+        } else if (err == ESP_OK && was_open) {
+            repaired++;
+        }
+        if (cb) {
+            cb(e->d_name, err, was_open, ctx);
+        }
+    }
+    closedir(d);
+    ESP_LOGI(TAG, "repair: %d clip(s) checked, %d repaired, %d unrecoverable removed (%lld ms)",
+             checked, repaired, removed, (esp_timer_get_time() - t_start) / 1000);
+    return repaired;
+}
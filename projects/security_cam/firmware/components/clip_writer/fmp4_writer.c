@@ -0,0 +1,850 @@
+/*
+ * fmp4_writer.c — Fragmented MP4 writer (see fmp4_writer.h for the layout)
+ *
+ * Fragment on disk (N = samples in it, M = fragment_frames):
+ *
+ *   frag_start  free <8 + 12(M-N)>           ← unused part of the reservation
+ *               moof <88 + 12N>
+ *                 mfhd <16>   sequence_number
+ *                 traf <64 + 12N>
+ *                   tfhd <16>  track 1, default-base-is-moof
+ *                   tfdt <20>  v1 baseMediaDecodeTime (90 kHz)
+ *                   trun <20 + 12N>  data_offset + {duration, size, flags} × N
+ *               mdat <8 + sample bytes>
+ *
+ * The 8 + (88 + 12M) + 8 header bytes are staged as zeros when the
+ * fragment starts and patched in one piece when it is finalised — the
+ * reservation may already be on the card by then (clip_stage_patch()
+ * handles both). Finalising waits for the next sample so the last
+ * duration comes from a real timestamp delta.
+ *
+ * All multi-byte fields are big-endian.
+ */
+
+#include "fmp4_writer.h"
+#include "clip_stage.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+static const char *TAG = "fmp4_writer";
+
+#define TRACK_ID            1
+#define MOVIE_TIMESCALE     1000
+#define TRACK_TIMESCALE     90000
+#define STAGING_DEFAULT     (128 * 1024)
+#define INIT_BUF_BYTES      1024        /* ftyp + moov incl. avcC */
+#define PARAM_SET_MAX       128         /* SPS / PPS bytes kept for avcC */
+#define FRAGMENT_MAX        255
+#define REPAIR_BUF_BYTES    4096        /* largest moov / moof repair will read */
+
+#define MOOF_BYTES(n)       (88u + 12u * (n))
+#define FRAG_RESERVE(n)     (8u + MOOF_BYTES(n) + 8u)  /* free header + moof + mdat header */
+
+#define SAMPLE_SYNC         0x02000000u /* sample_depends_on = 2: independent */
+#define SAMPLE_NON_SYNC     0x01010000u /* depends_on = 1, sample_is_non_sync */
+
+#define TFHD_DEFAULT_BASE_IS_MOOF 0x020000u
+#define TRUN_DATA_OFFSET    0x000001u
+#define TRUN_DURATION       0x000100u
+#define TRUN_SIZE           0x000200u
+#define TRUN_FLAGS          0x000400u
+
+#define NAL_IDR             5
+#define NAL_SPS             7
+#define NAL_PPS             8
+#define NAL_AUD             9
+
+/* ---------------------------------------------------------------------------
+ * Big-endian box builder over a fixed buffer
+ * -------------------------------------------------------------------------*/
+
+typedef struct {
+    uint8_t *p;
+    size_t   len;
+    size_t   cap;
+    bool     overflow;
+} bbuf_t;
+
+static void b_bytes(bbuf_t *b, const void *d, size_t n)
+{
+    if (b->len + n > b->cap) {
+        b->overflow = true;
+        return;
+    }
+    if (d) {
+        memcpy(b->p + b->len, d, n);
+    } else {
+        memset(b->p + b->len, 0, n);
+    }
+    b->len += n;
+}
+
+static void b_u8(bbuf_t *b, uint8_t v)   { b_bytes(b, &v, 1); }
+static void b_u16(bbuf_t *b, uint16_t v) { uint8_t t[2] = { v >> 8, (uint8_t)v }; b_bytes(b, t, 2); }
+static void b_u32(bbuf_t *b, uint32_t v)
+{
+    uint8_t t[4] = { v >> 24, v >> 16, v >> 8, (uint8_t)v };
+    b_bytes(b, t, 4);
+}
+static void b_u64(bbuf_t *b, uint64_t v) { b_u32(b, (uint32_t)(v >> 32)); b_u32(b, (uint32_t)v); }
+static void b_cc(bbuf_t *b, const char *cc) { b_bytes(b, cc, 4); }
+
+/* Open a box; returns its offset for b_end() */
+static size_t b_box(bbuf_t *b, const char *type)
+{
+    size_t at = b->len;
+    b_u32(b, 0);
+    b_cc(b, type);
+    return at;
+}
+
+static size_t b_fullbox(bbuf_t *b, const char *type, uint8_t version, uint32_t flags)
+{
+    size_t at = b_box(b, type);
+    b_u32(b, ((uint32_t)version << 24) | flags);
+    return at;
+}
+
+static void b_end(bbuf_t *b, size_t at)
+{
+    if (b->overflow) {
+        return;
+    }
+    uint32_t n = (uint32_t)(b->len - at);
+    b->p[at]     = n >> 24;
+    b->p[at + 1] = n >> 16;
+    b->p[at + 2] = n >> 8;
+    b->p[at + 3] = (uint8_t)n;
+}
+
+static void b_matrix(bbuf_t *b)
+{
+    static const uint32_t unity[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+    for (int i = 0; i < 9; i++) {
+        b_u32(b, unity[i]);
+    }
+}
+
+static uint32_t rd32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* ---------------------------------------------------------------------------
+ * Internal state
+ * -------------------------------------------------------------------------*/
+
+typedef struct {
+    uint32_t size;
+    uint32_t flags;
+    uint64_t ts_us;
+} sample_t;
+
+struct fmp4_writer_t {
+    clip_stage_t st;
+    fmp4_codec_t codec;
+    uint32_t     width;
+    uint32_t     height;
+    uint32_t     frag_frames;
+    uint32_t     nominal_dur;       /* 90 kHz ticks per frame at cfg.fps */
+    bool         init_written;
+    uint32_t     mehd_offset;       /* file offset of mehd.fragment_duration */
+
+    /* Fragment being written */
+    sample_t    *samples;           /* frag_frames entries */
+    uint32_t     n;
+    uint32_t     frag_start;        /* file offset of the reserved header space */
+    uint32_t     frag_bytes;        /* sample bytes staged */
+    uint8_t     *hdr;               /* FRAG_RESERVE(frag_frames) scratch */
+
+    uint32_t     seq;
+    uint64_t     dts;               /* decode time of the next fragment, 90 kHz */
+    uint32_t     frames;
+    uint32_t     dropped;
+
+    uint8_t      sps[PARAM_SET_MAX];
+    uint8_t      pps[PARAM_SET_MAX];
+    uint16_t     sps_len;
+    uint16_t     pps_len;
+
+    fmp4_fragment_cb_t on_fragment;
+    void        *cb_ctx;
+};
+
+/* ---------------------------------------------------------------------------
+ * H.264 Annex B
+ * -------------------------------------------------------------------------*/
+
+/* Find the next NAL unit in [*p, end). Returns false when none is left. */
+static bool next_nal(const uint8_t **p, const uint8_t *end, const uint8_t **nal, size_t *nal_len)
+{
+    const uint8_t *s = *p;
+    /* Skip to just past a 00 00 01 start code */
+    while (s + 3 <= end && !(s[0] == 0 && s[1] == 0 && s[2] == 1)) {
+        s++;
+    }
+    if (s + 3 > end) {
+        return false;
+    }
+    s += 3;
+
+    const uint8_t *e = s;
+    while (e + 3 <= end && !(e[0] == 0 && e[1] == 0 && (e[2] == 1 || e[2] == 0))) {
+        e++;
+    }
+    if (e + 3 > end) {
+        e = end;
+    }
+    const uint8_t *next = e;
+    while (e > s && e[-1] == 0) {
+        e--;                        /* trailing_zero_8bits / 4-byte start code */
+    }
+    *nal     = s;
+    *nal_len = (size_t)(e - s);
+    *p       = next;
+    return true;
+}
+
+static bool nal_in_sample(uint8_t type)
+{
+    return type != NAL_SPS && type != NAL_PPS && type != NAL_AUD;
+}
+
+/* Pick up parameter sets and size the length-prefixed sample */
+static uint32_t h264_scan(fmp4_writer_t *w, const uint8_t *data, size_t len, bool *idr)
+{
+    const uint8_t *p = data, *end = data + len, *nal;
+    size_t nal_len;
+    uint32_t size = 0;
+    *idr = false;
+    while (next_nal(&p, end, &nal, &nal_len)) {
+        if (nal_len == 0) {
+            continue;
+        }
+        uint8_t type = nal[0] & 0x1F;
+        if (type == NAL_SPS && nal_len <= PARAM_SET_MAX && nal_len >= 4) {
+            memcpy(w->sps, nal, nal_len);
+            w->sps_len = (uint16_t)nal_len;
+        } else if (type == NAL_PPS && nal_len <= PARAM_SET_MAX) {
+            memcpy(w->pps, nal, nal_len);
+            w->pps_len = (uint16_t)nal_len;
+        }
+        if (nal_in_sample(type)) {
+            size += 4 + (uint32_t)nal_len;
+        }
+        if (type == NAL_IDR) {
+            *idr = true;
+        }
+    }
+    return size;
+}
+
+static esp_err_t h264_stage(fmp4_writer_t *w, const uint8_t *data, size_t len)
+{
+    const uint8_t *p = data, *end = data + len, *nal;
+    size_t nal_len;
+    while (next_nal(&p, end, &nal, &nal_len)) {
+        if (nal_len == 0 || !nal_in_sample(nal[0] & 0x1F)) {
+            continue;
+        }
+        uint8_t be[4] = { nal_len >> 24, nal_len >> 16, nal_len >> 8, (uint8_t)nal_len };
+        if (clip_stage_put(&w->st, be, 4) != ESP_OK ||
+            clip_stage_put(&w->st, nal, nal_len) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
+/* ---------------------------------------------------------------------------
+ * Init segment
+ * -------------------------------------------------------------------------*/
+
+static void build_sample_entry(fmp4_writer_t *w, bbuf_t *b)
+{
+    size_t se = b_box(b, w->codec == FMP4_CODEC_MJPEG ? "mp4v" : "avc1");
+    b_bytes(b, NULL, 6);            /* reserved */
+    b_u16(b, 1);                    /* data_reference_index */
+    b_u16(b, 0);                    /* pre_defined */
+    b_u16(b, 0);                    /* reserved */
+    b_bytes(b, NULL, 12);           /* pre_defined */
+    b_u16(b, (uint16_t)w->width);
+    b_u16(b, (uint16_t)w->height);
+    b_u32(b, 0x00480000);           /* 72 dpi */
+    b_u32(b, 0x00480000);
+    b_u32(b, 0);                    /* reserved */
+    b_u16(b, 1);                    /* frame_count */
+    b_bytes(b, NULL, 32);           /* compressorname */
+    b_u16(b, 0x0018);               /* depth */
+    b_u16(b, 0xFFFF);               /* pre_defined = -1 */
+
+    if (w->codec == FMP4_CODEC_MJPEG) {
+        size_t esds = b_fullbox(b, "esds", 0, 0);
+        b_u8(b, 0x03);  b_u8(b, 21);            /* ES_Descriptor */
+        b_u16(b, TRACK_ID);
+        b_u8(b, 0);
+        b_u8(b, 0x04);  b_u8(b, 13);            /* DecoderConfigDescriptor */
+        b_u8(b, 0x6C);                          /* objectTypeIndication: JPEG */
+        b_u8(b, (0x04 << 2) | 1);               /* streamType visual, upStream 0, reserved 1 */
+        b_u8(b, 0);     b_u16(b, 0);            /* bufferSizeDB */
+        b_u32(b, 0);                            /* maxBitrate */
+        b_u32(b, 0);                            /* avgBitrate */
+        b_u8(b, 0x06);  b_u8(b, 1);  b_u8(b, 0x02);  /* SLConfigDescriptor: MP4 */
+        b_end(b, esds);
+    } else {
+        size_t avcc = b_box(b, "avcC");
+        b_u8(b, 1);                             /* configurationVersion */
+        b_u8(b, w->sps[1]);                     /* AVCProfileIndication */
+        b_u8(b, w->sps[2]);                     /* profile_compatibility */
+        b_u8(b, w->sps[3]);                     /* AVCLevelIndication */
+        b_u8(b, 0xFF);                          /* lengthSizeMinusOne = 3 */
+        b_u8(b, 0xE1);                          /* one SPS */
+        b_u16(b, w->sps_len);
+        b_bytes(b, w->sps, w->sps_len);
+        b_u8(b, 1);                             /* one PPS */
+        b_u16(b, w->pps_len);
+        b_bytes(b, w->pps, w->pps_len);
+        b_end(b, avcc);
+    }
+    b_end(b, se);
+}
+
+static esp_err_t write_init(fmp4_writer_t *w)
+{
+    uint8_t *buf = malloc(INIT_BUF_BYTES);
+    if (!buf) {
+        return ESP_ERR_NO_MEM;
+    }
+    bbuf_t b = { .p = buf, .cap = INIT_BUF_BYTES };
+
+    size_t ftyp = b_box(&b, "ftyp");
+    b_cc(&b, "isom");
+    b_u32(&b, 0x200);
+    b_cc(&b, "isom");
+    b_cc(&b, "iso5");
+    b_cc(&b, "iso6");
+    b_cc(&b, "mp41");
+    b_end(&b, ftyp);
+
+    size_t moov = b_box(&b, "moov");
+    {
+        size_t mvhd = b_fullbox(&b, "mvhd", 0, 0);
+        b_u32(&b, 0);                   /* creation_time */
+        b_u32(&b, 0);                   /* modification_time */
+        b_u32(&b, MOVIE_TIMESCALE);
+        b_u32(&b, 0);                   /* duration — see mehd */
+        b_u32(&b, 0x00010000);          /* rate 1.0 */
+        b_u16(&b, 0x0100);              /* volume 1.0 */
+        b_bytes(&b, NULL, 10);
+        b_matrix(&b);
+        b_bytes(&b, NULL, 24);
+        b_u32(&b, TRACK_ID + 1);        /* next_track_ID */
+        b_end(&b, mvhd);
+
+        size_t trak = b_box(&b, "trak");
+        size_t tkhd = b_fullbox(&b, "tkhd", 0, 0x000003);   /* enabled, in movie */
+        b_u32(&b, 0);
+        b_u32(&b, 0);
+        b_u32(&b, TRACK_ID);
+        b_u32(&b, 0);
+        b_u32(&b, 0);                   /* duration */
+        b_bytes(&b, NULL, 8);
+        b_u16(&b, 0);                   /* layer */
+        b_u16(&b, 0);                   /* alternate_group */
+        b_u16(&b, 0);                   /* volume */
+        b_u16(&b, 0);
+        b_matrix(&b);
+        b_u32(&b, w->width << 16);
+        b_u32(&b, w->height << 16);
+        b_end(&b, tkhd);
+
+        size_t mdia = b_box(&b, "mdia");
+        size_t mdhd = b_fullbox(&b, "mdhd", 0, 0);
+        b_u32(&b, 0);
+        b_u32(&b, 0);
+        b_u32(&b, TRACK_TIMESCALE);
+        b_u32(&b, 0);
+        b_u16(&b, 0x55C4);              /* language 'und' */
+        b_u16(&b, 0);
+        b_end(&b, mdhd);
+
+        size_t hdlr = b_fullbox(&b, "hdlr", 0, 0);
+        b_u32(&b, 0);
+        b_cc(&b, "vide");
+        b_bytes(&b, NULL, 12);
+        b_bytes(&b, "VideoHandler", 13);
+        b_end(&b, hdlr);
+
+        size_t minf = b_box(&b, "minf");
+        size_t vmhd = b_fullbox(&b, "vmhd", 0, 1);
+        b_bytes(&b, NULL, 8);           /* graphicsmode + opcolor */
+        b_end(&b, vmhd);
+        size_t dinf = b_box(&b, "dinf");
+        size_t dref = b_fullbox(&b, "dref", 0, 0);
+        b_u32(&b, 1);
+        size_t url = b_fullbox(&b, "url ", 0, 1);   /* self-contained */
+        b_end(&b, url);
+        b_end(&b, dref);
+        b_end(&b, dinf);
+
+        /* Sample tables stay empty — every sample lives in a fragment */
+        size_t stbl = b_box(&b, "stbl");
+        size_t stsd = b_fullbox(&b, "stsd", 0, 0);
+        b_u32(&b, 1);
+        build_sample_entry(w, &b);
+        b_end(&b, stsd);
+        size_t stts = b_fullbox(&b, "stts", 0, 0);
+        b_u32(&b, 0);
+        b_end(&b, stts);
+        size_t stsc = b_fullbox(&b, "stsc", 0, 0);
+        b_u32(&b, 0);
+        b_end(&b, stsc);
+        size_t stsz = b_fullbox(&b, "stsz", 0, 0);
+        b_u32(&b, 0);
+        b_u32(&b, 0);
+        b_end(&b, stsz);
+        size_t stco = b_fullbox(&b, "stco", 0, 0);
+        b_u32(&b, 0);
+        b_end(&b, stco);
+        b_end(&b, stbl);
+        b_end(&b, minf);
+        b_end(&b, mdia);
+        b_end(&b, trak);
+
+        size_t mvex = b_box(&b, "mvex");
+        size_t mehd = b_fullbox(&b, "mehd", 0, 0);
+        w->mehd_offset = w->st.pos + (uint32_t)b.len;
+        b_u32(&b, 0);                   /* fragment_duration — written at close */
+        b_end(&b, mehd);
+        size_t trex = b_fullbox(&b, "trex", 0, 0);
+        b_u32(&b, TRACK_ID);
+        b_u32(&b, 1);                   /* default_sample_description_index */
+        b_u32(&b, w->nominal_dur);
+        b_u32(&b, 0);
+        b_u32(&b, SAMPLE_SYNC);
+        b_end(&b, trex);
+        b_end(&b, mvex);
+    }
+    b_end(&b, moov);
+
+    esp_err_t err = b.overflow ? ESP_ERR_INVALID_SIZE : clip_stage_put(&w->st, buf, b.len);
+    free(buf);
+    if (err == ESP_OK) {
+        w->init_written = true;
+    }
+    return err;
+}
+
+/* ---------------------------------------------------------------------------
+ * Fragments
+ * -------------------------------------------------------------------------*/
+
+static uint32_t sample_duration(const fmp4_writer_t *w, uint64_t ts, uint64_t next_ts)
+{
+    if (ts == 0 || next_ts <= ts) {
+        return w->nominal_dur;
+    }
+    /* Convert both ends so rounding does not accumulate */
+    uint64_t t0 = ts * 9 / 100, t1 = next_ts * 9 / 100;
+    return (uint32_t)(t1 - t0);
+}
+
+/* Patch the reserved header space and commit the fragment.
+ * next_ts: timestamp of the sample after the last one (0 = unknown). */
+static esp_err_t finalize_fragment(fmp4_writer_t *w, uint64_t next_ts)
+{
+    uint32_t n = w->n;
+    if (n == 0) {
+        return ESP_OK;
+    }
+    bbuf_t b = { .p = w->hdr, .cap = FRAG_RESERVE(w->frag_frames) };
+
+    uint32_t free_bytes = FRAG_RESERVE(w->frag_frames) - 8 - MOOF_BYTES(n);
+    b_u32(&b, free_bytes);
+    b_cc(&b, "free");
+    b_bytes(&b, NULL, free_bytes - 8);
+
+    uint64_t frag_dur = 0;
+    size_t moof = b_box(&b, "moof");
+    size_t mfhd = b_fullbox(&b, "mfhd", 0, 0);
+    b_u32(&b, ++w->seq);
+    b_end(&b, mfhd);
+    size_t traf = b_box(&b, "traf");
+    size_t tfhd = b_fullbox(&b, "tfhd", 0, TFHD_DEFAULT_BASE_IS_MOOF);
+    b_u32(&b, TRACK_ID);
+    b_end(&b, tfhd);
+    size_t tfdt = b_fullbox(&b, "tfdt", 1, 0);
+    b_u64(&b, w->dts);
+    b_end(&b, tfdt);
+    size_t trun = b_fullbox(&b, "trun", 0,
+                            TRUN_DATA_OFFSET | TRUN_DURATION | TRUN_SIZE | TRUN_FLAGS);
+    b_u32(&b, n);
+    b_u32(&b, MOOF_BYTES(n) + 8);   /* data_offset: first byte after the mdat header */
+    for (uint32_t i = 0; i < n; i++) {
+        uint64_t nts = (i + 1 < n) ? w->samples[i + 1].ts_us : next_ts;
+        uint32_t dur = sample_duration(w, w->samples[i].ts_us, nts);
+        b_u32(&b, dur);
+        b_u32(&b, w->samples[i].size);
+        b_u32(&b, w->samples[i].flags);
+        frag_dur += dur;
+    }
+    b_end(&b, trun);
+    b_end(&b, traf);
+    b_end(&b, moof);
+
+    b_u32(&b, 8 + w->frag_bytes);
+    b_cc(&b, "mdat");
+
+    if (b.overflow || b.len != FRAG_RESERVE(w->frag_frames)) {
+        ESP_LOGE(TAG, "Fragment header layout mismatch (%u B)", (unsigned)b.len);
+        w->st.io_error = true;
+        return ESP_FAIL;
+    }
+    clip_stage_patch(&w->st, w->frag_start, w->hdr, b.len);
+
+    w->dts += frag_dur;
+    w->n    = 0;
+    esp_err_t err = clip_stage_commit(&w->st, true);
+    if (err == ESP_OK && w->on_fragment) {
+        w->on_fragment(w->st.pos, w->cb_ctx);
+    }
+    return err;
+}
+
+/* ---------------------------------------------------------------------------
+ * Public API
+ * -------------------------------------------------------------------------*/
+
+fmp4_writer_t *fmp4_writer_open(const fmp4_writer_config_t *cfg)
+{
+    if (!cfg || !cfg->path || cfg->fragment_frames == 0 || cfg->fragment_frames > FRAGMENT_MAX) {
+        return NULL;
+    }
+    fmp4_writer_t *w = calloc(1, sizeof(*w));
+    if (!w) {
+        ESP_LOGE(TAG, "Out of heap for writer struct");
+        return NULL;
+    }
+    w->codec        = cfg->codec;
+    w->width        = cfg->width;
+    w->height       = cfg->height;
+    w->frag_frames  = cfg->fragment_frames;
+    w->nominal_dur  = TRACK_TIMESCALE / (cfg->fps > 0 ? cfg->fps : 10);
+    w->on_fragment  = cfg->on_fragment;
+    w->cb_ctx       = cfg->cb_ctx;
+    w->samples      = calloc(w->frag_frames, sizeof(sample_t));
+    w->hdr          = malloc(FRAG_RESERVE(w->frag_frames));
+
+    size_t stage_size = cfg->staging_size ? cfg->staging_size : STAGING_DEFAULT;
+    if (!w->samples || !w->hdr ||
+        clip_stage_open(&w->st, cfg->path, stage_size, cfg->preallocated) != ESP_OK) {
+        ESP_LOGE(TAG, "fmp4_writer_open failed for %s", cfg->path);
+        free(w->samples);
+        free(w->hdr);
+        free(w);
+        return NULL;
+    }
+
+    if (w->codec == FMP4_CODEC_MJPEG && write_init(w) != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot write init segment");
+        clip_stage_close(&w->st);
+        free(w->samples);
+        free(w->hdr);
+        free(w);
+        return NULL;
+    }
+
+    ESP_LOGI(TAG, "fmp4_writer_open: %s (%s %"PRIu32"x%"PRIu32", %"PRIu32" frames/fragment)",
+             cfg->path, w->codec == FMP4_CODEC_MJPEG ? "MJPEG" : "H.264",
+             w->width, w->height, w->frag_frames);
+    return w;
+}
+
+esp_err_t fmp4_writer_write_frame(fmp4_writer_t *w, const void *data, size_t len,
+                                  uint64_t timestamp_us)
+{
+    if (!w || !w->st.fp || w->st.io_error) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!data || len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t size  = (uint32_t)len;
+    uint32_t flags = SAMPLE_SYNC;
+    if (w->codec == FMP4_CODEC_H264) {
+        bool idr;
+        size  = h264_scan(w, data, len, &idr);
+        flags = idr ? SAMPLE_SYNC : SAMPLE_NON_SYNC;
+        if (!w->init_written) {
+            /* Stream must start with parameter sets and an IDR frame */
+            if (!idr || w->sps_len == 0 || w->pps_len == 0) {
+                w->dropped++;
+                return ESP_ERR_NOT_FOUND;
+            }
+            if (write_init(w) != ESP_OK) {
+                w->st.io_error = true;
+                return ESP_FAIL;
+            }
+        }
+        if (size == 0) {
+            return ESP_OK;          /* parameter sets only */
+        }
+    }
+
+    if (w->n == w->frag_frames && finalize_fragment(w, timestamp_us) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (w->n == 0) {
+        w->frag_start = w->st.pos;
+        w->frag_bytes = 0;
+        if (clip_stage_zero(&w->st, FRAG_RESERVE(w->frag_frames)) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+
+    esp_err_t err = (w->codec == FMP4_CODEC_H264) ? h264_stage(w, data, len)
+                                                  : clip_stage_put(&w->st, data, len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Sample write failed at frame %"PRIu32, w->frames);
+        return ESP_FAIL;
+    }
+    w->samples[w->n] = (sample_t) { .size = size, .flags = flags, .ts_us = timestamp_us };
+    w->n++;
+    w->frag_bytes += size;
+    w->frames++;
+    return ESP_OK;
+}
+
+esp_err_t fmp4_writer_close(fmp4_writer_t *w)
+{
+    if (!w) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = finalize_fragment(w, 0);
+
+    /* A non-zero mehd marks the file as closed cleanly (see repair) */
+    if (w->init_written && w->frames > 0) {
+        uint32_t ms = (uint32_t)(w->dts * MOVIE_TIMESCALE / TRACK_TIMESCALE);
+        if (ms == 0) {
+            ms = 1;
+        }
+        uint8_t be[4] = { ms >> 24, ms >> 16, ms >> 8, (uint8_t)ms };
+        clip_stage_patch(&w->st, w->mehd_offset, be, 4);
+    }
+
+    uint32_t size = w->st.pos, flushes = w->st.flushes;
+    if (clip_stage_close(&w->st) != ESP_OK) {
+        err = ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "fmp4_writer_close: %"PRIu32" frames in %"PRIu32" fragments, %"PRIu32" KB, "
+             "%"PRIu32" ms, %"PRIu32" writes%s",
+             w->frames, w->seq, size >> 10,
+             (uint32_t)(w->dts * MOVIE_TIMESCALE / TRACK_TIMESCALE), flushes,
+             err == ESP_OK ? "" : " — I/O ERROR");
+    if (w->dropped) {
+        ESP_LOGW(TAG, "%"PRIu32" H.264 units dropped before the first IDR", w->dropped);
+    }
+    free(w->samples);
+    free(w->hdr);
+    free(w);
+    return err;
+}
+
+/* ---------------------------------------------------------------------------
+ * Repair
+ * -------------------------------------------------------------------------*/
+
+static bool read_at(FILE *fp, uint32_t off, void *buf, size_t len)
+{
+    return fseek(fp, (long)off, SEEK_SET) == 0 && fread(buf, 1, len, fp) == len;
+}
+
+/* Find a box by path ("trak/mdia/mdhd") inside [p, p+len). Returns the box
+ * header, or NULL; *box_len gets its size. */
+static const uint8_t *find_box(const uint8_t *p, size_t len, const char *path, uint32_t *box_len)
+{
+    while (len >= 8) {
+        uint32_t sz = rd32(p);
+        if (sz < 8 || sz > len) {
+            return NULL;
+        }
+        if (memcmp(p + 4, path, 4) == 0) {
+            if (path[4] == '\0') {
+                *box_len = sz;
+                return p;
+            }
+            return find_box(p + 8, sz - 8, path + 5, box_len);
+        }
+        p   += sz;
+        len -= sz;
+    }
+    return NULL;
+}
+
+/* The last sample of a fragment is the last thing written — if it is
+ * intact, the whole fragment reached the card. */
+static bool last_sample_ok(FILE *fp, bool mjpeg, uint32_t off, uint32_t size)
+{
+    if (mjpeg) {
+        uint8_t a[2], z[2];
+        return size >= 4 && read_at(fp, off, a, 2) && read_at(fp, off + size - 2, z, 2) &&
+               a[0] == 0xFF && a[1] == 0xD8 && z[0] == 0xFF && z[1] == 0xD9;
+    }
+    /* H.264: the NAL length prefixes must add up to the sample size */
+    uint32_t pos = 0;
+    while (pos + 4 <= size) {
+        uint8_t be[4];
+        if (!read_at(fp, off + pos, be, 4)) {
+            return false;
+        }
+        uint32_t n = rd32(be);
+        if (n == 0 || n > size - pos - 4) {
+            return false;
+        }
+        pos += 4 + n;
+    }
+    return pos == size;
+}
+
+esp_err_t fmp4_writer_repair(const char *path, bool *repaired)
+{
+    if (repaired) {
+        *repaired = false;
+    }
+    FILE *fp = fopen(path, "r+b");
+    if (!fp) {
+        return ESP_FAIL;
+    }
+    setvbuf(fp, NULL, _IONBF, 0);
+    fseek(fp, 0, SEEK_END);
+    long size_l = ftell(fp);
+    uint32_t file_size = size_l > 0 ? (uint32_t)size_l : 0;
+
+    uint8_t *buf = malloc(REPAIR_BUF_BYTES);
+    if (!buf) {
+        fclose(fp);
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint32_t pos = 0, good_end = 0, fragments = 0, mehd_off = 0;
+    uint32_t movie_ts = MOVIE_TIMESCALE, track_ts = TRACK_TIMESCALE;
+    uint64_t total = 0;
+    bool have_moov = false, mjpeg = true, clean = false;
+
+    while (pos + 8 <= file_size) {
+        uint8_t h[8];
+        if (!read_at(fp, pos, h, 8)) {
+            break;
+        }
+        uint32_t sz = rd32(h);
+        if (sz < 8 || sz > file_size - pos) {
+            break;                  /* zeroed reservation or truncated box */
+        }
+
+        if (!memcmp(h + 4, "ftyp", 4) || !memcmp(h + 4, "free", 4) || !memcmp(h + 4, "skip", 4)) {
+            pos += sz;
+            continue;
+        }
+
+        if (!memcmp(h + 4, "moov", 4) && !have_moov) {
+            if (sz > REPAIR_BUF_BYTES || !read_at(fp, pos, buf, sz)) {
+                break;
+            }
+            uint32_t bl;
+            const uint8_t *b;
+            if ((b = find_box(buf + 8, sz - 8, "mvhd", &bl)) && bl >= 24) {
+                movie_ts = rd32(b + 20);
+            }
+            if ((b = find_box(buf + 8, sz - 8, "trak/mdia/mdhd", &bl)) && bl >= 24) {
+                track_ts = rd32(b + 20);
+            }
+            if ((b = find_box(buf + 8, sz - 8, "trak/mdia/minf/stbl/stsd", &bl)) && bl >= 24) {
+                mjpeg = memcmp(b + 20, "avc1", 4) != 0;
+            }
+            if ((b = find_box(buf + 8, sz - 8, "mvex/mehd", &bl)) && bl >= 16) {
+                mehd_off = pos + (uint32_t)(b - buf) + 12;
+                clean    = rd32(b + 12) != 0;
+            }
+            if (clean || movie_ts == 0 || track_ts == 0) {
+                break;
+            }
+            have_moov = true;
+            pos += sz;
+            good_end = pos;
+            continue;
+        }
+
+        if (!memcmp(h + 4, "moof", 4) && have_moov) {
+            uint8_t mh[8];
+            uint32_t mdat = pos + sz;
+            if (sz > REPAIR_BUF_BYTES || !read_at(fp, pos, buf, sz) ||
+                mdat + 8 > file_size || !read_at(fp, mdat, mh, 8) ||
+                memcmp(mh + 4, "mdat", 4) != 0 ||
+                rd32(mh) < 8 || rd32(mh) > file_size - mdat) {
+                break;
+            }
+            uint32_t tl;
+            const uint8_t *t = find_box(buf + 8, sz - 8, "traf/trun", &tl);
+            /* Only the trun layout this writer produces */
+            if (!t || tl < 20 || (rd32(t + 8) & 0xFFFFFFu) !=
+                    (TRUN_DATA_OFFSET | TRUN_DURATION | TRUN_SIZE | TRUN_FLAGS)) {
+                break;
+            }
+            uint32_t n = rd32(t + 12), data_off = rd32(t + 16);
+            if (n == 0 || tl < 20 + 12 * n) {
+                break;
+            }
+            uint64_t dur = 0;
+            uint32_t bytes = 0;
+            for (uint32_t i = 0; i < n; i++) {
+                dur   += rd32(t + 20 + 12 * i);
+                bytes += rd32(t + 24 + 12 * i);
+            }
+            uint32_t last = rd32(t + 24 + 12 * (n - 1));
+            if (data_off != sz + 8 || bytes != rd32(mh) - 8 ||
+                !last_sample_ok(fp, mjpeg, pos + data_off + bytes - last, last)) {
+                break;
+            }
+            total += dur;
+            fragments++;
+            pos = mdat + rd32(mh);
+            good_end = pos;
+            continue;
+        }
+        break;
+    }
+    free(buf);
+
+    if (clean) {
+        fclose(fp);
+        return ESP_OK;
+    }
+    if (!have_moov || fragments == 0 || !mehd_off) {
+        fclose(fp);
+        ESP_LOGW(TAG, "repair: %s has no complete fragment", path);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint32_t ms = (uint32_t)(total * movie_ts / track_ts);
+    if (ms == 0) {
+        ms = 1;
+    }
+    uint8_t be[4] = { ms >> 24, ms >> 16, ms >> 8, (uint8_t)ms };
+    bool ok = fseek(fp, (long)mehd_off, SEEK_SET) == 0 && fwrite(be, 1, 4, fp) == 4;
+    if (good_end != file_size && ftruncate(fileno(fp), (off_t)good_end) != 0) {
+        ok = false;
+    }
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+    ESP_LOGW(TAG, "repair: %s — %"PRIu32" fragments, %"PRIu32" ms kept, %"PRIu32" KB%s",
+             path, fragments, ms, good_end >> 10, ok ? "" : " (write FAILED)");
+    if (repaired) {
+        *repaired = ok;
+    }
+    return ok ? ESP_OK : ESP_FAIL;
+}
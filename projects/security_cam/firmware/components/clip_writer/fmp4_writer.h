@@ -0,0 +1,110 @@
+/*
+ * fmp4_writer.h — Fragmented MP4 (ISO BMFF) writer
+ *
+ * Internal to clip_writer component.
+ * clip_writer.c uses fmp4_writer when CONFIG_CLIP_CONTAINER_FMP4 is set,
+ * for both MJPEG (S3) and H.264 (P4) cameras.
+ *
+ * File structure:
+ *   ftyp
+ *   moov  { mvhd, trak { tkhd, mdia { mdhd, hdlr, minf { vmhd, dinf, stbl } } },
+ *           mvex { mehd, trex } }              ← init segment, sample tables empty
+ *   free  moof { mfhd, traf { tfhd, tfdt, trun } }  mdat   ← fragment 1
+ *   free  moof ...                            mdat   ← fragment 2
+ *   ...
+ *
+ * Every fragment_frames samples the fragment is finalised and synced to the
+ * card: from then on the bytes before it never change, so each fragment
+ * can be uploaded or served as soon as on_fragment reports it. A reset
+ * loses at most the fragment being written. Space for the largest moof is
+ * reserved ahead of each fragment's samples; the unused part becomes the
+ * leading free box.
+ *
+ * Sample durations come from the frame timestamps (90 kHz track timescale),
+ * so frames dropped upstream do not speed up playback.
+ *
+ * MJPEG uses an 'mp4v' sample entry with objectTypeIndication 0x6C
+ * (ISO/IEC 10918-1 JPEG). H.264 input is Annex B; SPS/PPS from the stream
+ * go into the avcC box, so the init segment is written at the first access
+ * unit that carries them, and access units are stored length-prefixed.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct fmp4_writer_t fmp4_writer_t;
+
+typedef enum {
+    FMP4_CODEC_MJPEG,           /* One JPEG per sample */
+    FMP4_CODEC_H264,            /* One Annex B access unit per sample */
+} fmp4_codec_t;
+
+/* Called on the writing task after a fragment is on the card.
+ * committed_bytes: file length that is now final. */
+typedef void (*fmp4_fragment_cb_t)(uint32_t committed_bytes, void *ctx);
+
+typedef struct {
+    const char  *path;          /* Full path including .mp4 extension */
+    uint32_t     width;         /* Frame width */
+    uint32_t     height;        /* Frame height */
+    uint32_t     fps;           /* Nominal rate — durations when timestamps are missing */
+    fmp4_codec_t codec;
+    uint32_t     fragment_frames; /* Samples per moof/mdat (1–255) */
+    size_t       staging_size;  /* Write staging buffer in bytes. 0 = 128 KB */
+    bool         preallocated;  /* path sized by sdcard_preallocate() */
+    fmp4_fragment_cb_t on_fragment; /* Optional */
+    void        *cb_ctx;
+} fmp4_writer_config_t;
+
+/**
+ * @brief  Open an MP4 file for writing.
+ *         MJPEG: the init segment is staged immediately.
+ * @param  cfg  Writer configuration (path only used during the call).
+ * @return Handle on success, NULL on error.
+ */
+fmp4_writer_t *fmp4_writer_open(const fmp4_writer_config_t *cfg);
+
+/**
+ * @brief  Append one sample.
+ *         H.264 access units before the first SPS/PPS are dropped.
+ * @param  data          JPEG image or Annex B access unit.
+ * @param  len           Length in bytes.
+ * @param  timestamp_us  Capture time (esp_timer); 0 = use the nominal rate.
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE after a write failure,
+ *         ESP_ERR_NOT_FOUND for an H.264 unit dropped while waiting for SPS/PPS.
+ */
+esp_err_t fmp4_writer_write_frame(fmp4_writer_t *w, const void *data, size_t len,
+                                  uint64_t timestamp_us);
+
+/**
+ * @brief  Finalise the last fragment, record the total duration (mehd),
+ *         close the file and free w.
+ * @return ESP_OK on success, ESP_FAIL if any write failed.
+ */
+esp_err_t fmp4_writer_close(fmp4_writer_t *w);
+
+/**
+ * @brief  Cut an MP4 left open by a reset back to its last complete fragment.
+ *         Files closed cleanly (non-zero mehd) only have their moov read.
+ *         Otherwise each moof is checked against its mdat and the last
+ *         sample, the file is truncated after the last good fragment and
+ *         the duration written.
+ * @param  path      Full path of the .mp4 file.
+ * @param  repaired  Optional: set true if the file was rewritten.
+ * @return ESP_OK if the file is (now) complete,
+ *         ESP_ERR_NOT_FOUND if it holds no complete fragment (caller should delete),
+ *         ESP_FAIL on an I/O error.
+ */
+esp_err_t fmp4_writer_repair(const char *path, bool *repaired);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,250 @@
+/*
+ * frame_queue.c — Bounded frame queue drained by a dedicated writer task
+ *
+ * Two FreeRTOS queues:
+ *   free_q  — indices of empty slots (capture side takes, writer returns)
+ *   work_q  — work items in submission order (frames, jobs, fences)
+ * work_q holds slot_count + WORK_EXTRA items, so a submit that got a slot
+ * can always enqueue without blocking.
+ *
+ * Drain posts one fence and waits on q->fence. A drain that times out
+ * leaves its fence queued; the next one waits for that same fence instead
+ * of posting another, and posts a new one only if work was queued after it.
+ */
+
+#include "frame_queue.h"
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "frame_queue";
+
+#define WORK_EXTRA   4      /* room for jobs and fences on top of frames */
+#define WRITER_STACK 4096
+
+typedef enum { ITEM_FRAME, ITEM_JOB, ITEM_FENCE } item_type_t;
+
+typedef struct {
+    item_type_t type;
+    uint32_t    slot;                 /* ITEM_FRAME */
+    frame_queue_job_t job;            /* ITEM_JOB */
+    void       *ctx;                  /* ITEM_JOB: job arg; ITEM_FENCE: semaphore */
+} work_item_t;
+
+typedef struct {
+    cam_frame_t frame;                /* data → arena, or the HAL buffer */
+    bool        retained;             /* holds a HAL reference */
+} slot_meta_t;
+
+struct frame_queue_t {
+    frame_queue_config_t cfg;
+    uint8_t             *arena;       /* slot_count × slot_size, PSRAM */
+    QueueHandle_t        free_q;
+    QueueHandle_t        work_q;
+    frame_queue_stats_t  stats;
+    SemaphoreHandle_t    fence;       /* given by the writer at a fence */
+    bool                 fence_pending;  /* posted, not yet taken */
+    uint32_t             fence_at;    /* queued when it was posted */
+    uint32_t             queued;      /* frames and jobs queued, owner task */
+    slot_meta_t          meta[];      /* flexible array — slot_count entries */
+};
+
+static void writer_task(void *arg)
+{
+    frame_queue_t *q = arg;
+    work_item_t it;
+
+    while (1) {
+        if (xQueueReceive(q->work_q, &it, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        switch (it.type) {
+        case ITEM_FRAME: {
+            slot_meta_t *m = &q->meta[it.slot];
+            int64_t t0 = esp_timer_get_time();
+            esp_err_t err = q->cfg.sink(&m->frame, q->cfg.sink_ctx);
+            if (m->retained) {
+                camera_hal_release_frame(&m->frame);
+                m->retained = false;
+            }
+            uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+            if (us > q->stats.write_us_max) {
+                q->stats.write_us_max = us;
+            }
+            if (err == ESP_OK) {
+                q->stats.written++;
+            } else {
+                q->stats.write_errors++;
+            }
+            xQueueSend(q->free_q, &it.slot, portMAX_DELAY);
+            break;
+        }
+        case ITEM_JOB:
+            it.job(it.ctx);
+            break;
+        case ITEM_FENCE:
+            xSemaphoreGive((SemaphoreHandle_t)it.ctx);
+            break;
+        }
+    }
+}
+
+frame_queue_t *frame_queue_create(const frame_queue_config_t *cfg)
+{
+    if (!cfg || !cfg->sink || cfg->slot_count == 0 || cfg->slot_size == 0) {
+        return NULL;
+    }
+
+    frame_queue_t *q = calloc(1, sizeof(*q) + cfg->slot_count * sizeof(slot_meta_t));
+    if (!q) {
+        ESP_LOGE(TAG, "Out of heap for frame queue struct");
+        return NULL;
+    }
+    q->cfg            = *cfg;
+    q->cfg.slot_size  = (cfg->slot_size + 3) & ~(size_t)3;   /* keep slots 4-byte aligned */
+
+    q->arena  = heap_caps_malloc(q->cfg.slot_size * cfg->slot_count,
+                                 MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    q->free_q = xQueueCreate(cfg->slot_count, sizeof(uint32_t));
+    q->work_q = xQueueCreate(cfg->slot_count + WORK_EXTRA, sizeof(work_item_t));
+    q->fence  = xSemaphoreCreateBinary();
+    if (!q->arena || !q->free_q || !q->work_q || !q->fence) {
+        ESP_LOGE(TAG, "Cannot allocate frame queue (%u slots × %u B)",
+                 (unsigned)cfg->slot_count, (unsigned)q->cfg.slot_size);
+        goto fail;
+    }
+    for (uint32_t i = 0; i < cfg->slot_count; i++) {
+        xQueueSend(q->free_q, &i, 0);
+    }
+
+    if (xTaskCreatePinnedToCore(writer_task, "clip_wr", WRITER_STACK, q,
+                                cfg->priority, NULL, cfg->core) != pdPASS) {
+        ESP_LOGE(TAG, "Cannot start writer task");
+        goto fail;
+    }
+
+    ESP_LOGI(TAG, "Writer task on core %d: %"PRIu32" slots × %u B (%u KB PSRAM)",
+             cfg->core, cfg->slot_count, (unsigned)q->cfg.slot_size,
+             (unsigned)((q->cfg.slot_size * cfg->slot_count) >> 10));
+    return q;
+
+fail:
+    if (q->free_q) vQueueDelete(q->free_q);
+    if (q->work_q) vQueueDelete(q->work_q);
+    if (q->fence)  vSemaphoreDelete(q->fence);
+    heap_caps_free(q->arena);
+    free(q);
+    return NULL;
+}
+
+esp_err_t frame_queue_submit(frame_queue_t *q, const cam_frame_t *frame)
+{
+    if (!q || !frame || !frame->data) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    q->stats.submitted++;
+
+    uint32_t slot;
+    if (xQueueReceive(q->free_q, &slot, 0) != pdTRUE) {
+        q->stats.dropped++;
+        if ((q->stats.dropped & 0x1F) == 1) {
+            ESP_LOGW(TAG, "Writer behind — all %"PRIu32" slots busy, frame dropped (%"PRIu32" total)",
+                     q->cfg.slot_count, q->stats.dropped);
+        }
+        return ESP_ERR_NO_MEM;
+    }
+
+    slot_meta_t *m = &q->meta[slot];
+    m->frame = *frame;
+    m->retained = camera_hal_retain_frame(frame) == ESP_OK;
+    if (m->retained) {
+        q->stats.zero_copy++;
+    } else if (frame->len > q->cfg.slot_size) {
+        xQueueSend(q->free_q, &slot, 0);
+        q->stats.dropped++;
+        ESP_LOGW(TAG, "Frame %u B exceeds slot %u B — dropped",
+                 (unsigned)frame->len, (unsigned)q->cfg.slot_size);
+        return ESP_ERR_INVALID_SIZE;
+    } else {
+        m->frame.data    = q->arena + (size_t)slot * q->cfg.slot_size;
+        m->frame.hal_ref = NULL;
+        memcpy(m->frame.data, frame->data, frame->len);
+    }
+
+    uint32_t depth = q->cfg.slot_count - (uint32_t)uxQueueMessagesWaiting(q->free_q);
+    if (depth > q->stats.depth_high_water) {
+        q->stats.depth_high_water = depth;
+    }
+
+    work_item_t it = { .type = ITEM_FRAME, .slot = slot };
+    xQueueSend(q->work_q, &it, portMAX_DELAY);   /* never full — see WORK_EXTRA */
+    q->queued++;
+    return ESP_OK;
+}
+
+esp_err_t frame_queue_run(frame_queue_t *q, frame_queue_job_t job, void *ctx)
+{
+    if (!q || !job) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    work_item_t it = { .type = ITEM_JOB, .job = job, .ctx = ctx };
+    if (xQueueSend(q->work_q, &it, portMAX_DELAY) != pdTRUE) {
+        return ESP_FAIL;
+    }
+    q->queued++;
+    return ESP_OK;
+}
+
+esp_err_t frame_queue_drain(frame_queue_t *q, uint32_t timeout_ms)
+{
+    if (!q) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while (1) {
+        int64_t left_us = deadline - esp_timer_get_time();
+        if (!q->fence_pending) {
+            work_item_t it = { .type = ITEM_FENCE, .ctx = q->fence };
+            if (left_us <= 0 ||
+                xQueueSend(q->work_q, &it, pdMS_TO_TICKS(left_us / 1000)) != pdTRUE) {
+                break;
+            }
+            q->fence_pending = true;
+            q->fence_at      = q->queued;
+            left_us = deadline - esp_timer_get_time();
+        }
+        if (left_us <= 0 || xSemaphoreTake(q->fence, pdMS_TO_TICKS(left_us / 1000)) != pdTRUE) {
+            break;
+        }
+        q->fence_pending = false;
+        if (q->fence_at == q->queued) {
+            return ESP_OK;
+        }
+        /* The fence was an earlier drain's — work came in behind it */
+    }
+    ESP_LOGE(TAG, "Drain timed out after %"PRIu32" ms", timeout_ms);
+    return ESP_ERR_TIMEOUT;
+}
+
+void frame_queue_get_stats(const frame_queue_t *q, frame_queue_stats_t *out)
+{
+    if (!q || !out) {
+        return;
+    }
+    *out = q->stats;
+    out->depth = q->cfg.slot_count - (uint32_t)uxQueueMessagesWaiting(q->free_q);
+}
+
+void frame_queue_reset_stats(frame_queue_t *q)
+{
+    if (!q) {
+        return;
+    }
+    memset(&q->stats, 0, sizeof(q->stats));
+}
@@ -0,0 +1,106 @@
+/*
+ * frame_queue.h — Bounded frame queue drained by a dedicated writer task
+ *
+ * Internal to clip_writer component.
+ * Decouples capture from SD writes: clip_writer_write_frame() queues the
+ * frame in a free slot and returns; a writer task (pinned to its own
+ * core) hands slots to the sink in submission order. When the SD card
+ * stalls, the slots absorb it; when they run out, frames are dropped and
+ * counted instead of blocking the camera.
+ *
+ * A frame is queued by reference when camera_hal_retain_frame() agrees —
+ * the writer releases it after the sink — and copied into the slot's
+ * arena space when the HAL cannot spare the buffer (capture ring nearly
+ * all held, or hardware without retain). Both kinds share the slot count
+ * and stay in submission order.
+ *
+ * Memory layout:
+ *   One PSRAM arena of slot_count × slot_size bytes, allocated once at create.
+ *   Free slot indices circulate through a FreeRTOS queue; work items
+ *   (frames, jobs, fences) through a second one.
+ *
+ * Jobs let the owner run other file work (pre-roll flush) on the writer task
+ * in order with the frames around it.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "camera_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct frame_queue_t frame_queue_t;
+
+/* Called on the writer task for each frame, in order */
+typedef esp_err_t (*frame_queue_sink_t)(const cam_frame_t *frame, void *ctx);
+
+/* Called on the writer task between frames */
+typedef void (*frame_queue_job_t)(void *ctx);
+
+typedef struct {
+    uint32_t           slot_count;   /* Frames that can be in flight */
+    size_t             slot_size;    /* Largest frame accepted, bytes */
+    int                core;         /* Writer task core (0/1) */
+    uint32_t           priority;     /* Writer task priority */
+    frame_queue_sink_t sink;
+    void              *sink_ctx;
+} frame_queue_config_t;
+
+typedef struct {
+    uint32_t submitted;         /* Frames offered */
+    uint32_t written;           /* Frames the sink accepted */
+    uint32_t zero_copy;         /* Frames queued by reference, not copied */
+    uint32_t dropped;           /* No free slot, or frame larger than a slot */
+    uint32_t write_errors;      /* Sink returned an error */
+    uint32_t depth;             /* Slots in use right now */
+    uint32_t depth_high_water;  /* Max slots in use since reset */
+    uint32_t write_us_max;      /* Slowest single sink call since reset */
+} frame_queue_stats_t;
+
+/**
+ * @brief  Allocate the slot arena and start the writer task.
+ * @return Handle on success, NULL on error.
+ */
+frame_queue_t *frame_queue_create(const frame_queue_config_t *cfg);
+
+/**
+ * @brief  Queue a frame in a free slot, by reference or by copy. Never blocks.
+ *         The caller still releases its own reference afterwards.
+ * @return ESP_OK if queued, ESP_ERR_NO_MEM if all slots are busy,
+ *         ESP_ERR_INVALID_SIZE if the frame had to be copied and exceeds
+ *         slot_size. Both errors count as dropped.
+ */
+esp_err_t frame_queue_submit(frame_queue_t *q, const cam_frame_t *frame);
+
+/**
+ * @brief  Queue a job to run on the writer task after all earlier work.
+ */
+esp_err_t frame_queue_run(frame_queue_t *q, frame_queue_job_t job, void *ctx);
+
+/**
+ * @brief  Block until everything submitted so far has been processed.
+ *         Call it again after a timeout to keep waiting: the fence already
+ *         queued is reused, so retries cost no queue space. Same task as
+ *         submit and run.
+ * @return ESP_OK, or ESP_ERR_TIMEOUT.
+ */
+esp_err_t frame_queue_drain(frame_queue_t *q, uint32_t timeout_ms);
+
+/**
+ * @brief  Snapshot the counters. depth is live; the rest since the last reset.
+ */
+void frame_queue_get_stats(const frame_queue_t *q, frame_queue_stats_t *out);
+
+/**
+ * @brief  Zero the counters (not depth).
+ */
+void frame_queue_reset_stats(frame_queue_t *q);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,60 +1,295 @@
 /*
- * h264_writer.c — H.264 elementary stream writer (Phase 2 stub)
- *
- * Writes raw H.264 NALUs to a .h264 file.
- * This stub compiles cleanly but does no real work.
- * Real implementation added in Phase 2 Step 12.
+ * h264_writer.c — H.264 Annex B elementary stream writer
+ * (see h264_writer.h for the file layout)
  */
 
 #include "h264_writer.h"
+#include "clip_stage.h"
 #include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
 #include "esp_log.h"
 
 static const char *TAG = "h264_writer";
 
+#define STAGING_DEFAULT     (128 * 1024)
+#define PARAM_SET_MAX       128         /* SPS / PPS bytes cached */
+#define INDEX_VERSION       1
+
+#define NAL_IDR             5
+#define NAL_SEI             6
+#define NAL_SPS             7
+#define NAL_PPS             8
+
+#define SEI_USER_DATA_UNREGISTERED 5
+
+/* Identifies our index among other user_data_unregistered SEIs */
+static const uint8_t INDEX_UUID[16] = {
+    0x8a, 0x3c, 0x51, 0xe2, 0x47, 0x0d, 0x4b, 0x9f,
+    0xa1, 0x6e, 0x2c, 0x55, 0xd0, 0x73, 0x19, 0x4b,
+};
+
+static const uint8_t START_CODE[4] = { 0, 0, 0, 1 };
+
+typedef struct {
+    uint32_t frame;
+    uint32_t offset;
+} keyframe_t;
+
 struct h264_writer_t {
-    FILE    *fp;
-    uint32_t nalu_count;
+    clip_stage_t st;
+    uint8_t      sps[PARAM_SET_MAX];
+    uint8_t      pps[PARAM_SET_MAX];
+    uint16_t     sps_len;
+    uint16_t     pps_len;
+    bool         started;           /* first IDR written */
+    uint32_t     fps;
+    uint32_t     frames;
+    uint32_t     dropped;
+    uint32_t     key_count;         /* keyframes written, indexed or not */
+    keyframe_t   keys[H264_WRITER_KEYFRAMES_MAX];
 };
 
-h264_writer_t *h264_writer_open(const char *path)
+/* Find the next NAL unit in [*p, end). Returns false when none is left. */
+static bool next_nal(const uint8_t **p, const uint8_t *end, const uint8_t **nal, size_t *nal_len)
+{
+    const uint8_t *s = *p;
+    /* Skip to just past a 00 00 01 start code */
+    while (s + 3 <= end && !(s[0] == 0 && s[1] == 0 && s[2] == 1)) {
+        s++;
+    }
+    if (s + 3 > end) {
+        return false;
+    }
+    s += 3;
+
+    const uint8_t *e = s;
+    while (e + 3 <= end && !(e[0] == 0 && e[1] == 0 && (e[2] == 1 || e[2] == 0))) {
+        e++;
+    }
+    if (e + 3 > end) {
+        e = end;
+    }
+    const uint8_t *next = e;
+    while (e > s && e[-1] == 0) {
+        e--;                        /* trailing_zero_8bits / 4-byte start code */
+    }
+    *nal     = s;
+    *nal_len = (size_t)(e - s);
+    *p       = next;
+    return true;
+}
+
+static bool has_start_code(const uint8_t *d, size_t len)
+{
+    return (len >= 3 && d[0] == 0 && d[1] == 0 && d[2] == 1) ||
+           (len >= 4 && d[0] == 0 && d[1] == 0 && d[2] == 0 && d[3] == 1);
+}
+
+typedef struct {
+    bool idr, sps, pps;
+} au_info_t;
+
+/* Note which NAL types one NAL brings and cache parameter sets */
+static void inspect(h264_writer_t *w, const uint8_t *nal, size_t nal_len, au_info_t *au)
+{
+    if (nal_len == 0) {
+        return;
+    }
+    switch (nal[0] & 0x1F) {
+    case NAL_IDR:
+        au->idr = true;
+        break;
+    case NAL_SPS:
+        au->sps = true;
+        if (nal_len <= PARAM_SET_MAX) {
+            memcpy(w->sps, nal, nal_len);
+            w->sps_len = (uint16_t)nal_len;
+        }
+        break;
+    case NAL_PPS:
+        au->pps = true;
+        if (nal_len <= PARAM_SET_MAX) {
+            memcpy(w->pps, nal, nal_len);
+            w->pps_len = (uint16_t)nal_len;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static esp_err_t put_nal(h264_writer_t *w, const uint8_t *nal, size_t len)
+{
+    esp_err_t err = clip_stage_put(&w->st, START_CODE, sizeof(START_CODE));
+    return err == ESP_OK ? clip_stage_put(&w->st, nal, len) : err;
+}
+
+h264_writer_t *h264_writer_open(const h264_writer_config_t *cfg)
 {
+    if (!cfg || !cfg->path) {
+        return NULL;
+    }
     h264_writer_t *w = calloc(1, sizeof(*w));
     if (!w) {
         ESP_LOGE(TAG, "Out of heap");
         return NULL;
     }
-    w->fp = fopen(path, "wb");
-    if (!w->fp) {
-        ESP_LOGE(TAG, "Cannot open %s", path);
+    w->fps = cfg->fps;
+    size_t stage_size = cfg->staging_size ? cfg->staging_size : STAGING_DEFAULT;
+    if (clip_stage_open(&w->st, cfg->path, stage_size, cfg->preallocated) != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot open %s", cfg->path);
         free(w);
         return NULL;
     }
-    ESP_LOGI(TAG, "h264_writer_open: %s — STUB (Phase 2)", path);
+    ESP_LOGI(TAG, "h264_writer_open: %s", cfg->path);
     return w;
 }
 
 esp_err_t h264_writer_write_nalu(h264_writer_t *w, const void *nalu, size_t len)
 {
-    if (!w || !w->fp) {
+    if (!w) {
         return ESP_ERR_INVALID_STATE;
     }
-    /* TODO Phase 2: fwrite(nalu, 1, len, w->fp) with start code prefix if needed */
-    (void)nalu;
-    (void)len;
-    w->nalu_count++;
+    if (!nalu || len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const uint8_t *data = nalu;
+    bool annex_b = has_start_code(data, len);
+
+    au_info_t au = { 0 };
+    if (annex_b) {
+        const uint8_t *p = data, *end = data + len, *nal;
+        size_t nal_len;
+        while (next_nal(&p, end, &nal, &nal_len)) {
+            inspect(w, nal, nal_len, &au);
+        }
+    } else {
+        inspect(w, data, len, &au);
+    }
+
+    if (!au.idr && !w->started) {
+        w->dropped++;
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (au.idr) {
+        if ((!au.sps && !w->sps_len) || (!au.pps && !w->pps_len)) {
+            w->dropped++;           /* a keyframe nobody can decode */
+            return ESP_ERR_NOT_FOUND;
+        }
+        /* Everything up to this entry point is made durable */
+        if (w->started && clip_stage_commit(&w->st, true) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        if (w->key_count < H264_WRITER_KEYFRAMES_MAX) {
+            w->keys[w->key_count].frame  = w->frames;
+            w->keys[w->key_count].offset = w->st.pos;
+        }
+        w->key_count++;
+        if ((!au.sps && put_nal(w, w->sps, w->sps_len) != ESP_OK) ||
+            (!au.pps && put_nal(w, w->pps, w->pps_len) != ESP_OK)) {
+            return ESP_FAIL;
+        }
+        w->started = true;
+    }
+
+    esp_err_t err = annex_b ? clip_stage_put(&w->st, data, len) : put_nal(w, data, len);
+    if (err != ESP_OK) {
+        return ESP_FAIL;
+    }
+    w->frames++;
     return ESP_OK;
 }
 
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/* Keyframe index as an SEI NAL, emulation prevention applied.
+ * Returns the NAL length in out (caller frees), 0 on allocation failure. */
+static size_t build_index_sei(const h264_writer_t *w, uint8_t **out)
+{
+    uint32_t keys = w->key_count < H264_WRITER_KEYFRAMES_MAX ? w->key_count
+                                                             : H264_WRITER_KEYFRAMES_MAX;
+    size_t payload = sizeof(INDEX_UUID) + 16 + keys * 8;
+
+    /* header, type, ff-coded size, payload, rbsp trailing bits */
+    size_t raw_len = 1 + 1 + payload / 255 + 1 + payload + 1;
+    uint8_t *raw = malloc(raw_len);
+    /* Worst case one 0x03 per two bytes */
+    uint8_t *nal = malloc(raw_len + raw_len / 2 + 1);
+    if (!raw || !nal) {
+        free(raw);
+        free(nal);
+        return 0;
+    }
+
+    size_t n = 0;
+    raw[n++] = NAL_SEI;                         /* nal_ref_idc 0 */
+    raw[n++] = SEI_USER_DATA_UNREGISTERED;
+    size_t left = payload;
+    while (left >= 255) {
+        raw[n++] = 0xFF;
+        left -= 255;
+    }
+    raw[n++] = (uint8_t)left;
+    memcpy(raw + n, INDEX_UUID, sizeof(INDEX_UUID));
+    n += sizeof(INDEX_UUID);
+    put_be32(raw + n, INDEX_VERSION);  n += 4;
+    put_be32(raw + n, w->fps);         n += 4;
+    put_be32(raw + n, w->frames);      n += 4;
+    put_be32(raw + n, keys);           n += 4;
+    for (uint32_t i = 0; i < keys; i++) {
+        put_be32(raw + n, w->keys[i].frame);   n += 4;
+        put_be32(raw + n, w->keys[i].offset);  n += 4;
+    }
+    raw[n++] = 0x80;
+
+    /* 00 00 0x (x ≤ 3) inside a NAL would read as a start code */
+    size_t m = 0;
+    int zeros = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (zeros == 2 && raw[i] <= 3) {
+            nal[m++] = 0x03;
+            zeros = 0;
+        }
+        nal[m++] = raw[i];
+        zeros = raw[i] == 0 ? zeros + 1 : 0;
+    }
+    free(raw);
+    *out = nal;
+    return m;
+}
+
 esp_err_t h264_writer_close(h264_writer_t *w)
 {
     if (!w) {
         return ESP_ERR_INVALID_ARG;
     }
-    ESP_LOGI(TAG, "h264_writer_close: %"PRIu32" NALUs written (stub)", w->nalu_count);
-    if (w->fp) {
-        fclose(w->fp);
+    esp_err_t err = ESP_OK;
+    if (w->started) {
+        uint8_t *sei = NULL;
+        size_t sei_len = build_index_sei(w, &sei);
+        if (sei_len == 0) {
+            ESP_LOGW(TAG, "No heap for the keyframe index — clip written without it");
+        } else if (put_nal(w, sei, sei_len) != ESP_OK) {
+            err = ESP_FAIL;
+        }
+        free(sei);
     }
+    if (clip_stage_close(&w->st) != ESP_OK) {
+        err = ESP_FAIL;
+    }
+    if (w->key_count > H264_WRITER_KEYFRAMES_MAX) {
+        ESP_LOGW(TAG, "%"PRIu32" keyframes, first %d indexed", w->key_count,
+                 H264_WRITER_KEYFRAMES_MAX);
+    }
+    ESP_LOGI(TAG, "h264_writer_close: %"PRIu32" frames, %"PRIu32" keyframes, "
+             "%"PRIu32" dropped waiting for a decodable IDR", w->frames, w->key_count, w->dropped);
     free(w);
-    return ESP_OK;
+    return err;
 }
@@ -1,41 +1,75 @@
 /*
- * h264_writer.h — H.264 elementary stream writer (Phase 2 stub)
+ * h264_writer.h — H.264 Annex B elementary stream writer
  *
- * Used when cam_caps_t.delivers_h264 == true (ESP32-P4 path).
- * Writes raw H.264 NALUs to a .h264 file.
- * MP4 muxing can be added later if needed.
+ * Used when cam_caps_t.delivers_h264 == true (ESP32-P4 path) and the clip
+ * container is AVI/raw: one encoded access unit per write, stored as a
+ * plain Annex B .h264 stream that ffmpeg/VLC play directly.
+ *
+ * File layout:
+ *   [SPS][PPS][IDR] [P] … [P]  [SPS][PPS][IDR] [P] …  [SEI keyframe index]
+ *
+ *   - Nothing is written before the first IDR (a P-frame without its
+ *     reference is undecodable).
+ *   - SPS/PPS are cached from the stream and re-sent in front of any IDR
+ *     that arrives without them, so every keyframe is a clean entry point.
+ *   - At close, a user_data_unregistered SEI NAL carries a table of
+ *     {frame number, byte offset} for every keyframe. Decoders skip it;
+ *     a player or the cloud side can seek without scanning the stream.
+ *
+ * SEI payload (after the 16-byte UUID, all big-endian):
+ *   u32 version (1), u32 fps, u32 frame_count, u32 key_count,
+ *   key_count × { u32 frame, u32 offset }
+ *
+ * Writes go through clip_stage, so they are cluster-aligned like the AVI
+ * and MP4 paths, and each keyframe commits (fsyncs) everything before it —
+ * after a reset the file is valid Annex B up to the last keyframe, just
+ * without the index.
  */
 
 #pragma once
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Keyframes kept in the index; later ones are written but not indexed */
+#define H264_WRITER_KEYFRAMES_MAX  256
+
 typedef struct h264_writer_t h264_writer_t;
 
+typedef struct {
+    const char *path;           /* Full path including .h264 extension */
+    uint32_t    fps;            /* Nominal frame rate, stored in the index */
+    size_t      staging_size;   /* Write staging buffer bytes (0 = default) */
+    bool        preallocated;   /* path was sized by sdcard_preallocate() */
+} h264_writer_config_t;
+
 /**
  * @brief  Open an H.264 file for writing.
- * @param  path  Full path including .h264 extension.
  * @return Handle on success, NULL on error.
  */
-h264_writer_t *h264_writer_open(const char *path);
+h264_writer_t *h264_writer_open(const h264_writer_config_t *cfg);
 
 /**
- * @brief  Append one H.264 NALU to the file.
+ * @brief  Append one encoded frame (an access unit of one or more
+ *         start-code-prefixed NALUs). A buffer without a start code is
+ *         taken as a single NALU and gets one prepended.
  * @param  w     Writer handle.
- * @param  nalu  NALU data (including start code if present).
- * @param  len   NALU length in bytes.
- * @return ESP_OK on success.
+ * @param  nalu  Access unit data.
+ * @param  len   Length in bytes.
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the frame was dropped
+ *         (waiting for the first IDR, or an IDR with no SPS/PPS seen yet),
+ *         ESP_FAIL on a write error.
  */
 esp_err_t h264_writer_write_nalu(h264_writer_t *w, const void *nalu, size_t len);
 
 /**
- * @brief  Finalise and close the H.264 file. Frees w.
+ * @brief  Append the keyframe index SEI, close the file and free w.
  */
 esp_err_t h264_writer_close(h264_writer_t *w);
 
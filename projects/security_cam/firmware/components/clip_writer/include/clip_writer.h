@@ -2,17 +2,25 @@
  * clip_writer.h — Video clip recording to SD card
  *
  * clip_writer uses cam_caps_t (from camera_hal) at runtime to select
- * the AVI or H.264 path. No target ifdefs needed in the caller.
+ * the AVI or H.264 path. No target ifdefs needed in the caller. With
+ * CONFIG_CLIP_CONTAINER_FMP4 both codecs are written as fragmented MP4
+ * instead; clip_writer_get_extension() tells the caller which it is.
  *
  * Typical call sequence:
  *   clip_writer_configure(caps)        ← once at startup
- *   clip_writer_begin("clip_name")     ← on motion trigger
+ *   clip_writer_preroll_push(&frame)   ← for each motion-watch frame
+ *   clip_writer_begin("clip_name")     ← on motion trigger (flushes pre-roll)
  *   clip_writer_write_frame(&frame)    ← for each frame
  *   clip_writer_end()                  ← close and finalise file
+ *
+ * File writes run on a dedicated writer task (CONFIG_CLIP_WRITER_CORE) fed
+ * by a bounded frame queue, so SD stalls do not stall capture. Set
+ * CONFIG_CLIP_WRITER_QUEUE_FRAMES to 0 for synchronous writes.
  */
 
 #pragma once
 
+#include <stdbool.h>
 #include "esp_err.h"
 #include "camera_hal.h"
 
@@ -20,6 +28,25 @@
 extern "C" {
 #endif
 
+/* Writer pipeline counters. Reset at clip_writer_begin(); all but
+ * sink_kbps zero in synchronous mode. */
+typedef struct {
+    uint32_t frames_written;    /* Frames written to the file */
+    uint32_t frames_zero_copy;  /* Of those queued, held by reference (not copied) */
+    uint32_t frames_dropped;    /* Queue full or frame larger than a slot */
+    uint32_t write_errors;      /* Backend write failures */
+    uint32_t queue_depth;       /* Frames waiting right now */
+    uint32_t queue_high_water;  /* Peak frames waiting this clip */
+    uint32_t queue_capacity;    /* CONFIG_CLIP_WRITER_QUEUE_FRAMES */
+    uint32_t write_us_max;      /* Slowest single frame write this clip */
+    uint32_t sink_kbps;         /* Backend write rate, recent clips (0 = unknown) */
+} clip_writer_stats_t;
+
+/* Called on the writer task each time an MP4 fragment reaches the card.
+ * Bytes [0, committed_bytes) of path are final from then on. */
+typedef void (*clip_writer_fragment_cb_t)(const char *path, uint32_t committed_bytes,
+                                          void *ctx);
+
 /**
  * @brief  Configure the clip writer based on camera capabilities.
  *         Selects AVI path if caps->delivers_jpeg, H.264 path if caps->delivers_h264.
@@ -29,27 +56,122 @@ esp_err_t clip_writer_configure(const cam_caps_t *caps);
 
 /**
  * @brief  Begin a new clip.
+ *         Any frames held in the pre-roll ring are written first, so the clip
+ *         starts up to CONFIG_PREROLL_MS before the trigger. The ring is
+ *         emptied afterwards.
  * @param  clip_name  Base name (no extension, no path).
- *                    File written to /sdcard/<clip_name>.avi (or .h264).
+ *                    File written to /sdcard/<clip_name><clip_writer_get_extension()>.
  * @return ESP_OK on success.
  */
 esp_err_t clip_writer_begin(const char *clip_name);
 
 /**
  * @brief  Write one frame to the current clip.
+ *         With the async writer the frame is queued by reference (a
+ *         camera_hal_retain_frame()) and this returns immediately; it is
+ *         copied into a queue slot only when the HAL refuses the retain.
+ *         The caller may release its own reference as soon as this returns
+ *         either way.
  * @param  frame  Frame from camera_hal_get_frame(). Must not be NULL.
- *                Caller retains ownership — do not release before this returns.
- * @return ESP_OK on success.
+ * @return ESP_OK if written (sync) or queued (async),
+ *         ESP_ERR_NO_MEM if the queue is full — the frame is dropped and counted.
  */
 esp_err_t clip_writer_write_frame(const cam_frame_t *frame);
 
+/**
+ * @brief  Offer a motion-watch frame to the pre-roll ring.
+ *         The payload is copied into a fixed PSRAM slot (no allocation), so
+ *         the caller may release the frame immediately afterwards.
+ *         Keeps JPEG frames at the recording size only — the DUAL watch
+ *         stream. No-op if pre-roll is disabled, and the ring is not even
+ *         allocated when the watch stream cannot feed it
+ *         (CONFIG_CAMERA_DUAL_STREAM off, or a camera that records H.264).
+ */
+void clip_writer_preroll_push(const cam_frame_t *frame);
+
+/**
+ * @brief  Discard all frames held in the pre-roll ring.
+ */
+void clip_writer_preroll_reset(void);
+
+/**
+ * @brief  Snapshot writer pipeline counters for the current/last clip.
+ */
+void clip_writer_get_stats(clip_writer_stats_t *out);
+
+/**
+ * @brief  File extension of the clips this writer produces:
+ *         ".avi", ".mp4" or ".h264". Valid after clip_writer_configure().
+ */
+const char *clip_writer_get_extension(void);
+
+/**
+ * @brief  Frame rate for clips begun from now on (0 = CONFIG_RECORD_FPS).
+ *         Sets the container timing, clip frame limit, AVI checkpoint and
+ *         MP4 fragment spacing. The pre-roll ring keeps CONFIG_RECORD_FPS;
+ *         a lower-rate AVI gets every frame due at the clip's rate.
+ */
+void clip_writer_set_fps(uint32_t fps);
+
+/**
+ * @brief  Register a callback for finalised MP4 fragments (NULL to remove).
+ *         Lets a clip be uploaded or served while it is still recording.
+ *         Never called for AVI or raw H.264 clips.
+ */
+void clip_writer_set_fragment_cb(clip_writer_fragment_cb_t cb, void *ctx);
+
 /**
  * @brief  Finalise and close the current clip.
- *         Patches the AVI header (frame count, duration, idx1 table).
+ *         Waits for the writer queue to drain, then patches the AVI header
+ *         (frame count, duration, idx1 table) or the last MP4 fragment.
  *         Must be called even if zero frames were written.
+ *         AVI clips are also checkpointed every CONFIG_AVI_CHECKPOINT_S while
+ *         recording, and MP4 clips are synced every fragment, so a reset
+ *         before this call loses only the last few seconds (see
+ *         clip_writer_repair()).
  */
 esp_err_t clip_writer_end(void);
 
+/**
+ * @brief  Make a clip left open by a reset or brownout playable.
+ *         Cheap for clips that were closed normally (header read only).
+ *         Safe to call at any time: the clip currently being recorded is
+ *         refused. Works without clip_writer_configure().
+ * @param  path      Full path of the clip. Only .avi and .mp4 are checked.
+ * @param  repaired  Optional: set true if the file had to be rebuilt.
+ * @return ESP_OK if the clip is complete, ESP_ERR_NOT_FOUND if it holds no
+ *         recoverable frames (delete it), ESP_ERR_INVALID_STATE for the
+ *         open clip, ESP_FAIL on an I/O error.
+ */
+esp_err_t clip_writer_repair(const char *path, bool *repaired);
+
+/**
+ * @brief  Delete a clip and the files stored next to it
+ *         (<base>_thumb.jpg, <base>_trace.json, the <base>.upj upload journal).
+ * @param  path  Full path of the clip.
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND if the clip itself was not there.
+ */
+esp_err_t clip_writer_remove(const char *path);
+
+/**
+ * @brief  Called by clip_writer_repair_all() for every clip it checked.
+ * @param  clip_file  File name without the directory.
+ * @param  err        clip_writer_repair() result; ESP_ERR_NOT_FOUND after
+ *                    the clip was deleted.
+ * @param  repaired   The clip had been left open and was rebuilt.
+ */
+typedef void (*clip_writer_repair_cb_t)(const char *clip_file, esp_err_t err,
+                                        bool repaired, void *ctx);
+
+/**
+ * @brief  Repair every *.avi and *.mp4 in dir and delete the unrecoverable
+ *         ones with their sidecars (clip_writer_remove()). *.h264 streams have nothing to repair but are reported too.
+ * @param  cb   Optional per-clip callback (the clip's upload only starts at
+ *              close, so a rebuilt clip is not in the upload manifest yet).
+ * @return Number of clips rebuilt.
+ */
+int clip_writer_repair_all(const char *dir, clip_writer_repair_cb_t cb, void *ctx);
+
 #ifdef __cplusplus
 }
 #endif
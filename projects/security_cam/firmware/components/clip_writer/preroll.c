@@ -0,0 +1,156 @@
+/*
+ * preroll.c — Fixed-budget ring of recent frames (pre-roll)
+ *
+ * Slot metadata lives in DRAM next to the handle; payloads live in a single
+ * PSRAM arena. head always points at the slot the next push overwrites, so
+ * the oldest held frame is at (head - used) mod slot_count.
+ */
+
+#include "preroll.h"
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+static const char *TAG = "preroll";
+
+typedef struct {
+    size_t       len;
+    uint32_t     width;
+    uint32_t     height;
+    cam_pixfmt_t fmt;
+    uint64_t     timestamp_us;
+} preroll_slot_t;
+
+struct preroll_t {
+    uint8_t        *arena;          /* slot_count × slot_size, PSRAM */
+    size_t          slot_size;
+    uint32_t        slot_count;
+    uint32_t        head;           /* next slot to overwrite */
+    uint32_t        used;           /* valid slots (≤ slot_count) */
+    uint64_t        interval_us;    /* minimum spacing between stored frames */
+    uint64_t        last_push_us;
+    uint32_t        oversize_drops; /* frames too large for a slot */
+    preroll_slot_t  slots[];        /* flexible array — slot_count entries */
+};
+
+preroll_t *preroll_create(size_t budget_bytes, uint32_t slot_count, uint32_t fps)
+{
+    if (slot_count == 0 || fps == 0) {
+        return NULL;
+    }
+
+    /* Keep slots 4-byte aligned inside the arena */
+    size_t slot_size = (budget_bytes / slot_count) & ~(size_t)3;
+    if (slot_size == 0) {
+        ESP_LOGE(TAG, "Budget %u B too small for %"PRIu32" slots",
+                 (unsigned)budget_bytes, slot_count);
+        return NULL;
+    }
+
+    preroll_t *p = calloc(1, sizeof(*p) + slot_count * sizeof(preroll_slot_t));
+    if (!p) {
+        ESP_LOGE(TAG, "Out of heap for pre-roll struct");
+        return NULL;
+    }
+
+    p->arena = heap_caps_malloc(slot_size * slot_count, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!p->arena) {
+        ESP_LOGE(TAG, "Cannot allocate pre-roll arena (%u bytes)",
+                 (unsigned)(slot_size * slot_count));
+        free(p);
+        return NULL;
+    }
+
+    p->slot_size   = slot_size;
+    p->slot_count  = slot_count;
+    p->interval_us = 1000000ull / fps;
+
+    ESP_LOGI(TAG, "Pre-roll: %"PRIu32" slots × %u B (%u KB PSRAM)",
+             slot_count, (unsigned)slot_size,
+             (unsigned)((slot_size * slot_count) >> 10));
+    return p;
+}
+
+bool preroll_push(preroll_t *p, const cam_frame_t *frame)
+{
+    if (!p || !frame || !frame->data || frame->len == 0) {
+        return false;
+    }
+
+    /* Rate limit to the recording fps. The small slack absorbs capture
+     * jitter so a 10 fps ring fed at ~10 fps doesn't skip every other frame. */
+    if (p->used > 0 &&
+        frame->timestamp_us + p->interval_us / 8 < p->last_push_us + p->interval_us) {
+        return false;
+    }
+
+    if (frame->len > p->slot_size) {
+        p->oversize_drops++;
+        if ((p->oversize_drops & 0x3F) == 1) {
+            ESP_LOGW(TAG, "Frame %u B exceeds slot %u B — dropped (%"PRIu32" total)",
+                     (unsigned)frame->len, (unsigned)p->slot_size, p->oversize_drops);
+        }
+        return false;
+    }
+
+    preroll_slot_t *s = &p->slots[p->head];
+    memcpy(p->arena + (size_t)p->head * p->slot_size, frame->data, frame->len);
+    s->len          = frame->len;
+    s->width        = frame->width;
+    s->height       = frame->height;
+    s->fmt          = frame->fmt;
+    s->timestamp_us = frame->timestamp_us;
+
+    p->head = (p->head + 1) % p->slot_count;
+    if (p->used < p->slot_count) {
+        p->used++;
+    }
+    p->last_push_us = frame->timestamp_us;
+    return true;
+}
+
+uint32_t preroll_count(const preroll_t *p)
+{
+    return p ? p->used : 0;
+}
+
+bool preroll_get(const preroll_t *p, uint32_t i, cam_frame_t *out)
+{
+    if (!p || !out || i >= p->used) {
+        return false;
+    }
+    uint32_t idx = (p->head + p->slot_count - p->used + i) % p->slot_count;
+    const preroll_slot_t *s = &p->slots[idx];
+
+    out->data         = p->arena + (size_t)idx * p->slot_size;
+    out->len          = s->len;
+    out->width        = s->width;
+    out->height       = s->height;
+    out->fmt          = s->fmt;
+    out->timestamp_us = s->timestamp_us;
+    return true;
+}
+
+size_t preroll_slot_size(const preroll_t *p)
+{
+    return p ? p->slot_size : 0;
+}
+
+void preroll_clear(preroll_t *p)
+{
+    if (!p) {
+        return;
+    }
+    p->head = 0;
+    p->used = 0;
+}
+
+void preroll_destroy(preroll_t *p)
+{
+    if (!p) {
+        return;
+    }
+    heap_caps_free(p->arena);
+    free(p);
+}
@@ -0,0 +1,74 @@
+/*
+ * preroll.h — Fixed-budget ring of recent frames (pre-roll)
+ *
+ * Internal to clip_writer component.
+ * clip_writer.c pushes motion-watch frames here and flushes the ring into
+ * the next clip, so each recording starts from before the motion trigger.
+ *
+ * Memory layout:
+ *   One PSRAM arena of slot_count × slot_size bytes, allocated once at create.
+ *   Each push copies the frame payload into the oldest slot — no per-frame
+ *   allocation. Frames larger than slot_size are dropped (and counted).
+ *
+ * Pushes are rate-limited to the recording frame rate so the flushed frames
+ * play back at the correct speed inside a constant-fps AVI.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "camera_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct preroll_t preroll_t;
+
+/**
+ * @brief  Create a pre-roll ring.
+ * @param  budget_bytes  Total payload memory for all slots.
+ * @param  slot_count    Number of frames the ring holds.
+ * @param  fps           Push rate limit (frames per second).
+ * @return Handle on success, NULL on error.
+ */
+preroll_t *preroll_create(size_t budget_bytes, uint32_t slot_count, uint32_t fps);
+
+/**
+ * @brief  Copy a frame into the ring, overwriting the oldest slot.
+ *         Frames arriving faster than fps are skipped.
+ * @return true if the frame was stored.
+ */
+bool preroll_push(preroll_t *p, const cam_frame_t *frame);
+
+/**
+ * @brief  Number of frames currently held.
+ */
+uint32_t preroll_count(const preroll_t *p);
+
+/**
+ * @brief  Get frame i (0 = oldest). out->data points into the ring and stays
+ *         valid until the next push or clear.
+ * @return true if i is in range.
+ */
+bool preroll_get(const preroll_t *p, uint32_t i, cam_frame_t *out);
+
+/**
+ * @brief  Size of one slot in bytes (largest frame the ring accepts).
+ */
+size_t preroll_slot_size(const preroll_t *p);
+
+/**
+ * @brief  Drop all held frames. Slots are kept for reuse.
+ */
+void preroll_clear(preroll_t *p);
+
+/**
+ * @brief  Free the ring.
+ */
+void preroll_destroy(preroll_t *p);
+
+#ifdef __cplusplus
+}
+#endif
@@ -8,76 +8,361 @@
  *
  * NOTE: esp_tls is NOT a standalone component in IDF v5.4.
  * Use esp_crt_bundle_attach from mbedtls for TLS trust. (Telemetry lesson learned.)
+ *
+ * Connections: one long-lived esp_http_client per host (Lambda, S3). HTTP/1.1
+ * keep-alive lets back-to-back requests skip TCP+TLS entirely; when the
+ * server has closed an idle socket, the saved TLS session
+ * (CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS) makes the reconnect an abbreviated
+ * handshake instead of a full ECDHE/RSA one (~1–2 s on the S3). Each request
+ * logs its phases: dns, connect+tls, send, first byte, receive.
+ *
+ * Live upload: the same presign Lambda also drives S3 multipart uploads
+ * (action=mp_*). Parts 2..N are PUT from the clip file while it is still
+ * recording; part 1 holds the container header, which is patched at close,
+ * so it goes last. S3 assembles parts by number, not by arrival.
  */
 
 #include "cloud_client.h"
+#include "upload_pipe.h"
 #include "esp_http_client.h"
 #include "esp_crt_bundle.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "esp_heap_caps.h"
 #include "cJSON.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include "lwip/netdb.h"
+#include "trace.h"
 
 static const char *TAG = "cloud_client";
 
 /* Maximum presigned URL length — AWS SigV4 presigned URLs can reach ~1500 chars */
 #define PRESIGN_URL_LEN 2048
 
-/* HTTP response buffer for the presign Lambda response.
+/* HTTP response buffer for the presign Lambda response (PSRAM).
  * Two STS-session presigned URLs with large X-Amz-Security-Token can reach
- * ~1900 bytes of JSON. 4096 gives comfortable headroom. */
+ * ~1900 bytes of JSON. 4096 gives comfortable headroom; the buffer grows
+ * for batch replies (~4 KB per clip). */
 #define RESP_BUF_LEN    4096
+#define RESP_BUF_MAX    (CLOUD_PRESIGN_BATCH_MAX * 4096 + 2048)
+
+/* Batch-presigned URL pairs are used until this long before they expire —
+ * S3 checks the signature when the PUT starts, so this only has to cover
+ * getting the request out. */
+#define URL_EXPIRY_MARGIN_S  30
+
+/* mp_* queries: the URL-encoded upload ID (url_encode() stops 4 bytes
+ * short of the end) plus action, clip and thumbnail names */
+#define UPLOAD_ID_ENC_LEN  (CLOUD_UPLOAD_ID_LEN * 3 + 4)
+#define MP_QUERY_LEN       (UPLOAD_ID_ENC_LEN + 256)
+
+#define HOST_LEN        128
+#define PUT_TIMEOUT_MS  120000      /* 2 min — large AVI over home WiFi */
+#define GET_TIMEOUT_MS  15000
 
 static char s_clip_url [PRESIGN_URL_LEN];
 static char s_thumb_url[PRESIGN_URL_LEN];
-static char s_resp_buf [RESP_BUF_LEN];
-static int  s_resp_len  = 0;
+static char *s_resp_buf;
+static int   s_resp_cap;
+static int   s_resp_len  = 0;
+
+/* Presigned URL pairs fetched ahead by cloud_client_prefetch(). Each entry
+ * is used once; the strings live in PSRAM. */
+typedef struct {
+    char    clip_file[64];      /* "" = free slot */
+    char   *clip_url;
+    char   *thumb_url;
+    int64_t expires_us;         /* esp_timer time after which it is not used */
+} url_cache_entry_t;
+
+static url_cache_entry_t s_url_cache[CLOUD_PRESIGN_BATCH_MAX];
+
+/* SD read-ahead for PUT bodies, created on the first upload */
+static upload_pipe_t *s_pipe;
+
+/* Smoothed PUT body throughput (KB/s, 0 = no sample yet), read by the
+ * rate controller from the main task */
+#define UPLOAD_RATE_MIN_BYTES  (64 * 1024)   /* smaller bodies are RTT-bound */
+static volatile uint32_t s_upload_kbps;
+
+/* Phase timestamps of the current request (esp_timer µs) */
+typedef struct {
+    int64_t start;
+    int64_t dns;            /* lookup done (= start if skipped) */
+    int64_t connected;      /* TCP+TLS up; 0 = existing connection reused */
+    int64_t sent;           /* request (headers + body) written */
+    int64_t first_byte;     /* first response header */
+    int64_t end;
+} http_timing_t;
+
+typedef enum { CONN_LAMBDA, CONN_S3, CONN_COUNT } conn_id_t;
+
+typedef struct {
+    esp_http_client_handle_t client;
+    char          host[HOST_LEN];
+    bool          open;         /* last request left the socket up */
+    uint32_t      requests;
+    uint32_t      connects;
+    http_timing_t tm;
+} http_conn_t;
+
+static http_conn_t s_conn[CONN_COUNT];
 
 static esp_err_t http_event_handler(esp_http_client_event_t *evt)
 {
-    if (evt->event_id == HTTP_EVENT_ON_DATA) {
-        int remaining = RESP_BUF_LEN - s_resp_len - 1;
-        if (remaining > 0) {
-            int copy = evt->data_len < remaining ? evt->data_len : remaining;
-            memcpy(s_resp_buf + s_resp_len, evt->data, copy);
-            s_resp_len += copy;
-            s_resp_buf[s_resp_len] = '\0';
+    http_conn_t *c = evt->user_data;
+    int64_t now = esp_timer_get_time();
+    switch (evt->event_id) {
+    case HTTP_EVENT_ON_CONNECTED:
+        c->tm.connected = now;
+        c->connects++;
+        break;
+    case HTTP_EVENT_HEADERS_SENT:
+        c->tm.sent = now;
+        break;
+    case HTTP_EVENT_ON_HEADER:
+        if (!c->tm.first_byte) {
+            c->tm.first_byte = now;
         }
+        break;
+    case HTTP_EVENT_ON_DATA:
+        if (c == &s_conn[CONN_LAMBDA]) {
+            if (s_resp_len + evt->data_len + 1 > s_resp_cap && s_resp_cap < RESP_BUF_MAX) {
+                int cap = s_resp_cap;
+                while (cap < s_resp_len + evt->data_len + 1 && cap < RESP_BUF_MAX) {
+                    cap *= 2;
+                }
+                cap = cap < RESP_BUF_MAX ? cap : RESP_BUF_MAX;
+                char *grown = heap_caps_realloc(s_resp_buf, cap, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+                if (grown) {
+                    s_resp_buf = grown;
+                    s_resp_cap = cap;
+                }
+            }
+            int remaining = s_resp_cap - s_resp_len - 1;
+            if (remaining > 0) {
+                int copy = evt->data_len < remaining ? evt->data_len : remaining;
+                memcpy(s_resp_buf + s_resp_len, evt->data, copy);
+                s_resp_len += copy;
+                s_resp_buf[s_resp_len] = '\0';
+            }
+        }
+        break;
+    default:
+        break;
     }
     return ESP_OK;
 }
 
-/* GET presigned URLs from Lambda Function URL */
-static esp_err_t get_presigned_urls(const char *clip_name)
+/* "https://host[:port]/path?..." → "host" */
+static void url_host(const char *url, char *out, size_t out_len)
 {
-    char url[512];
-    snprintf(url, sizeof(url), "%s?clip=%s.avi&thumb=%s_thumb.jpg",
-             CONFIG_LAMBDA_PRESIGN_URL, clip_name, clip_name);
+    const char *p = strstr(url, "://");
+    p = p ? p + 3 : url;
+    size_t n = strcspn(p, ":/?");
+    if (n >= out_len) {
+        n = out_len - 1;
+    }
+    memcpy(out, p, n);
+    out[n] = '\0';
+}
 
-    s_resp_len = 0;
-    memset(s_resp_buf, 0, sizeof(s_resp_buf));
+/* Drop the socket but keep the handle — it holds the saved TLS session */
+static void conn_close(http_conn_t *c)
+{
+    if (c->client) {
+        esp_http_client_close(c->client);
+    }
+    c->open = false;
+}
 
-    esp_http_client_config_t cfg = {
-        .url               = url,
-        .method            = HTTP_METHOD_GET,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-        .event_handler     = http_event_handler,
-        .timeout_ms        = 15000,
-    };
+/* Point the connection's client at url, creating it on first use or when
+ * the host changes. Returns NULL if the client cannot be created. */
+static esp_http_client_handle_t conn_prepare(http_conn_t *c, const char *url,
+                                             esp_http_client_method_t method, int timeout_ms)
+{
+    char host[HOST_LEN];
+    url_host(url, host, sizeof(host));
+    if (c->client && strcmp(c->host, host) != 0) {
+        esp_http_client_cleanup(c->client);
+        c->client = NULL;
+        c->open   = false;
+    }
 
-    esp_http_client_handle_t client = esp_http_client_init(&cfg);
-    if (!client) {
-        ESP_LOGE(TAG, "esp_http_client_init failed — bad URL? (%s)", CONFIG_LAMBDA_PRESIGN_URL);
-        return ESP_ERR_INVALID_ARG;
+    memset(&c->tm, 0, sizeof(c->tm));
+    c->tm.start = esp_timer_get_time();
+
+    /* Time the lookup separately; lwIP caches it for the connect that follows */
+    if (!c->open) {
+        struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+        struct addrinfo *res = NULL;
+        if (getaddrinfo(host, NULL, &hints, &res) == 0) {
+            freeaddrinfo(res);
+        } else {
+            ESP_LOGW(TAG, "DNS lookup failed for %s", host);
+        }
+    }
+    c->tm.dns = esp_timer_get_time();
+
+    if (!c->client) {
+        esp_http_client_config_t cfg = {
+            .url                 = url,
+            .method              = method,
+            .crt_bundle_attach   = esp_crt_bundle_attach,
+            .event_handler       = http_event_handler,
+            .user_data           = c,
+            .timeout_ms          = timeout_ms,
+            .buffer_size_tx      = 32768,   /* larger TCP send buffer → fewer segments */
+            .keep_alive_enable   = true,    /* TCP keep-alive: notice dead idle sockets */
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+            .save_client_session = true,
+#endif
+        };
+        c->client = esp_http_client_init(&cfg);
+        if (!c->client) {
+            return NULL;
+        }
+        strlcpy(c->host, host, sizeof(c->host));
+        if (c == &s_conn[CONN_LAMBDA]) {
+            esp_http_client_set_header(c->client, "x-api-key", CONFIG_API_KEY);
+        }
+    } else {
+        if (esp_http_client_set_url(c->client, url) != ESP_OK) {
+            return NULL;
+        }
+        esp_http_client_set_method(c->client, method);
+        esp_http_client_set_timeout_ms(c->client, timeout_ms);
+    }
+    c->requests++;
+    return c->client;
+}
+
+/* True if the request failed on a kept-alive socket the server had closed */
+static bool conn_was_stale(const http_conn_t *c)
+{
+    return c->open && c->tm.connected == 0 && c->tm.first_byte == 0;
+}
+
+static void log_timing(const http_conn_t *c, const char *what)
+{
+    const http_timing_t *t = &c->tm;
+    int64_t up   = t->connected ? t->connected : t->dns;
+    int64_t sent = t->sent ? t->sent : up;
+    int64_t fb   = t->first_byte ? t->first_byte : t->end;
+    ESP_LOGI(TAG, "%s %s: dns %lld, connect+tls %lld%s, send %lld, first byte %lld, "
+             "recv %lld ms (total %lld ms, %"PRIu32" connects / %"PRIu32" requests)",
+             what, c->host,
+             (t->dns - t->start) / 1000,
+             t->connected ? (t->connected - t->dns) / 1000 : 0,
+             t->connected ? "" : " (reused)",
+             (sent - up) / 1000, (fb - sent) / 1000, (t->end - fb) / 1000,
+             (t->end - t->start) / 1000, c->connects, c->requests);
+}
+
+/* PUT phases into the trace histograms (connect only when one was made) */
+static void trace_put(const http_timing_t *t)
+{
+    int64_t up = t->connected ? t->connected : t->dns;
+    if (t->connected) {
+        trace_record(TRACE_PUT_CONNECT, (uint32_t)(t->connected - t->start));
+    }
+    trace_record(TRACE_PUT_BODY,     (uint32_t)(t->sent - up));
+    trace_record(TRACE_PUT_RESPONSE, (uint32_t)(t->end - t->sent));
+}
+
+/* "<base>.mp4" → "<base>" */
+static void clip_base_name(const char *clip_file, char *out, size_t out_len)
+{
+    strlcpy(out, clip_file, out_len);
+    char *dot = strrchr(out, '.');
+    if (dot) {
+        *dot = '\0';
+    }
+}
+
+static const char *clip_content_type(const char *clip_file)
+{
+    const char *dot = strrchr(clip_file, '.');
+    if (dot && strcmp(dot, ".mp4") == 0) {
+        return "video/mp4";
+    }
+    return (dot && strcmp(dot, ".h264") == 0) ? "video/h264" : "video/avi";
+}
+
+/* Percent-encode a query parameter value (S3 upload IDs contain '+', '/', '=') */
+static void url_encode(const char *in, char *out, size_t out_len)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    size_t o = 0;
+    for (; *in && o + 4 < out_len; in++) {
+        unsigned char c = (unsigned char)*in;
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+            c == '-' || c == '_' || c == '.' || c == '~') {
+            out[o++] = (char)c;
+        } else {
+            out[o++] = '%';
+            out[o++] = hex[c >> 4];
+            out[o++] = hex[c & 0x0F];
+        }
+    }
+    out[o] = '\0';
+}
+
+/* GET CONFIG_LAMBDA_PRESIGN_URL?<query> and parse the JSON reply.
+ * On ESP_OK *out must be freed with cJSON_Delete(). */
+static esp_err_t presign_request(const char *query, cJSON **out)
+{
+    static char url[PRESIGN_URL_LEN];          /* upload task only; off its stack */
+    if (snprintf(url, sizeof(url), "%s?%s", CONFIG_LAMBDA_PRESIGN_URL, query) >=
+        (int)sizeof(url)) {
+        ESP_LOGE(TAG, "Presign query too long (%u B)", (unsigned)strlen(query));
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (!s_resp_buf) {
+        s_resp_buf = heap_caps_malloc(RESP_BUF_LEN, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!s_resp_buf) {
+            return ESP_ERR_NO_MEM;
+        }
+        s_resp_cap = RESP_BUF_LEN;
+    }
+
+    http_conn_t *c = &s_conn[CONN_LAMBDA];
+    esp_err_t err = ESP_FAIL;
+    int status = 0;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        s_resp_len = 0;
+        s_resp_buf[0] = '\0';
+
+        esp_http_client_handle_t client = conn_prepare(c, url, HTTP_METHOD_GET, GET_TIMEOUT_MS);
+        if (!client) {
+            ESP_LOGE(TAG, "esp_http_client_init failed — bad URL? (%s)", CONFIG_LAMBDA_PRESIGN_URL);
+            return ESP_ERR_INVALID_ARG;
+        }
+        err = esp_http_client_perform(client);
+        status = esp_http_client_get_status_code(client);
+        c->tm.end = esp_timer_get_time();
+        if (err == ESP_OK) {
+            c->open = true;
+            log_timing(c, "GET");
+            trace_record(TRACE_PRESIGN, (uint32_t)(c->tm.end - c->tm.start));
+            break;
+        }
+        bool stale = conn_was_stale(c);
+        conn_close(c);
+        if (!stale) {
+            break;
+        }
+        ESP_LOGI(TAG, "Kept-alive connection to %s was closed — reconnecting", c->host);
     }
-    esp_http_client_set_header(client, "x-api-key", CONFIG_API_KEY);
-    esp_err_t err = esp_http_client_perform(client);
-    int status = esp_http_client_get_status_code(client);
-    esp_http_client_cleanup(client);
 
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Presign GET failed: %s", esp_err_to_name(err));
@@ -85,158 +370,780 @@ static esp_err_t get_presigned_urls(const char *clip_name)
     }
     if (status != 200) {
         ESP_LOGE(TAG, "Presign Lambda returned HTTP %d: %s", status, s_resp_buf);
-        return ESP_FAIL;
+        /* 409: parts missing; 404: no such multipart upload */
+        return status == 409 ? ESP_ERR_INVALID_STATE :
+               status == 404 ? ESP_ERR_NOT_FOUND : ESP_FAIL;
     }
 
-    /* Parse JSON: { "clip_url": "...", "thumb_url": "..." } */
-    cJSON *root = cJSON_Parse(s_resp_buf);
-    if (!root) {
+    *out = cJSON_Parse(s_resp_buf);
+    if (!*out) {
         ESP_LOGE(TAG, "JSON parse failed: %s", s_resp_buf);
         return ESP_FAIL;
     }
+    return ESP_OK;
+}
 
-    const cJSON *clip_url  = cJSON_GetObjectItem(root, "clip_url");
-    const cJSON *thumb_url = cJSON_GetObjectItem(root, "thumb_url");
+/* Copy string member name of root into out. False if missing. */
+static bool json_get_string(const cJSON *root, const char *name, char *out, size_t out_len)
+{
+    const cJSON *item = cJSON_GetObjectItem(root, name);
+    if (!cJSON_IsString(item)) {
+        ESP_LOGE(TAG, "Missing %s in JSON", name);
+        return false;
+    }
+    strlcpy(out, item->valuestring, out_len);
+    return true;
+}
 
-    if (!cJSON_IsString(clip_url) || !cJSON_IsString(thumb_url)) {
-        ESP_LOGE(TAG, "Missing clip_url or thumb_url in JSON");
+static char *psram_strdup(const char *str)
+{
+    size_t n = strlen(str) + 1;
+    char *p = heap_caps_malloc(n, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (p) {
+        memcpy(p, str, n);
+    }
+    return p;
+}
+
+static void cache_free(url_cache_entry_t *e)
+{
+    heap_caps_free(e->clip_url);
+    heap_caps_free(e->thumb_url);
+    memset(e, 0, sizeof(*e));
+}
+
+/* Valid entry for clip_file, or NULL. Expired entries are dropped on the way. */
+static url_cache_entry_t *cache_find(const char *clip_file)
+{
+    int64_t now = esp_timer_get_time();
+    url_cache_entry_t *hit = NULL;
+    for (int i = 0; i < CLOUD_PRESIGN_BATCH_MAX; i++) {
+        url_cache_entry_t *e = &s_url_cache[i];
+        if (!e->clip_file[0]) {
+            continue;
+        }
+        if (now >= e->expires_us) {
+            cache_free(e);
+        } else if (!strcmp(e->clip_file, clip_file)) {
+            hit = e;
+        }
+    }
+    return hit;
+}
+
+static url_cache_entry_t *cache_slot(void)
+{
+    url_cache_entry_t *oldest = &s_url_cache[0];
+    for (int i = 0; i < CLOUD_PRESIGN_BATCH_MAX; i++) {
+        if (!s_url_cache[i].clip_file[0]) {
+            return &s_url_cache[i];
+        }
+        if (s_url_cache[i].expires_us < oldest->expires_us) {
+            oldest = &s_url_cache[i];
+        }
+    }
+    cache_free(oldest);
+    return oldest;
+}
+
+/* cloud_client_upload() sends the clip in one PUT (not as a multipart
+ * upload presigned part by part), so single-PUT URLs are worth fetching */
+static bool single_put(const char *clip_file)
+{
+    char path[128];
+    struct stat st;
+    snprintf(path, sizeof(path), "/sdcard/%s", clip_file);
+    return stat(path, &st) == 0 && (uint32_t)st.st_size <= CLOUD_LIVE_PART_MIN;
+}
+
+esp_err_t cloud_client_prefetch(const char *const *clip_files, size_t count)
+{
+    char   query[64 + CLOUD_PRESIGN_BATCH_MAX * 72];
+    size_t q = strlcpy(query, "clips=", sizeof(query));
+    size_t wanted = 0;
+    for (size_t i = 0; i < count && wanted < CLOUD_PRESIGN_BATCH_MAX; i++) {
+        if (cache_find(clip_files[i]) || !single_put(clip_files[i])) {
+            continue;
+        }
+        char enc[72];
+        url_encode(clip_files[i], enc, sizeof(enc));
+        q += snprintf(query + q, sizeof(query) - q, "%s%s", wanted ? "," : "", enc);
+        if (q >= sizeof(query)) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        wanted++;
+    }
+    if (wanted == 0) {
+        return ESP_OK;
+    }
+
+    int64_t t_start = esp_timer_get_time();
+    cJSON *root = NULL;
+    esp_err_t err = presign_request(query, &root);
+    if (err != ESP_OK) {
+        return err;
+    }
+    const cJSON *urls    = cJSON_GetObjectItem(root, "urls");
+    const cJSON *expires = cJSON_GetObjectItem(root, "expires_in");
+    int ttl_s = cJSON_IsNumber(expires) ? expires->valueint : 0;
+    if (!cJSON_IsObject(urls) || ttl_s <= URL_EXPIRY_MARGIN_S) {
+        ESP_LOGE(TAG, "Batch presign reply malformed");
         cJSON_Delete(root);
         return ESP_FAIL;
     }
 
-    strlcpy(s_clip_url,  clip_url->valuestring,  sizeof(s_clip_url));
-    strlcpy(s_thumb_url, thumb_url->valuestring, sizeof(s_thumb_url));
+    int64_t expires_us = t_start + (int64_t)(ttl_s - URL_EXPIRY_MARGIN_S) * 1000000;
+    size_t cached = 0;
+    const cJSON *pair;
+    cJSON_ArrayForEach(pair, urls) {
+        const cJSON *cu = cJSON_GetObjectItem(pair, "clip_url");
+        const cJSON *tu = cJSON_GetObjectItem(pair, "thumb_url");
+        if (!pair->string || !cJSON_IsString(cu) || !cJSON_IsString(tu)) {
+            continue;
+        }
+        url_cache_entry_t *e = cache_slot();
+        e->clip_url  = psram_strdup(cu->valuestring);
+        e->thumb_url = psram_strdup(tu->valuestring);
+        if (!e->clip_url || !e->thumb_url) {
+            cache_free(e);
+            continue;
+        }
+        strlcpy(e->clip_file, pair->string, sizeof(e->clip_file));
+        e->expires_us = expires_us;
+        cached++;
+    }
+    cJSON_Delete(root);
+
+    ESP_LOGI(TAG, "Batch presign: %u/%u clips in %lld ms, valid %d s",
+             (unsigned)cached, (unsigned)wanted, (esp_timer_get_time() - t_start) / 1000,
+             ttl_s - URL_EXPIRY_MARGIN_S);
+    return cached ? ESP_OK : ESP_FAIL;
+}
+
+/* GET presigned URLs from Lambda Function URL (or the prefetch cache) */
+static esp_err_t get_presigned_urls(const char *clip_file)
+{
+    url_cache_entry_t *hit = cache_find(clip_file);
+    if (hit) {
+        strlcpy(s_clip_url,  hit->clip_url,  sizeof(s_clip_url));
+        strlcpy(s_thumb_url, hit->thumb_url, sizeof(s_thumb_url));
+        cache_free(hit);        /* one upload per URL pair */
+        ESP_LOGI(TAG, "Presigned URLs from cache");
+        return ESP_OK;
+    }
+
+    char query[256];
+    char base[96];
+    clip_base_name(clip_file, base, sizeof(base));
+    snprintf(query, sizeof(query), "clip=%s&thumb=%s_thumb.jpg", clip_file, base);
+
+    /* Parse JSON: { "clip_url": "...", "thumb_url": "..." } */
+    cJSON *root = NULL;
+    esp_err_t err = presign_request(query, &root);
+    if (err != ESP_OK) {
+        return err;
+    }
+    bool ok = json_get_string(root, "clip_url",  s_clip_url,  sizeof(s_clip_url)) &&
+              json_get_string(root, "thumb_url", s_thumb_url, sizeof(s_thumb_url));
     cJSON_Delete(root);
+    if (!ok) {
+        return ESP_FAIL;
+    }
 
     ESP_LOGI(TAG, "Presigned URLs received OK");
     return ESP_OK;
 }
 
-/* PUT a file from SD card to a presigned S3 URL */
-static esp_err_t put_file_to_s3(const char *sd_path, const char *presigned_url,
-                                 const char *content_type)
+/* PUT len bytes of a file from SD card, starting at offset, to a presigned
+ * S3 URL. len 0 = to the end of the file. content_type NULL = no header
+ * (multipart parts take the type given at mp_start).
+ * The file is opened per call: FATFS fixes a file's size when it is opened,
+ * and a clip being recorded keeps growing. */
+static esp_err_t put_range_to_s3(const char *sd_path, uint32_t offset, uint32_t len,
+                                 const char *presigned_url, const char *content_type)
 {
     struct stat st;
     if (stat(sd_path, &st) != 0) {
         ESP_LOGE(TAG, "File not found: %s", sd_path);
         return ESP_ERR_NOT_FOUND;
     }
+    if (len == 0) {
+        len = (uint32_t)st.st_size > offset ? (uint32_t)st.st_size - offset : 0;
+    }
+    if ((uint64_t)offset + len > (uint64_t)st.st_size) {
+        ESP_LOGE(TAG, "%s: range %"PRIu32"+%"PRIu32" past end (%ld)",
+                 sd_path, offset, len, (long)st.st_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
 
     FILE *f = fopen(sd_path, "rb");
     if (!f) {
         ESP_LOGE(TAG, "Cannot open %s", sd_path);
         return ESP_FAIL;
     }
+    if (offset && fseek(f, (long)offset, SEEK_SET) != 0) {
+        ESP_LOGE(TAG, "Seek to %"PRIu32" failed in %s", offset, sd_path);
+        fclose(f);
+        return ESP_FAIL;
+    }
 
-    ESP_LOGI(TAG, "Uploading %s (%ld bytes) → S3", sd_path, (long)st.st_size);
-
-    esp_http_client_config_t cfg = {
-        .url               = presigned_url,
-        .method            = HTTP_METHOD_PUT,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-        .timeout_ms        = 120000,   /* 2 min — large AVI over home WiFi */
-        .buffer_size_tx    = 32768,    /* larger TCP send buffer → fewer segments */
-    };
+    ESP_LOGI(TAG, "Uploading %s (%"PRIu32" bytes at %"PRIu32") → S3", sd_path, len, offset);
 
-    esp_http_client_handle_t client = esp_http_client_init(&cfg);
-    if (!client) {
-        ESP_LOGE(TAG, "esp_http_client_init failed for PUT");
+    /* Stream the file in UPLOAD_BUFFER_KB chunks from PSRAM. The reader
+     * task fills the next buffer from SD while this one is on the wire.
+     * 4 KB on the stack gave 2200+ iterations for a 9 MB clip; 32 KB
+     * reduces that to ~280 (8× fewer SD + TCP calls). */
+    if (!s_pipe) {
+        s_pipe = upload_pipe_create(CONFIG_UPLOAD_BUFFERS, CONFIG_UPLOAD_BUFFER_KB * 1024,
+                                    uxTaskPriorityGet(NULL));
+    }
+    if (!s_pipe) {
+        ESP_LOGE(TAG, "Cannot allocate upload buffers");
         fclose(f);
+        return ESP_ERR_NO_MEM;
+    }
+
+    http_conn_t *c = &s_conn[CONN_S3];
+    esp_err_t err = ESP_FAIL;
+    int status = 0;
+    size_t remaining = len;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (attempt > 0 && fseek(f, (long)offset, SEEK_SET) != 0) {
+            break;
+        }
+        esp_http_client_handle_t client = conn_prepare(c, presigned_url, HTTP_METHOD_PUT,
+                                                       PUT_TIMEOUT_MS);
+        if (!client) {
+            ESP_LOGE(TAG, "esp_http_client_init failed for PUT");
+            break;
+        }
+        if (content_type) {
+            esp_http_client_set_header(client, "Content-Type", content_type);
+        } else {
+            esp_http_client_delete_header(client, "Content-Type");
+        }
+
+        remaining = len;
+        err = esp_http_client_open(client, (int)len);
+        int64_t t_body = esp_timer_get_time();
+        if (err == ESP_OK) {
+            upload_pipe_start(s_pipe, f, len);    /* read-ahead starts once the socket is up */
+        }
+        while (err == ESP_OK && remaining > 0) {
+            const uint8_t *data;
+            int n = upload_pipe_next(s_pipe, &data);
+            if (n <= 0) {
+                ESP_LOGE(TAG, "File read error at byte %zu", (size_t)(offset + len - remaining));
+                err = ESP_FAIL;
+                break;
+            }
+            int written = esp_http_client_write(client, (const char *)data, n);
+            if (written < 0) {
+                ESP_LOGE(TAG, "PUT write error");
+                err = ESP_FAIL;
+                break;
+            }
+            remaining -= (size_t)n;
+        }
+        c->tm.sent = esp_timer_get_time();
+        upload_pipe_stop(s_pipe);
+
+        if (err == ESP_OK) {
+            int64_t elapsed_ms = (c->tm.sent - t_body) / 1000;
+            if (elapsed_ms > 0) {
+                upload_pipe_stats_t ps;
+                upload_pipe_get_stats(s_pipe, &ps);
+                /* sd wait: sender starved by the card; net wait: reader
+                 * had every buffer full, i.e. WiFi was the bottleneck */
+                ESP_LOGI(TAG, "PUT stream: %"PRIu32" bytes in %lld ms → %lld KB/s "
+                         "(%d × %d KB buffers, SD read %"PRIu32" ms, sd wait %"PRIu32" ms, "
+                         "net wait %"PRIu32" ms, throttled %"PRIu32" ms)",
+                         len, elapsed_ms, (int64_t)len / elapsed_ms,
+                         CONFIG_UPLOAD_BUFFERS, CONFIG_UPLOAD_BUFFER_KB,
+                         ps.read_ms, ps.data_wait_ms, ps.free_wait_ms, ps.throttle_ms);
+                /* Throttled time is the uploader's own choice, not the link */
+                int64_t link_ms = elapsed_ms - ps.throttle_ms;
+                if (len >= UPLOAD_RATE_MIN_BYTES && link_ms > 0) {
+                    uint32_t kbps = (uint32_t)(((int64_t)len * 1000 / link_ms) >> 10);
+                    s_upload_kbps = s_upload_kbps ? (s_upload_kbps * 3 + kbps) / 4 : kbps;
+                }
+            }
+            if (esp_http_client_fetch_headers(client) < 0) {
+                err = ESP_FAIL;
+            }
+        }
+        if (err == ESP_OK) {
+            status = esp_http_client_get_status_code(client);
+            /* Read out the (small) response so the socket can carry the next request */
+            esp_http_client_flush_response(client, NULL);
+            c->tm.end = esp_timer_get_time();
+            c->open = true;
+            log_timing(c, "PUT");
+            trace_put(&c->tm);
+            break;
+        }
+
+        bool stale = conn_was_stale(c) && remaining == len;
+        conn_close(c);
+        if (!stale) {
+            ESP_LOGE(TAG, "PUT failed: %s", esp_err_to_name(err));
+            break;
+        }
+        ESP_LOGI(TAG, "Kept-alive connection to %s was closed — reconnecting", c->host);
+    }
+    fclose(f);
+
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (remaining > 0) {
+        ESP_LOGE(TAG, "PUT aborted with %zu bytes unsent for %s", remaining, sd_path);
         return ESP_FAIL;
     }
+    if (status < 200 || status >= 300) {
+        ESP_LOGE(TAG, "S3 PUT returned HTTP %d for %s", status, sd_path);
+        conn_close(c);      /* error bodies may not have been drained */
+        return status == 404 ? ESP_ERR_NOT_FOUND : ESP_FAIL;   /* 404: NoSuchUpload */
+    }
+
+    ESP_LOGI(TAG, "Upload complete: %s (HTTP %d)", sd_path, status);
+    return ESP_OK;
+}
 
-    esp_http_client_set_header(client, "Content-Type", content_type);
+static esp_err_t put_file_to_s3(const char *sd_path, const char *presigned_url,
+                                const char *content_type)
+{
+    return put_range_to_s3(sd_path, 0, 0, presigned_url, content_type);
+}
+
+/* ── Multipart upload and resume journal ───────────────────────────────── */
+
+/* /sdcard/<name>.upj — one per clip with a multipart upload in progress.
+ * Text, rewritten after each confirmed part:
+ *   upload_id=<id>
+ *   part_size=<bytes>
+ *   parts_done=<hex bitmap, bit n-1 = part n>
+ *   thumb=<0|1>
+ * A torn write fails to parse and the upload starts over; the orphaned
+ * multipart upload is dropped by the bucket lifecycle rule. */
+static void journal_path(const char *clip_file, char *out, size_t out_len)
+{
+    char base[96];
+    clip_base_name(clip_file, base, sizeof(base));
+    snprintf(out, out_len, "/sdcard/%s.upj", base);
+}
+
+static void journal_save(const cloud_live_upload_t *lu)
+{
+    char path[128];
+    journal_path(lu->clip_file, path, sizeof(path));
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        ESP_LOGW(TAG, "Cannot write %s — upload will not be resumable", path);
+        return;
+    }
+    fprintf(f, "upload_id=%s\npart_size=%"PRIu32"\nparts_done=%llx\nthumb=%d\n",
+            lu->upload_id, lu->part_size, (unsigned long long)lu->parts_done,
+            lu->thumb_done ? 1 : 0);
+    fclose(f);
+}
+
+static bool journal_load(const char *clip_file, cloud_live_upload_t *lu)
+{
+    char path[128];
+    journal_path(clip_file, path, sizeof(path));
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    memset(lu, 0, sizeof(*lu));
+    char line[CLOUD_UPLOAD_ID_LEN + 32];
+    unsigned long long done = 0;
+    int thumb = 0;
+    int fields = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (!strncmp(line, "upload_id=", 10)) {
+            fields += strlcpy(lu->upload_id, line + 10, sizeof(lu->upload_id)) > 0;
+        } else {
+            fields += sscanf(line, "part_size=%"SCNu32, &lu->part_size) == 1;
+            fields += sscanf(line, "parts_done=%llx", &done) == 1;
+            fields += sscanf(line, "thumb=%d", &thumb) == 1;
+        }
+    }
+    fclose(f);
+    if (fields != 4 || lu->part_size < CLOUD_LIVE_PART_MIN) {
+        ESP_LOGW(TAG, "Ignoring unreadable resume journal %s", path);
+        unlink(path);
+        return false;
+    }
+    strlcpy(lu->clip_file, clip_file, sizeof(lu->clip_file));
+    lu->parts_done = done;
+    lu->thumb_done = thumb != 0;
+    lu->active     = true;
+    return true;
+}
+
+static void journal_remove(const char *clip_file)
+{
+    char path[128];
+    journal_path(clip_file, path, sizeof(path));
+    unlink(path);
+}
+
+static uint32_t parts_count(uint64_t bitmap)
+{
+    uint32_t n = 0;
+    for (; bitmap; bitmap &= bitmap - 1) {
+        n++;
+    }
+    return n;
+}
 
-    esp_err_t err = esp_http_client_open(client, (int)st.st_size);
+/* PUT part n of the clip: bytes [(n-1)·part_size, +len) */
+static esp_err_t mp_put_part(cloud_live_upload_t *lu, uint32_t n, uint32_t len)
+{
+    if (n > CLOUD_UPLOAD_PARTS_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    char query[MP_QUERY_LEN];
+    char id_enc[UPLOAD_ID_ENC_LEN];
+    url_encode(lu->upload_id, id_enc, sizeof(id_enc));
+    if (snprintf(query, sizeof(query), "action=mp_part&clip=%s&upload_id=%s&part=%"PRIu32,
+                 lu->clip_file, id_enc, n) >= (int)sizeof(query)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    cJSON *root = NULL;
+    esp_err_t err = presign_request(query, &root);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "PUT open failed: %s", esp_err_to_name(err));
-        esp_http_client_cleanup(client);
-        fclose(f);
         return err;
     }
+    bool ok = json_get_string(root, "part_url", s_clip_url, sizeof(s_clip_url));
+    cJSON_Delete(root);
+    if (!ok) {
+        return ESP_FAIL;
+    }
 
-    /* Stream file in 32 KB chunks from PSRAM.
-     * 4 KB on the stack gave 2200+ iterations for a 9 MB clip.
-     * 32 KB reduces that to ~280 iterations (8× fewer SD + TCP calls). */
-    #define UPLOAD_CHUNK_SIZE  (32 * 1024)
-    uint8_t *buf = heap_caps_malloc(UPLOAD_CHUNK_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!buf) {
-        buf = malloc(UPLOAD_CHUNK_SIZE);   /* fallback to DRAM */
+    char path[128];
+    snprintf(path, sizeof(path), "/sdcard/%s", lu->clip_file);
+    err = put_range_to_s3(path, (n - 1) * lu->part_size, len, s_clip_url, NULL);
+    if (err == ESP_OK) {
+        lu->bytes_sent += len;
+        lu->parts_done |= 1ull << (n - 1);
+        journal_save(lu);
     }
-    if (!buf) {
-        ESP_LOGE(TAG, "Cannot allocate upload buffer");
-        esp_http_client_cleanup(client);
-        fclose(f);
-        return ESP_ERR_NO_MEM;
+    return err;
+}
+
+/* mp_complete / mp_abort */
+static esp_err_t mp_finish_request(cloud_live_upload_t *lu, const char *action, uint32_t parts)
+{
+    char query[MP_QUERY_LEN];
+    char id_enc[UPLOAD_ID_ENC_LEN];
+    url_encode(lu->upload_id, id_enc, sizeof(id_enc));
+    if (snprintf(query, sizeof(query), "action=%s&clip=%s&upload_id=%s&parts=%"PRIu32,
+                 action, lu->clip_file, id_enc, parts) >= (int)sizeof(query)) {
+        return ESP_ERR_INVALID_SIZE;
     }
+    cJSON *root = NULL;
+    esp_err_t err = presign_request(query, &root);
+    if (err == ESP_OK) {
+        cJSON_Delete(root);
+    }
+    return err;
+}
 
-    int64_t t_start = esp_timer_get_time();
-    size_t remaining = (size_t)st.st_size;
-    while (remaining > 0) {
-        size_t to_read = remaining < UPLOAD_CHUNK_SIZE ? remaining : UPLOAD_CHUNK_SIZE;
-        size_t n = fread(buf, 1, to_read, f);
-        if (n == 0) {
-            ESP_LOGE(TAG, "File read error at byte %zu", (size_t)st.st_size - remaining);
-            break;
+/* Thumbnail PUT; url NULL = presign a fresh one for this upload only
+ * (resumed upload, or the mp_start URL may have expired) */
+static void mp_put_thumb(cloud_live_upload_t *lu, const char *url)
+{
+    static char thumb_url[PRESIGN_URL_LEN];     /* upload task only; off its stack */
+    char base[96];
+    clip_base_name(lu->clip_file, base, sizeof(base));
+    if (url) {
+        strlcpy(thumb_url, url, sizeof(thumb_url));
+    } else {
+        char query[MP_QUERY_LEN];
+        char id_enc[UPLOAD_ID_ENC_LEN];
+        url_encode(lu->upload_id, id_enc, sizeof(id_enc));
+        cJSON *root = NULL;
+        if (snprintf(query, sizeof(query), "action=mp_thumb&clip=%s&upload_id=%s&thumb=%s_thumb.jpg",
+                     lu->clip_file, id_enc, base) >= (int)sizeof(query) ||
+            presign_request(query, &root) != ESP_OK) {
+            return;
         }
-        int written = esp_http_client_write(client, (char *)buf, (int)n);
-        if (written < 0) {
-            ESP_LOGE(TAG, "PUT write error");
-            break;
+        bool ok = json_get_string(root, "thumb_url", thumb_url, sizeof(thumb_url));
+        cJSON_Delete(root);
+        if (!ok) {
+            return;
         }
-        remaining -= n;
     }
-    free(buf);
-    fclose(f);
 
-    int64_t elapsed_ms = (esp_timer_get_time() - t_start) / 1000;
-    if (elapsed_ms > 0) {
-        ESP_LOGI(TAG, "PUT stream: %ld bytes in %lld ms → %lld KB/s",
-                 (long)st.st_size, elapsed_ms,
-                 (int64_t)st.st_size / elapsed_ms);
+    char thumb_path[128];
+    snprintf(thumb_path, sizeof(thumb_path), "/sdcard/%s_thumb.jpg", base);
+    if (put_file_to_s3(thumb_path, thumb_url, "image/jpeg") == ESP_OK) {
+        lu->thumb_done = true;
+        journal_save(lu);
+    } else {
+        ESP_LOGW(TAG, "Thumbnail upload failed — clip continues without");
     }
+}
 
-    esp_http_client_fetch_headers(client);
-    int status = esp_http_client_get_status_code(client);
-    esp_http_client_close(client);
-    esp_http_client_cleanup(client);
+/* mp_start, journal, thumbnail */
+static esp_err_t mp_begin(cloud_live_upload_t *lu, const char *clip_file, uint32_t part_size)
+{
+    memset(lu, 0, sizeof(*lu));
+    strlcpy(lu->clip_file, clip_file, sizeof(lu->clip_file));
+    lu->part_size = part_size;
+    lu->next_part = 2;              /* part 1 (header) is sent at finish */
 
-    if (status < 200 || status >= 300) {
-        ESP_LOGE(TAG, "S3 PUT returned HTTP %d for %s", status, sd_path);
+    char base[96];
+    char query[256];
+    clip_base_name(clip_file, base, sizeof(base));
+    if (snprintf(query, sizeof(query), "action=mp_start&clip=%s&thumb=%s_thumb.jpg",
+                 clip_file, base) >= (int)sizeof(query)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    cJSON *root = NULL;
+    esp_err_t err = presign_request(query, &root);
+    if (err != ESP_OK) {
+        return err;
+    }
+    bool ok = json_get_string(root, "upload_id", lu->upload_id, sizeof(lu->upload_id)) &&
+              json_get_string(root, "thumb_url", s_thumb_url, sizeof(s_thumb_url));
+    cJSON_Delete(root);
+    if (!ok) {
         return ESP_FAIL;
     }
+    lu->active = true;
+    journal_save(lu);
+    ESP_LOGI(TAG, "Multipart upload started: %s (%"PRIu32" KB parts)",
+             clip_file, part_size >> 10);
 
-    ESP_LOGI(TAG, "Upload complete: %s (HTTP %d)", sd_path, status);
+    mp_put_thumb(lu, s_thumb_url);
     return ESP_OK;
 }
 
-esp_err_t cloud_client_upload(const char *clip_name)
+/* Clip is closed: PUT every part S3 does not have yet — part 1 last, its
+ * header is the one byte range patched at close — then mp_complete.
+ * ESP_ERR_INVALID_STATE / ESP_ERR_NOT_FOUND: the journal no longer matches
+ * the file or S3; the upload has to start over. */
+static esp_err_t mp_finish(cloud_live_upload_t *lu)
 {
-    /* Step 1: get presigned PUT URLs */
-    esp_err_t err = get_presigned_urls(clip_name);
+    char path[128];
+    struct stat st;
+    snprintf(path, sizeof(path), "/sdcard/%s", lu->clip_file);
+    if (stat(path, &st) != 0 || st.st_size <= 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint32_t size  = (uint32_t)st.st_size;
+    uint32_t parts = (size + lu->part_size - 1) / lu->part_size;
+    if (parts > CLOUD_UPLOAD_PARTS_MAX ||
+        (parts < CLOUD_UPLOAD_PARTS_MAX && (lu->parts_done >> parts))) {
+        /* Parts past the end: the clip was cut back by a repair */
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!lu->thumb_done) {
+        mp_put_thumb(lu, NULL);
+    }
+
+    for (uint32_t n = 2; n <= parts + 1; n++) {
+        uint32_t part = n <= parts ? n : 1;
+        if (lu->parts_done & (1ull << (part - 1))) {
+            continue;
+        }
+        uint32_t off = (part - 1) * lu->part_size;
+        uint32_t len = size - off < lu->part_size ? size - off : lu->part_size;
+        esp_err_t err = mp_put_part(lu, part, len);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Part %"PRIu32"/%"PRIu32" of %s failed: %s",
+                     part, parts, lu->clip_file, esp_err_to_name(err));
+            return err;
+        }
+    }
+    esp_err_t err = mp_finish_request(lu, "mp_complete", parts);
     if (err != ESP_OK) {
         return err;
     }
+    lu->active = false;
+    journal_remove(lu->clip_file);
+    return ESP_OK;
+}
 
-    /* Step 2: upload clip */
+esp_err_t cloud_client_upload(const char *clip_file)
+{
     char clip_path[128];
-    snprintf(clip_path, sizeof(clip_path), "/sdcard/%s.avi", clip_name);
-    err = put_file_to_s3(clip_path, s_clip_url, "video/avi");
+    struct stat st;
+    snprintf(clip_path, sizeof(clip_path), "/sdcard/%s", clip_file);
+    if (stat(clip_path, &st) != 0) {
+        ESP_LOGE(TAG, "File not found: %s", clip_path);
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint32_t size = (uint32_t)st.st_size;
+
+    /* Multipart: pick up an interrupted upload, or start a resumable one
+     * for clips longer than one part */
+    static cloud_live_upload_t mp;
+    esp_err_t err;
+    if (journal_load(clip_file, &mp)) {
+        uint32_t had = parts_count(mp.parts_done);
+        ESP_LOGI(TAG, "Resuming upload of %s: %"PRIu32" of %"PRIu32" parts already on S3",
+                 clip_file, had, (size + mp.part_size - 1) / mp.part_size);
+        err = mp_finish(&mp);
+        if (err == ESP_OK) {
+            ESP_LOGI(TAG, "Resumed upload complete: %s — %"PRIu32" KB of %"PRIu32" KB sent",
+                     clip_file, mp.bytes_sent >> 10, size >> 10);
+            return ESP_OK;
+        }
+        if (err != ESP_ERR_INVALID_STATE && err != ESP_ERR_NOT_FOUND) {
+            return err;             /* journal kept — next attempt resumes */
+        }
+        ESP_LOGW(TAG, "Stored upload of %s no longer matches (%s) — starting over",
+                 clip_file, esp_err_to_name(err));
+        mp_finish_request(&mp, "mp_abort", 0);
+        journal_remove(clip_file);
+    }
+    if (size > CLOUD_LIVE_PART_MIN) {
+        uint32_t part_size = CLOUD_LIVE_PART_MIN;
+        while ((size + part_size - 1) / part_size > CLOUD_UPLOAD_PARTS_MAX) {
+            part_size *= 2;
+        }
+        err = mp_begin(&mp, clip_file, part_size);
+        return err == ESP_OK ? mp_finish(&mp) : err;
+    }
+
+    /* Step 1: get presigned PUT URLs */
+    err = get_presigned_urls(clip_file);
     if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Clip upload failed: %s", esp_err_to_name(err));
-        /* Continue to try thumbnail upload */
+        return err;
     }
 
-    /* Step 3: upload thumbnail */
+    /* Step 2: upload thumbnail — first, so it is in S3 when the clip's
+     * ObjectCreated event fires and the alert email can embed it */
     char thumb_path[128];
-    snprintf(thumb_path, sizeof(thumb_path), "/sdcard/%s_thumb.jpg", clip_name);
+    char base[96];
+    clip_base_name(clip_file, base, sizeof(base));
+    snprintf(thumb_path, sizeof(thumb_path), "/sdcard/%s_thumb.jpg", base);
     esp_err_t thumb_err = put_file_to_s3(thumb_path, s_thumb_url, "image/jpeg");
     if (thumb_err != ESP_OK) {
         ESP_LOGW(TAG, "Thumbnail upload failed: %s", esp_err_to_name(thumb_err));
     }
 
+    /* Step 3: upload clip */
+    err = put_file_to_s3(clip_path, s_clip_url, clip_content_type(clip_file));
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Clip upload failed: %s", esp_err_to_name(err));
+    }
+
     /* Clip upload status is the primary result.
      * Missing thumbnail is logged as a warning but doesn't fail the upload —
      * the S3 event trigger fires on the clip and the SES email still goes out. */
     return err;
 }
+
+esp_err_t cloud_client_upload_trace(const char *clip_file)
+{
+    char base[96];
+    clip_base_name(clip_file, base, sizeof(base));
+    char path[128];
+    snprintf(path, sizeof(path), "/sdcard/%s_trace.json", base);
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    char query[160];
+    snprintf(query, sizeof(query), "trace=%s_trace.json", base);
+    cJSON *root = NULL;
+    esp_err_t err = presign_request(query, &root);
+    if (err != ESP_OK) {
+        return err;
+    }
+    char url[PRESIGN_URL_LEN];
+    bool ok = json_get_string(root, "trace_url", url, sizeof(url));
+    cJSON_Delete(root);
+    if (!ok) {
+        return ESP_FAIL;
+    }
+    return put_file_to_s3(path, url, "application/json");
+}
+
+/* ── Live (multipart) upload ───────────────────────────────────────────── */
+
+esp_err_t cloud_client_live_begin(cloud_live_upload_t *lu, const char *clip_file,
+                                  uint32_t part_size)
+{
+    if (!lu || !clip_file || part_size < CLOUD_LIVE_PART_MIN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    /* The thumbnail is ready CONFIG_THUMB_WINDOW_MS into the clip — mp_begin
+     * sends it if it is there by now, else mp_finish does. Its arrival is
+     * what raises the alert for a multipart upload (notify Lambda). */
+    return mp_begin(lu, clip_file, part_size);
+}
+
+esp_err_t cloud_client_live_advance(cloud_live_upload_t *lu, uint32_t committed_bytes)
+{
+    if (!lu || !lu->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    while ((uint64_t)lu->next_part * lu->part_size <= committed_bytes) {
+        esp_err_t err = mp_put_part(lu, lu->next_part, lu->part_size);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Live part %"PRIu32" failed: %s", lu->next_part, esp_err_to_name(err));
+            return err;
+        }
+        lu->next_part++;
+    }
+    return ESP_OK;
+}
+
+esp_err_t cloud_client_live_finish(cloud_live_upload_t *lu)
+{
+    if (!lu || !lu->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint32_t live   = lu->next_part - 2;    /* parts already sent while recording */
+    uint32_t before = lu->bytes_sent;
+    int64_t t_start = esp_timer_get_time();
+
+    esp_err_t err = mp_finish(lu);
+    if (err != ESP_OK) {
+        return err;
+    }
+    ESP_LOGI(TAG, "Live upload complete: %s — %"PRIu32" parts sent while recording, "
+             "%"PRIu32" KB after close in %lld ms",
+             lu->clip_file, live, (lu->bytes_sent - before) >> 10,
+             (esp_timer_get_time() - t_start) / 1000);
+    return ESP_OK;
+}
+
+void cloud_client_live_detach(cloud_live_upload_t *lu)
+{
+    if (!lu || !lu->active) {
+        return;
+    }
+    ESP_LOGI(TAG, "Live upload of %s paused after %"PRIu32" parts — resumes at upload",
+             lu->clip_file, parts_count(lu->parts_done));
+    lu->active = false;
+}
+
+void cloud_client_live_abort(cloud_live_upload_t *lu)
+{
+    if (!lu || !lu->active) {
+        return;
+    }
+    if (mp_finish_request(lu, "mp_abort", 0) != ESP_OK) {
+        ESP_LOGW(TAG, "mp_abort failed for %s — S3 lifecycle will drop the parts",
+                 lu->clip_file);
+    }
+    journal_remove(lu->clip_file);
+    lu->active = false;
+}
+
+uint32_t cloud_client_get_upload_kbps(void)
+{
+    return s_upload_kbps;
+}
@@ -2,14 +2,38 @@
  * cloud_client.h — Upload clips and thumbnails to S3 via presigned PUT URLs
  *
  * Flow:
- *   1. GET CONFIG_LAMBDA_PRESIGN_URL?clip=<name>.avi&thumb=<name>_thumb.jpg
+ *   1. GET CONFIG_LAMBDA_PRESIGN_URL?clip=<name>.<ext>&thumb=<name>_thumb.jpg
  *      → JSON: { "clip_url": "...", "thumb_url": "..." }
- *   2. PUT /sdcard/<name>.avi  → clip_url
+ *   2. PUT /sdcard/<name>.<ext>  → clip_url   (ext: avi or mp4)
  *   3. PUT /sdcard/<name>_thumb.jpg → thumb_url
+ * A backlog can presign up to CLOUD_PRESIGN_BATCH_MAX clips in one GET
+ * (?clips=A.mp4,B.avi,...) with cloud_client_prefetch().
+ *
+ * The HTTPS connections to the Lambda and to S3 stay open between calls
+ * (keep-alive, TLS session resumption), so only the first upload of a
+ * backlog pays for full handshakes. All calls must come from one task.
+ *
+ * Live flow (clip still recording, S3 multipart upload):
+ *   cloud_client_live_begin()    mp_start → upload_id; thumbnail PUT, which
+ *                                raises the alert while the clip records
+ *   cloud_client_live_advance()  each time another part_size bytes are final
+ *                                on the card: PUT parts 2, 3, ...
+ *   cloud_client_live_finish()   after the clip is closed: PUT the tail parts,
+ *                                then part 1 (its header was patched at
+ *                                close), then mp_complete
+ *   cloud_client_live_detach()   on failure; cloud_client_upload() later
+ *                                resumes from the parts already sent
+ *
+ * Resume: clips longer than one part are always sent as multipart uploads.
+ * /sdcard/<name>.upj records the upload ID and the parts S3 confirmed;
+ * after a WiFi drop or reboot cloud_client_upload() re-sends only the
+ * missing parts. The journal is removed when the upload completes.
  */
 
 #pragma once
 
+#include <stdint.h>
+#include <stdbool.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
@@ -18,12 +42,96 @@ extern "C" {
 
 /**
  * @brief  Upload a clip and its thumbnail to S3.
- * @param  clip_name  Base name (no extension, no path).
- *                    Expects /sdcard/<clip_name>.avi and /sdcard/<clip_name>_thumb.jpg
- *                    to exist on the SD card.
+ * @param  clip_file  Clip file name with extension, no path ("<name>.avi" or
+ *                    "<name>.mp4"). Expects /sdcard/<clip_file> and
+ *                    /sdcard/<name>_thumb.jpg to exist on the SD card.
+ *         Clips over CLOUD_LIVE_PART_MIN go up as a multipart upload that a
+ *         later call resumes if this one fails part-way.
  * @return ESP_OK on success.
  */
-esp_err_t cloud_client_upload(const char *clip_name);
+esp_err_t cloud_client_upload(const char *clip_file);
+
+/**
+ * @brief  Upload the clip's latency sidecar /sdcard/<name>_trace.json
+ *         (trace_write_json()) to traces/ — its own presign round trip,
+ *         so call it after the clip is up.
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if the clip has no sidecar.
+ */
+esp_err_t cloud_client_upload_trace(const char *clip_file);
+
+#define CLOUD_PRESIGN_BATCH_MAX  8      /* clips per batch presign request */
+
+/**
+ * @brief  Fetch presigned URL pairs for several clips in one Lambda call.
+ *         cloud_client_upload() then uses them instead of a presign round
+ *         trip each, as long as they are well inside their expiry
+ *         (Lambda PUT_EXPIRY). Clips already cached are skipped, and so
+ *         are clips over CLOUD_LIVE_PART_MIN — they go up as multipart
+ *         uploads presigned per part. At most CLOUD_PRESIGN_BATCH_MAX are
+ *         fetched.
+ * @param  clip_files  File names with extension, no path.
+ * @return ESP_OK if URLs were cached (or nothing was missing).
+ */
+esp_err_t cloud_client_prefetch(const char *const *clip_files, size_t count);
+
+#define CLOUD_LIVE_PART_MIN   (5u * 1024 * 1024)   /* S3 minimum for all but the last part */
+#define CLOUD_UPLOAD_ID_LEN   256
+#define CLOUD_UPLOAD_PARTS_MAX 64                  /* parts_done bitmap width */
+
+/* One live clip upload. Owned by the caller (one upload task).
+ * Progress is mirrored to the clip's resume journal. */
+typedef struct {
+    char     clip_file[64];     /* "<name>.mp4" */
+    char     upload_id[CLOUD_UPLOAD_ID_LEN];
+    uint32_t part_size;         /* Bytes per part, ≥ CLOUD_LIVE_PART_MIN */
+    uint32_t next_part;         /* Next part to send from the growing file (≥ 2) */
+    uint32_t bytes_sent;
+    uint64_t parts_done;        /* Bit n-1 set: S3 accepted part n */
+    bool     thumb_done;
+    bool     active;            /* Multipart upload open on S3 */
+} cloud_live_upload_t;
+
+/**
+ * @brief  Start a multipart upload for a clip that is being recorded and
+ *         upload its thumbnail. lu is reset first.
+ * @param  clip_file  Clip file name with extension, no path.
+ * @param  part_size  Bytes per part (≥ CLOUD_LIVE_PART_MIN).
+ * @return ESP_OK with lu->active set.
+ */
+esp_err_t cloud_client_live_begin(cloud_live_upload_t *lu, const char *clip_file,
+                                  uint32_t part_size);
+
+/**
+ * @brief  Upload every whole part below committed_bytes not sent yet.
+ *         Blocks for the duration of the PUTs.
+ * @param  committed_bytes  File length that will not change any more
+ *                          (except the header in part 1).
+ */
+esp_err_t cloud_client_live_advance(cloud_live_upload_t *lu, uint32_t committed_bytes);
+
+/**
+ * @brief  After the clip is closed: upload the remaining parts and part 1,
+ *         then complete the multipart upload (S3 then fires the notify Lambda).
+ */
+esp_err_t cloud_client_live_finish(cloud_live_upload_t *lu);
+
+/**
+ * @brief  Stop driving the live upload without aborting it. The journal
+ *         stays on SD; cloud_client_upload() resumes from it.
+ */
+void cloud_client_live_detach(cloud_live_upload_t *lu);
+
+/**
+ * @brief  Abandon the multipart upload and delete its journal (best effort;
+ *         the bucket lifecycle drops incomplete uploads after a day anyway).
+ */
+void cloud_client_live_abort(cloud_live_upload_t *lu);
+
+/**
+ * @brief  Recent upload throughput in KB/s (averaged over the last few PUT
+ *         bodies of 64 KB and up, throttled time excluded), 0 = not known yet.
+ */
+uint32_t cloud_client_get_upload_kbps(void);
 
 #ifdef __cplusplus
 }
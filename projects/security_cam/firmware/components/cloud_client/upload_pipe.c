@@ -0,0 +1,216 @@
+/*
+ * upload_pipe.c — SD read-ahead for S3 PUT bodies
+ *
+ * Three FreeRTOS queues:
+ *   job_q   — transfers for the reader (FILE + length), one at a time
+ *   free_q  — indices of empty buffers (reader takes, sender returns)
+ *   full_q  — filled chunks in file order, then one END item per transfer
+ * full_q holds buf_count + 1 items, so the reader never blocks posting.
+ *
+ * Each read first asks sdcard_io for its turn, so a recording in progress
+ * keeps the card.
+ *
+ * Every transfer ends with exactly one END item, whether the file was read
+ * to len, a read failed, or the sender called stop early. stop drains
+ * full_q up to it, so afterwards all buffers are free and the reader is
+ * back waiting on job_q.
+ */
+
+#include "upload_pipe.h"
+#include "sdcard.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+static const char *TAG = "upload_pipe";
+
+#define READER_STACK 4096
+#define IDX_END      UINT32_MAX     /* full_q: transfer finished */
+
+typedef struct {
+    FILE    *f;
+    uint32_t len;
+} job_t;
+
+typedef struct {
+    uint32_t idx;                   /* buffer, or IDX_END */
+    int32_t  len;                   /* bytes, -1 = read error */
+} chunk_t;
+
+struct upload_pipe_t {
+    uint8_t      *arena;            /* buf_count × buf_size, PSRAM */
+    uint32_t      buf_count;
+    size_t        buf_size;
+    QueueHandle_t job_q;
+    QueueHandle_t free_q;
+    QueueHandle_t full_q;
+    volatile bool abort;
+    bool          ended;            /* END item already received */
+    uint32_t      held;             /* buffer the sender has, or IDX_END */
+    upload_pipe_stats_t stats;
+};
+
+static void reader_task(void *arg)
+{
+    upload_pipe_t *p = arg;
+    job_t job;
+
+    while (1) {
+        if (xQueueReceive(p->job_q, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        uint32_t remaining = job.len;
+        while (remaining > 0 && !p->abort) {
+            chunk_t c;
+            int64_t t0 = esp_timer_get_time();
+            xQueueReceive(p->free_q, &c.idx, portMAX_DELAY);
+            int64_t t1 = esp_timer_get_time();
+            p->stats.free_wait_ms += (uint32_t)((t1 - t0) / 1000);
+            if (p->abort) {
+                xQueueSend(p->free_q, &c.idx, 0);
+                break;
+            }
+
+            size_t want = remaining < p->buf_size ? remaining : p->buf_size;
+            p->stats.throttle_ms += sdcard_io_background_wait(want);  /* recording first */
+            t1 = esp_timer_get_time();
+            size_t n = fread(p->arena + (size_t)c.idx * p->buf_size, 1, want, job.f);
+            p->stats.read_ms += (uint32_t)((esp_timer_get_time() - t1) / 1000);
+            if (n == 0) {
+                c.len = -1;
+                xQueueSend(p->full_q, &c, portMAX_DELAY);
+                break;
+            }
+            c.len = (int32_t)n;
+            xQueueSend(p->full_q, &c, portMAX_DELAY);
+            remaining -= n;
+        }
+        chunk_t end = { .idx = IDX_END, .len = 0 };
+        xQueueSend(p->full_q, &end, portMAX_DELAY);
+    }
+}
+
+upload_pipe_t *upload_pipe_create(uint32_t buf_count, size_t buf_size, uint32_t priority)
+{
+    if (buf_count == 0 || buf_size == 0) {
+        return NULL;
+    }
+
+    upload_pipe_t *p = calloc(1, sizeof(*p));
+    if (!p) {
+        ESP_LOGE(TAG, "Out of heap for upload pipe struct");
+        return NULL;
+    }
+    p->buf_count = buf_count;
+    p->buf_size  = buf_size;
+    p->held      = IDX_END;
+    p->ended     = true;
+
+    p->arena  = heap_caps_malloc(buf_size * buf_count, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    p->job_q  = xQueueCreate(1, sizeof(job_t));
+    p->free_q = xQueueCreate(buf_count, sizeof(uint32_t));
+    p->full_q = xQueueCreate(buf_count + 1, sizeof(chunk_t));
+    if (!p->arena || !p->job_q || !p->free_q || !p->full_q) {
+        ESP_LOGE(TAG, "Cannot allocate upload pipe (%"PRIu32" × %u B)",
+                 buf_count, (unsigned)buf_size);
+        goto fail;
+    }
+    for (uint32_t i = 0; i < buf_count; i++) {
+        xQueueSend(p->free_q, &i, 0);
+    }
+
+    if (xTaskCreatePinnedToCore(reader_task, "upload_rd", READER_STACK, p, priority, NULL,
+                                CONFIG_TASK_NET_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Cannot start reader task");
+        goto fail;
+    }
+
+    ESP_LOGI(TAG, "Reader task: %"PRIu32" buffers × %u KB PSRAM",
+             buf_count, (unsigned)(buf_size >> 10));
+    return p;
+
+fail:
+    if (p->job_q)  vQueueDelete(p->job_q);
+    if (p->free_q) vQueueDelete(p->free_q);
+    if (p->full_q) vQueueDelete(p->full_q);
+    heap_caps_free(p->arena);
+    free(p);
+    return NULL;
+}
+
+esp_err_t upload_pipe_start(upload_pipe_t *p, FILE *f, uint32_t len)
+{
+    if (!p || !f || !p->ended) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    memset(&p->stats, 0, sizeof(p->stats));
+    p->abort = false;
+    p->ended = false;
+    job_t job = { .f = f, .len = len };
+    xQueueSend(p->job_q, &job, portMAX_DELAY);
+    return ESP_OK;
+}
+
+static void release_held(upload_pipe_t *p)
+{
+    if (p->held != IDX_END) {
+        xQueueSend(p->free_q, &p->held, portMAX_DELAY);
+        p->held = IDX_END;
+    }
+}
+
+int upload_pipe_next(upload_pipe_t *p, const uint8_t **data)
+{
+    release_held(p);
+    if (p->ended) {
+        return 0;
+    }
+
+    chunk_t c;
+    int64_t t0 = esp_timer_get_time();
+    xQueueReceive(p->full_q, &c, portMAX_DELAY);
+    p->stats.data_wait_ms += (uint32_t)((esp_timer_get_time() - t0) / 1000);
+    if (c.idx == IDX_END) {
+        p->ended = true;
+        return 0;
+    }
+    p->held = c.idx;
+    if (c.len < 0) {
+        return -1;
+    }
+    p->stats.chunks++;
+    *data = p->arena + (size_t)c.idx * p->buf_size;
+    return c.len;
+}
+
+void upload_pipe_stop(upload_pipe_t *p)
+{
+    if (!p) {
+        return;
+    }
+    release_held(p);
+    p->abort = true;
+    while (!p->ended) {
+        chunk_t c;
+        xQueueReceive(p->full_q, &c, portMAX_DELAY);
+        if (c.idx == IDX_END) {
+            p->ended = true;
+        } else {
+            xQueueSend(p->free_q, &c.idx, portMAX_DELAY);
+        }
+    }
+}
+
+void upload_pipe_get_stats(const upload_pipe_t *p, upload_pipe_stats_t *out)
+{
+    if (!p || !out) {
+        return;
+    }
+    *out = p->stats;
+}
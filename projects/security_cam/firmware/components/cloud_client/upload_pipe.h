@@ -0,0 +1,70 @@
+/*
+ * upload_pipe.h — SD read-ahead for S3 PUT bodies
+ *
+ * Internal to cloud_client component.
+ * A reader task fills PSRAM buffers from the open file while the upload
+ * task sends the previous buffer over TCP, so SD reads and WiFi sends
+ * overlap instead of alternating. With one buffer the reader and the
+ * sender take turns, which is the old fread → write loop.
+ *
+ * Memory layout:
+ *   One PSRAM arena of buf_count × buf_size bytes, allocated once at create.
+ *   Free buffer indices circulate through a FreeRTOS queue; filled chunks
+ *   (index + length) through a second one, in file order.
+ *
+ * One transfer at a time: start → next/release … → stop. The FILE is only
+ * touched by the reader between start and stop.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct upload_pipe_t upload_pipe_t;
+
+typedef struct {
+    uint32_t chunks;            /* Buffers sent */
+    uint32_t data_wait_ms;      /* Sender waited for the card */
+    uint32_t free_wait_ms;      /* Reader waited for the network */
+    uint32_t read_ms;           /* Time inside fread */
+    uint32_t throttle_ms;       /* Held back by sdcard_io (recording, rate cap) */
+} upload_pipe_stats_t;
+
+/**
+ * @brief  Allocate the buffers and start the reader task.
+ * @return Handle on success, NULL on error.
+ */
+upload_pipe_t *upload_pipe_create(uint32_t buf_count, size_t buf_size, uint32_t priority);
+
+/**
+ * @brief  Start reading len bytes from f's current position. Resets stats.
+ */
+esp_err_t upload_pipe_start(upload_pipe_t *p, FILE *f, uint32_t len);
+
+/**
+ * @brief  Wait for the next chunk in file order. Releases the previous one.
+ * @return Bytes in *data, 0 once len bytes have been delivered,
+ *         -1 on a read error (short file, card error).
+ */
+int upload_pipe_next(upload_pipe_t *p, const uint8_t **data);
+
+/**
+ * @brief  End the transfer, complete or not. Returns once the reader is
+ *         idle and no longer touches the FILE.
+ */
+void upload_pipe_stop(upload_pipe_t *p);
+
+/**
+ * @brief  Counters of the current (or last) transfer.
+ */
+void upload_pipe_get_stats(const upload_pipe_t *p, upload_pipe_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
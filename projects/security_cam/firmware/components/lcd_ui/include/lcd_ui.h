@@ -14,8 +14,10 @@ extern "C" {
 #endif
 
 /**
- * @brief Initialise SPI bus, ST7789V panel, backlight GPIO, and start the
- *        refresh task. Must be called after the SD card is mounted.
+ * @brief Initialise the backlight GPIO and start the refresh task, which
+ *        brings up the SPI bus and ST7789V panel in the background.
+ *        Returns without waiting for the panel. Must be called after the
+ *        SD card is mounted.
  */
 esp_err_t lcd_ui_init(void);
 
@@ -43,11 +45,6 @@ void lcd_ui_notify_recording(bool recording, uint32_t elapsed_s);
  */
 void lcd_ui_notify_uploading(bool uploading, const char *clip_name);
 
-/**
- * @brief Increment the session "Done" counter (called after each successful upload).
- */
-void lcd_ui_inc_uploaded(void);
-
 #ifdef __cplusplus
 }
 #endif
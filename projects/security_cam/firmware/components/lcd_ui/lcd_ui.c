@@ -14,6 +14,12 @@
  *   y=120  "Free:    X.X GB"  white
  *   y=145  "Pending: N"       white
  *   y=170  "Done:    N"       white
+ *
+ * Rendering: the refresh task sleeps until a notify_* call, the screen
+ * toggle or clip_catalog reports a change. Each line remembers what is on
+ * the panel; only the span of cells that differ is rendered into an
+ * off-screen buffer and sent as one rectangle (a single DMA transfer).
+ * A recording second tick is a 2-cell update, an idle screen sends nothing.
  */
 
 #include "lcd_ui.h"
@@ -22,15 +28,15 @@
 #include <string.h>
 #include <stdio.h>
 #include <inttypes.h>
-#include <dirent.h>
 
-#include "esp_vfs_fat.h"
+#include "clip_catalog.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 #include "esp_lcd_panel_io.h"
 #include "esp_lcd_panel_vendor.h"
 #include "esp_lcd_panel_ops.h"
@@ -65,7 +71,6 @@ typedef struct {
     uint32_t elapsed_s;
     bool     uploading;
     char     clip_name[64];
-    uint32_t done_count;
 } ui_state_t;
 
 static ui_state_t  g_state;
@@ -73,142 +78,222 @@ static SemaphoreHandle_t g_mutex;
 static volatile bool  g_screen_on   = true;
 static volatile bool  g_needs_clear = false;  /* set by set_screen_on, cleared by refresh_task */
 static esp_lcd_panel_handle_t g_panel;
+static TaskHandle_t   g_task;                 /* refresh_task — woken on state changes */
+
+/* ── Text lines ─────────────────────────────────────────────────────────── */
 
-/* SD stats — written by sd_stats_task, read by refresh_task.
- * Both are floats/ints; no mutex needed (torn reads are harmless here). */
-static volatile float g_sd_free_gb  = -1.0f;
-static volatile int   g_sd_pending  = -1;
+/* Each line owns a fixed run of character cells; what is on the panel is
+ * kept per line so a redraw only sends the cells that changed. */
+#define LINE_MAX_CHARS  20
 
-/* ── Low-level pixel buffer helpers ─────────────────────────────────────── */
+typedef struct {
+    int16_t  x, y;
+    uint8_t  scale;                     /* 1 → 8×16, 2 → 16×32 */
+    uint8_t  chars;                     /* cells owned, padded with blanks */
+    bool     drawn;                     /* text/fg match the panel */
+    uint16_t fg;
+    char     text[LINE_MAX_CHARS + 1];
+} text_line_t;
+
+enum { LINE_STATE, LINE_UPLOAD, LINE_FREE, LINE_PENDING, LINE_DONE, LINE_COUNT };
+
+static text_line_t g_lines[LINE_COUNT] = {
+    [LINE_STATE]   = { .x = 4, .y = 20,  .scale = 2, .chars = 12 },
+    [LINE_UPLOAD]  = { .x = 4, .y = 80,  .scale = 1, .chars = 20 },
+    [LINE_FREE]    = { .x = 4, .y = 120, .scale = 1, .chars = 20 },
+    [LINE_PENDING] = { .x = 4, .y = 145, .scale = 1, .chars = 20 },
+    [LINE_DONE]    = { .x = 4, .y = 170, .scale = 1, .chars = 20 },
+};
+
+/* ── Off-screen buffer ──────────────────────────────────────────────────── */
+
+/* Large enough for the widest line at its scale (12 cells of 16×32), and
+ * a strip of LINE_BUF_PX / LCD_WIDTH rows for a full clear. Every region
+ * goes out as one draw_bitmap — one colour DMA transfer. */
+#define LINE_BUF_PX     (12 * 16 * 32)
+
+static uint16_t          *g_buf;        /* DMA-capable, big-endian RGB565 */
+static SemaphoreHandle_t  g_dma_done;   /* given when g_buf may be reused */
+
+static bool on_color_done(esp_lcd_panel_io_handle_t io,
+                          esp_lcd_panel_io_event_data_t *edata, void *ctx)
+{
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(g_dma_done, &woken);
+    return woken == pdTRUE;
+}
 
-/* Fill a rectangular area with a solid colour (RGB565 big-endian on-wire).
- * Draws one row at a time — draw_bitmap expects a buffer sized for exactly
- * the rectangle passed; sending a single row for a tall rect would DMA past
- * the end of the array. */
-static void fill_rect(int x, int y, int w, int h, uint16_t colour)
+/* Send g_buf to the rectangle and wait for the transfer — the buffer is
+ * read by DMA after draw_bitmap returns */
+static void push(int x0, int y0, int x1, int y1)
 {
-    uint16_t row[LCD_WIDTH];
-    uint16_t be = (colour >> 8) | (colour << 8);
-    for (int i = 0; i < w; i++) row[i] = be;
-    for (int ry = y; ry < y + h; ry++) {
-        esp_lcd_panel_draw_bitmap(g_panel, x, ry, x + w, ry + 1, row);
+    if (esp_lcd_panel_draw_bitmap(g_panel, x0, y0, x1, y1, g_buf) == ESP_OK) {
+        xSemaphoreTake(g_dma_done, portMAX_DELAY);
     }
 }
 
-/*
- * Draw one character glyph at pixel position (px, py).
- * scale=1 → 8×16, scale=2 → 16×32.
- * fg/bg are RGB565.
- */
-static void draw_char(int px, int py, char c, int scale,
-                      uint16_t fg, uint16_t bg)
+static inline uint16_t to_be(uint16_t colour)
 {
-    uint16_t fg_be = (fg >> 8) | (fg << 8);
-    uint16_t bg_be = (bg >> 8) | (bg << 8);
+    return (uint16_t)((colour >> 8) | (colour << 8));
+}
 
-    const uint8_t *glyph = font8x16[(uint8_t)c];
+/* Fill the whole screen, LINE_BUF_PX / LCD_WIDTH rows per transfer */
+static void clear_screen(uint16_t colour)
+{
+    const int rows = LINE_BUF_PX / LCD_WIDTH;
+    uint16_t be = to_be(colour);
+    for (int i = 0; i < rows * LCD_WIDTH; i++) g_buf[i] = be;
+    for (int y = 0; y < LCD_HEIGHT; y += rows) {
+        int y1 = y + rows < LCD_HEIGHT ? y + rows : LCD_HEIGHT;
+        push(0, y, LCD_WIDTH, y1);
+    }
+    for (int i = 0; i < LINE_COUNT; i++) {
+        g_lines[i].drawn = false;
+    }
+}
+
+/* Render cells [c0, c1) of text into g_buf as one w×h bitmap */
+static void render_cells(const text_line_t *l, const char *text, int c0, int c1,
+                         uint16_t fg, uint16_t bg)
+{
+    const int gw = 8 * l->scale;
+    const int w  = (c1 - c0) * gw;
+    uint16_t fg_be = to_be(fg), bg_be = to_be(bg);
 
     for (int row = 0; row < 16; row++) {
-        uint8_t bits = glyph[row];
-        /* Build one (scaled) row of pixels */
-        uint16_t line[16]; /* max 8×2 = 16 pixels */
-        for (int col = 0; col < 8; col++) {
-            uint16_t pix = (bits & (0x80 >> col)) ? fg_be : bg_be;
-            for (int s = 0; s < scale; s++) {
-                line[col * scale + s] = pix;
+        uint16_t *dst = g_buf + row * l->scale * w;
+        for (int c = c0; c < c1; c++) {
+            uint8_t bits = font8x16[(uint8_t)text[c]][row];
+            for (int col = 0; col < 8; col++) {
+                uint16_t pix = (bits & (0x80 >> col)) ? fg_be : bg_be;
+                for (int s = 0; s < l->scale; s++) {
+                    *dst++ = pix;
+                }
             }
         }
-        for (int sr = 0; sr < scale; sr++) {
-            esp_lcd_panel_draw_bitmap(g_panel,
-                                      px, py + row * scale + sr,
-                                      px + 8 * scale,
-                                      py + row * scale + sr + 1,
-                                      line);
+        /* Vertical scaling: repeat the row just built */
+        for (int sr = 1; sr < l->scale; sr++) {
+            memcpy(g_buf + (row * l->scale + sr) * w, g_buf + row * l->scale * w,
+                   (size_t)w * sizeof(uint16_t));
         }
     }
 }
 
-/* Draw a NUL-terminated string; returns x after last glyph. */
-static int draw_string(int px, int py, const char *s, int scale,
-                       uint16_t fg, uint16_t bg)
+/* Bring a line to text/fg: the changed cells, first to last, go out as one
+ * rectangle; an unchanged line costs nothing */
+static void set_line(int id, const char *text, uint16_t fg)
 {
-    while (*s) {
-        draw_char(px, py, *s, scale, fg, bg);
-        px += 8 * scale;
-        s++;
+    text_line_t *l = &g_lines[id];
+    char want[LINE_MAX_CHARS + 1];
+    int n = (int)strlen(text);
+    if (n > l->chars) n = l->chars;
+    memcpy(want, text, (size_t)n);
+    memset(want + n, ' ', (size_t)(l->chars - n));
+    want[l->chars] = '\0';
+
+    int c0 = 0, c1 = l->chars;
+    if (l->drawn && l->fg == fg) {
+        while (c0 < c1 && want[c0] == l->text[c0]) c0++;
+        while (c1 > c0 && want[c1 - 1] == l->text[c1 - 1]) c1--;
+        if (c0 == c1) {
+            return;
+        }
     }
-    return px;
+    render_cells(l, want, c0, c1, fg, COL_BLACK);
+    const int gw = 8 * l->scale;
+    push(l->x + c0 * gw, l->y, l->x + c1 * gw, l->y + 16 * l->scale);
+
+    memcpy(l->text, want, sizeof(want));
+    l->fg    = fg;
+    l->drawn = true;
 }
 
-/*
- * Draw a string and then blank-pad the rest of the row area up to
- * max_chars (so leftover characters from longer previous strings disappear).
- */
-static void draw_string_padded(int px, int py, const char *s, int scale,
-                               uint16_t fg, uint16_t bg, int max_chars)
+static void wake_refresh(void)
 {
-    int x = draw_string(px, py, s, scale, fg, bg);
-    int glyph_w = 8 * scale;
-    int written = (int)(x - px) / glyph_w;
-    for (int i = written; i < max_chars; i++) {
-        draw_char(px + i * glyph_w, py, ' ', scale, fg, bg);
+    if (g_task) {
+        xTaskNotifyGive(g_task);
     }
 }
 
-/* ── SD card queries ────────────────────────────────────────────────────── */
-
-static float sd_free_gb(void)
+/* clip_catalog change callback — writer / upload task */
+static void on_catalog_change(void *ctx)
 {
-    uint64_t total_bytes = 0, free_bytes = 0;
-    if (esp_vfs_fat_info("/sdcard", &total_bytes, &free_bytes) != ESP_OK) return -1.0f;
-    return (float)free_bytes / (1024.0f * 1024.0f * 1024.0f);
+    wake_refresh();
 }
 
-static int sd_pending_count(void)
+/* ── Refresh task ───────────────────────────────────────────────────────── */
+
+/* SPI bus and ST7789V bring-up (~150 ms of reset and init delays) — run
+ * on the refresh task so lcd_ui_init() does not hold up the camera */
+static void panel_init(void)
 {
-    DIR *d = opendir("/sdcard");
-    if (!d) return -1;
-    int n = 0;
-    struct dirent *e;
-    while ((e = readdir(d)) != NULL) {
-        size_t len = strlen(e->d_name);
-        if (len > 4 && strcmp(e->d_name + len - 4, ".avi") == 0) n++;
-    }
-    closedir(d);
-    return n;
-}
+    g_buf = heap_caps_malloc(LINE_BUF_PX * sizeof(uint16_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    ESP_ERROR_CHECK(g_buf ? ESP_OK : ESP_ERR_NO_MEM);
+
+    /* SPI bus */
+    spi_bus_config_t buscfg = {
+        .mosi_io_num   = LCD_MOSI,
+        .miso_io_num   = -1,
+        .sclk_io_num   = LCD_SCK,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = LINE_BUF_PX * sizeof(uint16_t),
+    };
+    ESP_ERROR_CHECK(spi_bus_initialize(LCD_HOST, &buscfg, SPI_DMA_CH_AUTO));
 
-/* ── SD stats task (separate from refresh — f_getfree blocks for seconds) ── */
+    /* LCD IO handle (SPI panel IO) */
+    esp_lcd_panel_io_handle_t io_handle;
+    esp_lcd_panel_io_spi_config_t io_cfg = {
+        .dc_gpio_num       = LCD_DC,
+        .cs_gpio_num       = LCD_CS,
+        .pclk_hz           = LCD_CLK_HZ,
+        .lcd_cmd_bits      = 8,
+        .lcd_param_bits    = 8,
+        .spi_mode          = 0,
+        .trans_queue_depth = 10,
+        .on_color_trans_done = on_color_done,
+    };
+    ESP_ERROR_CHECK(esp_lcd_new_panel_io_spi((esp_lcd_spi_bus_handle_t)LCD_HOST,
+                                              &io_cfg, &io_handle));
 
-static void sd_stats_task(void *arg)
-{
-    /* Stagger start so the initial FAT scan doesn't race with boot activity */
-    vTaskDelay(pdMS_TO_TICKS(3000));
-    while (1) {
-        g_sd_free_gb = sd_free_gb();
-        g_sd_pending = sd_pending_count();
-        vTaskDelay(pdMS_TO_TICKS(5000));
-    }
-}
+    /* ST7789V panel */
+    esp_lcd_panel_dev_config_t panel_cfg = {
+        .reset_gpio_num = LCD_RST,
+        .rgb_ele_order  = LCD_RGB_ELEMENT_ORDER_RGB,
+        .bits_per_pixel = 16,
+    };
+    ESP_ERROR_CHECK(esp_lcd_new_panel_st7789(io_handle, &panel_cfg, &g_panel));
 
-/* ── Refresh task ───────────────────────────────────────────────────────── */
+    ESP_ERROR_CHECK(esp_lcd_panel_reset(g_panel));
+    ESP_ERROR_CHECK(esp_lcd_panel_init(g_panel));
+    ESP_ERROR_CHECK(esp_lcd_panel_invert_color(g_panel, true));  /* ST7789V needs inversion */
+    ESP_ERROR_CHECK(esp_lcd_panel_set_gap(g_panel, 0, 0));
+    ESP_ERROR_CHECK(esp_lcd_panel_disp_on_off(g_panel, true));
+
+    ESP_LOGI(TAG, "ST7789V ready");
+}
 
 static void refresh_task(void *arg)
 {
+    panel_init();
+
     /* Initial clear — safe here because no other task touches the LCD yet */
-    fill_rect(0, 0, LCD_WIDTH, LCD_HEIGHT, COL_BLACK);
+    clear_screen(COL_BLACK);
 
-    bool prev_uploading = false;
+    /* Sleep until a notify_* call, the screen toggle or the catalog reports
+     * a change; the first pass draws everything. Nothing changed → no
+     * wake-up, no SPI. */
+    xTaskNotifyGive(xTaskGetCurrentTaskHandle());
 
     while (1) {
-        vTaskDelay(pdMS_TO_TICKS(250));
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
         if (!g_screen_on) continue;
 
         /* Screen just turned back on — full clear before redrawing */
         if (g_needs_clear) {
             g_needs_clear = false;
-            fill_rect(0, 0, LCD_WIDTH, LCD_HEIGHT, COL_BLACK);
+            clear_screen(COL_BLACK);
         }
 
         ui_state_t s;
@@ -228,38 +313,32 @@ static void refresh_task(void *arg)
             snprintf(state_buf, sizeof(state_buf), "WATCHING");
             state_col = COL_YELLOW;
         }
-        draw_string_padded(4, 20, state_buf, 2, state_col, COL_BLACK, 12);
+        set_line(LINE_STATE, state_buf, state_col);
 
         /* ── Upload line (1× font, y=80) ────────────────────────────────── */
-        if (s.uploading != prev_uploading || s.uploading) {
-            if (s.uploading) {
-                draw_string_padded(4, 80, "Uploading...", 1, COL_CYAN, COL_BLACK, 20);
-            } else {
-                fill_rect(4, 80, LCD_WIDTH - 4, 16, COL_BLACK);
-            }
-            prev_uploading = s.uploading;
-        }
+        set_line(LINE_UPLOAD, s.uploading ? "Uploading..." : "", COL_CYAN);
 
-        /* ── SD stats — read from cache updated by sd_stats_task ────────── */
-        float  sd_free    = g_sd_free_gb;
-        int    sd_pending = g_sd_pending;
+        /* ── SD stats — clip_catalog keeps them, no card access here ────── */
+        clip_catalog_stats_t cat;
+        clip_catalog_get(&cat);
 
         char buf[28];
 
-        if (sd_free >= 0)
-            snprintf(buf, sizeof(buf), "Free:    %.1f GB", sd_free);
+        if (cat.valid)
+            snprintf(buf, sizeof(buf), "Free:    %.1f GB",
+                     (double)cat.free_bytes / (1024.0 * 1024.0 * 1024.0));
         else
             snprintf(buf, sizeof(buf), "Free:    ---");
-        draw_string_padded(4, 120, buf, 1, COL_WHITE, COL_BLACK, 20);
+        set_line(LINE_FREE, buf, COL_WHITE);
 
-        if (sd_pending >= 0)
-            snprintf(buf, sizeof(buf), "Pending: %d", sd_pending);
+        if (cat.valid)
+            snprintf(buf, sizeof(buf), "Pending: %u", (unsigned)cat.pending);
         else
             snprintf(buf, sizeof(buf), "Pending: ---");
-        draw_string_padded(4, 145, buf, 1, COL_WHITE, COL_BLACK, 20);
+        set_line(LINE_PENDING, buf, COL_WHITE);
 
-        snprintf(buf, sizeof(buf), "Done:    %u", (unsigned)s.done_count);
-        draw_string_padded(4, 170, buf, 1, COL_WHITE, COL_BLACK, 20);
+        snprintf(buf, sizeof(buf), "Done:    %u", (unsigned)cat.uploaded);
+        set_line(LINE_DONE, buf, COL_WHITE);
     }
 }
 
@@ -280,62 +359,26 @@ esp_err_t lcd_ui_init(void)
     ESP_ERROR_CHECK(gpio_config(&bl_cfg));
     gpio_set_level(LCD_BL, 0);  /* GPIO48 is active-low — 0 = backlight ON */
 
-    /* SPI bus */
-    spi_bus_config_t buscfg = {
-        .mosi_io_num   = LCD_MOSI,
-        .miso_io_num   = -1,
-        .sclk_io_num   = LCD_SCK,
-        .quadwp_io_num = -1,
-        .quadhd_io_num = -1,
-        .max_transfer_sz = LCD_WIDTH * 2 + 8,
-    };
-    ESP_ERROR_CHECK(spi_bus_initialize(LCD_HOST, &buscfg, SPI_DMA_CH_AUTO));
-
-    /* LCD IO handle (SPI panel IO) */
-    esp_lcd_panel_io_handle_t io_handle;
-    esp_lcd_panel_io_spi_config_t io_cfg = {
-        .dc_gpio_num       = LCD_DC,
-        .cs_gpio_num       = LCD_CS,
-        .pclk_hz           = LCD_CLK_HZ,
-        .lcd_cmd_bits      = 8,
-        .lcd_param_bits    = 8,
-        .spi_mode          = 0,
-        .trans_queue_depth = 10,
-    };
-    ESP_ERROR_CHECK(esp_lcd_new_panel_io_spi((esp_lcd_spi_bus_handle_t)LCD_HOST,
-                                              &io_cfg, &io_handle));
-
-    /* ST7789V panel */
-    esp_lcd_panel_dev_config_t panel_cfg = {
-        .reset_gpio_num = LCD_RST,
-        .rgb_ele_order  = LCD_RGB_ELEMENT_ORDER_RGB,
-        .bits_per_pixel = 16,
-    };
-    ESP_ERROR_CHECK(esp_lcd_new_panel_st7789(io_handle, &panel_cfg, &g_panel));
+    g_dma_done = xSemaphoreCreateBinary();
+    if (!g_dma_done) return ESP_ERR_NO_MEM;
 
-    ESP_ERROR_CHECK(esp_lcd_panel_reset(g_panel));
-    ESP_ERROR_CHECK(esp_lcd_panel_init(g_panel));
-    ESP_ERROR_CHECK(esp_lcd_panel_invert_color(g_panel, true));  /* ST7789V needs inversion */
-    ESP_ERROR_CHECK(esp_lcd_panel_set_gap(g_panel, 0, 0));
-    ESP_ERROR_CHECK(esp_lcd_panel_disp_on_off(g_panel, true));
-
-    xTaskCreate(refresh_task,  "lcd_ui",    4096, NULL, 3, NULL);
-    xTaskCreate(sd_stats_task, "lcd_sd",    2048, NULL, 2, NULL);
-
-    ESP_LOGI(TAG, "ST7789V ready");
+    /* Panel bring-up continues on the refresh task */
+    xTaskCreatePinnedToCore(refresh_task, "lcd_ui", 4096, NULL, 3, &g_task, CONFIG_TASK_NET_CORE);
+    clip_catalog_set_change_cb(on_catalog_change, NULL);
     return ESP_OK;
 }
 
 void lcd_ui_set_screen_on(bool on)
 {
     if (on && !g_screen_on) {
-        /* Ask refresh_task to do a full clear on next cycle before drawing.
-         * Never call fill_rect() here — only refresh_task owns the SPI bus. */
+        /* Ask refresh_task to do a full clear before drawing.
+         * Never draw here — only refresh_task owns the SPI bus. */
         g_needs_clear = true;
     }
     g_screen_on = on;
     gpio_set_level(LCD_BL, on ? 0 : 1);  /* GPIO48 is active-low */
     ESP_LOGI(TAG, "Screen %s", on ? "ON" : "OFF");
+    wake_refresh();
 }
 
 bool lcd_ui_get_screen_on(void)
@@ -345,15 +388,24 @@ bool lcd_ui_get_screen_on(void)
 
 void lcd_ui_notify_recording(bool recording, uint32_t elapsed_s)
 {
+    if (!recording) {
+        elapsed_s = 0;
+    }
     xSemaphoreTake(g_mutex, portMAX_DELAY);
+    /* Called for every recorded frame — wake only when the second ticks */
+    bool changed = g_state.recording != recording || g_state.elapsed_s != elapsed_s;
     g_state.recording = recording;
     g_state.elapsed_s = elapsed_s;
     xSemaphoreGive(g_mutex);
+    if (changed) {
+        wake_refresh();
+    }
 }
 
 void lcd_ui_notify_uploading(bool uploading, const char *clip_name)
 {
     xSemaphoreTake(g_mutex, portMAX_DELAY);
+    bool changed = g_state.uploading != uploading;
     g_state.uploading = uploading;
     if (clip_name) {
         strlcpy(g_state.clip_name, clip_name, sizeof(g_state.clip_name));
@@ -361,11 +413,7 @@ void lcd_ui_notify_uploading(bool uploading, const char *clip_name)
         g_state.clip_name[0] = '\0';
     }
     xSemaphoreGive(g_mutex);
-}
-
-void lcd_ui_inc_uploaded(void)
-{
-    xSemaphoreTake(g_mutex, portMAX_DELAY);
-    g_state.done_count++;
-    xSemaphoreGive(g_mutex);
+    if (changed) {
+        wake_refresh();
+    }
 }
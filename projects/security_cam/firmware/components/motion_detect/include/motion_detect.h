@@ -4,9 +4,29 @@
  * Pure algorithm — no hardware knowledge. Works on any cam_frame_t
  * with CAM_PIXFMT_GRAY8 format.
  *
- * Algorithm: compare consecutive grayscale frames pixel-by-pixel,
- * count pixels where |new - old| > pixel_threshold,
- * return the count as the motion score.
+ * Two algorithms (motion_detect_config_t.algo):
+ *
+ *   GRID (default) — the frame is averaged down to cells of cell_size ×
+ *   cell_size pixels (QVGA, cell 4 → 80×60 cells). The reference is that
+ *   cell image (4.7 KB, internal RAM) rather than a full frame copy. Cells
+ *   whose mean moved by more than pixel_threshold count as changed; cells
+ *   are grouped into blocks of MOTION_BLOCK_CELLS × MOTION_BLOCK_CELLS
+ *   (20×15 over QVGA, i.e. 16×16-pixel blocks) that can be masked out
+ *   individually. The score is the changed area of unmasked blocks, in
+ *   frame pixels, so cfg.threshold means the same as in PIXEL mode.
+ *
+ *   GRID + background — instead of last-frame cells, each cell keeps a
+ *   fixed-point exponentially weighted mean and variance. A cell is changed
+ *   when it sits more than bg_sigma_k standard deviations (and at least
+ *   pixel_threshold levels) from its background. The median cell offset is
+ *   treated as a global light change and applied to every cell at once, so
+ *   clouds and AE steps neither trigger nor need a reset. Slow intruders
+ *   stay foreground for ~4× longer than the normal adaptation time.
+ *
+ *   PIXEL — compare consecutive frames pixel-by-pixel, count pixels where
+ *   |new - old| > pixel_threshold. Full-frame reference (PSRAM for QVGA).
+ *   The inner loop has a scalar version (all targets) and a 128-bit SIMD
+ *   version (ESP32-S3 PIE); see motion_detect_config_t.kernel.
  */
 
 #pragma once
@@ -18,34 +38,95 @@
 extern "C" {
 #endif
 
+/* Block edge in cells (GRID mode) */
+#define MOTION_BLOCK_CELLS  4
+
+/* Detection algorithm */
+typedef enum {
+    MOTION_ALGO_GRID = 0,     /* Cell-mean reference, per-block scores + mask */
+    MOTION_ALGO_PIXEL,        /* Full-frame per-pixel reference */
+} motion_algo_t;
+
+/* Scoring kernel selection (PIXEL mode) */
+typedef enum {
+    MOTION_KERNEL_AUTO = 0,   /* SIMD when the target has it and buffers allow */
+    MOTION_KERNEL_SCALAR,     /* Portable byte loop */
+    MOTION_KERNEL_SIMD,       /* Vector kernel; falls back to scalar per frame
+                               * if a frame is unaligned */
+} motion_kernel_t;
+
 typedef struct {
-    uint32_t width;           /* Frame width (must match CAM_MODE_MOTION output) */
+    uint32_t width;           /* Frame width (must match the scored frames) */
     uint32_t height;          /* Frame height */
     int      threshold;       /* Changed-pixel count to trigger recording */
     /* Optional tuning */
-    uint8_t  pixel_threshold; /* Per-pixel change to count as "changed" (default 30) */
+    uint8_t  pixel_threshold; /* Per-pixel (or per-cell mean) change to count as
+                               * "changed" (default 40; 12 with background,
+                               * where it is only the noise floor) */
+    motion_algo_t   algo;     /* Default GRID */
+    motion_kernel_t kernel;   /* PIXEL mode only. Default AUTO */
+    uint8_t  cell_size;       /* GRID: cell edge in pixels, 1–16 (default 4) */
+    const uint32_t *block_mask; /* GRID: bit i set = block i (row-major) may
+                               * trigger. Copied at init. NULL = all blocks. */
+    bool     background;      /* GRID: adaptive background model (see above) */
+    uint8_t  bg_alpha_shift;  /* Learning rate 1/2^n per frame (default 5 ≈ 32 frames) */
+    uint8_t  bg_sigma_k;      /* Change threshold in std-devs (default 3) */
 } motion_detect_config_t;
 
+/* Per-frame analysis result. Pointers stay valid until the next call. */
+typedef struct {
+    int       score;          /* Same value motion_detect_score() returns */
+    int16_t   global_offset;  /* Background mode: median cell offset (light
+                               * change) removed this frame, in grey levels */
+    uint16_t  grid_w;         /* Blocks across (0 in PIXEL mode) */
+    uint16_t  grid_h;         /* Blocks down */
+    const uint16_t *block_scores; /* grid_w × grid_h changed pixels per block,
+                               * row-major, masked blocks included */
+    uint16_t  active_blocks;  /* Unmasked blocks with a non-zero score */
+    /* Bounding box of active blocks in frame pixels, inclusive-exclusive.
+     * Valid when active_blocks > 0; PIXEL mode reports the whole frame
+     * whenever score > 0. */
+    uint16_t  bbox_x0, bbox_y0, bbox_x1, bbox_y1;
+} motion_result_t;
+
 /**
  * @brief  Initialise the motion detector.
- *         Allocates a reference frame buffer in PSRAM.
+ *         GRID: allocates the cell reference and block arrays in internal RAM.
+ *         PIXEL: allocates a reference frame buffer (PSRAM for QVGA).
  * @param  cfg  Configuration (width, height, threshold).
- * @return ESP_OK on success.
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for a bad geometry.
  */
 esp_err_t motion_detect_init(const motion_detect_config_t *cfg);
 
 /**
  * @brief  Compute a motion score for the given frame.
  *         The first call after init returns 0 (no reference frame yet).
+ *         PIXEL mode: abs-diff, threshold, count and reference update run in
+ *         one pass. The SIMD kernel needs frame->data 16-byte aligned and
+ *         pixel_threshold < 127; otherwise the frame is scored by the
+ *         scalar loop (same result, slower).
  * @param  frame  GRAY8 frame from camera_hal.
  * @return Number of changed pixels. Compare to cfg.threshold.
  */
 int motion_detect_score(const cam_frame_t *frame);
 
+/**
+ * @brief  Score a frame and report where the motion is.
+ *         Same reference update and warmup behaviour as motion_detect_score().
+ * @param  frame  GRAY8 frame from camera_hal.
+ * @param  out    Filled on success.
+ * @return ESP_OK, ESP_ERR_INVALID_STATE before init,
+ *         ESP_ERR_INVALID_ARG for a non-GRAY8 frame.
+ */
+esp_err_t motion_detect_analyze(const cam_frame_t *frame, motion_result_t *out);
+
 /**
  * @brief  Reset the reference frame (force next score to return 0).
  *         Call after switching back to motion mode post-recording.
  *         Uses the full WARMUP_FRAMES warmup for AE settling.
+ *         With background enabled the model is kept: only a few frames
+ *         are absorbed without scoring while AE settles — global offset
+ *         compensation covers the brightness step.
  */
 void motion_detect_reset(void);
 
@@ -57,6 +138,11 @@ void motion_detect_reset(void);
  */
 void motion_detect_quick_reset(void);
 
+/**
+ * @brief  Kernel selected at init (MOTION_KERNEL_SCALAR or MOTION_KERNEL_SIMD).
+ */
+motion_kernel_t motion_detect_get_kernel(void);
+
 /**
  * @brief  Free resources.
  */
@@ -1,15 +1,39 @@
 /*
  * motion_detect.c — Frame-differencing motion detector
  *
- * Algorithm:
+ * GRID algorithm (default):
+ *   1. Receive GRAY8 frame (width × height bytes)
+ *   2. Average it down to cells (cell_size × cell_size pixels each)
+ *   3. Compare each cell mean against the reference cell image
+ *   4. Changed cells add their pixel area to their block's score
+ *   5. Sum unmasked blocks, track the bounding box, update the reference
+ *
+ *   The only per-pixel work is the read in step 2 — the reference, the
+ *   block scores and the mask are a few KB in internal RAM, and nothing is
+ *   written back to PSRAM.
+ *
+ *   With cfg.background, step 3 compares against a per-cell background
+ *   model instead of the previous frame:
+ *     mean  Q8.8 grey level            var  grey levels², ≥ BG_VAR_MIN
+ *     d      = cell·256 − mean
+ *     offset = median(d) over all cells — global light change
+ *     r      = d − offset               residual after compensation
+ *     changed if |r| > pixel_threshold and r² > k²·var
+ *     mean  += offset + r / 2^shift     (shift + 2 if changed)
+ *     var   += (r² − var) / 2^shift     (background cells only)
+ *   The median tolerates anything up to half the frame being foreground.
+ *
+ * PIXEL algorithm:
  *   1. Receive GRAY8 frame (width × height bytes)
  *   2. Compare each pixel against the previous frame
  *   3. Count pixels where |new - old| > pixel_threshold
- *   4. Update the reference frame
+ *   4. Update the reference frame (same pass as 2–3)
  *   5. Return the changed-pixel count
  *
- * Phase 1 Step 5 target: implement the real algorithm.
- * Current status: STUB — counts nothing, always returns 0.
+ *   Steps 2–4 run in motion_kernel_simd() (ESP32-S3 PIE, 16 px/instruction
+ *   group) or in score_scalar(). The reference buffer is 16-byte aligned and
+ *   kept in internal RAM when small enough (DUAL-mode 80×60 luma), since both
+ *   kernels read and write it every frame.
  */
 
 #include "motion_detect.h"
@@ -17,39 +41,90 @@
 #include <string.h>
 #include "esp_log.h"
 #include "esp_heap_caps.h"
+#include "motion_kernel.h"
 
 static const char *TAG = "motion_detect";
 
 /* Frames to discard on init/reset while AE/AWB settles */
 #define WARMUP_FRAMES  30
 
+/* Reference frames up to this size go in internal RAM (PSRAM otherwise) */
+#define REF_INTERNAL_MAX_BYTES  (16 * 1024)
+
+/* Background model */
+#define BG_SEED_FRAMES     8      /* first frames after init: running average, no scoring */
+#define BG_SETTLE_FRAMES   3      /* after reset: absorb AE settling, model kept */
+#define BG_DEFAULT_SHIFT   5
+#define BG_DEFAULT_K       3
+#define BG_DEFAULT_FLOOR   12
+#define BG_FG_EXTRA_SHIFT  2      /* foreground cells adapt 4× slower */
+#define BG_VAR_MIN         4      /* σ ≥ 2 grey levels — keeps flat areas from triggering on noise */
+#define BG_VAR_INIT        64     /* σ = 8 until learned */
+
+#define DEFAULT_CELL_SIZE  4
+#define MAX_CELL_SIZE      16     /* 16×16×255 still fits the uint16 accumulators */
+
 static motion_detect_config_t s_cfg;
-static uint8_t               *s_ref_frame   = NULL;
 static bool                   s_has_ref     = false;
-static size_t                 s_frame_bytes = 0;
 static int                    s_warmup_left = WARMUP_FRAMES;
 
-esp_err_t motion_detect_init(const motion_detect_config_t *cfg)
+/* PIXEL state */
+static uint8_t               *s_ref_frame   = NULL;
+static size_t                 s_frame_bytes = 0;
+static motion_kernel_t        s_kernel      = MOTION_KERNEL_SCALAR;
+
+/* SIMD constants: 16 × sign bias, 16 × pixel_threshold */
+static uint8_t s_simd_consts[2 * MOTION_KERNEL_ALIGN] __attribute__((aligned(16)));
+
+/* GRID state — all internal RAM */
+static uint32_t  s_cells_w, s_cells_h;
+static uint32_t  s_grid_w, s_grid_h;
+static uint16_t  s_cell_area;
+static uint8_t  *s_cell_cur;      /* this frame's cell means */
+static uint8_t  *s_cell_ref;      /* reference cell means */
+static uint16_t *s_col_acc;       /* s_cells_w column sums for one cell row */
+static uint16_t *s_block_scores;  /* s_grid_w × s_grid_h */
+static uint32_t *s_block_mask;    /* (blocks + 31) / 32 words */
+
+/* Background state — internal RAM */
+static uint16_t *s_bg_mean;       /* Q8.8 */
+static uint16_t *s_bg_var;        /* grey levels² */
+static uint32_t  s_bg_frames;     /* frames absorbed since init (saturating) */
+static uint16_t  s_diff_hist[511];/* offset histogram, d = −255…255 */
+static int16_t   s_last_offset;
+
+static uint32_t score_scalar(const uint8_t *cur, uint8_t *ref, size_t n, int thresh)
 {
-    if (!cfg || cfg->width == 0 || cfg->height == 0) {
-        return ESP_ERR_INVALID_ARG;
+    uint32_t changed = 0;
+    for (size_t i = 0; i < n; i++) {
+        int diff = (int)cur[i] - (int)ref[i];
+        if (diff < 0) diff = -diff;
+        changed += (diff > thresh);
+        ref[i] = cur[i];
     }
+    return changed;
+}
 
-    s_cfg        = *cfg;
-    s_frame_bytes = (size_t)cfg->width * cfg->height;
+/* ── PIXEL ──────────────────────────────────────────────────────────────── */
 
-    /* Default pixel sensitivity if not set.
-     * 40/255 ≈ 16% per-pixel change required — filters global brightness
-     * shifts (clouds, lamp flicker) that affect the whole frame uniformly. */
-    if (s_cfg.pixel_threshold == 0) {
-        s_cfg.pixel_threshold = 40;
-    }
+static esp_err_t pixel_init(void)
+{
+    s_frame_bytes = (size_t)s_cfg.width * s_cfg.height;
 
-    /* Allocate reference frame buffer in PSRAM if available */
-    s_ref_frame = heap_caps_malloc(s_frame_bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    /* Reference frame: 16-byte aligned for the SIMD kernel. Small frames
+     * in internal RAM, QVGA (75 KB) in PSRAM if available. */
+    if (s_frame_bytes <= REF_INTERNAL_MAX_BYTES) {
+        s_ref_frame = heap_caps_aligned_alloc(MOTION_KERNEL_ALIGN, s_frame_bytes,
+                                              MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (!s_ref_frame) {
+        s_ref_frame = heap_caps_aligned_alloc(MOTION_KERNEL_ALIGN, s_frame_bytes,
+                                              MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
     if (!s_ref_frame) {
         ESP_LOGW(TAG, "PSRAM unavailable, allocating ref frame in DRAM");
-        s_ref_frame = malloc(s_frame_bytes);
+        s_ref_frame = heap_caps_aligned_alloc(MOTION_KERNEL_ALIGN, s_frame_bytes,
+                                              MALLOC_CAP_8BIT);
     }
     if (!s_ref_frame) {
         ESP_LOGE(TAG, "Cannot allocate reference frame buffer (%u bytes)",
@@ -57,25 +132,31 @@ esp_err_t motion_detect_init(const motion_detect_config_t *cfg)
         return ESP_ERR_NO_MEM;
     }
 
-    s_has_ref     = false;
-    s_warmup_left = WARMUP_FRAMES;
-    ESP_LOGI(TAG, "Init: %"PRIu32"x%"PRIu32" px_thresh=%u trigger=%d",
-             cfg->width, cfg->height, s_cfg.pixel_threshold, cfg->threshold);
+    /* Kernel: the vector compare saturates |d| at 127, so higher
+     * thresholds can't be expressed — scalar only. */
+    bool simd_ok = motion_kernel_simd_available && s_cfg.pixel_threshold < 127;
+    switch (s_cfg.kernel) {
+    case MOTION_KERNEL_SCALAR:
+        s_kernel = MOTION_KERNEL_SCALAR;
+        break;
+    case MOTION_KERNEL_SIMD:
+        if (!simd_ok) {
+            ESP_LOGW(TAG, "SIMD kernel unavailable (target or px_thresh=%u) — using scalar",
+                     s_cfg.pixel_threshold);
+        }
+        /* fall through */
+    case MOTION_KERNEL_AUTO:
+    default:
+        s_kernel = simd_ok ? MOTION_KERNEL_SIMD : MOTION_KERNEL_SCALAR;
+        break;
+    }
+    memset(s_simd_consts, 0x80, MOTION_KERNEL_ALIGN);
+    memset(s_simd_consts + MOTION_KERNEL_ALIGN, s_cfg.pixel_threshold, MOTION_KERNEL_ALIGN);
     return ESP_OK;
 }
 
-int motion_detect_score(const cam_frame_t *frame)
+static int pixel_score(const cam_frame_t *frame)
 {
-    if (!frame || !frame->data || !s_ref_frame) {
-        return 0;
-    }
-
-    /* Expect GRAY8 */
-    if (frame->fmt != CAM_PIXFMT_GRAY8) {
-        ESP_LOGW(TAG, "motion_detect_score called with non-GRAY8 frame (fmt=%d)", frame->fmt);
-        return 0;
-    }
-
     /* Warm-up: discard first WARMUP_FRAMES frames while AE/AWB settles.
      * Just update reference each time so the first real comparison is stable. */
     if (s_warmup_left > 0) {
@@ -87,22 +168,387 @@ int motion_detect_score(const cam_frame_t *frame)
     }
 
     const uint8_t *cur = (const uint8_t *)frame->data;
-    const uint8_t *ref = s_ref_frame;
-    int changed = 0;
     size_t n = frame->len < s_frame_bytes ? frame->len : s_frame_bytes;
-    for (size_t i = 0; i < n; i++) {
-        int diff = (int)cur[i] - (int)ref[i];
-        if (diff < 0) diff = -diff;
-        if (diff > (int)s_cfg.pixel_threshold) changed++;
+    size_t done = 0;
+    uint32_t changed = 0;
+
+    /* ref is always aligned; the frame buffer usually is (DMA / HAL buffers) */
+    if (s_kernel == MOTION_KERNEL_SIMD &&
+        ((uintptr_t)cur & (MOTION_KERNEL_ALIGN - 1)) == 0) {
+        size_t n16 = n / MOTION_KERNEL_ALIGN;
+        changed = motion_kernel_simd(cur, s_ref_frame, n16, s_simd_consts);
+        done    = n16 * MOTION_KERNEL_ALIGN;
     }
-    memcpy(s_ref_frame, cur, n);
-    return changed;
+    changed += score_scalar(cur + done, s_ref_frame + done, n - done,
+                            s_cfg.pixel_threshold);
+    return (int)changed;
+}
+
+/* ── GRID ───────────────────────────────────────────────────────────────── */
+
+static esp_err_t grid_init(void)
+{
+    if (s_cfg.cell_size == 0) {
+        s_cfg.cell_size = DEFAULT_CELL_SIZE;
+    }
+    if (s_cfg.cell_size > MAX_CELL_SIZE) {
+        ESP_LOGE(TAG, "cell_size %u > %d", s_cfg.cell_size, MAX_CELL_SIZE);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Trailing pixels that don't fill a whole cell are ignored */
+    s_cells_w   = s_cfg.width  / s_cfg.cell_size;
+    s_cells_h   = s_cfg.height / s_cfg.cell_size;
+    s_cell_area = (uint16_t)(s_cfg.cell_size * s_cfg.cell_size);
+    if (s_cells_w == 0 || s_cells_h == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_grid_w = (s_cells_w + MOTION_BLOCK_CELLS - 1) / MOTION_BLOCK_CELLS;
+    s_grid_h = (s_cells_h + MOTION_BLOCK_CELLS - 1) / MOTION_BLOCK_CELLS;
+
+    size_t cells      = (size_t)s_cells_w * s_cells_h;
+    size_t blocks     = (size_t)s_grid_w * s_grid_h;
+    size_t mask_words = (blocks + 31) / 32;
+    const uint32_t caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+
+    s_cell_cur     = heap_caps_aligned_alloc(MOTION_KERNEL_ALIGN, cells, caps);
+    s_col_acc      = heap_caps_malloc(s_cells_w * sizeof(uint16_t), caps);
+    s_block_scores = heap_caps_calloc(blocks, sizeof(uint16_t), caps);
+    s_block_mask   = heap_caps_malloc(mask_words * sizeof(uint32_t), caps);
+    size_t ref_bytes;
+    bool ref_ok;
+    if (s_cfg.background) {
+        /* 19 KB for 80×60 — internal RAM preferred, PSRAM if tight */
+        s_bg_mean = heap_caps_malloc(cells * sizeof(uint16_t), caps);
+        s_bg_var  = heap_caps_malloc(cells * sizeof(uint16_t), caps);
+        if (!s_bg_mean || !s_bg_var) {
+            heap_caps_free(s_bg_mean);
+            heap_caps_free(s_bg_var);
+            ESP_LOGW(TAG, "Background model in PSRAM (internal RAM low)");
+            s_bg_mean = heap_caps_malloc(cells * sizeof(uint16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+            s_bg_var  = heap_caps_malloc(cells * sizeof(uint16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        }
+        ref_ok    = s_bg_mean && s_bg_var;
+        ref_bytes = 2 * cells * sizeof(uint16_t);
+        s_bg_frames = 0;
+    } else {
+        s_cell_ref = heap_caps_aligned_alloc(MOTION_KERNEL_ALIGN, cells, caps);
+        ref_ok     = s_cell_ref != NULL;
+        ref_bytes  = cells;
+    }
+    if (!s_cell_cur || !ref_ok || !s_col_acc || !s_block_scores || !s_block_mask) {
+        ESP_LOGE(TAG, "Cannot allocate %ux%u cell grid", (unsigned)s_cells_w, (unsigned)s_cells_h);
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (s_cfg.block_mask) {
+        memcpy(s_block_mask, s_cfg.block_mask, mask_words * sizeof(uint32_t));
+    } else {
+        memset(s_block_mask, 0xFF, mask_words * sizeof(uint32_t));
+    }
+    s_cfg.block_mask = NULL;   /* caller's array need not outlive init */
+
+    uint32_t enabled = 0;
+    for (size_t b = 0; b < blocks; b++) {
+        enabled += (s_block_mask[b / 32] >> (b % 32)) & 1;
+    }
+    ESP_LOGI(TAG, "Grid: %"PRIu32"x%"PRIu32" cells of %upx, %"PRIu32"x%"PRIu32" blocks (%"PRIu32" enabled), %u B%s",
+             s_cells_w, s_cells_h, s_cfg.cell_size, s_grid_w, s_grid_h, enabled,
+             (unsigned)(cells + ref_bytes + blocks * sizeof(uint16_t) + s_cells_w * sizeof(uint16_t)),
+             s_cfg.background ? " (background model)" : "");
+    return ESP_OK;
+}
+
+/* Average the frame down into s_cell_cur */
+static void grid_downsample(const uint8_t *src)
+{
+    const uint32_t cs = s_cfg.cell_size;
+    const uint32_t w  = s_cfg.width;
+
+    if (cs == 1) {
+        for (uint32_t y = 0; y < s_cells_h; y++) {
+            memcpy(s_cell_cur + y * s_cells_w, src + y * w, s_cells_w);
+        }
+        return;
+    }
+
+    /* Power-of-two cells divide by shift; others by the area */
+    int shift = -1;
+    if ((s_cell_area & (s_cell_area - 1)) == 0) {
+        shift = __builtin_ctz(s_cell_area);
+    }
+
+    for (uint32_t cy = 0; cy < s_cells_h; cy++) {
+        memset(s_col_acc, 0, s_cells_w * sizeof(uint16_t));
+        for (uint32_t r = 0; r < cs; r++) {
+            const uint8_t *row = src + (cy * cs + r) * w;
+            for (uint32_t cx = 0; cx < s_cells_w; cx++) {
+                uint32_t sum = 0;
+                for (uint32_t i = 0; i < cs; i++) {
+                    sum += row[i];
+                }
+                s_col_acc[cx] += (uint16_t)sum;
+                row += cs;
+            }
+        }
+        uint8_t *out = s_cell_cur + cy * s_cells_w;
+        for (uint32_t cx = 0; cx < s_cells_w; cx++) {
+            out[cx] = (uint8_t)(shift >= 0 ? (s_col_acc[cx] >> shift)
+                                           : (s_col_acc[cx] / s_cell_area));
+        }
+    }
+}
+
+/* Seed / settle: blend cells into the model without scoring.
+ * Starts as a running average (1/1, 1/2, 1/4 …) so a fresh model converges
+ * in a few frames, then continues at the configured rate. */
+static void bg_absorb(void)
+{
+    const size_t cells = (size_t)s_cells_w * s_cells_h;
+    uint32_t shift = 31 - __builtin_clz(s_bg_frames + 1);   /* floor(log2(n+1)) */
+    if (shift > s_cfg.bg_alpha_shift) {
+        shift = s_cfg.bg_alpha_shift;
+    }
+
+    if (s_bg_frames == 0) {
+        for (size_t i = 0; i < cells; i++) {
+            s_bg_mean[i] = (uint16_t)(s_cell_cur[i] << 8);
+            s_bg_var[i]  = BG_VAR_INIT;
+        }
+    } else {
+        for (size_t i = 0; i < cells; i++) {
+            int32_t d = ((int32_t)s_cell_cur[i] << 8) - s_bg_mean[i];
+            s_bg_mean[i] = (uint16_t)(s_bg_mean[i] + (d >> shift));
+        }
+    }
+    if (s_bg_frames < UINT32_MAX) {
+        s_bg_frames++;
+    }
+}
+
+/* Classify cells against the background model and update it */
+static void bg_classify(void)
+{
+    const int32_t floor_q8 = (int32_t)s_cfg.pixel_threshold << 8;
+    const int32_t k2       = (int32_t)s_cfg.bg_sigma_k * s_cfg.bg_sigma_k;
+    const uint32_t shift   = s_cfg.bg_alpha_shift;
+
+    /* Global offset = median cell difference */
+    memset(s_diff_hist, 0, sizeof(s_diff_hist));
+    const size_t cells = (size_t)s_cells_w * s_cells_h;
+    for (size_t i = 0; i < cells; i++) {
+        int32_t d = (int32_t)s_cell_cur[i] - ((s_bg_mean[i] + 128) >> 8);
+        s_diff_hist[d + 255]++;
+    }
+    int32_t offset = 0;
+    size_t  seen   = 0;
+    for (int b = 0; b < 511; b++) {
+        seen += s_diff_hist[b];
+        if (seen * 2 >= cells) {
+            offset = b - 255;
+            break;
+        }
+    }
+    s_last_offset = (int16_t)offset;
+    const int32_t offset_q8 = offset << 8;
+
+    for (uint32_t cy = 0; cy < s_cells_h; cy++) {
+        uint16_t *brow = s_block_scores + (cy / MOTION_BLOCK_CELLS) * s_grid_w;
+        for (uint32_t cx = 0; cx < s_cells_w; cx++) {
+            size_t  i  = (size_t)cy * s_cells_w + cx;
+            int32_t r  = ((int32_t)s_cell_cur[i] << 8) - s_bg_mean[i] - offset_q8;   /* Q8.8 */
+            int32_t ra = r < 0 ? -r : r;
+            int32_t ri = (ra + 128) >> 8;
+            int32_t r2 = ri * ri;
+            bool changed = ra > floor_q8 && r2 > k2 * s_bg_var[i];
+
+            if (changed) {
+                brow[cx / MOTION_BLOCK_CELLS] += s_cell_area;
+            } else {
+                int32_t v = s_bg_var[i] + ((r2 - (int32_t)s_bg_var[i]) >> shift);
+                s_bg_var[i] = (uint16_t)(v < BG_VAR_MIN ? BG_VAR_MIN : v > UINT16_MAX ? UINT16_MAX : v);
+            }
+
+            int32_t m = s_bg_mean[i] + offset_q8 + (r >> (changed ? shift + BG_FG_EXTRA_SHIFT : shift));
+            s_bg_mean[i] = (uint16_t)(m < 0 ? 0 : m > (255 << 8) ? (255 << 8) : m);
+        }
+    }
+}
+
+static int grid_analyze(const cam_frame_t *frame, motion_result_t *out)
+{
+    const size_t cells  = (size_t)s_cells_w * s_cells_h;
+    const size_t blocks = (size_t)s_grid_w * s_grid_h;
+
+    grid_downsample((const uint8_t *)frame->data);
+    memset(s_block_scores, 0, blocks * sizeof(uint16_t));
+
+    if (s_cfg.background) {
+        if (s_warmup_left > 0) {
+            bg_absorb();
+            s_has_ref = true;
+            s_warmup_left--;
+        } else {
+            bg_classify();
+        }
+    } else if (s_warmup_left > 0) {
+        memcpy(s_cell_ref, s_cell_cur, cells);
+        s_has_ref = true;
+        s_warmup_left--;
+    } else {
+        const int thresh = s_cfg.pixel_threshold;
+        for (uint32_t cy = 0; cy < s_cells_h; cy++) {
+            const uint8_t *cur = s_cell_cur + cy * s_cells_w;
+            uint8_t       *ref = s_cell_ref + cy * s_cells_w;
+            uint16_t      *brow = s_block_scores + (cy / MOTION_BLOCK_CELLS) * s_grid_w;
+            for (uint32_t cx = 0; cx < s_cells_w; cx++) {
+                int diff = (int)cur[cx] - (int)ref[cx];
+                if (diff < 0) diff = -diff;
+                if (diff > thresh) {
+                    brow[cx / MOTION_BLOCK_CELLS] += s_cell_area;
+                }
+                ref[cx] = cur[cx];
+            }
+        }
+    }
+
+    /* Sum unmasked blocks and find their bounding box */
+    const uint32_t bpx = (uint32_t)s_cfg.cell_size * MOTION_BLOCK_CELLS;   /* block edge, px */
+    int score = 0;
+    uint16_t active = 0;
+    uint32_t bx0 = UINT32_MAX, by0 = UINT32_MAX, bx1 = 0, by1 = 0;
+    for (uint32_t by = 0; by < s_grid_h; by++) {
+        for (uint32_t bx = 0; bx < s_grid_w; bx++) {
+            uint32_t b = by * s_grid_w + bx;
+            if (s_block_scores[b] == 0 || !((s_block_mask[b / 32] >> (b % 32)) & 1)) {
+                continue;
+            }
+            score += s_block_scores[b];
+            active++;
+            if (bx < bx0) bx0 = bx;
+            if (by < by0) by0 = by;
+            if (bx > bx1) bx1 = bx;
+            if (by > by1) by1 = by;
+        }
+    }
+
+    if (out) {
+        out->score         = score;
+        out->global_offset = s_cfg.background ? s_last_offset : 0;
+        out->grid_w        = (uint16_t)s_grid_w;
+        out->grid_h        = (uint16_t)s_grid_h;
+        out->block_scores  = s_block_scores;
+        out->active_blocks = active;
+        if (active) {
+            uint32_t x1 = (bx1 + 1) * bpx, y1 = (by1 + 1) * bpx;
+            out->bbox_x0 = (uint16_t)(bx0 * bpx);
+            out->bbox_y0 = (uint16_t)(by0 * bpx);
+            out->bbox_x1 = (uint16_t)(x1 < s_cfg.width  ? x1 : s_cfg.width);
+            out->bbox_y1 = (uint16_t)(y1 < s_cfg.height ? y1 : s_cfg.height);
+        } else {
+            out->bbox_x0 = out->bbox_y0 = out->bbox_x1 = out->bbox_y1 = 0;
+        }
+    }
+    return score;
+}
+
+/* ── Public API ─────────────────────────────────────────────────────────── */
+
+esp_err_t motion_detect_init(const motion_detect_config_t *cfg)
+{
+    if (!cfg || cfg->width == 0 || cfg->height == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    motion_detect_deinit();
+    s_cfg = *cfg;
+
+    /* Default pixel sensitivity if not set.
+     * 40/255 ≈ 16% per-pixel change required — filters global brightness
+     * shifts (clouds, lamp flicker) that affect the whole frame uniformly. */
+    if (s_cfg.algo == MOTION_ALGO_PIXEL) {
+        s_cfg.background = false;
+    }
+    if (s_cfg.pixel_threshold == 0) {
+        /* With a background model the σ test filters noise; the floor only
+         * guards cells whose variance has collapsed. */
+        s_cfg.pixel_threshold = s_cfg.background ? BG_DEFAULT_FLOOR : 40;
+    }
+    if (s_cfg.bg_alpha_shift == 0 || s_cfg.bg_alpha_shift > 12) {
+        s_cfg.bg_alpha_shift = BG_DEFAULT_SHIFT;
+    }
+    if (s_cfg.bg_sigma_k == 0) {
+        s_cfg.bg_sigma_k = BG_DEFAULT_K;
+    }
+
+    esp_err_t err = (s_cfg.algo == MOTION_ALGO_PIXEL) ? pixel_init() : grid_init();
+    if (err != ESP_OK) {
+        motion_detect_deinit();
+        return err;
+    }
+
+    s_has_ref     = false;
+    s_warmup_left = s_cfg.background ? BG_SEED_FRAMES : WARMUP_FRAMES;
+    ESP_LOGI(TAG, "Init: %"PRIu32"x%"PRIu32" px_thresh=%u trigger=%d algo=%s",
+             cfg->width, cfg->height, s_cfg.pixel_threshold, cfg->threshold,
+             s_cfg.algo == MOTION_ALGO_GRID ? "grid" :
+             s_kernel == MOTION_KERNEL_SIMD ? "pixel/simd" : "pixel/scalar");
+    return ESP_OK;
+}
+
+esp_err_t motion_detect_analyze(const cam_frame_t *frame, motion_result_t *out)
+{
+    if (!s_ref_frame && !s_cell_cur) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!frame || !frame->data || !out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Expect GRAY8 */
+    if (frame->fmt != CAM_PIXFMT_GRAY8) {
+        ESP_LOGW(TAG, "motion_detect called with non-GRAY8 frame (fmt=%d)", frame->fmt);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (s_cfg.algo == MOTION_ALGO_GRID) {
+        if (frame->len < (size_t)s_cfg.width * s_cfg.height) {
+            ESP_LOGW(TAG, "Short frame (%u B) for %"PRIu32"x%"PRIu32" grid",
+                     (unsigned)frame->len, s_cfg.width, s_cfg.height);
+            return ESP_ERR_INVALID_ARG;
+        }
+        grid_analyze(frame, out);
+        return ESP_OK;
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->score = pixel_score(frame);
+    if (out->score > 0) {
+        out->bbox_x1 = (uint16_t)s_cfg.width;
+        out->bbox_y1 = (uint16_t)s_cfg.height;
+    }
+    return ESP_OK;
+}
+
+int motion_detect_score(const cam_frame_t *frame)
+{
+    motion_result_t r;
+    if (motion_detect_analyze(frame, &r) != ESP_OK) {
+        return 0;
+    }
+    return r.score;
 }
 
 void motion_detect_reset(void)
 {
+    if (s_cfg.background && s_bg_frames > 0) {
+        /* Keep the learned background — a sensor reinit only shifts
+         * brightness, which the per-frame offset removes. */
+        s_warmup_left = BG_SETTLE_FRAMES;
+        return;
+    }
     s_has_ref     = false;
-    s_warmup_left = WARMUP_FRAMES;
+    s_warmup_left = s_cfg.background ? BG_SEED_FRAMES : WARMUP_FRAMES;
 }
 
 void motion_detect_quick_reset(void)
@@ -113,12 +559,30 @@ void motion_detect_quick_reset(void)
     s_warmup_left = 1;
 }
 
+motion_kernel_t motion_detect_get_kernel(void)
+{
+    return s_kernel;
+}
+
 void motion_detect_deinit(void)
 {
-    if (s_ref_frame) {
-        free(s_ref_frame);
-        s_ref_frame = NULL;
-    }
-    s_has_ref     = false;
-    s_frame_bytes = 0;
+    heap_caps_free(s_ref_frame);
+    heap_caps_free(s_cell_cur);
+    heap_caps_free(s_cell_ref);
+    heap_caps_free(s_col_acc);
+    heap_caps_free(s_block_scores);
+    heap_caps_free(s_block_mask);
+    heap_caps_free(s_bg_mean);
+    heap_caps_free(s_bg_var);
+    s_bg_mean      = NULL;
+    s_bg_var       = NULL;
+    s_bg_frames    = 0;
+    s_ref_frame    = NULL;
+    s_cell_cur     = NULL;
+    s_cell_ref     = NULL;
+    s_col_acc      = NULL;
+    s_block_scores = NULL;
+    s_block_mask   = NULL;
+    s_has_ref      = false;
+    s_frame_bytes  = 0;
 }
@@ -0,0 +1,43 @@
+/*
+ * motion_kernel.h — Target-specific motion scoring kernels
+ *
+ * Internal to motion_detect component. CMake links exactly one backend:
+ *   esp32s3/motion_kernel_pie.S  — 128-bit PIE (ee.*) vector kernel
+ *   motion_kernel_none.c         — no SIMD on this target
+ *
+ * motion_detect.c picks the kernel at runtime and always keeps the scalar
+ * loop as the fallback (unaligned buffers, high thresholds, the tail).
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bytes per vector step; cur/ref must both be aligned to this for SIMD */
+#define MOTION_KERNEL_ALIGN  16
+
+/* True if motion_kernel_simd() is a real implementation on this target */
+extern const bool motion_kernel_simd_available;
+
+/**
+ * @brief  One pass over n16 × 16 pixels: count |cur - ref| > thresh and
+ *         copy cur into ref.
+ * @param  cur     Current frame, MOTION_KERNEL_ALIGN-byte aligned.
+ * @param  ref     Reference frame, same alignment. Overwritten with cur.
+ * @param  n16     Number of 16-byte blocks.
+ * @param  consts  32 bytes, 16-byte aligned: 16 × 0x80 (sign bias), then
+ *                 16 × thresh (0–126). Precomputed once at init.
+ * @return Number of changed pixels.
+ */
+uint32_t motion_kernel_simd(const uint8_t *cur, uint8_t *ref, size_t n16,
+                            const uint8_t *consts);
+
+#ifdef __cplusplus
+}
+#endif
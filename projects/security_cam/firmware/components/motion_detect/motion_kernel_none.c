@@ -0,0 +1,17 @@
+/*
+ * motion_kernel_none.c — No SIMD motion kernel on this target
+ *
+ * motion_detect.c sees motion_kernel_simd_available == false and uses the
+ * scalar loop.
+ */
+
+#include "motion_kernel.h"
+
+const bool motion_kernel_simd_available = false;
+
+uint32_t motion_kernel_simd(const uint8_t *cur, uint8_t *ref, size_t n16,
+                            const uint8_t *consts)
+{
+    (void)cur; (void)ref; (void)n16; (void)consts;
+    return 0;
+}
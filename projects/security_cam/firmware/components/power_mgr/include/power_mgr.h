@@ -0,0 +1,70 @@
+/*
+ * power_mgr.h — Low-power motion watch (CPU clock, WiFi modem sleep, pacing)
+ *
+ * Scoring every frame keeps the CPU at full clock and WiFi awake the whole
+ * time nothing happens. In low-power watch the recording loop scores
+ * CONFIG_POWER_WATCH_FPS frames a second, esp_pm lowers the CPU to
+ * CONFIG_POWER_WATCH_CPU_MHZ in the idle time between them, and WiFi
+ * sleeps CONFIG_POWER_WIFI_LISTEN_INTERVAL beacons at a time.
+ *
+ * Full rate (CPU max lock held, min modem sleep, every frame scored):
+ *   - while a user is active: a clip records, an upload runs, a preview
+ *     viewer is connected
+ *   - for CONFIG_POWER_FULL_HOLD_S after a score of CONFIG_POWER_RAMP_PCT %
+ *     of the threshold, and after the last user went idle
+ *
+ * The sensor keeps streaming at its own rate and the camera HAL keeps only
+ * the newest frame, so after a ramp the next frame scored is current — a
+ * trigger is never more than one frame late.
+ *
+ * Automatic light sleep is not used: it stops the XCLK and the camera DMA,
+ * and the sensor reinit after every wake costs more than a frame.
+ *
+ * Call sequence from the recording task:
+ *   power_mgr_init()                  ← once, before the upload task starts
+ *   ms = power_mgr_watch_frame(s, t)  ← every scored watch frame; wait ms
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    POWER_USER_RECORD = 0,    /* recording loop: a clip is open */
+    POWER_USER_NET,           /* upload task: presign / PUT in progress */
+    POWER_USER_PREVIEW,       /* preview_stream: a viewer is connected */
+    POWER_USER_COUNT,
+} power_user_t;
+
+/**
+ * @brief  Configure esp_pm for dynamic frequency scaling and start at
+ *         full rate (the hold period runs from here).
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED without PM_ENABLE / POWER_WATCH —
+ *         every other call then does nothing and power_mgr_watch_frame()
+ *         returns 0 — or the esp_pm error.
+ */
+esp_err_t power_mgr_init(void);
+
+/**
+ * @brief  Account one scored watch frame and pick the watch rate.
+ * @param  score      motion_result_t.score of the frame.
+ * @param  threshold  Score that starts a clip.
+ * @return Milliseconds to wait before fetching the next frame (0 at full rate).
+ */
+uint32_t power_mgr_watch_frame(int score, int threshold);
+
+/**
+ * @brief  Mark a user busy (full rate) or idle. Going idle starts the hold
+ *         period. Any task; idempotent.
+ */
+void power_mgr_set_active(power_user_t user, bool active);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,151 @@
+/*
+ * power_mgr.c — Low-power motion watch (see power_mgr.h)
+ *
+ * State changes come from the recording loop and the upload task, so they
+ * go through one mutex; the esp_pm lock and esp_wifi_set_ps() are only
+ * touched on a change between full rate and low-power watch.
+ */
+
+#include "power_mgr.h"
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "wifi_manager.h"
+
+static const char *TAG = "power_mgr";
+
+#if CONFIG_PM_ENABLE && CONFIG_POWER_WATCH
+#define POWER_WATCH     1
+#define WATCH_FPS       CONFIG_POWER_WATCH_FPS
+#define CPU_MIN_MHZ     CONFIG_POWER_WATCH_CPU_MHZ
+#define RAMP_PCT        CONFIG_POWER_RAMP_PCT
+#define HOLD_S          CONFIG_POWER_FULL_HOLD_S
+#else
+/* Compiled out — power_mgr_init() refuses; these only keep the code building */
+#define POWER_WATCH     0
+#define WATCH_FPS       1
+#define CPU_MIN_MHZ     CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+#define RAMP_PCT        100
+#define HOLD_S          1
+#endif
+
+#define PERIOD_US       (1000000LL / WATCH_FPS)
+#define HOLD_US         ((int64_t)HOLD_S * 1000000LL)
+
+static bool                  s_enabled;
+static SemaphoreHandle_t     s_lock;
+static esp_pm_lock_handle_t  s_cpu_lock;    /* held at full rate */
+static uint32_t              s_users;       /* bit per busy power_user_t */
+static int64_t               s_hold_until_us;
+static bool                  s_full;        /* state last applied */
+static int64_t               s_next_us;     /* low rate: next frame due */
+
+/* Caller holds s_lock */
+static void apply(int64_t now_us)
+{
+    bool full = s_users != 0 || now_us < s_hold_until_us;
+    if (full == s_full) {
+        return;
+    }
+    s_full = full;
+    if (full) {
+        esp_pm_lock_acquire(s_cpu_lock);
+    } else {
+        esp_pm_lock_release(s_cpu_lock);
+        s_next_us = 0;
+    }
+    esp_err_t err = wifi_manager_set_power_save(!full);
+    if (err != ESP_OK && err != ESP_ERR_NOT_SUPPORTED) {
+        ESP_LOGW(TAG, "WiFi power save: %s", esp_err_to_name(err));
+    }
+    ESP_LOGD(TAG, "%s", full ? "full rate" : "low-power watch");
+}
+
+esp_err_t power_mgr_init(void)
+{
+    if (!POWER_WATCH) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    esp_pm_config_t pm_cfg = {
+        .max_freq_mhz       = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz       = CPU_MIN_MHZ,
+        .light_sleep_enable = false,
+    };
+    esp_err_t err = esp_pm_configure(&pm_cfg);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "esp_pm_configure(%d-%d MHz): %s",
+                 CPU_MIN_MHZ, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, esp_err_to_name(err));
+        return err;
+    }
+    err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "power_mgr", &s_cpu_lock);
+    if (err != ESP_OK) {
+        return err;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        esp_pm_lock_delete(s_cpu_lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* Start at full rate: the motion detector is still warming up */
+    esp_pm_lock_acquire(s_cpu_lock);
+    s_full = true;
+    s_hold_until_us = esp_timer_get_time() + HOLD_US;
+    s_enabled = true;
+    ESP_LOGI(TAG, "Low-power watch: %d fps, CPU %d-%d MHz, full rate from %d%% of threshold",
+             WATCH_FPS, CPU_MIN_MHZ, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, RAMP_PCT);
+    return ESP_OK;
+}
+
+uint32_t power_mgr_watch_frame(int score, int threshold)
+{
+    if (!s_enabled) {
+        return 0;
+    }
+    int64_t now_us = esp_timer_get_time();
+    uint32_t wait_ms = 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if ((int64_t)score * 100 >= (int64_t)threshold * RAMP_PCT) {
+        if (!s_full) {
+            ESP_LOGD(TAG, "ramp: score %d of %d", score, threshold);
+        }
+        s_hold_until_us = now_us + HOLD_US;
+    }
+    apply(now_us);
+    if (!s_full) {
+        /* Fixed schedule, so the time spent waiting for and scoring a frame
+         * does not lower the rate; restart it after falling a period behind */
+        if (s_next_us + PERIOD_US < now_us) {
+            s_next_us = now_us;
+        }
+        s_next_us += PERIOD_US;
+        if (s_next_us > now_us) {
+            wait_ms = (uint32_t)((s_next_us - now_us) / 1000);
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return wait_ms;
+}
+
+void power_mgr_set_active(power_user_t user, bool active)
+{
+    if (!s_enabled || user >= POWER_USER_COUNT) {
+        return;
+    }
+    uint32_t bit = 1u << user;
+    int64_t now_us = esp_timer_get_time();
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (active) {
+        s_users |= bit;
+    } else if (s_users & bit) {
+        s_users &= ~bit;
+        s_hold_until_us = now_us + HOLD_US;
+    }
+    apply(now_us);
+    xSemaphoreGive(s_lock);
+}
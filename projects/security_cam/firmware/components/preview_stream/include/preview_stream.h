@@ -0,0 +1,71 @@
+/*
+ * preview_stream.h — Live MJPEG preview over HTTP (multipart/x-mixed-replace)
+ *
+ * GET /stream serves the camera's JPEG frames to a browser or VLC on the
+ * LAN. Frames are not copied: the recording loop offers each frame it
+ * already holds, and every viewer whose rate limit allows takes a
+ * reference (camera_hal_retain_frame) into its own one-frame slot. A
+ * newer frame replaces one the viewer has not started sending, so a slow
+ * client sees fewer frames and never holds more than two buffers — one
+ * on the wire, one waiting. When the capture ring cannot spare a buffer
+ * the viewer skips the frame; recording and the clip writer never wait.
+ * A camera mode switch that reinitialises the sensor needs every buffer
+ * back: preview_stream_drop_frames() empties the slots and cuts off a
+ * viewer still sending after 500 ms (sends also time out after 1 s).
+ *
+ * Each viewer is sent by its own task on the network core; the httpd task
+ * only accepts. CONFIG_PREVIEW_MAX_VIEWERS at once, the rest get 503.
+ * While no frames come (single-stream watch, P4) a viewer's task peeks at
+ * its socket every 2 s, and TCP keep-alive catches clients that vanished,
+ * so a closed tab frees its slot and the power_mgr full-rate hold.
+ *
+ *   GET /stream[?token=T]               stream
+ *   GET /stream/fps?v=N[&token=T]       set the per-viewer fps limit
+ *
+ * Call sequence:
+ *   preview_stream_start()       ← once, after the TCP/IP stack is up
+ *   preview_stream_offer(&frame) ← every frame, before it is released
+ *   preview_stream_drop_frames() ← before a set_mode that reinits the sensor
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "camera_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief  Start the HTTP server on port 80.
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED if CONFIG_PREVIEW_STREAM is off or
+ *         the camera does not deliver JPEG — preview_stream_offer() then
+ *         does nothing — or the httpd error.
+ */
+esp_err_t preview_stream_start(void);
+
+/**
+ * @brief  Offer a frame to the viewers. Costs one compare with no viewer
+ *         connected; non-JPEG frames are ignored. The caller keeps its
+ *         own reference and releases it as usual.
+ */
+void preview_stream_offer(const cam_frame_t *frame);
+
+/**
+ * @brief  Give every held camera buffer back: release frames waiting in
+ *         the slots, wait up to 500 ms for frames being sent, then shut
+ *         the sockets of viewers still sending (they disconnect). Call
+ *         from the task that offers frames, so none arrive meanwhile.
+ */
+void preview_stream_drop_frames(void);
+
+/**
+ * @brief  Per-viewer frame rate limit, 1..30 fps. Any task.
+ */
+esp_err_t preview_stream_set_fps(uint32_t fps);
+
+#ifdef __cplusplus
+}
+#endif
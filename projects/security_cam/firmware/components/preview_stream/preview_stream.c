@@ -0,0 +1,345 @@
+/*
+ * preview_stream.c — Live MJPEG preview over HTTP (see preview_stream.h)
+ *
+ * Slots are shared between the recording loop (offer) and the viewer
+ * tasks under one mutex; the frame payload is only read by the viewer's
+ * task after it has taken the slot's reference.
+ */
+
+#include "preview_stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_http_server.h"
+#include "lwip/sockets.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "power_mgr.h"
+
+static const char *TAG = "preview";
+
+#if CONFIG_PREVIEW_STREAM
+#define PREVIEW_STREAM  1
+#define MAX_VIEWERS     CONFIG_PREVIEW_MAX_VIEWERS
+#define FPS_DEFAULT     CONFIG_PREVIEW_FPS
+#define TOKEN           CONFIG_PREVIEW_TOKEN
+#else
+/* Compiled out — preview_stream_start() refuses; these only keep the code building */
+#define PREVIEW_STREAM  0
+#define MAX_VIEWERS     1
+#define FPS_DEFAULT     1
+#define TOKEN           ""
+#endif
+
+#define FPS_MAX         30
+#define BOUNDARY        "camframe"
+#define STREAM_TYPE     "multipart/x-mixed-replace;boundary=" BOUNDARY
+#define HTTPD_PRIO      2           /* below upload (5) and lcd_ui (3) */
+#define VIEWER_PRIO     2
+#define VIEWER_STACK    4096
+#define IDLE_PROBE_MS   2000        /* no frame this long: check the socket */
+#define KEEPALIVE_S     5           /* TCP keep-alive idle and interval, 3 probes */
+#define SEND_TIMEOUT_S  1           /* one stalled send; well under camera_hal's held-frame wait */
+#define DROP_WAIT_MS    500         /* drop_frames: let frames on the wire finish */
+
+typedef struct {
+    bool          used;             /* slot taken (task may still be starting) */
+    TaskHandle_t  task;             /* set once the viewer can be fed */
+    httpd_req_t  *req;              /* async copy, owned by the task */
+    bool          has_frame;
+    cam_frame_t   pending;          /* one reference, not yet being sent */
+    bool          sending;          /* the task holds a frame on the wire */
+    int64_t       next_us;          /* rate limit: next frame due */
+    uint32_t      sent;             /* viewer task only */
+    uint32_t      replaced;         /* superseded before they were sent */
+    uint32_t      skipped;          /* capture ring could not spare a buffer */
+} viewer_t;
+
+static SemaphoreHandle_t s_lock;
+static viewer_t          s_viewer[MAX_VIEWERS];
+static volatile int      s_viewers;         /* fed slots; read unlocked by offer */
+static volatile uint32_t s_fps = FPS_DEFAULT;
+
+static bool token_ok(httpd_req_t *req)
+{
+    if (!TOKEN[0]) {
+        return true;
+    }
+    char query[96], token[64];
+    return httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+           httpd_query_key_value(query, "token", token, sizeof(token)) == ESP_OK &&
+           strcmp(token, TOKEN) == 0;
+}
+
+/* Without frames to send (single-stream watch, WiFi paused) a closed tab
+ * is only seen by reading: a FIN shows as 0, a reset or TCP keep-alive
+ * giving up on a vanished client as an error */
+static bool client_gone(httpd_req_t *req)
+{
+    char c;
+    int r = recv(httpd_req_to_sockfd(req), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+static void viewer_task(void *arg)
+{
+    viewer_t *v = arg;
+    httpd_req_t *req = v->req;
+    int id = (int)(v - s_viewer);
+
+    httpd_resp_set_type(req, STREAM_TYPE);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+    /* Until a send fails — the client left or stopped reading for longer
+     * than the httpd send timeout — or an idle probe finds it gone */
+    esp_err_t err = ESP_OK;
+    while (err == ESP_OK) {
+        if (!ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IDLE_PROBE_MS))) {
+            if (client_gone(req)) {
+                err = ESP_ERR_INVALID_STATE;
+            }
+            continue;
+        }
+
+        cam_frame_t f;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        bool have = v->has_frame;
+        f = v->pending;
+        v->has_frame = false;
+        v->sending   = have;
+        xSemaphoreGive(s_lock);
+        if (!have) {
+            continue;
+        }
+
+        char part[128];
+        int n = snprintf(part, sizeof(part),
+                         "\r\n--" BOUNDARY "\r\n"
+                         "Content-Type: image/jpeg\r\n"
+                         "Content-Length: %u\r\n"
+                         "X-Timestamp: %"PRIu64"\r\n\r\n",
+                         (unsigned)f.len, f.timestamp_us);
+        err = httpd_resp_send_chunk(req, part, n);
+        if (err == ESP_OK) {
+            err = httpd_resp_send_chunk(req, f.data, f.len);   /* from the camera buffer */
+        }
+        camera_hal_release_frame(&f);
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        v->sending = false;
+        xSemaphoreGive(s_lock);
+        if (err == ESP_OK) {
+            v->sent++;
+        }
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (v->has_frame) {
+        camera_hal_release_frame(&v->pending);
+        v->has_frame = false;
+    }
+    ESP_LOGI(TAG, "Viewer %d gone: %"PRIu32" sent, %"PRIu32" replaced, %"PRIu32" skipped",
+             id, v->sent, v->replaced, v->skipped);
+    v->task = NULL;
+    v->used = false;
+    bool last = --s_viewers == 0;
+    xSemaphoreGive(s_lock);
+
+    if (last) {
+        power_mgr_set_active(POWER_USER_PREVIEW, false);
+    }
+    httpd_req_async_handler_complete(req);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t stream_handler(httpd_req_t *req)
+{
+    if (!token_ok(req)) {
+        return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "token required");
+    }
+
+    viewer_t *v = NULL;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < MAX_VIEWERS && !v; i++) {
+        if (!s_viewer[i].used) {
+            v = &s_viewer[i];
+            memset(v, 0, sizeof(*v));
+            v->used = true;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    if (!v) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "viewer limit reached\n");
+    }
+
+    /* The stream outlives this handler: hand the request to a task of its
+     * own so the httpd task stays free for the next client */
+    TaskHandle_t task = NULL;
+    esp_err_t err = httpd_req_async_handler_begin(req, &v->req);
+    if (err == ESP_OK &&
+        xTaskCreatePinnedToCore(viewer_task, "preview", VIEWER_STACK, v, VIEWER_PRIO,
+                                &task, CONFIG_TASK_NET_CORE) != pdPASS) {
+        httpd_req_async_handler_complete(v->req);
+        err = ESP_ERR_NO_MEM;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool first = false;
+    if (err == ESP_OK) {
+        v->task = task;
+        first = ++s_viewers == 1;
+    } else {
+        v->used = false;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot start viewer: %s", esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+    if (first) {
+        power_mgr_set_active(POWER_USER_PREVIEW, true);
+    }
+    ESP_LOGI(TAG, "Viewer %d connected (%d/%d)", (int)(v - s_viewer), s_viewers, MAX_VIEWERS);
+    return ESP_OK;
+}
+
+static esp_err_t fps_handler(httpd_req_t *req)
+{
+    if (!token_ok(req)) {
+        return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "token required");
+    }
+    char query[96], val[8];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "v", val, sizeof(val)) == ESP_OK &&
+        preview_stream_set_fps((uint32_t)strtoul(val, NULL, 10)) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "v must be 1-30");
+    }
+    char body[24];
+    snprintf(body, sizeof(body), "fps=%"PRIu32"\n", s_fps);
+    httpd_resp_set_type(req, "text/plain");
+    return httpd_resp_sendstr(req, body);
+}
+
+esp_err_t preview_stream_start(void)
+{
+    if (!PREVIEW_STREAM || !camera_hal_get_caps()->delivers_jpeg) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    httpd_config_t cfg = HTTPD_DEFAULT_CONFIG();
+    cfg.core_id          = CONFIG_TASK_NET_CORE;
+    cfg.task_priority    = HTTPD_PRIO;
+    cfg.max_open_sockets = MAX_VIEWERS + 2;     /* + /stream/fps and a refused viewer */
+    cfg.keep_alive_enable   = true;             /* a client that vanished without a FIN */
+    cfg.keep_alive_idle     = KEEPALIVE_S;
+    cfg.keep_alive_interval = KEEPALIVE_S;
+    cfg.keep_alive_count    = 3;
+    cfg.send_wait_timeout   = SEND_TIMEOUT_S;   /* a stalled client lets go of its frame */
+
+    httpd_handle_t server;
+    esp_err_t err = httpd_start(&server, &cfg);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "httpd_start: %s", esp_err_to_name(err));
+        return err;
+    }
+    const httpd_uri_t stream = { .uri = "/stream",     .method = HTTP_GET, .handler = stream_handler };
+    const httpd_uri_t fps    = { .uri = "/stream/fps", .method = HTTP_GET, .handler = fps_handler };
+    httpd_register_uri_handler(server, &stream);
+    httpd_register_uri_handler(server, &fps);
+
+    ESP_LOGI(TAG, "Preview on :%d/stream — %d viewer(s), %"PRIu32" fps%s",
+             cfg.server_port, MAX_VIEWERS, s_fps, TOKEN[0] ? ", token required" : "");
+    return ESP_OK;
+}
+
+void preview_stream_offer(const cam_frame_t *frame)
+{
+    if (s_viewers == 0 || frame->fmt != CAM_PIXFMT_JPEG) {
+        return;
+    }
+    int64_t now_us = esp_timer_get_time();
+    int64_t period_us = 1000000LL / s_fps;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < MAX_VIEWERS; i++) {
+        viewer_t *v = &s_viewer[i];
+        if (!v->task || now_us < v->next_us) {
+            continue;
+        }
+        if (camera_hal_retain_frame(frame) != ESP_OK) {
+            v->skipped++;
+            continue;
+        }
+        if (v->has_frame) {
+            camera_hal_release_frame(&v->pending);  /* latest frame only */
+            v->replaced++;
+        }
+        v->pending   = *frame;
+        v->has_frame = true;
+        if (v->next_us + period_us < now_us) {
+            v->next_us = now_us;
+        }
+        v->next_us += period_us;
+        xTaskNotifyGive(v->task);
+    }
+    xSemaphoreGive(s_lock);
+}
+
+esp_err_t preview_stream_set_fps(uint32_t fps)
+{
+    if (fps < 1 || fps > FPS_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_fps = fps;
+    return ESP_OK;
+}
+
+void preview_stream_drop_frames(void)
+{
+    if (s_viewers == 0) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < MAX_VIEWERS; i++) {
+        viewer_t *v = &s_viewer[i];
+        if (v->has_frame) {
+            camera_hal_release_frame(&v->pending);
+            v->has_frame = false;
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    /* Frames on the wire: a healthy client finishes in a few ms. One that
+     * is still sending after DROP_WAIT_MS has its socket shut, so the send
+     * fails and the task releases the buffer — it then disconnects. */
+    for (int ms = 0; ; ms += 10) {
+        int sending = 0;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        for (int i = 0; i < MAX_VIEWERS; i++) {
+            viewer_t *v = &s_viewer[i];
+            if (!v->sending) {
+                continue;
+            }
+            sending++;
+            if (ms >= DROP_WAIT_MS) {
+                ESP_LOGW(TAG, "Viewer %d too slow for a camera mode switch — closing", i);
+                shutdown(httpd_req_to_sockfd(v->req), SHUT_RDWR);
+            }
+        }
+        xSemaphoreGive(s_lock);
+        if (sending == 0 || ms >= DROP_WAIT_MS) {
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
@@ -0,0 +1,76 @@
+/*
+ * rate_ctrl.h — Recording bitrate controller (JPEG quality + frame rate)
+ *
+ * A fixed sensor quality makes clip size a function of the scene: a busy
+ * VGA scene at q12 runs 40-60 KB a frame, 20+ MB a minute, and the odd
+ * frame overflows the camera buffer and is cut off. This controller keeps
+ * the recording stream under a target rate with two loops:
+ *
+ *   - quality, every second: the last second's bytes against the target,
+ *     one step worse above 110 % (two above 150 %), one better below 80 %,
+ *     between CONFIG_RATE_JPEG_QUALITY_BEST and _WORST. A frame within 1/8
+ *     of cam_caps_t.record_frame_max steps two worse at once.
+ *   - frame rate, per clip: when the last clip ran over target with quality
+ *     pinned at its worst, the next one records proportionally slower
+ *     (down to CONFIG_RATE_FPS_MIN); when it ran well under at best quality,
+ *     faster again (up to CONFIG_RECORD_FPS). The rate is fixed within a
+ *     clip because the containers store one.
+ *
+ * Target = min(CONFIG_RATE_CLIP_BUDGET_KB / CONFIG_MAX_CLIP_SECONDS,
+ *              upload KB/s, SD write KB/s / 2), unknown rates ignored.
+ *
+ * Call sequence from the recording task:
+ *   rate_ctrl_init(caps)           ← once, after camera_hal_init()
+ *   fps = rate_ctrl_clip_begin(..) ← before each clip_writer_begin()
+ *   rate_ctrl_on_frame(&frame)     ← every recorded frame
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "camera_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    bool     enabled;
+    int      quality;           /* current sensor JPEG quality */
+    uint32_t fps;               /* frame rate of the current clip */
+    uint32_t target_kbps;       /* KB/s the current clip is steered to */
+    uint32_t last_clip_kbps;    /* what the previous clip averaged */
+    uint32_t quality_steps;     /* quality changes since init */
+} rate_ctrl_status_t;
+
+/**
+ * @brief  Start controlling. Sets the best configured quality.
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED if the camera does not deliver
+ *         sensor JPEG (or CONFIG_RATE_CONTROL is off) — every other call
+ *         then does nothing and rate_ctrl_clip_begin() returns
+ *         CONFIG_RECORD_FPS.
+ */
+esp_err_t rate_ctrl_init(const cam_caps_t *caps);
+
+/**
+ * @brief  A clip is about to start: settle the target from the given rates
+ *         (KB/s, 0 = unknown) and pick its frame rate.
+ * @return Frame rate for the clip.
+ */
+uint32_t rate_ctrl_clip_begin(uint32_t sd_kbps, uint32_t upload_kbps);
+
+/**
+ * @brief  Account one recorded frame; may change the sensor quality.
+ */
+void rate_ctrl_on_frame(const cam_frame_t *frame);
+
+/**
+ * @brief  Snapshot the controller state (for logs and the console).
+ */
+void rate_ctrl_get_status(rate_ctrl_status_t *out);
+
+#ifdef __cplusplus
+}
+#endif
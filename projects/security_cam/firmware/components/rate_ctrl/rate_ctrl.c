@@ -0,0 +1,219 @@
+/*
+ * rate_ctrl.c — Recording bitrate controller (see rate_ctrl.h)
+ *
+ * Everything runs on the recording task; no locking.
+ */
+
+#include "rate_ctrl.h"
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+
+static const char *TAG = "rate_ctrl";
+
+#if CONFIG_RATE_CONTROL
+#define QUALITY_BEST    CONFIG_RATE_JPEG_QUALITY_BEST
+#define QUALITY_WORST   CONFIG_RATE_JPEG_QUALITY_WORST
+#define FPS_MIN         CONFIG_RATE_FPS_MIN
+#define BUDGET_KB       CONFIG_RATE_CLIP_BUDGET_KB
+#else
+/* Compiled out — rate_ctrl_init() refuses; these only keep the code building */
+#define QUALITY_BEST    12
+#define QUALITY_WORST   12
+#define FPS_MIN         CONFIG_RECORD_FPS
+#define BUDGET_KB       0
+#endif
+
+#define FPS_MAX         CONFIG_RECORD_FPS
+
+#define WINDOW_US       1000000     /* quality loop period */
+#define HOLD_US         300000      /* frames already in the DMA ring still
+                                     * carry the old quality */
+#define MIN_CLIP_US     3000000     /* shorter clips do not move the fps */
+#define OVER_PCT        110
+#define FAR_OVER_PCT    150
+#define UNDER_PCT       80
+#define FPS_UP_PCT      60          /* last clip below this % of target at best quality */
+
+static bool     s_enabled;
+static int      s_quality;
+static uint32_t s_fps = FPS_MAX;
+static uint32_t s_target_kbps;
+static uint32_t s_frame_max;
+static uint32_t s_steps;
+static uint32_t s_last_clip_kbps;
+
+/* Current clip */
+static uint64_t s_clip_bytes;
+static uint64_t s_clip_first_us;
+static uint64_t s_clip_last_us;
+static bool     s_pinned_worst;     /* quality hit QUALITY_WORST this clip */
+
+/* Quality loop window */
+static uint64_t s_win_start_us;     /* 0 = open at the next frame */
+static uint64_t s_win_bytes;
+static uint64_t s_hold_until_us;
+
+static uint32_t clamp_u32(uint32_t v, uint32_t lo, uint32_t hi)
+{
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+/* Returns true if the quality changed */
+static bool set_quality(int q, const char *why)
+{
+    q = q < QUALITY_BEST ? QUALITY_BEST : q > QUALITY_WORST ? QUALITY_WORST : q;
+    if (q == s_quality) {
+        return false;
+    }
+    esp_err_t err = camera_hal_set_quality(q);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "set_quality(%d) failed: %s", q, esp_err_to_name(err));
+        return false;
+    }
+    ESP_LOGD(TAG, "quality %d -> %d (%s)", s_quality, q, why);
+    s_quality = q;
+    s_steps++;
+    return true;
+}
+
+esp_err_t rate_ctrl_init(const cam_caps_t *caps)
+{
+    s_enabled = false;
+    s_fps     = FPS_MAX;
+#if !CONFIG_RATE_CONTROL
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+    if (!caps || !caps->delivers_jpeg) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    esp_err_t err = camera_hal_set_quality(QUALITY_BEST);
+    if (err != ESP_OK) {
+        return err == ESP_ERR_NOT_SUPPORTED ? err : ESP_FAIL;
+    }
+    s_quality     = QUALITY_BEST;
+    s_frame_max   = caps->record_frame_max;
+    s_target_kbps = BUDGET_KB / CONFIG_MAX_CLIP_SECONDS;
+    s_enabled     = true;
+    ESP_LOGI(TAG, "Budget %d KB per %d s clip (%"PRIu32" KB/s), quality %d-%d, %d-%d fps",
+             BUDGET_KB, CONFIG_MAX_CLIP_SECONDS, s_target_kbps,
+             QUALITY_BEST, QUALITY_WORST, FPS_MIN, FPS_MAX);
+    return ESP_OK;
+}
+
+/* Frame rate for the next clip from how the last one went */
+static uint32_t next_fps(void)
+{
+    uint64_t span_us = s_clip_last_us - s_clip_first_us;
+    if (!s_clip_first_us || span_us < MIN_CLIP_US || s_last_clip_kbps == 0) {
+        return s_fps;
+    }
+    uint32_t fps = s_fps;
+    if (s_pinned_worst && s_last_clip_kbps * 100 > s_target_kbps * OVER_PCT) {
+        /* Rounded down: better a little under than over again */
+        fps = (uint32_t)((uint64_t)s_fps * s_target_kbps / s_last_clip_kbps);
+    } else if (s_quality == QUALITY_BEST && s_fps < FPS_MAX &&
+               s_last_clip_kbps * 100 < s_target_kbps * FPS_UP_PCT) {
+        fps = (uint32_t)((uint64_t)s_fps * s_target_kbps / s_last_clip_kbps);
+        fps = fps > s_fps * 2 ? s_fps * 2 : fps;
+    }
+    return clamp_u32(fps, FPS_MIN, FPS_MAX);
+}
+
+uint32_t rate_ctrl_clip_begin(uint32_t sd_kbps, uint32_t upload_kbps)
+{
+    if (!s_enabled) {
+        return FPS_MAX;
+    }
+    /* Last clip first: its rate is judged against the target it ran under */
+    if (s_clip_last_us > s_clip_first_us) {
+        s_last_clip_kbps = (uint32_t)((s_clip_bytes * 1000000 /
+                                       (s_clip_last_us - s_clip_first_us)) >> 10);
+    }
+    uint32_t fps = next_fps();
+
+    uint32_t target = BUDGET_KB / CONFIG_MAX_CLIP_SECONDS;
+    if (upload_kbps && upload_kbps < target) {
+        target = upload_kbps;
+    }
+    if (sd_kbps && sd_kbps / 2 < target) {
+        target = sd_kbps / 2;
+    }
+    s_target_kbps = target ? target : 1;
+
+    if (fps != s_fps || s_clip_first_us) {
+        ESP_LOGI(TAG, "Last clip %"PRIu32" KB/s at %"PRIu32" fps; target %"PRIu32" KB/s "
+                 "(sd %"PRIu32", upload %"PRIu32") -> %"PRIu32" fps, quality %d",
+                 s_last_clip_kbps, s_fps, s_target_kbps, sd_kbps, upload_kbps, fps, s_quality);
+    }
+    s_fps           = fps;
+    s_clip_bytes    = 0;
+    s_clip_first_us = 0;
+    s_clip_last_us  = 0;
+    s_pinned_worst  = s_quality == QUALITY_WORST;
+    s_win_start_us  = 0;
+    return s_fps;
+}
+
+void rate_ctrl_on_frame(const cam_frame_t *frame)
+{
+    if (!s_enabled || !frame || frame->fmt != CAM_PIXFMT_JPEG) {
+        return;
+    }
+    uint64_t ts = frame->timestamp_us;
+    if (!s_clip_first_us) {
+        s_clip_first_us = ts;
+    } else {
+        s_clip_bytes += frame->len;     /* bytes per interval after the first */
+    }
+    s_clip_last_us = ts;
+
+    if (ts < s_hold_until_us) {
+        return;
+    }
+    if (s_frame_max && frame->len > s_frame_max - s_frame_max / 8) {
+        if (set_quality(s_quality + 2, "near buffer size")) {
+            s_hold_until_us = ts + HOLD_US;
+        }
+        s_win_start_us = 0;
+    } else if (!s_win_start_us) {
+        s_win_start_us = ts;
+        s_win_bytes    = 0;
+    } else {
+        s_win_bytes += frame->len;
+        uint64_t elapsed = ts - s_win_start_us;
+        if (elapsed < WINDOW_US) {
+            return;
+        }
+        uint64_t kbps = (s_win_bytes * 1000000 / elapsed) >> 10;
+        uint64_t pct  = kbps * 100 / s_target_kbps;
+        bool changed = false;
+        if (pct > FAR_OVER_PCT) {
+            changed = set_quality(s_quality + 2, "far over target");
+        } else if (pct > OVER_PCT) {
+            changed = set_quality(s_quality + 1, "over target");
+        } else if (pct < UNDER_PCT) {
+            changed = set_quality(s_quality - 1, "under target");
+        }
+        if (changed) {
+            s_hold_until_us = ts + HOLD_US;
+        }
+        s_win_start_us = 0;
+    }
+    if (s_quality == QUALITY_WORST) {
+        s_pinned_worst = true;
+    }
+}
+
+void rate_ctrl_get_status(rate_ctrl_status_t *out)
+{
+    if (!out) {
+        return;
+    }
+    out->enabled        = s_enabled;
+    out->quality        = s_quality;
+    out->fps            = s_fps;
+    out->target_kbps    = s_target_kbps;
+    out->last_clip_kbps = s_last_clip_kbps;
+    out->quality_steps  = s_steps;
+}
@@ -7,15 +7,24 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* FAT allocation unit (cluster) used when this firmware formats the card.
+ * Writers that flush in multiples of this at matching offsets never split
+ * a cluster between two writes. Cards formatted elsewhere may differ. */
+#define SDCARD_ALLOC_UNIT_SIZE  (16 * 1024)
+
 /**
  * @brief  Mount the SD card at /sdcard.
- *         Uses SDMMC in 1-bit SPI mode (compatible with ESP32-S3-EYE).
+ *         Probes the fastest SDMMC bus mode the wiring allows (4-bit if
+ *         D1–D3 are configured, high-speed if enabled), falling back to
+ *         1-bit at the default clock as on the ESP32-S3-EYE.
  *         Logs available space.
  * @return ESP_OK on success.
  */
@@ -26,6 +35,24 @@ esp_err_t sdcard_init(void);
  */
 esp_err_t sdcard_deinit(void);
 
+/**
+ * @brief  Create (or replace) a file of the given size, ready to be written
+ *         in place with fopen(path, "r+b").
+ *         Tries one contiguous cluster run first; if the free space is too
+ *         fragmented, falls back to an ordinary pre-linked cluster chain.
+ *         Either way FAT updates happen now rather than during later writes.
+ *         The contents are whatever the clusters held before — callers must
+ *         truncate to the real length when done.
+ *         Free space is not checked here (f_getfree() walks the whole FAT):
+ *         callers check first, e.g. against clip_catalog_get().
+ * @param  path        Full path under /sdcard.
+ * @param  size        Bytes to allocate.
+ * @param  contiguous  Optional: set true if a contiguous run was allocated.
+ * @return ESP_OK on success, ESP_FAIL if the card is too full or on
+ *         other errors (no file is left behind).
+ */
+esp_err_t sdcard_preallocate(const char *path, uint32_t size, bool *contiguous);
+
 /**
  * @brief  FAT32-format the SD card.
  *         Unmounts first if mounted, then mounts with format_if_mount_failed=true.
@@ -34,6 +61,69 @@ esp_err_t sdcard_deinit(void);
  */
 esp_err_t sdcard_format(void);
 
+/**
+ * @brief  Bus mode the card was mounted with.
+ * @param  width     Data lines in use (1 or 4).
+ * @param  freq_khz  Actual card clock.
+ * @return ESP_ERR_INVALID_STATE if not mounted.
+ */
+esp_err_t sdcard_get_bus(uint32_t *width, uint32_t *freq_khz);
+
+/* ── Benchmark ────────────────────────────────────────────────────────────
+ * Replays the clip writer's access pattern on a scratch file so cards can
+ * be certified before deployment: a preallocated file written in
+ * staging-buffer-sized, cluster-aligned writes with a header patch and
+ * fsync every checkpoint, read back in upload-buffer-sized reads, then
+ * small-file create/write/close/unlink cycles like the sidecar and
+ * journal files. Destroys nothing but its own scratch files. */
+
+typedef struct {
+    uint32_t bus_width;
+    uint32_t bus_khz;
+    uint32_t prealloc_ms;       /* sdcard_preallocate() of the whole file */
+    uint32_t write_kbps;        /* including checkpoints */
+    uint32_t write_max_ms;      /* slowest single write or checkpoint */
+    uint32_t read_kbps;
+    uint32_t read_max_ms;
+    uint32_t small_avg_ms;      /* one 4 KB file: create, write, fsync, close, unlink */
+    uint32_t small_max_ms;
+} sdcard_bench_result_t;
+
+/**
+ * @brief  Run the benchmark. Blocks for several seconds; nothing else
+ *         should be using the card.
+ * @param  size_kb  Sequential test size (rounded to the staging size).
+ * @return ESP_ERR_INVALID_STATE if not mounted, ESP_ERR_NO_MEM if the card
+ *         or PSRAM is too full, ESP_FAIL on an I/O error.
+ */
+esp_err_t sdcard_bench(uint32_t size_kb, sdcard_bench_result_t *out);
+
+/* ── I/O arbitration ──────────────────────────────────────────────────────
+ * Recording and uploads share one SDMMC bus and the FATFS lock. The clip
+ * writer reports when it is active and how full its frame queue is;
+ * background readers (the upload pipe) call sdcard_io_background_wait()
+ * before each read. While recording, reads are held to
+ * CONFIG_UPLOAD_RECORDING_RATE_KBPS and stop entirely when the writer
+ * queue is half full, until it drains below a quarter. Otherwise they are
+ * held to CONFIG_UPLOAD_MAX_RATE_KBPS (0 = unlimited).
+ * One background reader is assumed. */
+
+/**
+ * @brief  Foreground (recording) writes started / finished.
+ */
+void sdcard_io_set_foreground(bool active);
+
+/**
+ * @brief  Foreground writer backlog, percent of its queue in use.
+ */
+void sdcard_io_set_backlog(uint32_t percent);
+
+/**
+ * @brief  Block until a background read of bytes may start.
+ * @return Milliseconds waited.
+ */
+uint32_t sdcard_io_background_wait(size_t bytes);
+
 #ifdef __cplusplus
 }
 #endif
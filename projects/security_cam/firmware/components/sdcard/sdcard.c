@@ -10,6 +10,11 @@
  *   D0   → GPIO40
  *   CD   → not connected (no card-detect pin)
  *   WP   → not connected
+ *
+ * D1–D3 are not wired on the S3-EYE. Boards that wire them set
+ * CONFIG_SDCARD_PIN_D1..D3; mount then tries 4-bit before 1-bit, and
+ * 40 MHz high-speed before the 20 MHz default, keeping the first mode
+ * whose probe write reads back intact.
  */
 
 #include "sdcard.h"
@@ -17,8 +22,12 @@
 #include "esp_vfs_fat.h"
 #include "driver/sdmmc_host.h"
 #include "sdmmc_cmd.h"
+#include "esp_heap_caps.h"
 
 #include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
 
 static const char *TAG = "sdcard";
 
@@ -29,49 +38,155 @@ static const char *TAG = "sdcard";
 #define SD_PIN_CMD  GPIO_NUM_38
 #define SD_PIN_D0   GPIO_NUM_40
 
+/* D1–D3 only on boards that wire them (Kconfig, -1 = not wired) */
+#define SD_4BIT_WIRED (CONFIG_SDCARD_PIN_D1 >= 0 && CONFIG_SDCARD_PIN_D2 >= 0 && \
+                       CONFIG_SDCARD_PIN_D3 >= 0)
+
+/* Probe pattern written and read back after each mount attempt. 64 KB is
+ * a multi-block transfer, which is where a marginal bus shows CRC errors
+ * or silently corrupted data first. */
+#define PROBE_PATH  MOUNT_POINT "/.sdprobe"
+#define PROBE_SIZE  (64 * 1024)
+
+typedef struct {
+    uint8_t  width;
+    uint32_t freq_khz;
+} bus_mode_t;
+
+/* Fastest first. UHS-I needs 1.8 V signalling, which the S3 SDMMC pins
+ * cannot do, so 40 MHz high-speed is the ceiling here. */
+static const bus_mode_t s_modes[] = {
+    { 4, SDMMC_FREQ_HIGHSPEED },
+    { 4, SDMMC_FREQ_DEFAULT },
+    { 1, SDMMC_FREQ_HIGHSPEED },
+    { 1, SDMMC_FREQ_DEFAULT },
+};
+#define MODE_COUNT (sizeof(s_modes) / sizeof(s_modes[0]))
+
 static sdmmc_card_t *s_card = NULL;
+static size_t        s_mode = 0;        /* first s_modes[] entry to try */
 
 /* Fill in host and slot structs — used by both mount and format */
-static void sdcard_get_hw_config(sdmmc_host_t *host, sdmmc_slot_config_t *slot)
+static void sdcard_get_hw_config(sdmmc_host_t *host, sdmmc_slot_config_t *slot,
+                                 const bus_mode_t *mode)
 {
     *host = (sdmmc_host_t)SDMMC_HOST_DEFAULT();
+    host->max_freq_khz = mode->freq_khz;
     *slot = (sdmmc_slot_config_t)SDMMC_SLOT_CONFIG_DEFAULT();
     slot->clk   = SD_PIN_CLK;
     slot->cmd   = SD_PIN_CMD;
     slot->d0    = SD_PIN_D0;
-    slot->width = 1;
+    slot->width = mode->width;
+    if (mode->width == 4) {
+        slot->d1 = CONFIG_SDCARD_PIN_D1;
+        slot->d2 = CONFIG_SDCARD_PIN_D2;
+        slot->d3 = CONFIG_SDCARD_PIN_D3;
+    }
     slot->flags |= SDMMC_SLOT_FLAG_INTERNAL_PULLUP;
 }
 
+static bool mode_allowed(const bus_mode_t *mode)
+{
+    if (mode->width == 4 && !SD_4BIT_WIRED) {
+        return false;
+    }
+#if !CONFIG_SDCARD_HIGH_SPEED
+    if (mode->freq_khz == SDMMC_FREQ_HIGHSPEED) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+/* Write a pattern, read it back. Card init only exercises CMD and a few
+ * short data reads, so a bus that is too fast for the wiring can mount
+ * fine and still corrupt clip data. */
+static bool probe_data_bus(void)
+{
+    uint8_t *buf = heap_caps_malloc(PROBE_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!buf) {
+        return true;                /* cannot check — keep the mode */
+    }
+    for (size_t i = 0; i < PROBE_SIZE; i++) {
+        buf[i] = (uint8_t)(i * 7 + (i >> 8));
+    }
+
+    /* A card that is full or write-protected cannot be probed; that says
+     * nothing about the bus */
+    bool written = false;
+    FILE *f = fopen(PROBE_PATH, "wb");
+    if (f) {
+        written = fwrite(buf, 1, PROBE_SIZE, f) == PROBE_SIZE;
+        written = fclose(f) == 0 && written;
+    }
+    bool ok = !written;
+    if (written) {
+        memset(buf, 0, PROBE_SIZE);
+        f = fopen(PROBE_PATH, "rb");
+        ok = f && fread(buf, 1, PROBE_SIZE, f) == PROBE_SIZE;
+        if (f) {
+            fclose(f);
+        }
+        for (size_t i = 0; ok && i < PROBE_SIZE; i++) {
+            ok = buf[i] == (uint8_t)(i * 7 + (i >> 8));
+        }
+    }
+    remove(PROBE_PATH);
+    heap_caps_free(buf);
+    return ok;
+}
+
 static esp_err_t sdcard_mount(bool format_if_needed)
 {
     esp_vfs_fat_sdmmc_mount_config_t mount_cfg = {
         .format_if_mount_failed = format_if_needed,
         .max_files              = 8,
-        .allocation_unit_size   = 16 * 1024,
+        .allocation_unit_size   = SDCARD_ALLOC_UNIT_SIZE,
     };
 
-    sdmmc_host_t host;
-    sdmmc_slot_config_t slot;
-    sdcard_get_hw_config(&host, &slot);
+    esp_err_t err = ESP_ERR_NOT_SUPPORTED;
+    for (size_t m = s_mode; m < MODE_COUNT; m++) {
+        const bus_mode_t *mode = &s_modes[m];
+        if (!mode_allowed(mode)) {
+            continue;
+        }
 
-    ESP_LOGI(TAG, "Mounting SD card (SDMMC 1-bit: CLK=%d CMD=%d D0=%d)%s",
-             SD_PIN_CLK, SD_PIN_CMD, SD_PIN_D0,
-             format_if_needed ? " [format-on-fail]" : "");
+        sdmmc_host_t host;
+        sdmmc_slot_config_t slot;
+        sdcard_get_hw_config(&host, &slot, mode);
 
-    esp_err_t err = esp_vfs_fat_sdmmc_mount(MOUNT_POINT, &host, &slot,
-                                             &mount_cfg, &s_card);
-    if (err != ESP_OK) {
+        ESP_LOGI(TAG, "Mounting SD card (SDMMC %u-bit @ %"PRIu32" kHz: CLK=%d CMD=%d D0=%d)%s",
+                 mode->width, mode->freq_khz, SD_PIN_CLK, SD_PIN_CMD, SD_PIN_D0,
+                 format_if_needed ? " [format-on-fail]" : "");
+
+        err = esp_vfs_fat_sdmmc_mount(MOUNT_POINT, &host, &slot, &mount_cfg, &s_card);
         if (err == ESP_FAIL) {
+            /* The bus worked, the filesystem did not — no slower mode helps */
             ESP_LOGE(TAG, "Failed to mount filesystem — card not FAT32? Use 'format' in boot console.");
-        } else {
-            ESP_LOGE(TAG, "Mount failed: %s", esp_err_to_name(err));
+            return err;
         }
-        return err;
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Mount failed: %s", esp_err_to_name(err));
+            continue;
+        }
+        if (!probe_data_bus()) {
+            ESP_LOGW(TAG, "Probe read-back failed at %u-bit %"PRIu32" kHz — trying slower",
+                     mode->width, mode->freq_khz);
+            esp_vfs_fat_sdcard_unmount(MOUNT_POINT, s_card);
+            s_card = NULL;
+            err = ESP_ERR_INVALID_CRC;
+            continue;
+        }
+
+        s_mode = m;                 /* remount and format start here */
+        sdmmc_card_print_info(stdout, s_card);
+        ESP_LOGI(TAG, "SD bus: %u-bit @ %d kHz", 1u << s_card->log_bus_width,
+                 s_card->real_freq_khz);
+        return ESP_OK;
     }
 
-    sdmmc_card_print_info(stdout, s_card);
-    return ESP_OK;
+    ESP_LOGE(TAG, "Mount failed: %s", esp_err_to_name(err));
+    return err;
 }
 
 esp_err_t sdcard_init(void)
@@ -110,6 +225,61 @@ esp_err_t sdcard_deinit(void)
     return ESP_OK;
 }
 
+esp_err_t sdcard_get_bus(uint32_t *width, uint32_t *freq_khz)
+{
+    if (!s_card) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (width) {
+        *width = 1u << s_card->log_bus_width;
+    }
+    if (freq_khz) {
+        *freq_khz = (uint32_t)s_card->real_freq_khz;
+    }
+    return ESP_OK;
+}
+
+esp_err_t sdcard_preallocate(const char *path, uint32_t size, bool *contiguous)
+{
+    if (contiguous) {
+        *contiguous = false;
+    }
+    if (!s_card) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!path || size == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* f_expand() only works on an empty file */
+    remove(path);
+
+    /* alloc_now = true: clusters are linked and the FAT written here */
+    if (esp_vfs_fat_create_contiguous_file(MOUNT_POINT, path, size, true) == ESP_OK) {
+        if (contiguous) {
+            *contiguous = true;
+        }
+        return ESP_OK;
+    }
+
+    /* Fragmented — seeking past EOF and writing one byte makes FATFS
+     * allocate the whole chain in one go */
+    remove(path);
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return ESP_FAIL;
+    }
+    bool ok = fseek(f, (long)size - 1, SEEK_SET) == 0 && fputc(0, f) != EOF;
+    if (fclose(f) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        remove(path);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
 esp_err_t sdcard_format(void)
 {
     /* Must be mounted to hold the card handle for f_mkfs */
@@ -0,0 +1,192 @@
+/*
+ * sdcard_bench.c — Card throughput benchmark in the clip writer's pattern
+ *
+ * Sequential write: sdcard_preallocate(), fopen "r+b", unbuffered, one
+ * fwrite per staging buffer (CONFIG_AVI_STAGING_KB rounded to whole
+ * allocation units, so every write is cluster-aligned). Every
+ * CHECKPOINT_BYTES a 512-byte header patch at offset 0 plus fsync, as
+ * avi_writer's checkpoint does.
+ * Sequential read: CONFIG_UPLOAD_BUFFER_KB freads, as the upload pipe does.
+ * Small files: 4 KB create/write/fsync/close/unlink, like sidecar,
+ * journal and manifest rewrites.
+ */
+
+#include "sdcard.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_vfs_fat.h"
+
+static const char *TAG = "sdcard_bench";
+
+#define MOUNT_POINT       "/sdcard"
+#define BENCH_PATH        MOUNT_POINT "/.sdbench"
+#define SMALL_PATH        "/sdcard/.sdbsmall"
+#define HEADER_BYTES      512
+#define SMALL_BYTES       4096
+#define SMALL_FILES       32
+/* ~2 s of VGA JPEG at 15 fps — one CONFIG_AVI_CHECKPOINT_S interval */
+#define CHECKPOINT_BYTES  (1024 * 1024)
+
+#define STAGING_BYTES ((CONFIG_AVI_STAGING_KB * 1024 + SDCARD_ALLOC_UNIT_SIZE - 1) & \
+                       ~(SDCARD_ALLOC_UNIT_SIZE - 1))
+#define READ_BYTES    (CONFIG_UPLOAD_BUFFER_KB * 1024)
+
+static uint32_t elapsed_ms(int64_t t0)
+{
+    return (uint32_t)((esp_timer_get_time() - t0) / 1000);
+}
+
+static uint32_t kbps(uint32_t bytes, int64_t us)
+{
+    return us > 0 ? (uint32_t)((uint64_t)bytes * 1000000 / 1024 / (uint64_t)us) : 0;
+}
+
+static esp_err_t bench_write(uint8_t *buf, uint32_t size, sdcard_bench_result_t *out)
+{
+    /* Nothing else is on the card, so the slow f_getfree() is fine here */
+    uint64_t total = 0, free_bytes = 0;
+    if (esp_vfs_fat_info(MOUNT_POINT, &total, &free_bytes) == ESP_OK && free_bytes < size) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t err = sdcard_preallocate(BENCH_PATH, size, NULL);
+    out->prealloc_ms = elapsed_ms(t0);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    FILE *f = fopen(BENCH_PATH, "r+b");
+    if (!f) {
+        return ESP_FAIL;
+    }
+    setvbuf(f, NULL, _IONBF, 0);
+
+    uint32_t since_checkpoint = 0;
+    int64_t start = esp_timer_get_time();
+    for (uint32_t pos = 0; pos < size; pos += STAGING_BYTES) {
+        t0 = esp_timer_get_time();
+        if (fwrite(buf, 1, STAGING_BYTES, f) != STAGING_BYTES) {
+            err = ESP_FAIL;
+            break;
+        }
+        since_checkpoint += STAGING_BYTES;
+        if (since_checkpoint >= CHECKPOINT_BYTES) {
+            since_checkpoint = 0;
+            long end = ftell(f);
+            if (fseek(f, 0, SEEK_SET) != 0 || fwrite(buf, 1, HEADER_BYTES, f) != HEADER_BYTES ||
+                fseek(f, end, SEEK_SET) != 0 || fsync(fileno(f)) != 0) {
+                err = ESP_FAIL;
+                break;
+            }
+        }
+        uint32_t ms = elapsed_ms(t0);
+        if (ms > out->write_max_ms) {
+            out->write_max_ms = ms;
+        }
+    }
+    if (fsync(fileno(f)) != 0) {
+        err = ESP_FAIL;
+    }
+    int64_t us = esp_timer_get_time() - start;
+    fclose(f);
+    out->write_kbps = kbps(size, us);
+    return err;
+}
+
+static esp_err_t bench_read(uint8_t *buf, uint32_t size, sdcard_bench_result_t *out)
+{
+    FILE *f = fopen(BENCH_PATH, "rb");
+    if (!f) {
+        return ESP_FAIL;
+    }
+    setvbuf(f, NULL, _IONBF, 0);
+
+    esp_err_t err = ESP_OK;
+    int64_t start = esp_timer_get_time();
+    for (uint32_t pos = 0; pos < size; pos += READ_BYTES) {
+        int64_t t0 = esp_timer_get_time();
+        size_t want = size - pos < READ_BYTES ? size - pos : READ_BYTES;
+        if (fread(buf, 1, want, f) != want) {
+            err = ESP_FAIL;
+            break;
+        }
+        uint32_t ms = elapsed_ms(t0);
+        if (ms > out->read_max_ms) {
+            out->read_max_ms = ms;
+        }
+    }
+    out->read_kbps = kbps(size, esp_timer_get_time() - start);
+    fclose(f);
+    return err;
+}
+
+static esp_err_t bench_small(const uint8_t *buf, sdcard_bench_result_t *out)
+{
+    uint32_t total_ms = 0;
+    for (int i = 0; i < SMALL_FILES; i++) {
+        int64_t t0 = esp_timer_get_time();
+        FILE *f = fopen(SMALL_PATH, "wb");
+        if (!f) {
+            return ESP_FAIL;
+        }
+        bool ok = fwrite(buf, 1, SMALL_BYTES, f) == SMALL_BYTES && fsync(fileno(f)) == 0;
+        ok = fclose(f) == 0 && ok;
+        ok = unlink(SMALL_PATH) == 0 && ok;
+        if (!ok) {
+            return ESP_FAIL;
+        }
+        uint32_t ms = elapsed_ms(t0);
+        total_ms += ms;
+        if (ms > out->small_max_ms) {
+            out->small_max_ms = ms;
+        }
+    }
+    out->small_avg_ms = total_ms / SMALL_FILES;
+    return ESP_OK;
+}
+
+esp_err_t sdcard_bench(uint32_t size_kb, sdcard_bench_result_t *out)
+{
+    if (!out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(out, 0, sizeof(*out));
+    esp_err_t err = sdcard_get_bus(&out->bus_width, &out->bus_khz);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    uint32_t chunks = (size_kb * 1024 + STAGING_BYTES - 1) / STAGING_BYTES;
+    uint32_t size = (chunks ? chunks : 1) * STAGING_BYTES;
+
+    uint8_t *buf = heap_caps_aligned_alloc(64, STAGING_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!buf) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < STAGING_BYTES; i++) {
+        buf[i] = (uint8_t)i;
+    }
+
+    ESP_LOGI(TAG, "%"PRIu32" KB sequential, %u KB writes, %u KB reads",
+             size >> 10, (unsigned)(STAGING_BYTES >> 10), (unsigned)(READ_BYTES >> 10));
+    err = bench_write(buf, size, out);
+    if (err == ESP_OK) {
+        err = bench_read(buf, size, out);
+    }
+    remove(BENCH_PATH);
+    if (err == ESP_OK) {
+        err = bench_small(buf, out);
+    }
+
+    heap_caps_free(buf);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Benchmark failed: %s", esp_err_to_name(err));
+    }
+    return err;
+}
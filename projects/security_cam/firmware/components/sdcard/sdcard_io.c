@@ -0,0 +1,65 @@
+/*
+ * sdcard_io.c — Background read throttling behind recording writes
+ *
+ * Token bucket in bytes: tokens refill at the current rate, capped at
+ * BURST_BYTES, and a read takes its size up front. When that leaves the
+ * bucket negative the reader sleeps until it is paid back, so the average
+ * rate holds even for reads larger than the burst.
+ */
+
+#include "sdcard.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define BURST_BYTES      (64 * 1024)
+#define BACKLOG_HIGH_PCT 50         /* writer queue this full: stop reading */
+#define BACKLOG_LOW_PCT  25         /* ... until it drains below this */
+#define BACKLOG_POLL_MS  20
+
+static volatile bool     s_foreground;
+static volatile uint32_t s_backlog_pct;
+static int64_t           s_tokens = BURST_BYTES;
+static int64_t           s_refill_us;
+
+void sdcard_io_set_foreground(bool active)
+{
+    s_foreground = active;
+    if (!active) {
+        s_backlog_pct = 0;
+    }
+}
+
+void sdcard_io_set_backlog(uint32_t percent)
+{
+    s_backlog_pct = percent;
+}
+
+uint32_t sdcard_io_background_wait(size_t bytes)
+{
+    int64_t t_start = esp_timer_get_time();
+
+    /* Writes win: stay off the bus while the recorder's queue is backing up */
+    if (s_foreground && s_backlog_pct >= BACKLOG_HIGH_PCT) {
+        while (s_foreground && s_backlog_pct >= BACKLOG_LOW_PCT) {
+            vTaskDelay(pdMS_TO_TICKS(BACKLOG_POLL_MS));
+        }
+    }
+
+    uint32_t kbps = s_foreground ? CONFIG_UPLOAD_RECORDING_RATE_KBPS : CONFIG_UPLOAD_MAX_RATE_KBPS;
+    if (kbps > 0) {
+        int64_t rate = (int64_t)kbps * 1024;        /* bytes/s */
+        int64_t now  = esp_timer_get_time();
+        s_tokens += (now - s_refill_us) * rate / 1000000;
+        s_refill_us = now;
+        if (s_tokens > BURST_BYTES) {
+            s_tokens = BURST_BYTES;
+        }
+        s_tokens -= (int64_t)bytes;
+        if (s_tokens < 0) {
+            int64_t debt_ms = -s_tokens * 1000 / rate;
+            vTaskDelay(pdMS_TO_TICKS(debt_ms) + 1);
+        }
+    }
+    return (uint32_t)((esp_timer_get_time() - t_start) / 1000);
+}
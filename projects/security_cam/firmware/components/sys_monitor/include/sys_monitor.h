@@ -0,0 +1,42 @@
+/*
+ * sys_monitor.h — Per-task CPU load, stack margin and heap telemetry
+ *
+ * Needs CONFIG_FREERTOS_USE_TRACE_FACILITY and
+ * CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS (set in sdkconfig.defaults).
+ * Loads are measured between two snapshots of the FreeRTOS run-time
+ * counters, so a figure always covers a known window:
+ *
+ *   task        core prio   cpu%  stack free
+ *   clip_wr        1    6   12.4       2104
+ *   IDLE0          0    0   61.0        836
+ *
+ * cpu% is of one core; each core's IDLE task shows what is left on it.
+ * "-" in the core column means the task is not pinned.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief  Start the periodic report (every CONFIG_SYS_MONITOR_PERIOD_S;
+ *         0 = do nothing). One summary line — per-core load and heap — plus
+ *         a line for each task that used ≥ 1 % of a core or is within
+ *         512 bytes of its stack end.
+ */
+esp_err_t sys_monitor_start(void);
+
+/**
+ * @brief  Sample for sample_ms and print the full task table and heap
+ *         figures to stdout (boot console 'top'). Blocks for sample_ms.
+ */
+esp_err_t sys_monitor_print(uint32_t sample_ms);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,228 @@
+/*
+ * sys_monitor.c — Per-task CPU load, stack margin and heap telemetry
+ * (see sys_monitor.h)
+ */
+
+#include "sys_monitor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#if !CONFIG_FREERTOS_USE_TRACE_FACILITY || !CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+#error "sys_monitor needs CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS"
+#endif
+
+static const char *TAG = "sys_monitor";
+
+#define SNAPSHOT_SLACK     4        /* tasks created between count and snapshot */
+#define TASK_STACK         3072
+#define TASK_PRIO          1        /* just above idle */
+#define LOG_CPU_PERMILLE   10       /* periodic log: tasks using ≥ 1 % … */
+#define LOG_STACK_BYTES    512      /* … or this close to their stack end */
+#define LINE_LEN           96
+
+typedef struct {
+    TaskStatus_t               *tasks;
+    UBaseType_t                 count;
+    configRUN_TIME_COUNTER_TYPE total;      /* run-time clock at the snapshot */
+} snapshot_t;
+
+typedef struct {
+    const char *name;
+    BaseType_t  core;
+    UBaseType_t prio;
+    uint32_t    permille;                   /* of one core over the window */
+    uint32_t    stack_free;                 /* bytes never used */
+} row_t;
+
+static esp_err_t snapshot_take(snapshot_t *s)
+{
+    UBaseType_t cap = uxTaskGetNumberOfTasks() + SNAPSHOT_SLACK;
+    s->tasks = malloc(cap * sizeof(TaskStatus_t));
+    if (!s->tasks) {
+        return ESP_ERR_NO_MEM;
+    }
+    s->count = uxTaskGetSystemState(s->tasks, cap, &s->total);
+    if (s->count == 0) {
+        free(s->tasks);
+        s->tasks = NULL;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+static void snapshot_free(snapshot_t *s)
+{
+    free(s->tasks);
+    s->tasks = NULL;
+    s->count = 0;
+}
+
+/* Run time a task had before the window; tasks created since start at 0 */
+static configRUN_TIME_COUNTER_TYPE prev_runtime(const snapshot_t *prev, TaskHandle_t h)
+{
+    for (UBaseType_t i = 0; i < prev->count; i++) {
+        if (prev->tasks[i].xHandle == h) {
+            return prev->tasks[i].ulRunTimeCounter;
+        }
+    }
+    return 0;
+}
+
+/* Rows sorted by load, busiest first. Counters are unsigned, so a
+ * wrap inside the window still subtracts correctly. */
+static row_t *build_rows(const snapshot_t *prev, const snapshot_t *cur, uint32_t core_idle[])
+{
+    row_t *rows = malloc(cur->count * sizeof(row_t));
+    if (!rows) {
+        return NULL;
+    }
+    configRUN_TIME_COUNTER_TYPE elapsed = cur->total - prev->total;
+    for (UBaseType_t i = 0; i < cur->count; i++) {
+        const TaskStatus_t *t = &cur->tasks[i];
+        configRUN_TIME_COUNTER_TYPE ran = t->ulRunTimeCounter - prev_runtime(prev, t->xHandle);
+        row_t r = {
+            .name       = t->pcTaskName,
+            .core       = xTaskGetCoreID(t->xHandle),
+            .prio       = t->uxCurrentPriority,
+            .permille   = elapsed ? (uint32_t)((uint64_t)ran * 1000 / elapsed) : 0,
+            .stack_free = (uint32_t)t->usStackHighWaterMark,
+        };
+        for (int c = 0; c < portNUM_PROCESSORS; c++) {
+            if (t->xHandle == xTaskGetIdleTaskHandleForCore(c)) {
+                core_idle[c] = r.permille;
+            }
+        }
+        UBaseType_t j = i;
+        while (j > 0 && rows[j - 1].permille < r.permille) {
+            rows[j] = rows[j - 1];
+            j--;
+        }
+        rows[j] = r;
+    }
+    return rows;
+}
+
+static void format_row(char *line, size_t len, const row_t *r)
+{
+    char core[4] = "-";
+    if (r->core != tskNO_AFFINITY) {
+        snprintf(core, sizeof(core), "%d", (int)r->core);
+    }
+    snprintf(line, len, "%-16s %4s %4u %4"PRIu32".%"PRIu32" %10"PRIu32,
+             r->name, core, (unsigned)r->prio, r->permille / 10, r->permille % 10,
+             r->stack_free);
+}
+
+static void format_summary(char *line, size_t len, const uint32_t core_idle[])
+{
+    int n = snprintf(line, len, "load");
+    for (int c = 0; c < portNUM_PROCESSORS && n > 0 && (size_t)n < len; c++) {
+        uint32_t busy = core_idle[c] > 1000 ? 0 : 1000 - core_idle[c];
+        n += snprintf(line + n, len - n, " core%d %"PRIu32".%"PRIu32"%%",
+                      c, busy / 10, busy % 10);
+    }
+}
+
+static void format_heap(char *line, size_t len, uint32_t caps, const char *name)
+{
+    snprintf(line, len, "%-8s free %6u KB  min %6u KB  largest %6u KB", name,
+             (unsigned)(heap_caps_get_free_size(caps) >> 10),
+             (unsigned)(heap_caps_get_minimum_free_size(caps) >> 10),
+             (unsigned)(heap_caps_get_largest_free_block(caps) >> 10));
+}
+
+esp_err_t sys_monitor_print(uint32_t sample_ms)
+{
+    snapshot_t prev, cur;
+    esp_err_t err = snapshot_take(&prev);
+    if (err != ESP_OK) {
+        return err;
+    }
+    vTaskDelay(pdMS_TO_TICKS(sample_ms));
+    err = snapshot_take(&cur);
+    if (err != ESP_OK) {
+        snapshot_free(&prev);
+        return err;
+    }
+
+    uint32_t core_idle[portNUM_PROCESSORS] = { 0 };
+    row_t *rows = build_rows(&prev, &cur, core_idle);
+    if (!rows) {
+        snapshot_free(&prev);
+        snapshot_free(&cur);
+        return ESP_ERR_NO_MEM;
+    }
+
+    char line[LINE_LEN];
+    printf("\n  %-16s %4s %4s %6s %10s\n", "task", "core", "prio", "cpu%", "stack free");
+    for (UBaseType_t i = 0; i < cur.count; i++) {
+        format_row(line, sizeof(line), &rows[i]);
+        printf("  %s\n", line);
+    }
+    format_summary(line, sizeof(line), core_idle);
+    printf("\n  %s over %"PRIu32" ms\n", line, sample_ms);
+    format_heap(line, sizeof(line), MALLOC_CAP_INTERNAL, "internal");
+    printf("  %s\n", line);
+    format_heap(line, sizeof(line), MALLOC_CAP_SPIRAM, "psram");
+    printf("  %s\n\n", line);
+
+    free(rows);
+    snapshot_free(&prev);
+    snapshot_free(&cur);
+    return ESP_OK;
+}
+
+static void monitor_task(void *arg)
+{
+    (void)arg;
+    snapshot_t prev = { 0 };
+    snapshot_take(&prev);
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_SYS_MONITOR_PERIOD_S * 1000));
+        snapshot_t cur;
+        if (snapshot_take(&cur) != ESP_OK) {
+            continue;
+        }
+        uint32_t core_idle[portNUM_PROCESSORS] = { 0 };
+        row_t *rows = prev.tasks ? build_rows(&prev, &cur, core_idle) : NULL;
+        if (rows) {
+            char line[LINE_LEN];
+            format_summary(line, sizeof(line), core_idle);
+            ESP_LOGI(TAG, "%s | internal %u KB free (min %u) | psram %u KB free (min %u)",
+                     line,
+                     (unsigned)(heap_caps_get_free_size(MALLOC_CAP_INTERNAL) >> 10),
+                     (unsigned)(heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL) >> 10),
+                     (unsigned)(heap_caps_get_free_size(MALLOC_CAP_SPIRAM) >> 10),
+                     (unsigned)(heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM) >> 10));
+            for (UBaseType_t i = 0; i < cur.count; i++) {
+                if (rows[i].permille >= LOG_CPU_PERMILLE || rows[i].stack_free < LOG_STACK_BYTES) {
+                    format_row(line, sizeof(line), &rows[i]);
+                    ESP_LOGI(TAG, "  %s", line);
+                }
+            }
+            free(rows);
+        }
+        snapshot_free(&prev);
+        prev = cur;
+    }
+}
+
+esp_err_t sys_monitor_start(void)
+{
+    if (CONFIG_SYS_MONITOR_PERIOD_S == 0) {
+        return ESP_OK;
+    }
+    if (xTaskCreatePinnedToCore(monitor_task, "sys_mon", TASK_STACK, NULL, TASK_PRIO, NULL,
+                                CONFIG_TASK_NET_CORE) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Task/heap report every %d s", CONFIG_SYS_MONITOR_PERIOD_S);
+    return ESP_OK;
+}
@@ -0,0 +1,68 @@
+/*
+ * thumbnail.h — Clip thumbnail, picked and encoded off the recording loop
+ *
+ * The recording loop offers every frame of the first CONFIG_THUMB_WINDOW_MS
+ * of a clip. A frame that scores higher than the best so far is copied into
+ * a PSRAM candidate buffer (one memcpy, no decode); everything else costs a
+ * compare. When the window closes — or the clip ends first — the candidate
+ * goes to the "thumb" task, which runs camera_hal_make_thumbnail() and
+ * writes <path>. The loop never waits for the card. H.264 frames are
+ * thumbnailed by the HAL as they are offered (hardware JPEG on the P4) and
+ * the largest thumbnail becomes the candidate.
+ *
+ * Call sequence from one task:
+ *   thumbnail_init()                       ← once at startup
+ *   thumbnail_begin("/sdcard/X_thumb.jpg") ← clip opened
+ *   thumbnail_offer(&frame)                ← every recorded frame
+ *   thumbnail_end()                        ← clip closed
+ *
+ * From the upload task, before the clip goes up:
+ *   thumbnail_settle("/sdcard/X_thumb.jpg", ms)
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "camera_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief  Allocate candidate buffers and start the encoder task.
+ * @param  max_frame  Largest JPEG frame that can become a candidate.
+ */
+esp_err_t thumbnail_init(size_t max_frame);
+
+/**
+ * @brief  Start selecting for a new clip. A selection still open (no
+ *         thumbnail_end) is handed to the encoder first.
+ */
+void thumbnail_begin(const char *thumb_path);
+
+/**
+ * @brief  Consider a frame. Cheap unless it is the best so far.
+ *         An H.264 frame must still be held (camera_hal_make_thumbnail()
+ *         reads its YUV frame); it may be released as soon as this returns.
+ */
+void thumbnail_offer(const cam_frame_t *frame);
+
+/**
+ * @brief  Clip ended. Hands the candidate over if the window was still open.
+ */
+void thumbnail_end(void);
+
+/**
+ * @brief  Wait for a clip's thumbnail to be written. Any task.
+ *         After the timeout the thumbnail is dropped — the encoder will not
+ *         write it later — so the clip can go up (and be deleted) without it.
+ * @return ESP_OK if the file is written or none was selected,
+ *         ESP_ERR_TIMEOUT if it was dropped.
+ */
+esp_err_t thumbnail_settle(const char *thumb_path, uint32_t timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
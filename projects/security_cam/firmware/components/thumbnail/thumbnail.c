@@ -0,0 +1,293 @@
+/*
+ * thumbnail.c — Clip thumbnail, picked and encoded off the recording loop
+ *
+ * Two candidate slots circulate through free_q and job_q, so the next clip
+ * can start selecting while the previous thumbnail is still encoding (a
+ * clip continued after CONFIG_MAX_CLIP_SECONDS starts within one frame).
+ * If both are busy the new clip simply gets no thumbnail. A slot's bit in
+ * s_idle is set while it is free, which is what thumbnail_settle() waits on.
+ *
+ * H.264 frames cannot be scaled from a copy: the HAL thumbnails each one
+ * on the recording loop while its YUV frame is still held (P4 hardware
+ * JPEG), and the largest thumbnail is kept — the same detail score as a
+ * JPEG frame's size. The thumb task then only writes it.
+ *
+ * Hardware without a thumbnail path (camera_hal_make_thumbnail() returns
+ * ESP_ERR_NOT_SUPPORTED) gets the selected full frame written instead.
+ */
+
+#include "thumbnail.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+static const char *TAG = "thumbnail";
+
+#define SLOT_COUNT     2
+#define OUT_MAX        (16 * 1024)      /* 160×120 q70 is 4–8 KB */
+#define TASK_STACK     4096
+#define TASK_PRIO      2                /* below capture and the recording loop */
+#define PATH_LEN       96
+
+typedef struct {
+    uint8_t *buf;                       /* copy of the best frame, PSRAM */
+    size_t   len;                       /* 0 = nothing selected yet */
+    uint32_t width, height;
+    uint64_t timestamp_us;
+    char     path[PATH_LEN];
+    bool     scaled;                    /* buf holds the thumbnail itself */
+    bool     busy;                      /* between begin and the file write */
+    bool     cancelled;                 /* thumbnail_settle() gave up: no file */
+} slot_t;
+
+static slot_t        s_slots[SLOT_COUNT];
+static QueueHandle_t s_free_q;
+static QueueHandle_t s_job_q;
+static SemaphoreHandle_t  s_lock;       /* busy / cancelled / path vs. settle */
+static EventGroupHandle_t s_idle;       /* bit i: slot i free */
+static uint8_t      *s_out;             /* encoder output, thumb task only */
+static uint8_t      *s_trial;           /* H.264 thumbnails, recording loop only */
+static size_t        s_max_frame;
+static int           s_cur = -1;        /* slot being filled, -1 = none */
+static uint64_t      s_window_end_us;   /* 0 = no frame offered yet */
+
+static void write_file(const char *path, const uint8_t *data, size_t len)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        ESP_LOGW(TAG, "Cannot create %s", path);
+        return;
+    }
+    size_t n = fwrite(data, 1, len, f);
+    if (fclose(f) != 0 || n != len) {
+        ESP_LOGW(TAG, "Short write %s", path);
+    }
+}
+
+/* Slot done (written, skipped or empty): wake thumbnail_settle() */
+static void recycle(int idx)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_slots[idx].busy = false;
+    xSemaphoreGive(s_lock);
+    xEventGroupSetBits(s_idle, 1u << idx);
+    xQueueSend(s_free_q, &idx, 0);          /* holds SLOT_COUNT — never full */
+}
+
+static void thumb_task(void *arg)
+{
+    int idx;
+    while (1) {
+        if (xQueueReceive(s_job_q, &idx, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        slot_t *s = &s_slots[idx];
+        cam_frame_t frame = {
+            .data         = s->buf,
+            .len          = s->len,
+            .width        = s->width,
+            .height       = s->height,
+            .fmt          = CAM_PIXFMT_JPEG,
+            .timestamp_us = s->timestamp_us,
+        };
+
+        int64_t t0 = esp_timer_get_time();
+        size_t out_len = 0;
+        esp_err_t err = ESP_OK;
+        if (s->cancelled) {
+            err = ESP_ERR_INVALID_STATE;
+        } else if (!s->scaled) {
+            err = camera_hal_make_thumbnail(&frame, s_out, OUT_MAX, &out_len);
+        }
+
+        /* The clip may have been uploaded without it meanwhile: a file
+         * written now would be an orphan on the card */
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (s->cancelled) {
+            ESP_LOGW(TAG, "%s: dropped, the clip went without it", s->path);
+        } else if (err == ESP_OK && s->scaled) {
+            write_file(s->path, s->buf, s->len);
+            ESP_LOGI(TAG, "%s: %u B, scaled while recording", s->path, (unsigned)s->len);
+        } else if (err == ESP_OK) {
+            write_file(s->path, s_out, out_len);
+            ESP_LOGI(TAG, "%s: %u B (from %u B frame) in %lld ms", s->path,
+                     (unsigned)out_len, (unsigned)s->len,
+                     (esp_timer_get_time() - t0) / 1000);
+        } else if (err == ESP_ERR_NOT_SUPPORTED) {
+            write_file(s->path, s->buf, s->len);
+            ESP_LOGI(TAG, "%s: full frame, %u B", s->path, (unsigned)s->len);
+        } else {
+            ESP_LOGW(TAG, "%s: encode failed (%s)", s->path, esp_err_to_name(err));
+        }
+        xSemaphoreGive(s_lock);
+        recycle(idx);
+    }
+}
+
+esp_err_t thumbnail_init(size_t max_frame)
+{
+    s_max_frame = max_frame;
+    s_free_q = xQueueCreate(SLOT_COUNT, sizeof(int));
+    s_job_q  = xQueueCreate(SLOT_COUNT, sizeof(int));
+    s_lock   = xSemaphoreCreateMutex();
+    s_idle   = xEventGroupCreate();
+    s_out    = heap_caps_malloc(OUT_MAX, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!s_free_q || !s_job_q || !s_lock || !s_idle || !s_out) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (camera_hal_get_caps()->delivers_h264) {
+        s_trial = heap_caps_malloc(OUT_MAX, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!s_trial) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        s_slots[i].buf = heap_caps_malloc(max_frame, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!s_slots[i].buf) {
+            return ESP_ERR_NO_MEM;
+        }
+        xQueueSend(s_free_q, &i, 0);
+        xEventGroupSetBits(s_idle, 1u << i);
+    }
+    if (xTaskCreatePinnedToCore(thumb_task, "thumb", TASK_STACK, NULL, TASK_PRIO, NULL,
+                                CONFIG_TASK_MEDIA_CORE) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "%d × %u KB candidate slots, %d ms window", SLOT_COUNT,
+             (unsigned)(max_frame >> 10), CONFIG_THUMB_WINDOW_MS);
+    return ESP_OK;
+}
+
+/* Selection over: encode the candidate, or recycle an empty slot */
+static void submit(void)
+{
+    if (s_cur < 0) {
+        return;
+    }
+    if (s_slots[s_cur].len > 0) {
+        xQueueSend(s_job_q, &s_cur, 0);     /* holds SLOT_COUNT — never full */
+    } else {
+        recycle(s_cur);
+    }
+    s_cur = -1;
+}
+
+void thumbnail_begin(const char *thumb_path)
+{
+    if (!s_free_q) {
+        return;
+    }
+    submit();
+    if (xQueueReceive(s_free_q, &s_cur, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Encoder busy — %s skipped", thumb_path);
+        s_cur = -1;
+        return;
+    }
+    slot_t *s = &s_slots[s_cur];
+    s->len    = 0;
+    s->scaled = false;
+    xEventGroupClearBits(s_idle, 1u << s_cur);
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    strlcpy(s->path, thumb_path, sizeof(s->path));
+    s->busy      = true;
+    s->cancelled = false;
+    xSemaphoreGive(s_lock);
+    s_window_end_us = 0;
+}
+
+/* Thumbnail an H.264 frame now, while the HAL still holds its YUV frame;
+ * keep it if it is the largest so far */
+static void offer_held(slot_t *s, const cam_frame_t *frame)
+{
+    size_t len = 0;
+    if (!s_trial || camera_hal_make_thumbnail(frame, s_trial, OUT_MAX, &len) != ESP_OK ||
+        len <= s->len) {
+        return;
+    }
+    memcpy(s->buf, s_trial, len);
+    s->len          = len;
+    s->width        = frame->width;
+    s->height       = frame->height;
+    s->timestamp_us = frame->timestamp_us;
+    s->scaled       = true;
+}
+
+void thumbnail_offer(const cam_frame_t *frame)
+{
+    if (s_cur < 0) {
+        return;
+    }
+    /* GRAB_LATEST can return a stale GRAY8 frame right after the mode
+     * switch — only real JPEGs (SOI marker) and H.264 are candidates */
+    bool h264 = frame->fmt == CAM_PIXFMT_H264_NALU;
+    if (!h264 && (frame->fmt != CAM_PIXFMT_JPEG || frame->len < 2 ||
+                  frame->len > s_max_frame ||
+                  ((const uint8_t *)frame->data)[0] != 0xFF ||
+                  ((const uint8_t *)frame->data)[1] != 0xD8)) {
+        return;
+    }
+    if (!s_window_end_us) {
+        s_window_end_us = frame->timestamp_us + (uint64_t)CONFIG_THUMB_WINDOW_MS * 1000;
+    }
+
+    /* Same quality setting throughout (rate_ctrl steps it at most once a
+     * second, a few % of size), so a larger JPEG has more detail: sharp
+     * edges survive quantisation, blur and AE flicker do not */
+    slot_t *s = &s_slots[s_cur];
+    if (h264) {
+        offer_held(s, frame);
+    } else if (frame->len > s->len) {
+        memcpy(s->buf, frame->data, frame->len);
+        s->len          = frame->len;
+        s->width        = frame->width;
+        s->height       = frame->height;
+        s->timestamp_us = frame->timestamp_us;
+    }
+    if (frame->timestamp_us >= s_window_end_us) {
+        submit();
+    }
+}
+
+void thumbnail_end(void)
+{
+    submit();
+}
+
+esp_err_t thumbnail_settle(const char *thumb_path, uint32_t timeout_ms)
+{
+    if (!s_lock) {
+        return ESP_OK;
+    }
+    int idx = -1;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < SLOT_COUNT; i++) {
+        if (s_slots[i].busy && !strcmp(s_slots[i].path, thumb_path)) {
+            idx = i;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    if (idx < 0) {
+        return ESP_OK;                      /* written already, or never selected */
+    }
+
+    EventBits_t bits = xEventGroupWaitBits(s_idle, 1u << idx, pdFALSE, pdTRUE,
+                                           pdMS_TO_TICKS(timeout_ms));
+    if (bits & (1u << idx)) {
+        return ESP_OK;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool pending = s_slots[idx].busy && !strcmp(s_slots[idx].path, thumb_path);
+    if (pending) {
+        s_slots[idx].cancelled = true;
+    }
+    xSemaphoreGive(s_lock);
+    return pending ? ESP_ERR_TIMEOUT : ESP_OK;
+}
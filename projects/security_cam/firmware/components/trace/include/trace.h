@@ -0,0 +1,117 @@
+/*
+ * trace.h — Hot-path latency tracing for capture → record → upload
+ *
+ * Each trace point keeps a histogram (count, sum, min, max and log2
+ * buckets with two steps per octave, ~±20 % on a percentile) for the
+ * current window, and every sample also goes into a ring of recent
+ * events. Rings and histograms are kept per core: a core only ever
+ * writes its own, with interrupts masked for the few stores of one
+ * event, so recording takes no lock. Readers merge the cores' histograms,
+ * retrying a copy the other core was updating.
+ *
+ * Windows: trace_snapshot(true) copies the current window and starts a new
+ * one — once per clip, so each clip's sidecar covers the time since the
+ * previous clip closed. The copy only merges a few KB in RAM;
+ * trace_write_json() puts it on the card later, from a task that may wait
+ * for SD. The histograms live in RAM that survives a software reset,
+ * panic or watchdog, so after one of those trace_print() (boot console
+ * 'trace') can show the previous boot's last window.
+ *
+ * Usage:
+ *   int64_t t0 = trace_start();
+ *   … work …
+ *   trace_stop(TRACE_FRAME_GET, t0);
+ *
+ * All calls are no-ops before trace_init().
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    TRACE_MOTION_WAIT,      /* camera_hal_get_frame() in motion watch */
+    TRACE_MOTION_SCORE,     /* motion_detect_analyze() incl. luma decode */
+    TRACE_MODE_SWITCH,      /* camera_hal_set_mode() */
+    TRACE_FRAME_GET,        /* camera_hal_get_frame() while recording */
+    TRACE_FRAME_WRITE,      /* backend write of one frame (writer task) */
+    TRACE_FRAME_DROP,       /* count only: frame not queued for the writer */
+    TRACE_PRESIGN,          /* presign Lambda request, start to end */
+    TRACE_PUT_CONNECT,      /* DNS + TCP + TLS of a PUT (new connections only) */
+    TRACE_PUT_BODY,         /* PUT headers and body sent */
+    TRACE_PUT_RESPONSE,     /* body sent → response read */
+    TRACE_POINT_COUNT
+} trace_point_t;
+
+/**
+ * @brief  Allocate the event rings and start a window. If the reset was
+ *         a software reset, panic or watchdog, the previous boot's
+ *         histograms are kept for trace_print() first.
+ */
+esp_err_t trace_init(void);
+
+/**
+ * @brief  Record one sample of point p, us microseconds long.
+ */
+void trace_record(trace_point_t p, uint32_t us);
+
+/**
+ * @brief  Record an event that has no duration (counted only).
+ */
+static inline void trace_count(trace_point_t p)
+{
+    trace_record(p, 0);
+}
+
+static inline int64_t trace_start(void)
+{
+    return esp_timer_get_time();
+}
+
+static inline void trace_stop(trace_point_t p, int64_t t0)
+{
+    trace_record(p, (uint32_t)(esp_timer_get_time() - t0));
+}
+
+/**
+ * @brief  Print min/avg/p50/p99/max per point for the current window (and
+ *         the previous boot's, if kept) plus the latest events, to stdout.
+ */
+void trace_print(void);
+
+typedef struct trace_window trace_window_t;
+
+/**
+ * @brief  Copy the current window, both cores merged (PSRAM).
+ * @param  reset  Start a new window afterwards (one task only).
+ * @return The copy — free it with trace_free() — or NULL before
+ *         trace_init() or without memory.
+ */
+trace_window_t *trace_snapshot(bool reset);
+
+/**
+ * @brief  Write a snapshot as JSON to path (the clip sidecar,
+ *         "<clip>_trace.json"):
+ *           { "version": 1, "window_ms": N,
+ *             "points": { "frame_get": { "count": N, "min_us": …, "avg_us": …,
+ *                         "p50_us": …, "p99_us": …, "max_us": … }, …,
+ *                         "frame_drop": { "count": N } } }
+ *         Points without samples are left out. Any task.
+ */
+esp_err_t trace_write_json(const trace_window_t *w, const char *path);
+
+/**
+ * @brief  Free a snapshot; NULL is ignored.
+ */
+void trace_free(trace_window_t *w);
+
+#ifdef __cplusplus
+}
+#endif
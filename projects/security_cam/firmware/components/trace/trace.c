@@ -0,0 +1,392 @@
+/*
+ * trace.c — Hot-path latency tracing (see trace.h)
+ */
+
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+
+static const char *TAG = "trace";
+
+#define TRACE_MAGIC     0x54524332u     /* "TRC2" — noinit histograms are valid */
+#define JSON_VERSION    1
+#define BUCKETS         64              /* two per octave covers all of uint32 */
+#define RING_EVENTS     256             /* per core, power of two */
+#define PRINT_EVENTS    24
+
+static const char *const POINT_NAMES[TRACE_POINT_COUNT] = {
+    [TRACE_MOTION_WAIT]  = "motion_wait",
+    [TRACE_MOTION_SCORE] = "motion_score",
+    [TRACE_MODE_SWITCH]  = "mode_switch",
+    [TRACE_FRAME_GET]    = "frame_get",
+    [TRACE_FRAME_WRITE]  = "frame_write",
+    [TRACE_FRAME_DROP]   = "frame_drop",
+    [TRACE_PRESIGN]      = "presign",
+    [TRACE_PUT_CONNECT]  = "put_connect",
+    [TRACE_PUT_BODY]     = "put_body",
+    [TRACE_PUT_RESPONSE] = "put_response",
+};
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t buckets[BUCKETS];
+} hist_t;
+
+/* A merged window: snapshots and the previous boot's copy */
+typedef struct trace_window {
+    int64_t  start_us;                  /* esp_timer time the window opened */
+    int64_t  last_us;                   /* latest sample */
+    hist_t   h[TRACE_POINT_COUNT];
+} window_t;
+
+typedef struct {
+    uint32_t epoch;                     /* window these samples belong to */
+    int64_t  last_us;
+    hist_t   h[TRACE_POINT_COUNT];
+} hist_set_t;
+
+/* One core's histograms. Only that core writes them, interrupts masked;
+ * seq is odd while it does, so a reader on the other core retries. The
+ * two sets alternate by window: a reset moves the writer to the other
+ * set and the finished one is read without racing it. */
+typedef struct {
+    volatile uint32_t seq;
+    hist_set_t        set[2];           /* set[epoch & 1] */
+} core_hist_t;
+
+typedef struct {
+    uint32_t          magic;
+    volatile uint32_t epoch;            /* current window */
+    int64_t           start_us;
+    core_hist_t       core[portNUM_PROCESSORS];
+} live_t;
+
+typedef struct {
+    int64_t  ts_us;
+    uint32_t us;
+    uint8_t  point;
+} event_t;
+
+typedef struct {
+    uint32_t head;                      /* next slot; only its own core writes */
+    event_t  ev[RING_EVENTS];
+} ring_t;
+
+/* Not cleared at boot: survives a software reset, panic or watchdog */
+static __NOINIT_ATTR live_t s_live;
+static window_t   *s_prev;              /* previous boot's window, PSRAM; NULL = none */
+static ring_t     *s_ring[portNUM_PROCESSORS];
+static bool        s_ready;
+
+static bool is_count(trace_point_t p)
+{
+    return p == TRACE_FRAME_DROP;
+}
+
+static unsigned bucket_of(uint32_t v)
+{
+    if (v < 2) {
+        return v;
+    }
+    unsigned msb = 31 - __builtin_clz(v);
+    return msb * 2 + ((v >> (msb - 1)) & 1);
+}
+
+/* Largest value that lands in bucket b */
+static uint32_t bucket_upper(unsigned b)
+{
+    if (b < 2) {
+        return b;
+    }
+    unsigned msb = b / 2;
+    uint64_t lower = (1ull << msb) + (uint64_t)(b & 1) * (1ull << (msb - 1));
+    return (uint32_t)(lower + (1ull << (msb - 1)) - 1);
+}
+
+static uint32_t percentile(const hist_t *h, uint32_t pct)
+{
+    uint64_t want = ((uint64_t)h->count * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= want) {
+            uint32_t up = bucket_upper(b);
+            return up < h->max ? up : h->max;
+        }
+    }
+    return h->max;
+}
+
+static void hist_merge(hist_t *to, const hist_t *from)
+{
+    if (from->count == 0) {
+        return;
+    }
+    if (to->count == 0 || from->min < to->min) {
+        to->min = from->min;
+    }
+    if (from->max > to->max) {
+        to->max = from->max;
+    }
+    to->count += from->count;
+    to->sum   += from->sum;
+    for (unsigned b = 0; b < BUCKETS; b++) {
+        to->buckets[b] += from->buckets[b];
+    }
+}
+
+/* Add one core's histograms of window epoch into w. Retries while that
+ * core is mid-update (a few stores, interrupts masked); a core that has
+ * not recorded since the window opened still holds an older window in
+ * that set and adds nothing. */
+static void core_merge(window_t *w, const core_hist_t *c, uint32_t epoch, hist_set_t *tmp)
+{
+    uint32_t seq;
+    do {
+        while ((seq = c->seq) & 1) {
+            /* the other core is updating */
+        }
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        memcpy(tmp, &c->set[epoch & 1], sizeof(*tmp));
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    } while (c->seq != seq);
+
+    if (tmp->epoch != epoch) {
+        return;
+    }
+    for (int p = 0; p < TRACE_POINT_COUNT; p++) {
+        hist_merge(&w->h[p], &tmp->h[p]);
+    }
+    if (tmp->last_us > w->last_us) {
+        w->last_us = tmp->last_us;
+    }
+}
+
+static void window_merge(window_t *w, uint32_t epoch, hist_set_t *tmp)
+{
+    memset(w, 0, sizeof(*w));
+    w->start_us = s_live.start_us;
+    w->last_us  = w->start_us;
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        core_merge(w, &s_live.core[c], epoch, tmp);
+    }
+}
+
+esp_err_t trace_init(void)
+{
+    esp_reset_reason_t why = esp_reset_reason();
+    bool survived = why == ESP_RST_SW || why == ESP_RST_PANIC || why == ESP_RST_INT_WDT ||
+                    why == ESP_RST_TASK_WDT || why == ESP_RST_WDT;
+    if (survived && s_live.magic == TRACE_MAGIC) {
+        s_prev = heap_caps_malloc(sizeof(window_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        hist_set_t *tmp = heap_caps_malloc(sizeof(hist_set_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (s_prev && tmp) {
+            for (int c = 0; c < portNUM_PROCESSORS; c++) {
+                s_live.core[c].seq = 0;         /* a reset mid-update left it odd */
+            }
+            window_merge(s_prev, s_live.epoch, tmp);
+        }
+        if (s_prev && (!tmp || s_prev->last_us < s_prev->start_us)) {
+            free(s_prev);
+            s_prev = NULL;
+        }
+        free(tmp);
+    }
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        s_ring[c] = heap_caps_calloc(1, sizeof(ring_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!s_ring[c]) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    memset(&s_live, 0, sizeof(s_live));
+    s_live.start_us = esp_timer_get_time();
+    s_live.magic    = TRACE_MAGIC;
+    s_ready = true;
+    ESP_LOGI(TAG, "%d points, %d-event ring per core%s", TRACE_POINT_COUNT, RING_EVENTS,
+             s_prev ? ", previous boot's window kept" : "");
+    return ESP_OK;
+}
+
+void trace_record(trace_point_t p, uint32_t us)
+{
+    if (!s_ready || (unsigned)p >= TRACE_POINT_COUNT) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+
+    /* Masked, the task cannot move to the other core or be preempted
+     * between taking a slot and filling it */
+    UBaseType_t irq = portSET_INTERRUPT_MASK_FROM_ISR();
+    int core = xPortGetCoreID();
+    ring_t *r = s_ring[core];
+    event_t *e = &r->ev[r->head++ & (RING_EVENTS - 1)];
+    e->ts_us = now;
+    e->us    = us;
+    e->point = (uint8_t)p;
+
+    core_hist_t *c = &s_live.core[core];
+    c->seq++;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint32_t epoch = s_live.epoch;
+    hist_set_t *hs = &c->set[epoch & 1];
+    if (hs->epoch != epoch) {
+        memset(hs, 0, sizeof(*hs));     /* first sample of a new window */
+        hs->epoch = epoch;
+    }
+    hist_t *h = &hs->h[p];
+    if (h->count == 0 || us < h->min) {
+        h->min = us;
+    }
+    if (us > h->max) {
+        h->max = us;
+    }
+    h->count++;
+    h->sum += us;
+    h->buckets[bucket_of(us)]++;
+    hs->last_us = now;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    c->seq++;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(irq);
+}
+
+/* Merged copy of the current window (caller frees). A reset first moves
+ * both cores to the other set, then reads the finished one; only one task
+ * resets windows (the recording loop, at clip end), plain copies may run
+ * alongside. */
+static window_t *window_snapshot(bool reset)
+{
+    window_t   *w   = heap_caps_malloc(sizeof(window_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    hist_set_t *tmp = heap_caps_malloc(sizeof(hist_set_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!w || !tmp) {
+        free(w);
+        free(tmp);
+        return NULL;
+    }
+    int64_t now = esp_timer_get_time();
+    uint32_t epoch = s_live.epoch;
+    int64_t start_us = s_live.start_us;
+    if (reset) {
+        s_live.epoch = epoch + 1;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        s_live.start_us = now;
+    }
+    window_merge(w, epoch, tmp);
+    w->start_us = start_us;
+    w->last_us  = now;
+    free(tmp);
+    return w;
+}
+
+static void print_window(const window_t *w, const char *title)
+{
+    printf("\n  %s — %lld s\n", title, (long long)((w->last_us - w->start_us) / 1000000));
+    printf("  %-13s %8s %9s %9s %9s %9s %9s\n",
+           "point", "count", "min us", "avg us", "p50 us", "p99 us", "max us");
+    for (int p = 0; p < TRACE_POINT_COUNT; p++) {
+        const hist_t *h = &w->h[p];
+        if (h->count == 0) {
+            continue;
+        }
+        if (is_count(p)) {
+            printf("  %-13s %8"PRIu32"\n", POINT_NAMES[p], h->count);
+            continue;
+        }
+        printf("  %-13s %8"PRIu32" %9"PRIu32" %9"PRIu32" %9"PRIu32" %9"PRIu32" %9"PRIu32"\n",
+               POINT_NAMES[p], h->count, h->min, (uint32_t)(h->sum / h->count),
+               percentile(h, 50), percentile(h, 99), h->max);
+    }
+}
+
+static int event_cmp(const void *a, const void *b)
+{
+    int64_t ta = ((const event_t *)a)->ts_us, tb = ((const event_t *)b)->ts_us;
+    return ta < tb ? -1 : ta > tb;
+}
+
+void trace_print(void)
+{
+    if (s_prev) {
+        print_window(s_prev, "Previous boot, last window");
+    }
+    if (!s_ready) {
+        printf("\n  Tracing not started yet\n\n");
+        return;
+    }
+    window_t *w = window_snapshot(false);
+    if (w) {
+        print_window(w, "Current window");
+        free(w);
+    }
+
+    /* Latest events of both cores, merged. Read without a lock — an
+     * event being written meanwhile may show half-updated. */
+    event_t ev[PRINT_EVENTS * portNUM_PROCESSORS];
+    int n = 0;
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        uint32_t head = s_ring[c]->head;
+        uint32_t take = head < PRINT_EVENTS ? head : PRINT_EVENTS;
+        for (uint32_t i = head - take; i != head; i++) {
+            ev[n++] = s_ring[c]->ev[i & (RING_EVENTS - 1)];
+        }
+    }
+    qsort(ev, n, sizeof(ev[0]), event_cmp);
+    printf("\n  Latest events\n");
+    for (int i = n > PRINT_EVENTS ? n - PRINT_EVENTS : 0; i < n; i++) {
+        printf("  %10lld.%03lld  %-13s %9"PRIu32" us\n",
+               (long long)(ev[i].ts_us / 1000000), (long long)(ev[i].ts_us / 1000 % 1000),
+               ev[i].point < TRACE_POINT_COUNT ? POINT_NAMES[ev[i].point] : "?", ev[i].us);
+    }
+    printf("\n");
+}
+
+trace_window_t *trace_snapshot(bool reset)
+{
+    return s_ready ? window_snapshot(reset) : NULL;
+}
+
+void trace_free(trace_window_t *w)
+{
+    free(w);
+}
+
+esp_err_t trace_write_json(const trace_window_t *w, const char *path)
+{
+    if (!w) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return ESP_FAIL;
+    }
+    fprintf(f, "{\"version\":%d,\"window_ms\":%lld,\"points\":{", JSON_VERSION,
+            (long long)((w->last_us - w->start_us) / 1000));
+    bool first = true;
+    for (int p = 0; p < TRACE_POINT_COUNT; p++) {
+        const hist_t *h = &w->h[p];
+        if (h->count == 0) {
+            continue;
+        }
+        fprintf(f, "%s\"%s\":{\"count\":%"PRIu32, first ? "" : ",", POINT_NAMES[p], h->count);
+        if (!is_count(p)) {
+            fprintf(f, ",\"min_us\":%"PRIu32",\"avg_us\":%"PRIu32",\"p50_us\":%"PRIu32
+                       ",\"p99_us\":%"PRIu32",\"max_us\":%"PRIu32,
+                    h->min, (uint32_t)(h->sum / h->count), percentile(h, 50),
+                    percentile(h, 99), h->max);
+        }
+        fputc('}', f);
+        first = false;
+    }
+    fputs("}}\n", f);
+    return fclose(f) == 0 ? ESP_OK : ESP_FAIL;
+}
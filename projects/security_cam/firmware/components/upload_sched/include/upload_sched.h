@@ -0,0 +1,87 @@
+/*
+ * upload_sched.h — Persistent clip upload queue with retry backoff
+ *
+ * Every clip waiting for upload has an entry in /sdcard/uploads.q, so the
+ * backlog survives reboots without scanning the card. The upload task asks
+ * for due clips newest first — a fresh alert never waits behind an old
+ * backlog — and reports each result:
+ *   success / file gone → entry removed (NOT_FOUND with the clip
+ *                         still on the card is an ordinary failure)
+ *   failure             → retried after CONFIG_UPLOAD_RETRY_BASE_S × 2^n,
+ *                         capped at CONFIG_UPLOAD_RETRY_MAX_S
+ * While offline nothing is due; going online makes every entry due at once.
+ *
+ * Backoff deadlines are kept in RAM only: after a reboot every clip is
+ * tried once straight away, then backs off from its stored attempt count.
+ *
+ * Thread-safe (one mutex); manifest writes happen on the calling task.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UPLOAD_SCHED_MAX        128    /* manifest entries */
+#define UPLOAD_SCHED_NAME_CHARS 63     /* clip file name incl. extension */
+#define UPLOAD_SCHED_NAME_LEN   (UPLOAD_SCHED_NAME_CHARS + 1)
+
+/**
+ * @brief  Load the manifest from <dir>/uploads.q. Starts online.
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND if there was no manifest yet
+ *         (first boot with this firmware — the caller imports the clips
+ *         already on the card with upload_sched_add()).
+ */
+esp_err_t upload_sched_init(const char *dir);
+
+/**
+ * @brief  Add a clip as the newest entry and make it due now. A clip
+ *         already listed keeps its place and attempt count and is made due.
+ *         When the manifest is full the oldest entry is dropped (the file
+ *         stays on the card).
+ */
+esp_err_t upload_sched_add(const char *clip_file);
+
+/**
+ * @brief  Copy up to max due clips into names, newest first.
+ * @return Number copied.
+ */
+size_t upload_sched_next(char names[][UPLOAD_SCHED_NAME_LEN], size_t max);
+
+/**
+ * @brief  Report an upload attempt. ESP_OK removes the entry, and so does
+ *         ESP_ERR_NOT_FOUND once the clip is no longer on the card; any
+ *         other result schedules a retry.
+ */
+void upload_sched_result(const char *clip_file, esp_err_t err);
+
+/**
+ * @brief  Link state from wifi_manager. Going online clears all backoff.
+ */
+void upload_sched_set_online(bool online);
+
+/**
+ * @brief  Make every entry due now (manual retry).
+ */
+void upload_sched_kick(void);
+
+/**
+ * @brief  Milliseconds until the next entry is due: 0 if one is due now,
+ *         UINT32_MAX if none is pending or the link is down.
+ */
+uint32_t upload_sched_wait_ms(void);
+
+/**
+ * @brief  Entries in the manifest.
+ */
+size_t upload_sched_pending(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,292 @@
+/*
+ * upload_sched.c — Persistent clip upload queue with retry backoff
+ *
+ * Manifest format (text, one clip per line, rewritten on every change):
+ *   <seq> <attempts> <clip_file>
+ * seq grows with every add, so the highest seq is the newest clip even
+ * when the clock was not set and clip names do not sort by time.
+ *
+ * The file is written to uploads.tmp and renamed over uploads.q. A reset
+ * between unlink and rename leaves only uploads.tmp, which init picks up.
+ */
+
+#include "upload_sched.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "upload_sched";
+
+typedef struct {
+    char     clip_file[UPLOAD_SCHED_NAME_LEN];   /* "" = free */
+    uint32_t seq;
+    uint32_t attempts;
+    int64_t  next_us;                            /* esp_timer time it is due */
+} entry_t;
+
+static entry_t          *s_entries;              /* UPLOAD_SCHED_MAX, PSRAM */
+static SemaphoreHandle_t s_lock;
+static char              s_dir[32];
+static char              s_path[64];
+static char              s_tmp_path[64];
+static uint32_t          s_next_seq = 1;
+static bool              s_online = true;
+
+static void save_locked(void)
+{
+    FILE *f = fopen(s_tmp_path, "w");
+    if (!f) {
+        ESP_LOGE(TAG, "Cannot write %s", s_tmp_path);
+        return;
+    }
+    for (int i = 0; i < UPLOAD_SCHED_MAX; i++) {
+        const entry_t *e = &s_entries[i];
+        if (e->clip_file[0]) {
+            fprintf(f, "%"PRIu32" %"PRIu32" %s\n", e->seq, e->attempts, e->clip_file);
+        }
+    }
+    fclose(f);
+    unlink(s_path);                 /* FAT rename does not replace */
+    if (rename(s_tmp_path, s_path) != 0) {
+        ESP_LOGE(TAG, "Cannot rename %s", s_tmp_path);
+    }
+}
+
+static entry_t *find_locked(const char *clip_file)
+{
+    for (int i = 0; i < UPLOAD_SCHED_MAX; i++) {
+        if (!strcmp(s_entries[i].clip_file, clip_file)) {
+            return &s_entries[i];
+        }
+    }
+    return NULL;
+}
+
+/* Free slot, or the oldest entry when full */
+static entry_t *slot_locked(void)
+{
+    entry_t *oldest = &s_entries[0];
+    for (int i = 0; i < UPLOAD_SCHED_MAX; i++) {
+        if (!s_entries[i].clip_file[0]) {
+            return &s_entries[i];
+        }
+        if (s_entries[i].seq < oldest->seq) {
+            oldest = &s_entries[i];
+        }
+    }
+    ESP_LOGW(TAG, "Manifest full — dropping oldest %s (stays on SD)", oldest->clip_file);
+    return oldest;
+}
+
+#define STR_(x)    #x
+#define STR(x)     STR_(x)
+#define NAME_SCAN  "%" STR(UPLOAD_SCHED_NAME_CHARS) "s"
+
+static int load(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    int n = 0;
+    char line[UPLOAD_SCHED_NAME_LEN + 32];
+    while (fgets(line, sizeof(line), f) && n < UPLOAD_SCHED_MAX) {
+        entry_t *e = &s_entries[n];
+        if (sscanf(line, "%"SCNu32" %"SCNu32" "NAME_SCAN, &e->seq, &e->attempts, e->clip_file) != 3) {
+            memset(e, 0, sizeof(*e));
+            continue;               /* torn last line */
+        }
+        if (e->seq >= s_next_seq) {
+            s_next_seq = e->seq + 1;
+        }
+        n++;
+    }
+    fclose(f);
+    return n;
+}
+
+esp_err_t upload_sched_init(const char *dir)
+{
+    if (!s_entries) {
+        s_entries = heap_caps_calloc(UPLOAD_SCHED_MAX, sizeof(entry_t),
+                                     MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_entries || !s_lock) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    strlcpy(s_dir, dir, sizeof(s_dir));
+    snprintf(s_path, sizeof(s_path), "%s/uploads.q", dir);
+    snprintf(s_tmp_path, sizeof(s_tmp_path), "%s/uploads.tmp", dir);
+
+    int n = load(s_path);
+    if (n < 0) {
+        n = load(s_tmp_path);       /* reset mid-save */
+    }
+    if (n < 0) {
+        ESP_LOGI(TAG, "No upload manifest yet");
+        return ESP_ERR_NOT_FOUND;
+    }
+    ESP_LOGI(TAG, "%d clip(s) pending upload", n);
+    return ESP_OK;
+}
+
+esp_err_t upload_sched_add(const char *clip_file)
+{
+    if (!s_entries || !clip_file || strlen(clip_file) >= UPLOAD_SCHED_NAME_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    entry_t *e = find_locked(clip_file);
+    if (e) {
+        e->next_us = 0;             /* keeps its place and attempt count */
+    } else {
+        e = slot_locked();
+        memset(e, 0, sizeof(*e));
+        strlcpy(e->clip_file, clip_file, sizeof(e->clip_file));
+        e->seq = s_next_seq++;
+        save_locked();
+    }
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+size_t upload_sched_next(char names[][UPLOAD_SCHED_NAME_LEN], size_t max)
+{
+    if (!s_entries) {
+        return 0;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    size_t n = 0;
+    if (s_online) {
+        int64_t now = esp_timer_get_time();
+        uint32_t below = UINT32_MAX;        /* seq of the last one taken */
+        while (n < max) {
+            const entry_t *best = NULL;
+            for (int i = 0; i < UPLOAD_SCHED_MAX; i++) {
+                const entry_t *e = &s_entries[i];
+                if (e->clip_file[0] && e->next_us <= now && e->seq < below &&
+                    (!best || e->seq > best->seq)) {
+                    best = e;
+                }
+            }
+            if (!best) {
+                break;
+            }
+            strlcpy(names[n++], best->clip_file, UPLOAD_SCHED_NAME_LEN);
+            below = best->seq;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return n;
+}
+
+/* NOT_FOUND also covers HTTP 404s (presign route, expired multipart
+ * upload ID) — only a clip that really left the card drops its entry. */
+static bool clip_exists(const char *clip_file)
+{
+    char path[sizeof(s_dir) + UPLOAD_SCHED_NAME_LEN];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", s_dir, clip_file);
+    return stat(path, &st) == 0;
+}
+
+void upload_sched_result(const char *clip_file, esp_err_t err)
+{
+    if (!s_entries) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    entry_t *e = find_locked(clip_file);
+    if (e) {
+        if (err == ESP_OK || (err == ESP_ERR_NOT_FOUND && !clip_exists(clip_file))) {
+            memset(e, 0, sizeof(*e));
+        } else {
+            uint32_t shift = e->attempts < 16 ? e->attempts : 16;
+            uint64_t delay_s = (uint64_t)CONFIG_UPLOAD_RETRY_BASE_S << shift;
+            if (delay_s > CONFIG_UPLOAD_RETRY_MAX_S) {
+                delay_s = CONFIG_UPLOAD_RETRY_MAX_S;
+            }
+            e->attempts++;
+            e->next_us = esp_timer_get_time() + (int64_t)delay_s * 1000000;
+            ESP_LOGW(TAG, "%s: attempt %"PRIu32" failed, retry in %llu s",
+                     clip_file, e->attempts, (unsigned long long)delay_s);
+        }
+        save_locked();
+    }
+    xSemaphoreGive(s_lock);
+}
+
+static void kick_locked(void)
+{
+    for (int i = 0; i < UPLOAD_SCHED_MAX; i++) {
+        s_entries[i].next_us = 0;
+    }
+}
+
+void upload_sched_set_online(bool online)
+{
+    if (!s_entries) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (online && !s_online) {
+        kick_locked();
+    }
+    s_online = online;
+    xSemaphoreGive(s_lock);
+}
+
+void upload_sched_kick(void)
+{
+    if (!s_entries) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    kick_locked();
+    xSemaphoreGive(s_lock);
+}
+
+uint32_t upload_sched_wait_ms(void)
+{
+    if (!s_entries) {
+        return UINT32_MAX;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int64_t next = INT64_MAX;
+    if (s_online) {
+        for (int i = 0; i < UPLOAD_SCHED_MAX; i++) {
+            if (s_entries[i].clip_file[0] && s_entries[i].next_us < next) {
+                next = s_entries[i].next_us;
+            }
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    if (next == INT64_MAX) {
+        return UINT32_MAX;
+    }
+    int64_t wait_ms = (next - esp_timer_get_time() + 999) / 1000;
+    return wait_ms <= 0 ? 0 : (uint32_t)(wait_ms < UINT32_MAX - 1 ? wait_ms : UINT32_MAX - 1);
+}
+
+size_t upload_sched_pending(void)
+{
+    if (!s_entries) {
+        return 0;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    size_t n = 0;
+    for (int i = 0; i < UPLOAD_SCHED_MAX; i++) {
+        n += s_entries[i].clip_file[0] != 0;
+    }
+    xSemaphoreGive(s_lock);
+    return n;
+}
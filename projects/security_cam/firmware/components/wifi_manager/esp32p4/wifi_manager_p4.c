@@ -38,3 +38,20 @@ void wifi_manager_connect(void)
      * Reference board SDIO pins: see ESP32-P4-FunctionalEVBoard schematic.
      */
 }
+
+void wifi_manager_start(void)
+{
+    wifi_manager_connect();     /* Phase 2: same as the S3 path */
+}
+
+void wifi_manager_set_link_cb(wifi_manager_link_cb_t cb, void *ctx)
+{
+    (void)cb;
+    (void)ctx;                  /* Phase 2: call from the esp_wifi event handler */
+}
+
+esp_err_t wifi_manager_set_power_save(bool max)
+{
+    (void)max;
+    return ESP_ERR_NOT_SUPPORTED;   /* Phase 2: esp_wifi_set_ps() as on the S3 */
+}
@@ -13,15 +13,46 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "esp_err.h"
+#include "esp_timer.h"
 
 static const char *TAG = "wifi_s3";
 
 #define WIFI_CONNECTED_BIT  BIT0
 #define WIFI_FAIL_BIT       BIT1
 #define WIFI_MAX_RETRIES    5
+#define WIFI_RECONNECT_US   (10 * 1000 * 1000)  /* after the fast retries, once connected */
 
 static EventGroupHandle_t s_wifi_event_group;
 static int s_retry_count = 0;
+static bool s_connected_once;
+static bool s_keep_trying;      /* wifi_manager_start(): never give up, never reboot */
+static bool s_started;
+static bool s_ps_max;
+static bool s_link_up;
+static esp_timer_handle_t s_reconnect_timer;
+static wifi_manager_link_cb_t s_link_cb;
+static void *s_link_ctx;
+
+static void reconnect_cb(void *arg)
+{
+    esp_wifi_connect();
+}
+
+void wifi_manager_set_link_cb(wifi_manager_link_cb_t cb, void *ctx)
+{
+    s_link_ctx = ctx;
+    s_link_cb  = cb;
+}
+
+static void set_link(bool up)
+{
+    if (up != s_link_up) {
+        s_link_up = up;
+        if (s_link_cb) {
+            s_link_cb(up, s_link_ctx);
+        }
+    }
+}
 
 static void wifi_event_handler(void *arg, esp_event_base_t base,
                                int32_t id, void *data)
@@ -32,10 +63,14 @@ static void wifi_event_handler(void *arg, esp_event_base_t base,
     } else if (base == WIFI_EVENT && id == WIFI_EVENT_STA_DISCONNECTED) {
         wifi_event_sta_disconnected_t *disc = (wifi_event_sta_disconnected_t *)data;
         ESP_LOGW(TAG, "Disconnected, reason=%d", disc->reason);
+        set_link(false);
         if (s_retry_count < WIFI_MAX_RETRIES) {
             esp_wifi_connect();
             s_retry_count++;
             ESP_LOGW(TAG, "Retrying WiFi (%d/%d)", s_retry_count, WIFI_MAX_RETRIES);
+        } else if (s_connected_once || s_keep_trying) {
+            /* Running: keep trying at a slower pace until the AP is back */
+            esp_timer_start_once(s_reconnect_timer, WIFI_RECONNECT_US);
         } else {
             xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
         }
@@ -44,13 +79,26 @@ static void wifi_event_handler(void *arg, esp_event_base_t base,
         ip_event_got_ip_t *event = (ip_event_got_ip_t *)data;
         ESP_LOGI(TAG, "Connected, IP: " IPSTR, IP2STR(&event->ip_info.ip));
         s_retry_count = 0;
+        s_connected_once = true;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        set_link(true);
     }
 }
 
-void wifi_manager_connect(void)
+esp_err_t wifi_manager_set_power_save(bool max)
+{
+    s_ps_max = max;             /* applied by start() if not started yet */
+    if (!s_started) {
+        return ESP_OK;
+    }
+    return esp_wifi_set_ps(max ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+}
+
+static void start(void)
 {
     s_wifi_event_group = xEventGroupCreate();
+    const esp_timer_create_args_t targs = { .callback = reconnect_cb, .name = "wifi_reconn" };
+    ESP_ERROR_CHECK(esp_timer_create(&targs, &s_reconnect_timer));
 
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
@@ -68,14 +116,31 @@ void wifi_manager_connect(void)
         .sta = {
             .ssid     = CONFIG_WIFI_SSID,
             .password = CONFIG_WIFI_PASSWORD,
+            /* Used only in max modem sleep (wifi_manager_set_power_save) */
+            .listen_interval = CONFIG_POWER_WIFI_LISTEN_INTERVAL,
         },
     };
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
     ESP_ERROR_CHECK(esp_wifi_start());
+    s_started = true;
+    if (s_ps_max) {
+        esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
+    }
 
     ESP_LOGI(TAG, "Connecting to '%s'...", CONFIG_WIFI_SSID);
+}
+
+void wifi_manager_start(void)
+{
+    s_keep_trying = true;
+    start();
+}
+
+void wifi_manager_connect(void)
+{
+    start();
 
     EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
         WIFI_CONNECTED_BIT | WIFI_FAIL_BIT, pdFALSE, pdFALSE,
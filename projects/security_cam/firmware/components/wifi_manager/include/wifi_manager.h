@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
@@ -21,6 +22,34 @@ extern "C" {
  */
 void wifi_manager_connect(void);
 
+/**
+ * @brief  Start connecting and return at once. Never reboots: until the
+ *         first connect, and after every loss, the link is retried
+ *         (WIFI_MAX_RETRIES immediately, then every 10 s). Link state
+ *         arrives through the wifi_manager_set_link_cb() callback —
+ *         register it first.
+ */
+void wifi_manager_start(void);
+
+/* Link up (got IP) / down. Runs on the event loop task — must not block. */
+typedef void (*wifi_manager_link_cb_t)(bool up, void *ctx);
+
+/**
+ * @brief  Register a callback for link changes after the initial connect.
+ *         Once connected, a lost link is retried indefinitely
+ *         (immediately WIFI_MAX_RETRIES times, then every 10 s).
+ */
+void wifi_manager_set_link_cb(wifi_manager_link_cb_t cb, void *ctx);
+
+/**
+ * @brief  Modem sleep depth. false: min modem (IDF default, wakes every
+ *         DTIM); true: max modem, sleeping CONFIG_POWER_WIFI_LISTEN_INTERVAL
+ *         beacons at a time — lower power, slower incoming traffic.
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED without WiFi (P4 stub),
+ *         or the esp_wifi error.
+ */
+esp_err_t wifi_manager_set_power_save(bool max);
+
 #ifdef __cplusplus
 }
 #endif
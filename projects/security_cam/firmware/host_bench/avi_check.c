@@ -0,0 +1,195 @@
+/*
+ * avi_check.c — AVI clip validator (see avi_check.h)
+ */
+
+#include "avi_check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#define FOURCC(a,b,c,d) ((uint32_t)(a) | ((uint32_t)(b)<<8) | \
+                         ((uint32_t)(c)<<16) | ((uint32_t)(d)<<24))
+
+#define AVIF_HASINDEX   0x00000010u
+#define IDX1_ENTRY      16
+#define SUPER_ENTRY     16
+#define STD_ENTRY       8
+#define INDEX_HEADER    24
+
+static uint32_t rd32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t rd64(const uint8_t *p)
+{
+    return rd32(p) | ((uint64_t)rd32(p + 4) << 32);
+}
+
+static bool fail(avi_check_t *out, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(out->error, sizeof(out->error), fmt, ap);
+    va_end(ap);
+    return false;
+}
+
+/* Offset of the first chunk id (LIST of type id when list) in [pos, end), 0 if none */
+static size_t find(const uint8_t *f, size_t pos, size_t end, uint32_t id, bool list)
+{
+    while (pos + 12 <= end) {
+        uint32_t ck = rd32(f + pos), cb = rd32(f + pos + 4);
+        if (list ? (ck == FOURCC('L','I','S','T') && rd32(f + pos + 8) == id) : ck == id) {
+            return pos;
+        }
+        size_t next = pos + 8 + cb + (cb & 1u);
+        if (next <= pos || next > end) {
+            break;
+        }
+        pos = next;
+    }
+    return 0;
+}
+
+/* End of the LIST at pos (bounded by end) */
+static size_t list_end(const uint8_t *f, size_t pos, size_t end)
+{
+    size_t e = pos + 8 + rd32(f + pos + 4);
+    return e < end ? e : end;
+}
+
+static bool check(const uint8_t *f, size_t size, const seq_t *src, avi_check_t *out)
+{
+    if (size < 12 || rd32(f) != FOURCC('R','I','F','F') || rd32(f + 8) != FOURCC('A','V','I',' ')) {
+        return fail(out, "not a RIFF AVI");
+    }
+    if ((size_t)rd32(f + 4) + 8 != size) {
+        return fail(out, "RIFF size %"PRIu32" + 8 != file size %zu", rd32(f + 4), size);
+    }
+
+    /* Header chunks */
+    size_t hdrl = find(f, 12, size, FOURCC('h','d','r','l'), true);
+    if (!hdrl) {
+        return fail(out, "no hdrl");
+    }
+    size_t hdrl_e = list_end(f, hdrl, size);
+    size_t avih = find(f, hdrl + 12, hdrl_e, FOURCC('a','v','i','h'), false);
+    size_t strl = find(f, hdrl + 12, hdrl_e, FOURCC('s','t','r','l'), true);
+    size_t odml = find(f, hdrl + 12, hdrl_e, FOURCC('o','d','m','l'), true);
+    size_t strl_e = strl ? list_end(f, strl, hdrl_e) : 0;
+    size_t strh = strl ? find(f, strl + 12, strl_e, FOURCC('s','t','r','h'), false) : 0;
+    size_t indx = strl ? find(f, strl + 12, strl_e, FOURCC('i','n','d','x'), false) : 0;
+    size_t dmlh = odml ? find(f, odml + 12, list_end(f, odml, hdrl_e), FOURCC('d','m','l','h'), false) : 0;
+    if (!avih || !strh || rd32(f + avih + 4) < 56 || rd32(f + strh + 4) < 56) {
+        return fail(out, "missing or short avih / strh");
+    }
+    if (dmlh && rd32(f + dmlh + 4) < 4) {
+        dmlh = 0;
+    }
+    if (!(rd32(f + avih + 8 + 12) & AVIF_HASINDEX)) {
+        return fail(out, "AVIF_HASINDEX not set");
+    }
+
+    /* movi, then idx1 right after it */
+    size_t movi = find(f, 12, size, FOURCC('m','o','v','i'), true);
+    if (!movi) {
+        return fail(out, "no movi");
+    }
+    size_t movi_e = movi + 8 + rd32(f + movi + 4);
+    if (movi_e + 8 > size || rd32(f + movi_e) != FOURCC('i','d','x','1')) {
+        return fail(out, "idx1 does not follow movi (movi ends at %zu)", movi_e);
+    }
+    uint32_t idx1_cb = rd32(f + movi_e + 4);
+    if (idx1_cb % IDX1_ENTRY || movi_e + 8 + idx1_cb != size) {
+        return fail(out, "idx1 size %"PRIu32" does not end the file", idx1_cb);
+    }
+    uint32_t n = idx1_cb / IDX1_ENTRY;
+    out->frames = n;
+
+    uint32_t avih_frames = rd32(f + avih + 8 + 16);
+    uint32_t strh_frames = rd32(f + strh + 8 + 32);
+    if (avih_frames != n || strh_frames != n || (dmlh && rd32(f + dmlh + 8) != n)) {
+        return fail(out, "frame counts avih %"PRIu32" strh %"PRIu32" dmlh %"PRIu32" != idx1 %"PRIu32,
+                    avih_frames, strh_frames, dmlh ? rd32(f + dmlh + 8) : 0, n);
+    }
+
+    /* Every idx1 entry points at a whole JPEG 00dc chunk inside movi */
+    const uint8_t *idx1 = f + movi_e + 8;
+    for (uint32_t i = 0; i < n; i++) {
+        const uint8_t *e = idx1 + (size_t)i * IDX1_ENTRY;
+        size_t ck = movi + rd32(e + 8);
+        uint32_t len = rd32(e + 12);
+        if (rd32(e) != FOURCC('0','0','d','c') || ck + 8 + len > movi_e ||
+            rd32(f + ck) != FOURCC('0','0','d','c') || rd32(f + ck + 4) != len) {
+            return fail(out, "idx1 entry %"PRIu32" does not match its chunk", i);
+        }
+        if (len < 2 || f[ck + 8] != 0xFF || f[ck + 9] != 0xD8) {
+            return fail(out, "frame %"PRIu32" has no JPEG SOI", i);
+        }
+        if (src && (i >= src->count || src->len[i] != len ||
+                    memcmp(f + ck + 8, src->data + src->offset[i], len) != 0)) {
+            return fail(out, "frame %"PRIu32" differs from the source", i);
+        }
+    }
+
+    /* Super index: ix00 chunks covering the same frames in order */
+    if (indx) {
+        uint32_t in_use = rd32(f + indx + 8 + 4);
+        uint64_t covered = 0;
+        if (INDEX_HEADER + (uint64_t)in_use * SUPER_ENTRY > rd32(f + indx + 4)) {
+            return fail(out, "super index claims %"PRIu32" slots", in_use);
+        }
+        out->index_chunks = in_use;
+        for (uint32_t s = 0; s < in_use; s++) {
+            const uint8_t *se = f + indx + 8 + INDEX_HEADER + (size_t)s * SUPER_ENTRY;
+            uint64_t ix = rd64(se);
+            uint32_t dur = rd32(se + 12);
+            if (ix + 8 + INDEX_HEADER + (uint64_t)dur * STD_ENTRY > movi_e ||
+                rd32(f + ix) != FOURCC('i','x','0','0') ||
+                rd32(f + ix + 8 + 4) != dur) {
+                return fail(out, "super index slot %"PRIu32" does not match its ix00", s);
+            }
+            uint64_t base = rd64(f + ix + 8 + 12);
+            for (uint32_t k = 0; k < dur; k++, covered++) {
+                const uint8_t *std = f + ix + 8 + INDEX_HEADER + (size_t)k * STD_ENTRY;
+                if (covered >= n ||
+                    base + rd32(std) - 8 != movi + rd32(idx1 + covered * IDX1_ENTRY + 8)) {
+                    return fail(out, "ix00 #%"PRIu32" entry %"PRIu32" disagrees with idx1", s, k);
+                }
+            }
+        }
+        if (in_use && covered != n) {
+            return fail(out, "super index covers %"PRIu64" of %"PRIu32" frames", covered, n);
+        }
+    }
+    return true;
+}
+
+bool avi_check_file(const char *path, const seq_t *src, avi_check_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return fail(out, "cannot open %s", path);
+    }
+    uint8_t *f = NULL;
+    long size = -1;
+    if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) > 0 && fseek(fp, 0, SEEK_SET) == 0) {
+        f = malloc((size_t)size);
+        if (f && fread(f, 1, (size_t)size, fp) != (size_t)size) {
+            free(f);
+            f = NULL;
+        }
+    }
+    fclose(fp);
+    if (!f) {
+        return fail(out, "cannot read %s", path);
+    }
+    out->file_bytes = (uint32_t)size;
+    bool ok = check(f, (size_t)size, src, out);
+    free(f);
+    return ok;
+}
@@ -0,0 +1,44 @@
+/*
+ * avi_check.h — Independent validator for the clips avi_writer produces
+ *
+ * Written from the AVI / OpenDML layout, not from avi_writer.c, so a bug
+ * shared by writer and check is unlikely. A file is valid when:
+ *   - RIFF size matches the file and idx1 directly follows movi
+ *   - avih has AVIF_HASINDEX; avih, strh and dmlh frame counts equal the
+ *     idx1 entry count
+ *   - every idx1 entry names a 00dc chunk inside movi of the stated length
+ *     that starts with a JPEG SOI
+ *   - the super index, if in use, covers the same frames in the same order
+ *     through ix00 chunks
+ *   - with a source sequence, the frames match it byte for byte
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "seq.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t frames;          /* idx1 entries */
+    uint32_t index_chunks;    /* super index entries in use (0 after repair) */
+    uint32_t file_bytes;
+    char     error[128];      /* first problem found; "" when valid */
+} avi_check_t;
+
+/**
+ * @brief  Validate an AVI file.
+ * @param  path  File to check.
+ * @param  src   Optional: frames 0..frames-1 must equal src's.
+ * @param  out   Filled in either case.
+ * @return true if valid.
+ */
+bool avi_check_file(const char *path, const seq_t *src, avi_check_t *out);
+
+#ifdef __cplusplus
+}
+#endif
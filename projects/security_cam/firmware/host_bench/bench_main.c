@@ -0,0 +1,499 @@
+/*
+ * bench_main.c — Host benchmark and replay harness for motion_detect and
+ * avi_writer
+ *
+ * Builds the firmware sources unchanged against the shims in shim/ and
+ * replays frame sequences through them:
+ *
+ *   GRAY8 → every detector configuration the firmware can run (grid,
+ *           grid + background, pixel with the scalar and the auto-selected
+ *           kernel). Reports ns/frame, MB/s and the trigger decisions;
+ *           scalar and auto kernels must produce identical scores.
+ *   JPEG  → avi_writer with the firmware's record settings. Reports
+ *           ns/frame and MB/s, validates the file (avi_check.h), then cuts
+ *           a second clip short as a reset would and checks that
+ *           avi_writer_repair() recovers at least the checkpointed frames.
+ *
+ * usage: host_bench [options] [sequence ...]
+ *   sequence       *.avi  — MJPEG clip from the SD card or the bucket
+ *                  *.gray — raw GRAY8 frames of --size, e.g. motion-mode
+ *                           frames, or a clip converted with
+ *                           ffmpeg -i clip.avi -vf scale=320:240,format=gray
+ *                                  -f rawvideo clip.gray
+ *                  none   — built-in synthetic scenes with known answers
+ *   --size WxH     GRAY8 frame size (default 320x240)
+ *   --threshold N  trigger in QVGA pixels (default 2000, as
+ *                  CONFIG_MOTION_THRESHOLD), scaled to the frame like main.c
+ *   --iters N      timed repetitions, best one reported (default 3)
+ *   --suite S      synthetic only: motion, avi or all (default all)
+ *   --out DIR      where the AVIs go (default .)
+ *   --scores FILE  per-frame scores as CSV: sequence,detector,frame,score
+ *   -v             component logs (info level)
+ *
+ * Exit status: 0 all checks passed, 1 a check failed, 2 usage or I/O error.
+ * Host timings say nothing absolute about the ESP32-S3 — compare them
+ * between builds on the same machine.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <time.h>
+#include "esp_log.h"
+#include "motion_detect.h"
+#include "avi_writer.h"
+#include "seq.h"
+#include "avi_check.h"
+
+int host_log_level = 1;             /* errors only; -v for info */
+
+#define QVGA_PIXELS         (320 * 240)
+#define DEFAULT_THRESHOLD   2000
+#define LUMA_MAX_WIDTH      160     /* DUAL luma — main.c uses cell size 1 */
+#define TIMING_SKIP         30      /* warmup frames left out of ns/frame */
+#define TRIGGER_GRACE       2       /* frames allowed to first trigger */
+#define SYNTH_FRAMES        120
+#define SYNTH_JPEG_FRAMES   300     /* 30 s at 10 fps */
+#define RECORD_FPS          10      /* CONFIG_RECORD_FPS */
+#define CHECKPOINT_S        2       /* CONFIG_AVI_CHECKPOINT_S */
+#define STAGING_KB          128     /* CONFIG_AVI_STAGING_KB */
+
+typedef struct {
+    const char      *name;
+    motion_algo_t    algo;
+    motion_kernel_t  kernel;
+    bool             background;
+} detector_t;
+
+static const detector_t DETECTORS[] = {
+    { "grid",         MOTION_ALGO_GRID,  MOTION_KERNEL_AUTO,   false },
+    { "grid_bg",      MOTION_ALGO_GRID,  MOTION_KERNEL_AUTO,   true  },
+    { "pixel_scalar", MOTION_ALGO_PIXEL, MOTION_KERNEL_SCALAR, false },
+    { "pixel_auto",   MOTION_ALGO_PIXEL, MOTION_KERNEL_AUTO,   false },
+};
+#define DETECTOR_COUNT  (sizeof(DETECTORS) / sizeof(DETECTORS[0]))
+
+static struct {
+    uint32_t    width, height;
+    int         threshold;
+    int         iters;
+    const char *out_dir;
+    FILE       *scores;
+} s_opt = { 320, 240, DEFAULT_THRESHOLD, 3, ".", NULL };
+
+static int s_failed;
+
+static void check_failed(const char *seq, const char *what, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static void check_failed(const char *seq, const char *what, const char *fmt, ...)
+{
+    char msg[160];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    printf("  FAIL %s / %s: %s\n", seq, what, msg);
+    s_failed++;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* ── Motion ─────────────────────────────────────────────────────────────── */
+
+/* Fills scores[count]; returns the best per-frame time in ns, 0 on error */
+static uint64_t run_detector(const seq_t *s, const detector_t *d, int threshold, int *scores)
+{
+    motion_detect_config_t cfg = {
+        .width      = s->width,
+        .height     = s->height,
+        .threshold  = threshold,
+        .algo       = d->algo,
+        .kernel     = d->kernel,
+        .cell_size  = s->width <= LUMA_MAX_WIDTH ? 1 : 4,
+        .background = d->background,
+    };
+    uint32_t skip = s->count > 2 * TIMING_SKIP ? TIMING_SKIP : 0;
+    uint64_t best = UINT64_MAX;
+    for (int it = 0; it < s_opt.iters; it++) {
+        esp_err_t err = motion_detect_init(&cfg);
+        if (err != ESP_OK) {
+            check_failed(s->name, d->name, "init: %s", esp_err_to_name(err));
+            return 0;
+        }
+        uint64_t spent = 0;
+        for (uint32_t i = 0; i < s->count; i++) {
+            cam_frame_t f = seq_frame(s, i);
+            motion_result_t r;
+            uint64_t t0 = now_ns();
+            err = motion_detect_analyze(&f, &r);
+            uint64_t t1 = now_ns();
+            if (err != ESP_OK) {
+                check_failed(s->name, d->name, "frame %"PRIu32": %s", i, esp_err_to_name(err));
+                motion_detect_deinit();
+                return 0;
+            }
+            if (i >= skip) {
+                spent += t1 - t0;
+            }
+            scores[i] = r.score;
+        }
+        motion_detect_deinit();
+        uint64_t per_frame = spent / (s->count - skip);
+        best = per_frame < best ? per_frame : best;
+    }
+    return best ? best : 1;
+}
+
+static void bench_motion(const seq_t *s)
+{
+    int threshold = (int)((int64_t)s_opt.threshold * s->width * s->height / QVGA_PIXELS);
+    threshold = threshold < 1 ? 1 : threshold;
+    printf("\n%s — %"PRIu32" GRAY8 frames %"PRIu32"x%"PRIu32", trigger %d px\n",
+           s->name, s->count, s->width, s->height, threshold);
+    printf("  %-13s %10s %9s %9s %9s %9s\n",
+           "detector", "ns/frame", "MB/s", "triggers", "first", "max score");
+
+    int *scores[DETECTOR_COUNT] = { 0 };
+    for (size_t k = 0; k < DETECTOR_COUNT; k++) {
+        const detector_t *d = &DETECTORS[k];
+        scores[k] = calloc(s->count, sizeof(int));
+        if (!scores[k]) {
+            check_failed(s->name, d->name, "out of memory");
+            continue;
+        }
+        uint64_t ns = run_detector(s, d, threshold, scores[k]);
+        if (!ns) {
+            free(scores[k]);
+            scores[k] = NULL;
+            continue;
+        }
+
+        uint32_t triggers = 0;
+        int64_t first = -1;
+        int max = 0;
+        for (uint32_t i = 0; i < s->count; i++) {
+            if (scores[k][i] >= threshold) {
+                triggers++;
+                first = first < 0 ? i : first;
+            }
+            max = scores[k][i] > max ? scores[k][i] : max;
+            if (s_opt.scores) {
+                fprintf(s_opt.scores, "%s,%s,%"PRIu32",%d\n", s->name, d->name, i, scores[k][i]);
+            }
+        }
+        double mbps = (double)s->width * s->height * 1000.0 / (double)ns;
+        char first_s[24] = "-";
+        if (first >= 0) {
+            snprintf(first_s, sizeof(first_s), "%"PRId64, first);
+        }
+        printf("  %-13s %10"PRIu64" %9.1f %9"PRIu32" %9s %9d\n",
+               d->name, ns, mbps, triggers, first_s, max);
+
+        if (s->expect == SEQ_EXPECT_QUIET && triggers > 0) {
+            check_failed(s->name, d->name, "%"PRIu32" triggers in a quiet scene (first at %"PRId64")",
+                         triggers, first);
+        } else if (s->expect == SEQ_EXPECT_MOTION &&
+                   (first < s->expect_from || first > s->expect_from + TRIGGER_GRACE)) {
+            check_failed(s->name, d->name, "first trigger at %"PRId64", motion starts at %"PRIu32,
+                         first, s->expect_from);
+        }
+    }
+
+    /* Every kernel must score exactly like the scalar loop */
+    const int *ref = NULL;
+    for (size_t k = 0; k < DETECTOR_COUNT; k++) {
+        if (DETECTORS[k].algo == MOTION_ALGO_PIXEL && DETECTORS[k].kernel == MOTION_KERNEL_SCALAR) {
+            ref = scores[k];
+        }
+    }
+    for (size_t k = 0; ref && k < DETECTOR_COUNT; k++) {
+        if (!scores[k] || DETECTORS[k].algo != MOTION_ALGO_PIXEL ||
+            DETECTORS[k].kernel == MOTION_KERNEL_SCALAR) {
+            continue;
+        }
+        for (uint32_t i = 0; i < s->count; i++) {
+            if (scores[k][i] != ref[i]) {
+                check_failed(s->name, DETECTORS[k].name, "frame %"PRIu32" scores %d, scalar %d",
+                             i, scores[k][i], ref[i]);
+                break;
+            }
+        }
+    }
+    for (size_t k = 0; k < DETECTOR_COUNT; k++) {
+        free(scores[k]);
+    }
+}
+
+/* ── AVI ────────────────────────────────────────────────────────────────── */
+
+static avi_writer_t *open_clip(const seq_t *s, const char *path)
+{
+    avi_writer_config_t cfg = {
+        .path              = path,
+        .width             = s->width,
+        .height            = s->height,
+        .fps               = RECORD_FPS,
+        .checkpoint_frames = CHECKPOINT_S * RECORD_FPS,
+        .staging_size      = STAGING_KB * 1024,
+    };
+    return avi_writer_open(&cfg);
+}
+
+static bool copy_file(const char *from, const char *to)
+{
+    FILE *in = fopen(from, "rb"), *out = fopen(to, "wb");
+    bool ok = in && out;
+    char buf[64 * 1024];
+    size_t n;
+    while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        ok = fwrite(buf, 1, n, out) == n;
+    }
+    if (in) fclose(in);
+    if (out && fclose(out) != 0) ok = false;
+    return ok;
+}
+
+/* Clip cut short after cut frames: repair must recover every frame up to
+ * the last checkpoint, and nothing that was never written */
+static void bench_repair(const seq_t *s, const char *base)
+{
+    const uint32_t cp = CHECKPOINT_S * RECORD_FPS;
+    uint32_t cut = s->count * 2 / 3;
+    if (cut <= cp) {
+        printf("  repair        skipped (needs more than %"PRIu32" frames)\n", cp * 3 / 2);
+        return;
+    }
+    if (cut % cp == 0) {
+        cut--;                          /* end between checkpoints */
+    }
+    char path[512], copy[512];
+    snprintf(path, sizeof(path), "%s/%s_cut.avi", s_opt.out_dir, base);
+    snprintf(copy, sizeof(copy), "%s/%s_repair.avi", s_opt.out_dir, base);
+
+    avi_writer_t *w = open_clip(s, path);
+    if (!w) {
+        check_failed(s->name, "repair", "cannot open %s", path);
+        return;
+    }
+    for (uint32_t i = 0; i < cut; i++) {
+        avi_writer_write_frame(w, s->data + s->offset[i], s->len[i]);
+    }
+    /* What is on the card at this moment is what a reset leaves behind */
+    bool copied = copy_file(path, copy);
+    avi_writer_close(w);
+    remove(path);
+    if (!copied) {
+        check_failed(s->name, "repair", "cannot copy %s", path);
+        return;
+    }
+
+    bool repaired = false;
+    uint64_t t0 = now_ns();
+    esp_err_t err = avi_writer_repair(copy, &repaired);
+    uint64_t t1 = now_ns();
+    avi_check_t chk;
+    uint32_t floor = cut / cp * cp;
+    if (err != ESP_OK || !repaired) {
+        check_failed(s->name, "repair", "avi_writer_repair: %s", esp_err_to_name(err));
+    } else if (!avi_check_file(copy, s, &chk)) {
+        check_failed(s->name, "repair", "%s", chk.error);
+    } else if (chk.frames < floor || chk.frames > cut) {
+        check_failed(s->name, "repair", "%"PRIu32" frames recovered, expected %"PRIu32"..%"PRIu32,
+                     chk.frames, floor, cut);
+    } else {
+        printf("  repair        %"PRIu32" of %"PRIu32" frames recovered (checkpoint at %"PRIu32") "
+               "in %.2f ms — valid\n", chk.frames, cut, floor, (double)(t1 - t0) / 1e6);
+    }
+}
+
+static void bench_avi(const seq_t *s)
+{
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < s->count; i++) {
+        bytes += s->len[i];
+    }
+    printf("\n%s — %"PRIu32" JPEG frames %"PRIu32"x%"PRIu32", avg %"PRIu64" B\n",
+           s->name, s->count, s->width, s->height, bytes / s->count);
+
+    char base[SEQ_NAME_LEN], path[512];
+    snprintf(base, sizeof(base), "%s", s->name);
+    char *dot = strrchr(base, '.');
+    if (dot) *dot = '\0';
+    snprintf(path, sizeof(path), "%s/%s_bench.avi", s_opt.out_dir, base);
+
+    uint64_t best = UINT64_MAX;
+    for (int it = 0; it < s_opt.iters; it++) {
+        uint64_t t0 = now_ns();
+        avi_writer_t *w = open_clip(s, path);
+        if (!w) {
+            check_failed(s->name, "avi_writer", "cannot open %s", path);
+            return;
+        }
+        for (uint32_t i = 0; i < s->count; i++) {
+            esp_err_t err = avi_writer_write_frame(w, s->data + s->offset[i], s->len[i]);
+            if (err != ESP_OK) {
+                check_failed(s->name, "avi_writer", "frame %"PRIu32": %s", i, esp_err_to_name(err));
+                break;
+            }
+        }
+        esp_err_t err = avi_writer_close(w);
+        uint64_t t1 = now_ns();
+        if (err != ESP_OK) {
+            check_failed(s->name, "avi_writer", "close: %s", esp_err_to_name(err));
+            return;
+        }
+        best = t1 - t0 < best ? t1 - t0 : best;
+    }
+
+    avi_check_t chk;
+    bool valid = avi_check_file(path, s, &chk);
+    printf("  %-13s %10s %9s %9s %s\n", "", "ns/frame", "MB/s", "KB", "file");
+    printf("  %-13s %10"PRIu64" %9.1f %9"PRIu32" %s\n", "avi_writer", best / s->count,
+           (double)bytes * 1000.0 / (double)best, chk.file_bytes >> 10,
+           valid ? "valid" : "INVALID");
+    if (!valid) {
+        check_failed(s->name, "avi_check", "%s", chk.error);
+    } else if (chk.frames != s->count) {
+        check_failed(s->name, "avi_check", "%"PRIu32" of %"PRIu32" frames in the file",
+                     chk.frames, s->count);
+    }
+
+    /* The clip must replay as the sequence it was written from */
+    seq_t back;
+    if (valid && seq_load_avi(path, &back) == ESP_OK) {
+        if (back.count != s->count || back.width != s->width || back.height != s->height) {
+            check_failed(s->name, "reload", "%"PRIu32" frames %"PRIu32"x%"PRIu32" read back",
+                         back.count, back.width, back.height);
+        }
+        seq_free(&back);
+    } else if (valid) {
+        check_failed(s->name, "reload", "cannot read %s back", path);
+    }
+    bench_repair(s, base);
+}
+
+/* ── Driver ─────────────────────────────────────────────────────────────── */
+
+static bool ends_with(const char *s, const char *suffix)
+{
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+static int usage(void)
+{
+    fprintf(stderr, "usage: host_bench [--size WxH] [--threshold N] [--iters N] "
+                    "[--suite motion|avi|all] [--out DIR] [--scores FILE] [-v] "
+                    "[file.avi | file.gray ...]\n");
+    return 2;
+}
+
+static void run_synthetic(bool motion, bool avi)
+{
+    static const uint32_t SIZES[][2] = { { 320, 240 }, { 80, 60 } };   /* QVGA, DUAL luma */
+    for (size_t z = 0; motion && z < sizeof(SIZES) / sizeof(SIZES[0]); z++) {
+        for (int sc = 0; sc < SEQ_SCENE_COUNT; sc++) {
+            seq_t s;
+            if (seq_synth_gray((seq_scene_t)sc, SIZES[z][0], SIZES[z][1], SYNTH_FRAMES, &s) != ESP_OK) {
+                check_failed("synthetic", "seq", "out of memory");
+                continue;
+            }
+            bench_motion(&s);
+            seq_free(&s);
+        }
+    }
+    if (avi) {
+        seq_t s;
+        if (seq_synth_jpeg(640, 480, SYNTH_JPEG_FRAMES, &s) != ESP_OK) {
+            check_failed("synthetic", "seq", "out of memory");
+            return;
+        }
+        bench_avi(&s);
+        seq_free(&s);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *suite = "all";
+    int first_file = argc;
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        bool more = i + 1 < argc;
+        if (!strcmp(a, "--size") && more) {
+            if (sscanf(argv[++i], "%"SCNu32"x%"SCNu32, &s_opt.width, &s_opt.height) != 2 ||
+                !s_opt.width || !s_opt.height) {
+                return usage();
+            }
+        } else if (!strcmp(a, "--threshold") && more) {
+            s_opt.threshold = atoi(argv[++i]);
+        } else if (!strcmp(a, "--iters") && more) {
+            s_opt.iters = atoi(argv[++i]);
+        } else if (!strcmp(a, "--suite") && more) {
+            suite = argv[++i];
+        } else if (!strcmp(a, "--out") && more) {
+            s_opt.out_dir = argv[++i];
+        } else if (!strcmp(a, "--scores") && more) {
+            s_opt.scores = fopen(argv[++i], "w");
+            if (!s_opt.scores) {
+                fprintf(stderr, "cannot write %s\n", argv[i]);
+                return 2;
+            }
+            fprintf(s_opt.scores, "sequence,detector,frame,score\n");
+        } else if (!strcmp(a, "-v")) {
+            host_log_level = 3;
+        } else if (a[0] == '-') {
+            return usage();
+        } else {
+            first_file = i;
+            break;
+        }
+    }
+    if (s_opt.iters < 1 || s_opt.threshold < 1) {
+        return usage();
+    }
+
+    if (first_file == argc) {
+        bool all = !strcmp(suite, "all");
+        if (!all && strcmp(suite, "motion") && strcmp(suite, "avi")) {
+            return usage();
+        }
+        run_synthetic(all || !strcmp(suite, "motion"), all || !strcmp(suite, "avi"));
+    }
+    for (int i = first_file; i < argc; i++) {
+        seq_t s;
+        esp_err_t err;
+        if (ends_with(argv[i], ".avi")) {
+            err = seq_load_avi(argv[i], &s);
+        } else if (ends_with(argv[i], ".gray")) {
+            err = seq_load_gray(argv[i], s_opt.width, s_opt.height, &s);
+        } else {
+            fprintf(stderr, "%s: expected .avi or .gray\n", argv[i]);
+            return 2;
+        }
+        if (err != ESP_OK) {
+            fprintf(stderr, "%s: %s\n", argv[i], esp_err_to_name(err));
+            return 2;
+        }
+        if (s.fmt == CAM_PIXFMT_JPEG) {
+            bench_avi(&s);
+        } else {
+            bench_motion(&s);
+        }
+        seq_free(&s);
+    }
+
+    if (s_opt.scores) {
+        fclose(s_opt.scores);
+    }
+    printf("\n%s — %d check%s failed\n", s_failed ? "FAIL" : "PASS", s_failed, s_failed == 1 ? "" : "s");
+    return s_failed ? 1 : 0;
+}
@@ -0,0 +1,323 @@
+/*
+ * seq.c — Frame sequences for the host bench (see seq.h)
+ */
+
+#include "seq.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_heap_caps.h"
+
+#define ALIGN           16
+#define FPS             10          /* timestamps only */
+
+#define FOURCC(a,b,c,d) ((uint32_t)(a) | ((uint32_t)(b)<<8) | \
+                         ((uint32_t)(c)<<16) | ((uint32_t)(d)<<24))
+
+/* Synthetic scenes, in QVGA units (scaled to the frame width) */
+#define NOISE_LEVELS    3           /* sensor noise, ± grey levels */
+#define LIGHT_STEP      30          /* below the 40-level pixel threshold */
+#define WALKER_W        64
+#define WALKER_H        96
+#define WALKER_SQUARE   8           /* one square per frame: every pixel flips */
+#define WALKER_START    40          /* after the 30-frame warmup */
+#define WALKER_DARK     40
+#define WALKER_LIGHT    220
+
+/* JPEG-shaped frames: VGA clip sizes */
+#define JPEG_MIN_BYTES  24000
+#define JPEG_SPREAD     16000
+
+static size_t round_up(size_t v)
+{
+    return (v + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+}
+
+static uint32_t xorshift(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/* Frame table for count frames and total bytes of frame data */
+static esp_err_t seq_alloc(seq_t *s, uint32_t count, size_t total)
+{
+    s->count  = count;
+    s->data   = heap_caps_aligned_alloc(ALIGN, total ? total : ALIGN, MALLOC_CAP_8BIT);
+    s->offset = calloc(count ? count : 1, sizeof(size_t));
+    s->len    = calloc(count ? count : 1, sizeof(size_t));
+    if (!s->data || !s->offset || !s->len) {
+        seq_free(s);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static void set_name(seq_t *s, const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    snprintf(s->name, sizeof(s->name), "%s", slash ? slash + 1 : path);
+}
+
+static uint8_t *read_file(const char *path, size_t *size)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+    uint8_t *buf = NULL;
+    long n = -1;
+    if (fseek(fp, 0, SEEK_END) == 0 && (n = ftell(fp)) > 0 && fseek(fp, 0, SEEK_SET) == 0) {
+        buf = malloc((size_t)n);
+        if (buf && fread(buf, 1, (size_t)n, fp) != (size_t)n) {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    fclose(fp);
+    *size = n > 0 ? (size_t)n : 0;
+    return buf;
+}
+
+static uint32_t rd32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+esp_err_t seq_load_gray(const char *path, uint32_t width, uint32_t height, seq_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    size_t size;
+    uint8_t *file = read_file(path, &size);
+    if (!file) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    size_t frame = (size_t)width * height;
+    uint32_t count = frame ? (uint32_t)(size / frame) : 0;
+    if (count == 0) {
+        free(file);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    esp_err_t err = seq_alloc(out, count, count * round_up(frame));
+    if (err != ESP_OK) {
+        free(file);
+        return err;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        out->offset[i] = i * round_up(frame);
+        out->len[i]    = frame;
+        memcpy(out->data + out->offset[i], file + i * frame, frame);
+    }
+    free(file);
+    set_name(out, path);
+    out->fmt    = CAM_PIXFMT_GRAY8;
+    out->width  = width;
+    out->height = height;
+    return ESP_OK;
+}
+
+/* First chunk with fourcc id (or LIST of type id) in [pos, end); 0 if none */
+static size_t find_chunk(const uint8_t *f, size_t pos, size_t end, uint32_t id, bool list)
+{
+    while (pos + 12 <= end) {
+        uint32_t ck = rd32(f + pos), cb = rd32(f + pos + 4);
+        if (list ? (ck == FOURCC('L','I','S','T') && rd32(f + pos + 8) == id) : ck == id) {
+            return pos;
+        }
+        size_t next = pos + 8 + cb + (cb & 1u);
+        if (next <= pos) {
+            break;
+        }
+        pos = next;
+    }
+    return 0;
+}
+
+esp_err_t seq_load_avi(const char *path, seq_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    size_t size;
+    uint8_t *f = read_file(path, &size);
+    if (!f) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (size < 12 || rd32(f) != FOURCC('R','I','F','F') || rd32(f + 8) != FOURCC('A','V','I',' ')) {
+        free(f);
+        return ESP_ERR_NOT_FOUND;
+    }
+    size_t hdrl = find_chunk(f, 12, size, FOURCC('h','d','r','l'), true);
+    size_t movi = find_chunk(f, 12, size, FOURCC('m','o','v','i'), true);
+    size_t avih = hdrl ? find_chunk(f, hdrl + 12, size, FOURCC('a','v','i','h'), false) : 0;
+    if (!movi || !avih || avih + 8 + 40 > size) {
+        free(f);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* Two passes over movi: count, then copy */
+    size_t movi_end = movi + 8 + rd32(f + movi + 4);
+    if (movi_end > size || movi_end <= movi + 12) {
+        movi_end = size;                /* unpatched header of a cut-short clip */
+    }
+    uint32_t count = 0;
+    size_t total = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        size_t pos = movi + 12;
+        uint32_t n = 0;
+        size_t at = 0;
+        while (pos + 8 <= movi_end) {
+            uint32_t ck = rd32(f + pos), cb = rd32(f + pos + 4);
+            size_t next = pos + 8 + cb + (cb & 1u);
+            if (next > movi_end || next <= pos) {
+                break;
+            }
+            if ((ck >> 16) == ('d' | ('c' << 8)) && cb >= 2 &&
+                f[pos + 8] == 0xFF && f[pos + 9] == 0xD8) {
+                if (pass == 0) {
+                    total += round_up(cb);
+                } else {
+                    out->offset[n] = at;
+                    out->len[n]    = cb;
+                    memcpy(out->data + at, f + pos + 8, cb);
+                    at += round_up(cb);
+                }
+                n++;
+            }
+            pos = next;
+        }
+        if (pass == 0) {
+            count = n;
+            if (count == 0) {
+                free(f);
+                return ESP_ERR_INVALID_SIZE;
+            }
+            esp_err_t err = seq_alloc(out, count, total);
+            if (err != ESP_OK) {
+                free(f);
+                return err;
+            }
+        }
+    }
+    set_name(out, path);
+    out->fmt    = CAM_PIXFMT_JPEG;
+    out->width  = rd32(f + avih + 8 + 32);      /* avih dwWidth */
+    out->height = rd32(f + avih + 8 + 36);
+    free(f);
+    return ESP_OK;
+}
+
+static uint8_t background(uint32_t x, uint32_t y, uint32_t scale_num, uint32_t scale_den)
+{
+    /* Texture in QVGA coordinates, so every resolution sees the same scene */
+    uint32_t qx = x * scale_den / scale_num, qy = y * scale_den / scale_num;
+    return (uint8_t)(64 + ((qx * 3 + qy * 5) & 63) + (((qx / 16 + qy / 16) & 1) ? 40 : 0));
+}
+
+esp_err_t seq_synth_gray(seq_scene_t scene, uint32_t width, uint32_t height,
+                         uint32_t frames, seq_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (scene >= SEQ_SCENE_COUNT || width == 0 || height == 0 || frames == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t frame = (size_t)width * height;
+    esp_err_t err = seq_alloc(out, frames, frames * round_up(frame));
+    if (err != ESP_OK) {
+        return err;
+    }
+    static const char *const NAMES[SEQ_SCENE_COUNT] = { "static", "light_step", "walker" };
+    snprintf(out->name, sizeof(out->name), "%s_%"PRIu32"x%"PRIu32, NAMES[scene], width, height);
+    out->fmt    = CAM_PIXFMT_GRAY8;
+    out->width  = width;
+    out->height = height;
+    out->expect = scene == SEQ_SCENE_WALKER ? SEQ_EXPECT_MOTION : SEQ_EXPECT_QUIET;
+    out->expect_from = WALKER_START;
+
+    const uint32_t num = width, den = 320;      /* QVGA → frame scale */
+    const uint32_t ww = WALKER_W * num / den, wh = WALKER_H * num / den;
+    const uint32_t sq = WALKER_SQUARE * num / den ? WALKER_SQUARE * num / den : 1;
+    const uint32_t wy = (height - (wh < height ? wh : height)) / 2;
+    uint32_t rng = 0x2545F491u;
+
+    for (uint32_t i = 0; i < frames; i++) {
+        out->offset[i] = i * round_up(frame);
+        out->len[i]    = frame;
+        uint8_t *p = out->data + out->offset[i];
+        int light = (scene == SEQ_SCENE_LIGHT_STEP && i >= frames / 2) ? LIGHT_STEP : 0;
+        /* Walker enters at WALKER_START and moves one square per frame */
+        int64_t wx = (scene == SEQ_SCENE_WALKER && i >= WALKER_START)
+                   ? (int64_t)(i - WALKER_START) * sq : -1;
+
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                int v;
+                if (wx >= 0 && (int64_t)x >= wx && (int64_t)x < wx + ww && y >= wy && y < wy + wh) {
+                    /* Squares fixed to the object: a one-square move flips them all */
+                    uint32_t cx = (uint32_t)((int64_t)x - wx) / sq, cy = (y - wy) / sq;
+                    v = ((cx + cy) & 1) ? WALKER_LIGHT : WALKER_DARK;
+                } else {
+                    v = background(x, y, num, den) + light;
+                }
+                v += (int)(xorshift(&rng) % (2 * NOISE_LEVELS + 1)) - NOISE_LEVELS;
+                p[(size_t)y * width + x] = (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t seq_synth_jpeg(uint32_t width, uint32_t height, uint32_t frames, seq_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (frames == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = seq_alloc(out, frames, frames * round_up(JPEG_MIN_BYTES + JPEG_SPREAD));
+    if (err != ESP_OK) {
+        return err;
+    }
+    snprintf(out->name, sizeof(out->name), "mjpeg_%"PRIu32"x%"PRIu32, width, height);
+    out->fmt    = CAM_PIXFMT_JPEG;
+    out->width  = width;
+    out->height = height;
+
+    uint32_t rng = 0x9E3779B9u;
+    for (uint32_t i = 0; i < frames; i++) {
+        size_t len = JPEG_MIN_BYTES + xorshift(&rng) % JPEG_SPREAD;   /* odd sizes too */
+        out->offset[i] = i * round_up(JPEG_MIN_BYTES + JPEG_SPREAD);
+        out->len[i]    = len;
+        uint8_t *p = out->data + out->offset[i];
+        for (size_t k = 2; k < len - 2; k++) {
+            p[k] = (uint8_t)xorshift(&rng);
+        }
+        p[0] = 0xFF; p[1] = 0xD8;
+        p[len - 2] = 0xFF; p[len - 1] = 0xD9;
+    }
+    return ESP_OK;
+}
+
+cam_frame_t seq_frame(const seq_t *s, uint32_t i)
+{
+    return (cam_frame_t) {
+        .data         = s->data + s->offset[i],
+        .len          = s->len[i],
+        .width        = s->width,
+        .height       = s->height,
+        .fmt          = s->fmt,
+        .timestamp_us = (uint64_t)i * 1000000u / FPS,
+    };
+}
+
+void seq_free(seq_t *s)
+{
+    heap_caps_free(s->data);
+    free(s->offset);
+    free(s->len);
+    s->data   = NULL;
+    s->offset = NULL;
+    s->len    = NULL;
+    s->count  = 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * seq.h — Frame sequences for the host bench
+ *
+ * A sequence is a run of same-sized frames held in one buffer:
+ *
+ *   GRAY8  — raw 8-bit frames back to back (motion-mode QVGA, or the DUAL
+ *            80×60 luma), loaded from a .gray file whose size is given on
+ *            the command line. Every frame starts 16-byte aligned, as the
+ *            camera DMA buffers do, so SIMD kernels take their fast path.
+ *   JPEG   — the 00dc chunks of an MJPEG AVI, i.e. a clip straight off the
+ *            SD card or out of the bucket.
+ *
+ * Synthetic scenes have a known answer (expect_*), so the bench can fail
+ * on a wrong trigger decision without any recording at hand.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "camera_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SEQ_NAME_LEN    64
+
+typedef enum {
+    SEQ_EXPECT_NONE = 0,      /* recording — no known answer */
+    SEQ_EXPECT_QUIET,         /* no frame may trigger */
+    SEQ_EXPECT_MOTION,        /* triggers from expect_from, none before */
+} seq_expect_t;
+
+typedef enum {
+    SEQ_SCENE_STATIC,         /* textured background + sensor noise */
+    SEQ_SCENE_LIGHT_STEP,     /* static, then the whole frame brightens */
+    SEQ_SCENE_WALKER,         /* checkerboard object crossing the frame */
+    SEQ_SCENE_COUNT,
+} seq_scene_t;
+
+typedef struct {
+    char          name[SEQ_NAME_LEN];
+    cam_pixfmt_t  fmt;        /* CAM_PIXFMT_GRAY8 or CAM_PIXFMT_JPEG */
+    uint32_t      width;
+    uint32_t      height;
+    uint32_t      count;
+    uint8_t      *data;       /* all frames, 16-byte aligned */
+    size_t       *offset;     /* count entries */
+    size_t       *len;        /* count entries */
+    seq_expect_t  expect;
+    uint32_t      expect_from;    /* SEQ_EXPECT_MOTION: first moving frame */
+} seq_t;
+
+/**
+ * @brief  Load raw GRAY8 frames. A trailing partial frame is ignored.
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if the file cannot be read,
+ *         ESP_ERR_INVALID_SIZE if it holds no whole frame.
+ */
+esp_err_t seq_load_gray(const char *path, uint32_t width, uint32_t height, seq_t *out);
+
+/**
+ * @brief  Load the JPEG frames of an MJPEG AVI by walking its movi list.
+ *         Frame size comes from avih. Stops at the first damaged chunk.
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if unreadable or not an AVI,
+ *         ESP_ERR_INVALID_SIZE if it holds no frame.
+ */
+esp_err_t seq_load_avi(const char *path, seq_t *out);
+
+/**
+ * @brief  Generate a synthetic GRAY8 scene. Geometry scales with width,
+ *         so 320×240 and 80×60 (DUAL luma) describe the same scene.
+ *         Deterministic: the same arguments give the same frames.
+ */
+esp_err_t seq_synth_gray(seq_scene_t scene, uint32_t width, uint32_t height,
+                         uint32_t frames, seq_t *out);
+
+/**
+ * @brief  Generate JPEG-shaped frames (SOI, random body, EOI) with a size
+ *         spread like VGA clips. Enough for the container — avi_writer
+ *         never decodes.
+ */
+esp_err_t seq_synth_jpeg(uint32_t width, uint32_t height, uint32_t frames, seq_t *out);
+
+/**
+ * @brief  Frame i as a cam_frame_t (timestamps at 10 fps).
+ */
+cam_frame_t seq_frame(const seq_t *s, uint32_t i);
+
+/**
+ * @brief  Free the frames. Safe on a zeroed seq_t.
+ */
+void seq_free(seq_t *s);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,26 @@
+/*
+ * esp_log.h — Host shim: ESP_LOGx to stderr
+ *
+ * host_log_level (bench_main.c) filters like the IDF log level:
+ * 0 none, 1 error, 2 warn, 3 info, 4 debug. The bench defaults to errors
+ * so per-clip info and repair warnings don't swamp the report; -v raises it.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <inttypes.h>
+
+extern int host_log_level;
+
+#define HOST_LOG(level, letter, tag, fmt, ...) do {                             \
+        if (host_log_level >= (level)) {                                        \
+            fprintf(stderr, letter " %s: " fmt "\n", tag, ##__VA_ARGS__);       \
+        }                                                                       \
+    } while (0)
+
+#define ESP_LOGE(tag, fmt, ...) HOST_LOG(1, "E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) HOST_LOG(2, "W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) HOST_LOG(3, "I", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) HOST_LOG(4, "D", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) HOST_LOG(5, "V", tag, fmt, ##__VA_ARGS__)
@@ -13,8 +13,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
-#include <dirent.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
@@ -31,12 +31,21 @@
 #include "boot_console.h"
 #include "lcd_ui.h"
 #include "button_adc.h"
+#include "upload_sched.h"
+#include "clip_catalog.h"
+#include "thumbnail.h"
+#include "rate_ctrl.h"
+#include "sys_monitor.h"
+#include "trace.h"
+#include "power_mgr.h"
+#include "preview_stream.h"
 
 static const char *TAG = "main";
 
-/* Queue depth: large enough to absorb all pending clips from upload_all_pending() */
+/* Queue depth: closed clips, live progress and wake-ups. The clips
+ * themselves wait in the upload_sched manifest, not in the queue. */
 #define UPLOAD_QUEUE_DEPTH  20
-#define CLIP_NAME_LEN       64
+#define CLIP_NAME_LEN       UPLOAD_SCHED_NAME_LEN
 
 /* Motion-stop detection during recording — passive JPEG size differencing.
  *
@@ -50,73 +59,366 @@ static const char *TAG = "main";
  *
  * JPEG_SIZE_MOTION_BYTES: consecutive frames must differ by at least this many
  * bytes to count as motion. A moving scene typically varies by 500–3000 bytes
- * per frame; a static scene varies by < 100 bytes. */
+ * per frame; a static scene varies by < 100 bytes. A rate_ctrl quality step
+ * moves the size too, so the comparison pauses for RATE_SETTLE_FRAMES. */
 #define JPEG_SIZE_MOTION_BYTES  500
+#define RATE_SETTLE_FRAMES       3
 #define MOTION_STOP_TIMEOUT_S    8
 
+/* app_main runs motion watch and the recording loop. At the default
+ * priority (1) the thumbnail encoder (2) would preempt it mid-clip; 4 keeps
+ * it below cam_cap and clip_wr (6) on the media core. The upload task (5)
+ * is on the other core. */
+#define MAIN_LOOP_PRIO           4
+#define UPLOAD_TASK_PRIO         5
+
+/* A short clip can be closed before its thumbnail is encoded; the upload
+ * waits this long for it, then sends the clip without one. A live upload
+ * waits the same before mp_start — its thumbnail triggers the alert. */
+#define THUMB_SETTLE_MS       3000
+
+/* Upload queue item. UPLOAD_LIVE is posted from the clip writer task while
+ * a clip records (CONFIG_LIVE_UPLOAD); UPLOAD_CLIP once it is closed and
+ * in the manifest. */
+typedef enum {
+    UPLOAD_CLIP,            /* clip closed and in the manifest — write its sidecar */
+    UPLOAD_LIVE,            /* clip still recording — committed bytes are final */
+    UPLOAD_WAKE,            /* scheduler state changed (link up) */
+    UPLOAD_RESCAN,          /* manual retry: adopt the card's clips, all due now */
+} upload_msg_type_t;
+
+typedef struct {
+    upload_msg_type_t type;
+    uint32_t          committed;
+    char              clip_file[CLIP_NAME_LEN];
+    trace_window_t   *trace;    /* UPLOAD_CLIP: sidecar to write, or NULL */
+} upload_msg_t;
+
+#define LIVE_PART_BYTES     ((uint32_t)CONFIG_LIVE_UPLOAD_PART_KB * 1024)
+
 static QueueHandle_t g_upload_queue;
 static QueueHandle_t g_btn_queue;
 
+static esp_err_t queue_upload(upload_msg_type_t type, const char *clip_file, uint32_t committed)
+{
+    upload_msg_t msg = { .type = type, .committed = committed };
+    strlcpy(msg.clip_file, clip_file, sizeof(msg.clip_file));
+    return xQueueSend(g_upload_queue, &msg, 0) == pdTRUE ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
 /* ── upload_all_pending ─────────────────────────────────────────────────── */
-/* Scan /sdcard/ for *.avi files and post each basename to the upload queue. */
+/* clip_catalog rebuild callback — adds the clip to the upload manifest.
+ * Clips cut short by a reset are repaired first; unrecoverable ones are
+ * deleted rather than uploaded. */
+static bool adopt_clip(const char *clip_file, void *ctx)
+{
+    if (strlen(clip_file) >= CLIP_NAME_LEN) {
+        return true;
+    }
+    char path[CLIP_NAME_LEN + 32];
+    snprintf(path, sizeof(path), "/sdcard/%s", clip_file);
+    esp_err_t rerr = clip_writer_repair(path, NULL);
+    if (rerr == ESP_ERR_NOT_FOUND) {
+        ESP_LOGW(TAG, "Deleting unrecoverable clip %s", clip_file);
+        clip_writer_remove(path);
+        return false;
+    }
+    if (rerr != ESP_ERR_INVALID_STATE) {        /* not still recording */
+        upload_sched_add(clip_file);
+    }
+    return true;
+}
+
+/* clip_writer_repair_all callback at boot. A clip reaches the manifest at
+ * close, on the recording loop, so one cut short by a reset is only on the
+ * card: add it. Raw H.264 has no open/closed state, and an uploaded clip is
+ * deleted, so any .h264 still on the card is waiting — listed ones just
+ * stay where they are. */
+static void on_boot_repair(const char *clip_file, esp_err_t err, bool repaired, void *ctx)
+{
+    size_t len = strlen(clip_file);
+    bool h264 = len > 5 && !strcmp(clip_file + len - 5, ".h264");
+    if (err == ESP_OK && (repaired || h264) && len < CLIP_NAME_LEN) {
+        upload_sched_add(clip_file);
+    }
+}
+
+/* Recount the card and add every clip on it to the upload manifest.
+ * Only needed when the manifest is missing (first boot with it) and on a
+ * manual PLAY long press, to pick up clips copied onto the card — that one
+ * runs on the upload task, f_getfree and the directory pass take seconds. */
 static void upload_all_pending(void)
 {
-    DIR *d = opendir("/sdcard");
-    if (!d) {
-        ESP_LOGW(TAG, "upload_all_pending: cannot open /sdcard");
+    clip_catalog_rebuild("/sdcard", adopt_clip, NULL);
+    clip_catalog_stats_t cat;
+    clip_catalog_get(&cat);
+    ESP_LOGI(TAG, "upload_all_pending: %u clip(s) on card, %u in manifest",
+             (unsigned)cat.pending, (unsigned)upload_sched_pending());
+}
+
+#if CONFIG_LIVE_UPLOAD
+/* clip_writer fragment callback — runs on the writer task, must not block.
+ * Posts once at the first fragment (starts the upload, sends the thumbnail
+ * — which raises the alert) and then once per whole part. */
+static void on_clip_fragment(const char *path, uint32_t committed, void *ctx)
+{
+    static char     s_clip[CLIP_NAME_LEN];
+    static uint32_t s_parts_posted;
+
+    const char *clip_file = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    bool first = strcmp(clip_file, s_clip) != 0;
+    uint32_t parts = committed / LIVE_PART_BYTES;
+    if (!first && parts <= s_parts_posted) {
         return;
     }
-    int queued = 0;
-    struct dirent *e;
-    while ((e = readdir(d)) != NULL) {
-        size_t len = strlen(e->d_name);
-        if (len < 5) continue;
-        if (strcmp(e->d_name + len - 4, ".avi") != 0) continue;
-
-        /* Strip ".avi" extension to get the basename */
-        char basename[CLIP_NAME_LEN];
-        strlcpy(basename, e->d_name, sizeof(basename));
-        basename[len - 4] = '\0';
-
-        if (xQueueSend(g_upload_queue, basename, 0) == pdTRUE) {
-            ESP_LOGI(TAG, "Queued for upload: %s", basename);
-            queued++;
-        } else {
-            ESP_LOGW(TAG, "Upload queue full — skipping %s", basename);
-        }
+    if (queue_upload(UPLOAD_LIVE, clip_file, committed) == ESP_OK) {
+        strlcpy(s_clip, clip_file, sizeof(s_clip));
+        s_parts_posted = parts;
+    }
+}
+#endif
+
+static void thumb_path_of(const char *clip_file, char *out, size_t out_len)
+{
+    const char *dot = strrchr(clip_file, '.');
+    snprintf(out, out_len, "/sdcard/%.*s_thumb.jpg",
+             dot ? (int)(dot - clip_file) : (int)strlen(clip_file), clip_file);
+}
+
+static void start_thumbnail(const char *base)
+{
+    char path[CLIP_NAME_LEN + 32];
+    snprintf(path, sizeof(path), "/sdcard/%s_thumb.jpg", base);
+    thumbnail_begin(path);
+}
+
+/* Let the rate controller pick the next clip's frame rate from the last
+ * clip and the measured SD and upload rates. Returns the frame interval. */
+static int64_t pick_clip_rate(void)
+{
+    clip_writer_stats_t ws;
+    clip_writer_get_stats(&ws);
+    uint32_t fps = rate_ctrl_clip_begin(ws.sink_kbps, cloud_client_get_upload_kbps());
+    clip_writer_set_fps(fps);
+    return 1000000LL / fps;
+}
+
+static void delete_clip_files(const char *clip_file)
+{
+    char path[CLIP_NAME_LEN + 32];
+    snprintf(path, sizeof(path), "/sdcard/%s", clip_file);
+    struct stat st;
+    uint64_t bytes = stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+    if (clip_writer_remove(path) == ESP_OK) {
+        clip_catalog_clip_removed(clip_file, bytes, true);
     }
-    closedir(d);
-    ESP_LOGI(TAG, "upload_all_pending: queued %d clip(s)", queued);
 }
 
 /* Upload task — owns all WiFi/HTTP work, decoupled from recording loop */
+static cloud_live_upload_t s_live;
+static char s_live_failed[CLIP_NAME_LEN];      /* no second live attempt for this clip */
+
+static void handle_live(const upload_msg_t *msg)
+{
+    const char *clip_file = msg->clip_file;
+    if (!strcmp(clip_file, s_live_failed)) {
+        return;
+    }
+    esp_err_t err = ESP_OK;
+    if (!s_live.active || strcmp(s_live.clip_file, clip_file) != 0) {
+        if (s_live.active) {
+            cloud_client_live_detach(&s_live);   /* previous clip never closed */
+        }
+        /* The thumbnail lands in S3 right after mp_start and the notify
+         * Lambda alerts on it, so the alert does not wait for the clip.
+         * It is due CONFIG_THUMB_WINDOW_MS into the clip. */
+        char thumb_path[CLIP_NAME_LEN + 32];
+        thumb_path_of(clip_file, thumb_path, sizeof(thumb_path));
+        if (thumbnail_settle(thumb_path, THUMB_SETTLE_MS) != ESP_OK) {
+            ESP_LOGW(TAG, "Thumbnail of %s not ready — alert waits for the clip", clip_file);
+        }
+        ESP_LOGW(TAG, ">>> LIVE START    %s", clip_file);
+        err = cloud_client_live_begin(&s_live, clip_file, LIVE_PART_BYTES);
+    }
+    if (err == ESP_OK) {
+        err = cloud_client_live_advance(&s_live, msg->committed);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, ">>> LIVE FAIL     %s  (%s) — upload after close",
+                 clip_file, esp_err_to_name(err));
+        cloud_client_live_detach(&s_live);
+        strlcpy(s_live_failed, clip_file, sizeof(s_live_failed));
+    }
+}
+
+static void upload_clip(const char *clip_file)
+{
+    ESP_LOGW(TAG, ">>> UPLOAD START  %s", clip_file);
+    lcd_ui_notify_uploading(true, clip_file);
+
+    char thumb_path[CLIP_NAME_LEN + 32];
+    thumb_path_of(clip_file, thumb_path, sizeof(thumb_path));
+    if (thumbnail_settle(thumb_path, THUMB_SETTLE_MS) != ESP_OK) {
+        ESP_LOGW(TAG, "Thumbnail of %s not ready — uploading without", clip_file);
+    }
+
+    esp_err_t err = ESP_FAIL;
+    if (s_live.active && !strcmp(s_live.clip_file, clip_file)) {
+        err = cloud_client_live_finish(&s_live);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Live upload of %s failed (%s) — resuming as a normal upload",
+                     clip_file, esp_err_to_name(err));
+            cloud_client_live_detach(&s_live);
+        }
+    }
+    if (err != ESP_OK) {
+        err = cloud_client_upload(clip_file);
+    }
+    if (err == ESP_OK) {
+        ESP_LOGW(TAG, ">>> UPLOAD OK     %s", clip_file);
+        /* Best effort: a missing sidecar never holds the clip on the card */
+        esp_err_t terr = cloud_client_upload_trace(clip_file);
+        if (terr != ESP_OK && terr != ESP_ERR_NOT_FOUND) {
+            ESP_LOGW(TAG, "Trace sidecar upload failed: %s", esp_err_to_name(terr));
+        }
+        /* Delete clip, thumbnail and sidecar from SD after successful upload */
+        delete_clip_files(clip_file);
+    } else {
+        ESP_LOGW(TAG, ">>> UPLOAD FAIL   %s  (%s)", clip_file, esp_err_to_name(err));
+    }
+    upload_sched_result(clip_file, err);
+    lcd_ui_notify_uploading(false, NULL);
+}
+
+/* Latency histograms of the clip's window, snapshot at close. Written
+ * here, before the clip is due, not on the recording loop. */
+static void write_trace_sidecar(const char *clip_file, trace_window_t *tw)
+{
+    if (!tw) {
+        return;
+    }
+    char path[CLIP_NAME_LEN + 32];
+    const char *dot = strrchr(clip_file, '.');
+    snprintf(path, sizeof(path), "/sdcard/%.*s_trace.json",
+             dot ? (int)(dot - clip_file) : (int)strlen(clip_file), clip_file);
+    if (trace_write_json(tw, path) != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot write %s", path);
+    }
+    trace_free(tw);
+}
+
+static void handle_msg(const upload_msg_t *msg)
+{
+    switch (msg->type) {
+    case UPLOAD_LIVE:
+        handle_live(msg);
+        break;
+    case UPLOAD_CLIP:
+        write_trace_sidecar(msg->clip_file, msg->trace);
+        break;
+    case UPLOAD_WAKE:
+        break;
+    case UPLOAD_RESCAN:
+        upload_all_pending();
+        upload_sched_kick();
+        break;
+    }
+}
+
+/* Presign the due clips in one Lambda round trip. The live clip uploads
+ * through its multipart session and needs no URLs, nor do clips over one
+ * part (cloud_client_prefetch() leaves those out). Misses and failures
+ * fall back to one presign per clip. */
+static void prefetch_due(char due[][UPLOAD_SCHED_NAME_LEN], size_t n)
+{
+    const char *names[CLOUD_PRESIGN_BATCH_MAX];
+    size_t count = 0;
+    for (size_t i = 0; i < n && count < CLOUD_PRESIGN_BATCH_MAX; i++) {
+        if (!(s_live.active && !strcmp(s_live.clip_file, due[i]))) {
+            names[count++] = due[i];
+        }
+    }
+    if (count > 1) {
+        cloud_client_prefetch(names, count);
+    }
+}
+
+/* wifi_manager link callback — event loop task */
+static void on_link_change(bool up, void *ctx)
+{
+    upload_sched_set_online(up);
+    if (up) {
+        queue_upload(UPLOAD_WAKE, "", 0);
+    }
+}
+
 static void upload_task(void *arg)
 {
-    char clip_name[CLIP_NAME_LEN];
+    static char due[CLOUD_PRESIGN_BATCH_MAX][UPLOAD_SCHED_NAME_LEN];
+    upload_msg_t msg;
+
+    /* WiFi associates here, in parallel with the motion watch loop.
+     * Nothing is due until the link callback reports it up. */
+    upload_sched_set_online(false);
+    wifi_manager_set_link_cb(on_link_change, NULL);
+    ESP_LOGI(TAG, "Connecting WiFi...");
+    wifi_manager_start();
+    esp_err_t perr = preview_stream_start();
+    if (perr != ESP_OK) {
+        ESP_LOGI(TAG, "Live preview off (%s)", esp_err_to_name(perr));
+    }
+
     while (1) {
-        /* Block until a clip filename is posted */
-        if (xQueueReceive(g_upload_queue, clip_name, portMAX_DELAY) == pdTRUE) {
-            ESP_LOGW(TAG, ">>> UPLOAD START  %s", clip_name);
-            lcd_ui_notify_uploading(true, clip_name);
-
-            esp_err_t err = cloud_client_upload(clip_name);
-            if (err == ESP_OK) {
-                ESP_LOGW(TAG, ">>> UPLOAD OK     %s", clip_name);
-                /* Delete clip and thumbnail from SD after successful upload */
-                char path[CLIP_NAME_LEN + 32];
-                snprintf(path, sizeof(path), "/sdcard/%s.avi", clip_name);
-                unlink(path);
-                snprintf(path, sizeof(path), "/sdcard/%s_thumb.jpg", clip_name);
-                unlink(path);
-                lcd_ui_inc_uploaded();
-            } else {
-                ESP_LOGW(TAG, ">>> UPLOAD FAIL   %s  (%s)", clip_name, esp_err_to_name(err));
+        /* Sleep until a message arrives or the next retry is due; handle
+         * every waiting message before starting an upload */
+        uint32_t wait_ms = upload_sched_wait_ms();
+        TickType_t ticks = wait_ms == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(wait_ms);
+        if (xQueueReceive(g_upload_queue, &msg, ticks) == pdTRUE) {
+            handle_msg(&msg);
+            continue;
+        }
+
+        /* Newest first. A new message (a clip that just closed, live
+         * progress) ends the round so it is looked at before older clips. */
+        size_t n = upload_sched_next(due, CLOUD_PRESIGN_BATCH_MAX);
+        if (n == 0) {
+            continue;
+        }
+        power_mgr_set_active(POWER_USER_NET, true);
+        prefetch_due(due, n);
+        for (size_t i = 0; i < n; i++) {
+            if (uxQueueMessagesWaiting(g_upload_queue) > 0) {
+                break;
             }
-            lcd_ui_notify_uploading(false, NULL);
+            upload_clip(due[i]);
         }
+        power_mgr_set_active(POWER_USER_NET, false);
     }
 }
 
+/* Recording → motion watch. A sensor reinit (single-stream) waits for
+ * every held frame, so preview viewers give theirs up first. On failure
+ * the camera is still in RECORD and the caller retries. */
+static esp_err_t enter_watch_mode(cam_mode_t watch_mode, bool dual)
+{
+    if (!dual) {
+        preview_stream_drop_frames();
+    }
+    int64_t t_mode = trace_start();
+    esp_err_t err = camera_hal_set_mode(watch_mode);
+    trace_stop(TRACE_MODE_SWITCH, t_mode);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Back to motion watch failed (%s) — retrying", esp_err_to_name(err));
+        return err;
+    }
+    if (dual) {
+        motion_detect_quick_reset();   /* same stream, AE already settled */
+    } else {
+        motion_detect_reset();   /* AE re-settling: 3 frames (background) or 30 */
+    }
+    return ESP_OK;
+}
+
 /* Generate a clip base name from current time and device ID.
  * Format: <device_id>_YYYYMMDD_HHMMSS
  * Returns pointer to static buffer — copy before next call. */
@@ -145,11 +447,82 @@ void app_main(void)
     }
     ESP_ERROR_CHECK(ret);
 
-    /* Boot console — 3-second window to enter interactive mode.
-     * Offers: format SD card, list files, system info, erase NVS, etc. */
+    if (trace_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Tracing off — no PSRAM for the event rings");
+    }
+
+    /* Boot console — blocks up to 5 s for Enter to open the interactive
+     * menu (format SD card, list files, system info, erase NVS, etc.).
+     * No wait at all after a watchdog, panic, brownout or esp_restart()
+     * reset, nor on power-on / EN with 'fastboot on'; a reset from the
+     * host over USB always opens it. */
     boot_console_run();
 
-    /* Step 1: Mount SD card — retry until a card is inserted */
+    /* Fast boot: camera and motion detection first, then the SD card so a
+     * clip can start; WiFi associates on the upload task and the LCD comes
+     * up on its refresh task, both in parallel with the watch loop. */
+
+    /* Step 1: Query capabilities — clip_writer and the watch mode depend on them */
+    const cam_caps_t *caps = camera_hal_get_caps();
+    ESP_LOGI(TAG, "Camera caps: jpeg=%d h264=%d dual=%d record=%"PRIu32"x%"PRIu32" motion=%"PRIu32"x%"PRIu32,
+             caps->delivers_jpeg, caps->delivers_h264, caps->supports_dual,
+             caps->record_width, caps->record_height,
+             caps->motion_width, caps->motion_height);
+
+    /* DUAL: stay in the record stream and score a small luma image derived
+     * from each frame — RECORD START costs nothing. MOTION: separate
+     * low-res grayscale mode, sensor reinit on every transition. */
+#if CONFIG_CAMERA_DUAL_STREAM
+    const bool dual = caps->supports_dual;
+#else
+    const bool dual = false;
+#endif
+    const cam_mode_t watch_mode = dual ? CAM_MODE_DUAL : CAM_MODE_MOTION;
+    const uint32_t   motion_w   = dual ? caps->luma_width  : caps->motion_width;
+    const uint32_t   motion_h   = dual ? caps->luma_height : caps->motion_height;
+
+    /* CONFIG_MOTION_THRESHOLD is in QVGA motion-mode pixels — scale it to
+     * the resolution actually scored (80×60 luma: 2000 → 125). */
+    int motion_threshold = (int)(((int64_t)CONFIG_MOTION_THRESHOLD * motion_w * motion_h) /
+                                 ((int64_t)caps->motion_width * caps->motion_height));
+    if (motion_threshold < 1) {
+        motion_threshold = 1;
+    }
+
+    /* Step 2: Initialise camera in watch mode — AE settles while the
+     * steps below run */
+    ESP_LOGI(TAG, "Initialising camera (%s watch)...", dual ? "dual-stream" : "motion-mode");
+    ESP_ERROR_CHECK(camera_hal_init(watch_mode));
+
+    /* Step 3: Configure clip writer for this hardware */
+    ESP_ERROR_CHECK(clip_writer_configure(caps));
+    ESP_ERROR_CHECK(thumbnail_init((size_t)CONFIG_CLIP_WRITER_SLOT_KB * 1024));
+    if (rate_ctrl_init(caps) != ESP_OK) {
+        ESP_LOGI(TAG, "Rate control off — clips record at %d fps", CONFIG_RECORD_FPS);
+    }
+#if CONFIG_LIVE_UPLOAD
+    /* Upload MP4 fragments while the clip records (S3 multipart) */
+    clip_writer_set_fragment_cb(on_clip_fragment, NULL);
+#endif
+
+    /* Step 4: Initialise motion detector.
+     * Grid cells: 4×4 px over QVGA, 1 px over the 80×60 luma (each luma
+     * pixel is already an 8×8 block mean) — an 80×60 cell grid either way. */
+    motion_detect_config_t md_cfg = {
+        .width     = motion_w,
+        .height    = motion_h,
+        .threshold = motion_threshold,
+        .algo      = MOTION_ALGO_GRID,
+        .cell_size = dual ? 1 : 4,
+#if CONFIG_MOTION_BACKGROUND_MODEL
+        .background = true,
+#endif
+    };
+    ESP_ERROR_CHECK(motion_detect_init(&md_cfg));
+    ESP_ERROR_CHECK(button_adc_init());
+    g_btn_queue = button_adc_get_queue();
+
+    /* Step 5: Mount SD card — retry until a card is inserted */
     ESP_LOGI(TAG, "Mounting SD card...");
     {
         esp_err_t sd_err;
@@ -160,45 +533,51 @@ void app_main(void)
         }
     }
 
-    /* Step 2: Connect WiFi */
-    ESP_LOGI(TAG, "Connecting WiFi...");
-    wifi_manager_connect();
+    /* Step 5b: LCD — the panel comes up on its refresh task */
+    ESP_ERROR_CHECK(lcd_ui_init());
 
-    /* Step 3: Initialise camera in motion-detection mode */
-    ESP_LOGI(TAG, "Initialising camera...");
-    ESP_ERROR_CHECK(camera_hal_init(CAM_MODE_MOTION));
+    /* Step 5c: Upload manifest — clips still waiting from before the reset */
+    esp_err_t sched_err = upload_sched_init("/sdcard");
+    if (sched_err != ESP_ERR_NOT_FOUND) {
+        ESP_ERROR_CHECK(sched_err);
+    }
 
-    /* Step 4: Query capabilities — clip_writer uses these at runtime */
-    const cam_caps_t *caps = camera_hal_get_caps();
-    ESP_LOGI(TAG, "Camera caps: jpeg=%d h264=%d record=%"PRIu32"x%"PRIu32" motion=%"PRIu32"x%"PRIu32,
-             caps->delivers_jpeg, caps->delivers_h264,
-             caps->record_width, caps->record_height,
-             caps->motion_width, caps->motion_height);
+    /* Step 5d: Clips cut short by a reset or brownout get their index
+     * rebuilt now, before anything tries to upload them — and before a
+     * new clip is open, which would look cut short too. They never got to
+     * the manifest, so the repair pass adds them. */
+    clip_writer_repair_all("/sdcard", on_boot_repair, NULL);
 
-    /* Step 5: Configure clip writer for this hardware */
-    ESP_ERROR_CHECK(clip_writer_configure(caps));
+    /* Step 5e: Without a manifest yet, adopt whatever clips are on the
+     * card. The catalog scan that counts the clips does this in the same
+     * directory pass. */
+    clip_catalog_rebuild("/sdcard", sched_err == ESP_ERR_NOT_FOUND ? adopt_clip : NULL, NULL);
 
-    /* Step 6: Initialise motion detector */
-    motion_detect_config_t md_cfg = {
-        .width     = caps->motion_width,
-        .height    = caps->motion_height,
-        .threshold = CONFIG_MOTION_THRESHOLD,
-    };
-    ESP_ERROR_CHECK(motion_detect_init(&md_cfg));
+    /* Step 6: Low-power watch — CPU clock scaling and WiFi modem sleep */
+    if (power_mgr_init() != ESP_OK) {
+        ESP_LOGI(TAG, "Low-power watch off — every frame scored at full clock");
+    }
 
-    /* Step 7: Start background upload task */
-    g_upload_queue = xQueueCreate(UPLOAD_QUEUE_DEPTH, CLIP_NAME_LEN);
+    /* Step 7: Start background upload task — it brings up WiFi */
+    g_upload_queue = xQueueCreate(UPLOAD_QUEUE_DEPTH, sizeof(upload_msg_t));
     ESP_ERROR_CHECK(g_upload_queue ? ESP_OK : ESP_ERR_NO_MEM);
 
-    xTaskCreate(upload_task, "upload", 8192, NULL, 5, NULL);
+    xTaskCreatePinnedToCore(upload_task, "upload", 8192, NULL, UPLOAD_TASK_PRIO, NULL,
+                            CONFIG_TASK_NET_CORE);
 
-    /* Step 8: Initialise LCD UI and button ADC */
-    ESP_ERROR_CHECK(lcd_ui_init());
-    ESP_ERROR_CHECK(button_adc_init());
-    g_btn_queue = button_adc_get_queue();
+    /* Step 8: Task placement check and CPU/heap telemetry */
+    if (xTaskGetCoreID(NULL) != CONFIG_TASK_MEDIA_CORE) {
+        ESP_LOGW(TAG, "app_main is not pinned to the media core (%d) — "
+                 "set ESP_MAIN_TASK_AFFINITY to match TASK_MEDIA_CORE", CONFIG_TASK_MEDIA_CORE);
+    }
+    vTaskPrioritySet(NULL, MAIN_LOOP_PRIO);
+    if (sys_monitor_start() != ESP_OK) {
+        ESP_LOGW(TAG, "sys_monitor not started");
+    }
 
     /* Main loop: motion watch → record → upload */
-    ESP_LOGI(TAG, "Entering motion watch loop");
+    ESP_LOGI(TAG, "Entering motion watch loop %"PRId64" ms after reset",
+             esp_timer_get_time() / 1000);
 
     bool recording = false;
     char current_clip[CLIP_NAME_LEN] = {0};
@@ -206,10 +585,11 @@ void app_main(void)
     int64_t motion_last_seen_us = 0;
     int64_t next_frame_us = 0;     /* FPS limiter: earliest time to capture next record frame */
     int frame_count = 0;
-    bool thumb_saved = false;
     size_t frame_prev_len = 0;     /* previous JPEG frame size for passive motion detection */
-
-#define RECORD_FRAME_INTERVAL_US  (1000000LL / CONFIG_RECORD_FPS)
+    int64_t frame_interval_us = 1000000LL / CONFIG_RECORD_FPS;  /* per clip, from rate_ctrl */
+    uint32_t rate_steps = 0;       /* rate_ctrl quality changes seen */
+    int size_settle = 0;           /* frames to skip the size comparison for */
+    bool watch_retry = false;      /* still in RECORD after a failed switch back */
 
     while (1) {
         /* ── Button event drain (non-blocking) ─────────────────────────── */
@@ -219,12 +599,15 @@ void app_main(void)
                 lcd_ui_set_screen_on(!lcd_ui_get_screen_on());
             }
             if (btn.id == BTN_PLAY && btn.type == BTN_EVT_LONG_PRESS) {
-                ESP_LOGI(TAG, "PLAY long press — queuing all pending clips");
-                upload_all_pending();
+                ESP_LOGI(TAG, "PLAY long press — retrying all pending clips now");
+                if (queue_upload(UPLOAD_RESCAN, "", 0) != ESP_OK) {
+                    ESP_LOGW(TAG, "Upload queue full — long press ignored");
+                }
             }
         }
 
         cam_frame_t frame;
+        int64_t t_get = trace_start();
         esp_err_t err = camera_hal_get_frame(&frame, 100 /* ms */);
         if (err != ESP_OK) {
             /* Timeout or transient error — keep looping */
@@ -233,85 +616,123 @@ void app_main(void)
         }
 
         if (!recording) {
+            if (watch_retry) {
+                /* RECORD frames are not what motion_detect scores */
+                camera_hal_release_frame(&frame);
+                watch_retry = enter_watch_mode(watch_mode, dual) != ESP_OK;
+                continue;
+            }
+
             /* --- MOTION WATCH --- */
-            int score = motion_detect_score(&frame);
+            trace_stop(TRACE_MOTION_WAIT, t_get);
+            int64_t t_score = trace_start();
+            motion_result_t mr = { 0 };
+            if (dual) {
+                cam_frame_t luma;
+                if (camera_hal_get_luma(&frame, &luma) == ESP_OK) {
+                    motion_detect_analyze(&luma, &mr);
+                }
+            } else {
+                motion_detect_analyze(&frame, &mr);
+            }
+            trace_stop(TRACE_MOTION_SCORE, t_score);
+            clip_writer_preroll_push(&frame);   /* copied — safe to release */
+            preview_stream_offer(&frame);       /* viewers take their own reference */
             camera_hal_release_frame(&frame);
 
-            if (score >= CONFIG_MOTION_THRESHOLD) {
-                ESP_LOGW(TAG, ">>> RECORD START  score=%d", score);
+            /* Low-power watch paces the scoring; a score near the threshold
+             * returns 0 and the next frame is scored straight away */
+            uint32_t watch_wait_ms = power_mgr_watch_frame(mr.score, motion_threshold);
 
-                /* Switch camera to record mode */
-                ESP_ERROR_CHECK(camera_hal_set_mode(CAM_MODE_RECORD));
+            if (mr.score >= motion_threshold) {
+                ESP_LOGW(TAG, ">>> RECORD START  score=%d blocks=%u bbox=(%u,%u)-(%u,%u)",
+                         mr.score, mr.active_blocks,
+                         mr.bbox_x0, mr.bbox_y0, mr.bbox_x1, mr.bbox_y1);
+                power_mgr_set_active(POWER_USER_RECORD, true);
 
-                /* Discard first 3 frames — OV2640 AE resets on reinit and needs
-                 * ~3 frames to stabilise exposure to steady state. */
-                { cam_frame_t f0; if (camera_hal_get_frame(&f0, 200) == ESP_OK) camera_hal_release_frame(&f0); }
-                { cam_frame_t f0; if (camera_hal_get_frame(&f0, 200) == ESP_OK) camera_hal_release_frame(&f0); }
-                { cam_frame_t f0; if (camera_hal_get_frame(&f0, 200) == ESP_OK) camera_hal_release_frame(&f0); }
+                /* Switch camera to record mode (no-op for the sensor in DUAL) */
+                int64_t t_mode = trace_start();
+                ESP_ERROR_CHECK(camera_hal_set_mode(CAM_MODE_RECORD));
+                trace_stop(TRACE_MODE_SWITCH, t_mode);
+
+                if (!dual) {
+                    /* Discard first 3 frames — OV2640 AE resets on reinit and needs
+                     * ~3 frames to stabilise exposure to steady state. */
+                    { cam_frame_t f0; if (camera_hal_get_frame(&f0, 200) == ESP_OK) camera_hal_release_frame(&f0); }
+                    { cam_frame_t f0; if (camera_hal_get_frame(&f0, 200) == ESP_OK) camera_hal_release_frame(&f0); }
+                    { cam_frame_t f0; if (camera_hal_get_frame(&f0, 200) == ESP_OK) camera_hal_release_frame(&f0); }
+                }
 
-                /* Open clip file */
+                /* Open clip file — clip_writer writes the pre-roll ring first,
+                 * covering the trigger latency (and the mode-switch gap above). */
                 const char *base = make_clip_name();
                 strlcpy(current_clip, base, sizeof(current_clip));
+                frame_interval_us = pick_clip_rate();
                 ESP_ERROR_CHECK(clip_writer_begin(current_clip));
+                start_thumbnail(current_clip);
 
                 recording = true;
                 record_start_us    = esp_timer_get_time();
                 motion_last_seen_us = record_start_us;
                 next_frame_us       = record_start_us;
                 frame_count = 0;
-                thumb_saved = false;
                 frame_prev_len = 0;
 
                 lcd_ui_notify_recording(true, 0);
+            } else if (watch_wait_ms > 0) {
+                vTaskDelay(pdMS_TO_TICKS(watch_wait_ms));
             }
 
         } else {
             /* --- RECORDING --- */
+            trace_stop(TRACE_FRAME_GET, t_get);
 
             /* Update elapsed time on the screen */
             int64_t now_us_rec = esp_timer_get_time();
             uint32_t elapsed_s = (uint32_t)((now_us_rec - record_start_us) / 1000000LL);
             lcd_ui_notify_recording(true, elapsed_s);
 
-            /* Save first valid JPEG frame as thumbnail.
-             * Check magic bytes (0xFF 0xD8) to reject any stale grayscale
-             * frame that GRAB_LATEST may return right after the mode switch. */
-            if (!thumb_saved && frame.fmt == CAM_PIXFMT_JPEG &&
-                frame.len > 2 &&
-                ((const uint8_t *)frame.data)[0] == 0xFF &&
-                ((const uint8_t *)frame.data)[1] == 0xD8) {
-                char thumb_path[CLIP_NAME_LEN + 32];
-                snprintf(thumb_path, sizeof(thumb_path), "/sdcard/%s_thumb.jpg", current_clip);
-                FILE *tf = fopen(thumb_path, "wb");
-                if (tf) {
-                    fwrite(frame.data, 1, frame.len, tf);
-                    fclose(tf);
-                    thumb_saved = true;
-                    ESP_LOGI(TAG, "Thumbnail saved: %s (%u bytes)",
-                             thumb_path, (unsigned)frame.len);
-                }
-            }
+            /* Thumbnail candidate — copied only if the best so far; the
+             * scaling and the file write happen on the thumb task */
+            thumbnail_offer(&frame);
 
-            /* Write frame to AVI — enforce CONFIG_RECORD_FPS rate.
+            /* Write frame to the clip — enforce the clip's frame rate
+             * (CONFIG_RECORD_FPS unless rate_ctrl lowered it).
              * The OV2640 at VGA JPEG outputs ~25fps natively; without this
-             * gate the idx1 buffer (sized for CONFIG_RECORD_FPS) overflows
-             * long before the 60s wall-clock limit is reached. */
+             * gate the idx1 buffer (sized for the clip's fps) overflows
+             * long before the 60s wall-clock limit is reached.
+             * H.264 comes paced by the HAL and every frame must be written:
+             * a skipped P-frame breaks the picture until the next IDR. */
             int64_t now_frame_us = esp_timer_get_time();
-            if (now_frame_us >= next_frame_us) {
+            if (frame.fmt == CAM_PIXFMT_H264_NALU || now_frame_us >= next_frame_us) {
                 clip_writer_write_frame(&frame);
+                rate_ctrl_on_frame(&frame);
                 frame_count++;
-                next_frame_us += RECORD_FRAME_INTERVAL_US;
+                next_frame_us += frame_interval_us;
                 /* If we fall badly behind (e.g. after a long mode switch),
                  * reset rather than burst-writing to catch up. */
                 if (next_frame_us < now_frame_us) {
-                    next_frame_us = now_frame_us + RECORD_FRAME_INTERVAL_US;
+                    next_frame_us = now_frame_us + frame_interval_us;
                 }
             }
             /* Passive motion detection: compare this JPEG frame size to the
              * previous one. A changing scene (motion) produces significant
              * frame-to-frame size variation; a static scene is stable.
-             * No mode switch — no recording gap, no video skip. */
-            if (frame_prev_len > 0) {
+             * No mode switch — no recording gap, no video skip.
+             * H.264 frame sizes jump at every IDR, so there the luma side
+             * output is scored instead, as in watch mode. */
+            if (frame.fmt == CAM_PIXFMT_H264_NALU) {
+                cam_frame_t luma;
+                motion_result_t mr = { 0 };
+                if (dual && camera_hal_get_luma(&frame, &luma) == ESP_OK) {
+                    motion_detect_analyze(&luma, &mr);
+                    if (mr.score >= motion_threshold) {
+                        motion_last_seen_us = now_frame_us;
+                    }
+                }
+            } else if (size_settle > 0) {
+                size_settle--;
+            } else if (frame_prev_len > 0) {
                 int64_t delta = (int64_t)frame.len - (int64_t)frame_prev_len;
                 if (delta < 0) delta = -delta;
                 if (delta > JPEG_SIZE_MOTION_BYTES) {
@@ -319,7 +740,14 @@ void app_main(void)
                 }
             }
             frame_prev_len = frame.len;
+            rate_ctrl_status_t rc;
+            rate_ctrl_get_status(&rc);
+            if (rc.quality_steps != rate_steps) {
+                rate_steps  = rc.quality_steps;
+                size_settle = RATE_SETTLE_FRAMES;
+            }
 
+            preview_stream_offer(&frame);
             camera_hal_release_frame(&frame);
 
             int64_t now_us = now_frame_us;
@@ -344,33 +772,46 @@ void app_main(void)
                 }
 
                 clip_writer_end();
+                thumbnail_end();
                 lcd_ui_notify_recording(false, 0);
 
-                /* Signal background upload task */
-                char upload_name[CLIP_NAME_LEN];
-                strlcpy(upload_name, current_clip, sizeof(upload_name));
-                if (xQueueSend(g_upload_queue, upload_name, 0) != pdTRUE) {
-                    ESP_LOGW(TAG, "Upload queue full — dropping clip %s", upload_name);
+                /* Into the manifest now, so a reset during a long upload
+                 * cannot strand the closed clip. The message right after
+                 * it wakes the upload task, which writes the trace sidecar
+                 * (latency histograms since the previous clip closed)
+                 * before it looks at the manifest again. */
+                upload_msg_t done = { .type = UPLOAD_CLIP };
+                snprintf(done.clip_file, sizeof(done.clip_file), "%s%s",
+                         current_clip, clip_writer_get_extension());
+#if CONFIG_TRACE_SIDECAR
+                done.trace = trace_snapshot(true);
+#endif
+                upload_sched_add(done.clip_file);
+                if (xQueueSend(g_upload_queue, &done, 0) != pdTRUE) {
+                    /* The task has messages pending — it wakes anyway */
+                    ESP_LOGW(TAG, "Upload queue full — %s without trace sidecar", done.clip_file);
+                    trace_free(done.trace);
                 }
 
                 if (stop_max) {
                     /* Motion still happening — start new clip immediately */
                     const char *base = make_clip_name();
                     strlcpy(current_clip, base, sizeof(current_clip));
+                    frame_interval_us = pick_clip_rate();
                     ESP_ERROR_CHECK(clip_writer_begin(current_clip));
+                    start_thumbnail(current_clip);
                     record_start_us     = esp_timer_get_time();
                     motion_last_seen_us = record_start_us;
                     next_frame_us       = record_start_us;
                     frame_count = 0;
-                    thumb_saved = false;
                     frame_prev_len = 0;
                     lcd_ui_notify_recording(true, 0);
                     ESP_LOGW(TAG, ">>> RECORD START  (continued after max duration)");
                 } else {
                     /* Motion stopped — return to motion watch */
-                    camera_hal_set_mode(CAM_MODE_MOTION);
-                    motion_detect_reset();   /* full warmup for AE re-settling */
+                    watch_retry = enter_watch_mode(watch_mode, dual) != ESP_OK;
                     recording = false;
+                    power_mgr_set_active(POWER_USER_RECORD, false);   /* full rate for the hold time */
                     ESP_LOGI(TAG, "Returning to motion watch");
                 }
             }
@@ -41,13 +41,19 @@ resource "aws_iam_role_policy" "lambda_s3_ses" {
           "s3:DeleteObject",       # manage Lambda: delete clip + thumbnail
           "s3:GetObjectTagging",   # list Lambda: read keep tag per clip
           "s3:PutObjectTagging",   # notify + manage Lambda: set keep tag
+          "s3:AbortMultipartUpload",     # presign Lambda: live upload abort
+          "s3:ListMultipartUploadParts", # presign Lambda: collect part ETags at complete
         ]
         Resource = "${aws_s3_bucket.clips.arn}/*"
       },
       {
-        # ListBucket required by list Lambda to paginate clips/
-        Effect   = "Allow"
-        Action   = "s3:ListBucket"
+        # ListBucket required by list Lambda to paginate clips/;
+        # ListBucketMultipartUploads by notify to spot a live upload
+        Effect = "Allow"
+        Action = [
+          "s3:ListBucket",
+          "s3:ListBucketMultipartUploads",
+        ]
         Resource = aws_s3_bucket.clips.arn
       },
       {
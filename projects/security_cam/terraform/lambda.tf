@@ -2,9 +2,12 @@
 # Lambda #1 — presign
 #
 # Called directly by the ESP32 device via HTTP GET:
-#   GET <function_url>?clip=X.avi&thumb=X_thumb.jpg
+#   GET <function_url>?clip=X.avi&thumb=X_thumb.jpg   (or clip=X.mp4, X.h264)
 #   → { "clip_url": "https://...", "thumb_url": "https://..." }
 #
+# With action=mp_start|mp_part|mp_complete|mp_abort it drives an S3
+# multipart upload instead, so a clip can be uploaded while it records.
+#
 # Returns presigned PUT URLs the device uses to upload directly to S3.
 # Exposed via Lambda Function URL (no API Gateway needed, no auth —
 # the presigned URLs themselves expire after 5 minutes).
@@ -88,7 +91,8 @@ resource "aws_cloudwatch_log_group" "presign" {
 # ---------------------------------------------------------------------------
 # Lambda #2 — notify
 #
-# Triggered by S3 when a new .avi clip lands in clips/.
+# Triggered by S3 when a new .avi, .mp4 or .h264 clip lands in clips/, or a
+# thumbnail in thumbs/ (live uploads alert on it, before the clip completes).
 # Generates a presigned GET URL (7-day expiry) and sends an SES email.
 # ---------------------------------------------------------------------------
 
@@ -16,7 +16,7 @@ Returns JSON array sorted newest-first:
     ...
   ]
 
-Clip filename format: <device_id>_YYYYMMDD_HHMMSS.avi
+Clip filename format: <device_id>_YYYYMMDD_HHMMSS.avi (or .mp4, .h264)
 Thumb filename format: <device_id>_YYYYMMDD_HHMMSS_thumb.jpg (under thumbs/ prefix)
 """
 
@@ -33,6 +33,8 @@ paginator = s3.get_paginator('list_objects_v2')
 BUCKET     = os.environ['CLIP_BUCKET']
 GET_EXPIRY = 7 * 24 * 3600   # 7 days
 
+CLIP_EXTENSIONS = ('.avi', '.mp4', '.h264')
+
 
 def parse_timestamp(name):
     """Parse DEVICE_YYYYMMDD_HHMMSS from clip basename. Returns ISO 8601 string or None."""
@@ -57,11 +59,11 @@ def handler(event, context):
     for page in pages:
         for obj in page.get('Contents', []):
             key = obj['Key']
-            if not key.endswith('.avi'):
+            if not key.endswith(CLIP_EXTENSIONS):
                 continue
 
-            # Base name: strip "clips/" prefix and ".avi" suffix
-            name = key[len('clips/'):-len('.avi')]
+            # Base name: strip "clips/" prefix and extension
+            name = os.path.splitext(key[len('clips/'):])[0]
 
             # Presigned GET URL for the clip (7-day expiry)
             clip_url = s3.generate_presigned_url(
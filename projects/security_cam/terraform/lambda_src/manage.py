@@ -3,7 +3,7 @@ manage.py — Keep and delete operations for gallery clips.
 
 Called by the web gallery (JWT-authenticated):
   POST /manage
-  Body: {"action": "keep"|"unkeep"|"delete", "clip_key": "clips/XXX.avi"}
+  Body: {"action": "keep"|"unkeep"|"delete", "clip_key": "clips/XXX.avi"}   (or .mp4, .h264)
 
 Actions:
   keep   — tag clip with keep=true  (exempt from 30-day lifecycle deletion)
@@ -22,10 +22,12 @@ from botocore.exceptions import ClientError
 s3     = boto3.client('s3')
 BUCKET = os.environ['CLIP_BUCKET']
 
+CLIP_EXTENSIONS = ('.avi', '.mp4', '.h264')
+
 
 def thumb_key(clip_key):
     """Derive thumbnail key from clip key."""
-    name = clip_key[len('clips/'):-len('.avi')]
+    name = os.path.splitext(clip_key[len('clips/'):])[0]
     return f'thumbs/{name}_thumb.jpg'
 
 
@@ -66,8 +68,8 @@ def handler(event, context):
     if not action or not clip_key:
         return {'statusCode': 400, 'body': json.dumps({'error': 'Missing action or clip_key'})}
 
-    if not clip_key.startswith('clips/') or not clip_key.endswith('.avi'):
-        return {'statusCode': 400, 'body': json.dumps({'error': 'clip_key must be clips/*.avi'})}
+    if not clip_key.startswith('clips/') or not clip_key.endswith(CLIP_EXTENSIONS):
+        return {'statusCode': 400, 'body': json.dumps({'error': 'clip_key must be clips/*.avi, clips/*.mp4 or clips/*.h264'})}
 
     try:
         if action == 'keep':
@@ -1,16 +1,33 @@
 """
 notify.py — Send a motion alert email when a new clip lands in S3.
 
-Triggered by S3 ObjectCreated event on clips/*.avi.
+Triggered by S3 ObjectCreated events on clips/*.avi, clips/*.mp4 and
+clips/*.h264 (ESP32-P4), and on thumbs/*_thumb.jpg.
 Generates a presigned GET URL (7-day expiry) so the recipient can
 download or play the clip directly from the email link.
+
+A single-PUT upload sends the 160×120 thumbnail (a few KB) just before
+the clip, so the alert goes out when the clip lands and shows the
+thumbnail inline.
+
+A multipart (live) upload sends the thumbnail right after mp_start, while
+the clip is still recording. Its thumbnail event finds the upload in
+progress and sends the alert straight away; the link works once the clip
+completes. Alert latency therefore does not grow with clip length. If
+the thumbnail never made it, the clip's own event sends a text-only alert
+at completion.
+
+Each clip is alerted once: the first event to create the alerts/<name>
+marker (a conditional PUT) sends the email, the other one finds it.
 """
 
 import boto3
-import json
+import html
 import os
 import urllib.parse
 
+from botocore.exceptions import ClientError
+
 s3  = boto3.client('s3')
 ses = boto3.client('ses')
 
@@ -18,54 +35,120 @@ BUCKET      = os.environ['CLIP_BUCKET']
 ALERT_EMAIL = os.environ['ALERT_EMAIL']
 GET_EXPIRY  = 7 * 24 * 3600   # 7 days
 
+CLIP_EXTENSIONS = ('.avi', '.mp4', '.h264')
+
+
+def live_clip_key(thumb_key):
+    """Clip key of a multipart upload in progress for this thumbnail, or None."""
+    base = thumb_key.split('/')[-1][:-len('_thumb.jpg')]
+    uploads = s3.list_multipart_uploads(Bucket=BUCKET, Prefix=f'clips/{base}.')
+    for upload in uploads.get('Uploads', []):
+        if upload['Key'].endswith(CLIP_EXTENSIONS):
+            return upload['Key']
+    return None
+
+
+def claim_alert(clip_name):
+    """True if this invocation is the first to alert for the clip."""
+    marker = f'alerts/{clip_name.rsplit(".", 1)[0]}'
+    try:
+        s3.put_object(Bucket=BUCKET, Key=marker, Body=b'', IfNoneMatch='*')
+    except ClientError as e:
+        if e.response['Error']['Code'] in ('PreconditionFailed', 'ConditionalRequestConflict'):
+            return False
+        print(f'Warning: could not write {marker}: {e} — alerting anyway')
+    return True
+
 
 def handler(event, context):
     for record in event.get('Records', []):
         key = urllib.parse.unquote_plus(record['s3']['object']['key'])
 
-        if not key.endswith('.avi'):
+        if key.startswith('thumbs/') and key.endswith('_thumb.jpg'):
+            key = live_clip_key(key)    # single-PUT uploads alert on the clip
+            if not key:
+                continue
+            live = True
+        elif key.endswith(CLIP_EXTENSIONS):
+            live = False
+        else:
             continue
 
         clip_name = key.split('/')[-1]                        # esp32-eye-01_19700101_005549.avi
         device_id = clip_name.split('_')[0]                   # esp32-eye-01
 
-        # Presigned GET URL — browser can download/play directly
-        view_url = s3.generate_presigned_url(
+        if not claim_alert(clip_name):
+            print(f'Alert for {clip_name} already sent')
+        else:
+            send_alert(key, clip_name, device_id, live)
+
+        if not live:
+            tag_not_kept(key)
+
+
+def send_alert(key, clip_name, device_id, live):
+    # Presigned GET URL — browser can download/play directly
+    view_url = s3.generate_presigned_url(
+        'get_object',
+        Params={'Bucket': BUCKET, 'Key': key},
+        ExpiresIn=GET_EXPIRY,
+    )
+
+    # Thumbnail — same presigned GET expiry as the clip link
+    thumb_key = f'thumbs/{clip_name.rsplit(".", 1)[0]}_thumb.jpg'
+    thumb_url = None
+    try:
+        s3.head_object(Bucket=BUCKET, Key=thumb_key)
+        thumb_url = s3.generate_presigned_url(
             'get_object',
-            Params={'Bucket': BUCKET, 'Key': key},
+            Params={'Bucket': BUCKET, 'Key': thumb_key},
             ExpiresIn=GET_EXPIRY,
         )
+    except ClientError:
+        pass  # not uploaded (yet) — text-only email
 
-        subject = f'Motion detected — {device_id}'
-        body = (
-            f'Motion detected on {device_id}\n\n'
-            f'Clip: {clip_name}\n\n'
-            f'Download / play (link expires in 7 days):\n'
-            f'{view_url}\n'
-        )
+    subject = f'Motion detected — {device_id}'
+    note = ' (still uploading — the link works once it is complete)' if live else ''
+    body = (
+        f'Motion detected on {device_id}\n\n'
+        f'Clip: {clip_name}{note}\n\n'
+        f'Download / play (link expires in 7 days):\n'
+        f'{view_url}\n'
+    )
 
-        ses.send_email(
-            Source=ALERT_EMAIL,
-            Destination={'ToAddresses': [ALERT_EMAIL]},
-            Message={
-                'Subject': {'Data': subject},
-                'Body':    {'Text': {'Data': body}},
-            },
-        )
+    message_body = {'Text': {'Data': body}}
+    if thumb_url:
+        message_body['Html'] = {'Data': (
+            f'<p>Motion detected on {html.escape(device_id)}</p>'
+            f'<p><a href="{html.escape(view_url)}">'
+            f'<img src="{html.escape(thumb_url)}" width="160" height="120" '
+            f'alt="{html.escape(clip_name)}"></a></p>'
+            f'<p>Clip: {html.escape(clip_name)}{html.escape(note)} — click to download / play '
+            f'(link expires in 7 days)</p>'
+        )}
 
-        print(f'Alert sent for {clip_name}')
-
-        # Tag the clip so the lifecycle rule knows it is not kept.
-        # The thumbnail is uploaded by the device immediately after the clip,
-        # but the S3 event fires as soon as the clip lands — the thumbnail may
-        # not exist yet, so we only tag the clip here.  The manage Lambda tags
-        # the thumbnail if the user explicitly keeps or un-keeps a clip.
-        try:
-            s3.put_object_tagging(
-                Bucket=BUCKET,
-                Key=key,
-                Tagging={'TagSet': [{'Key': 'keep', 'Value': 'false'}]},
-            )
-            print(f'Tagged keep=false: {key}')
-        except Exception as e:
-            print(f'Warning: could not tag {key}: {e}')
+    ses.send_email(
+        Source=ALERT_EMAIL,
+        Destination={'ToAddresses': [ALERT_EMAIL]},
+        Message={
+            'Subject': {'Data': subject},
+            'Body':    message_body,
+        },
+    )
+
+    print(f'Alert sent for {clip_name}')
+
+
+def tag_not_kept(key):
+    # Tag the clip so the lifecycle rule knows it is not kept.
+    # The manage Lambda tags the thumbnail if the user explicitly keeps
+    # or un-keeps a clip.
+    try:
+        s3.put_object_tagging(
+            Bucket=BUCKET,
+            Key=key,
+            Tagging={'TagSet': [{'Key': 'keep', 'Value': 'false'}]},
+        )
+        print(f'Tagged keep=false: {key}')
+    except Exception as e:
+        print(f'Warning: could not tag {key}: {e}')
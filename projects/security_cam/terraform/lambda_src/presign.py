@@ -2,18 +2,44 @@
 presign.py — Generate presigned S3 PUT URLs for the ESP32 device.
 
 Called by the device:
-  GET <function_url>?clip=X.avi&thumb=X_thumb.jpg
+  GET <function_url>?clip=X.avi&thumb=X_thumb.jpg     (or clip=X.mp4, X.h264)
 
 Returns:
   { "clip_url": "https://...", "thumb_url": "https://..." }
 
-The device then PUTs the AVI clip and JPEG thumbnail directly to S3
+The device then PUTs the AVI/MP4 clip and JPEG thumbnail directly to S3
 using these URLs. No AWS credentials needed on the device.
+
+Batch (a backlog of clips in one round trip):
+  GET <function_url>?clips=A.mp4,B.avi,...        (up to BATCH_MAX names)
+      → { "urls": { "A.mp4": { "clip_url": "...", "thumb_url": "..." }, ... },
+          "expires_in": 300 }
+  Thumbnail names are derived: <name>_thumb.jpg.
+
+Live upload (S3 multipart, used while a clip is still recording):
+  GET ?action=mp_start&clip=X.mp4&thumb=X_thumb.jpg
+      → { "upload_id": "...", "thumb_url": "https://..." }
+  GET ?action=mp_part&clip=X.mp4&upload_id=...&part=N
+      → { "part_url": "https://..." }          (PUT the part body here)
+  GET ?action=mp_complete&clip=X.mp4&upload_id=...&parts=N
+      → { "ok": true }
+  GET ?action=mp_abort&clip=X.mp4&upload_id=...
+      → { "ok": true }
+  GET ?action=mp_thumb&clip=X.mp4&upload_id=...&thumb=X_thumb.jpg
+      → { "thumb_url": "https://..." }    (thumbnail sent after mp_start)
+
+Trace sidecar (latency histograms written next to a clip, optional):
+  GET ?trace=X_trace.json
+      → { "trace_url": "https://..." }    (stored under traces/)
+
+The device does not track part ETags: mp_complete lists the parts S3
+holds and completes with them, after checking that exactly 1..N arrived.
 """
 
 import boto3
 import json
 import os
+from botocore.exceptions import ClientError
 
 s3 = boto3.client('s3')
 
@@ -21,6 +47,113 @@ BUCKET     = os.environ['CLIP_BUCKET']
 API_KEY    = os.environ['API_KEY']
 PUT_EXPIRY = 300   # 5 minutes — plenty of time for the device to upload
 
+CONTENT_TYPES = {'.mp4': 'video/mp4', '.avi': 'video/avi', '.h264': 'video/h264'}
+BATCH_MAX     = 8    # = CLOUD_PRESIGN_BATCH_MAX in cloud_client.h
+
+
+def put_url(key):
+    return s3.generate_presigned_url(
+        'put_object',
+        Params={'Bucket': BUCKET, 'Key': key},
+        ExpiresIn=PUT_EXPIRY,
+    )
+
+
+def reply(status, body):
+    return {
+        'statusCode': status,
+        'headers': {'Content-Type': 'application/json'},
+        'body': json.dumps(body),
+    }
+
+
+def multipart(action, params):
+    """Handle the mp_* live upload actions."""
+    clip      = params.get('clip')
+    upload_id = params.get('upload_id')
+    if not clip or (action != 'mp_start' and not upload_id):
+        return reply(400, {'error': 'Missing clip or upload_id parameter'})
+    key = f'clips/{clip}'
+
+    if action == 'mp_start':
+        thumb = params.get('thumb')
+        if not thumb:
+            return reply(400, {'error': 'Missing thumb parameter'})
+        ctype = CONTENT_TYPES.get(os.path.splitext(clip)[1], 'application/octet-stream')
+        mpu = s3.create_multipart_upload(Bucket=BUCKET, Key=key, ContentType=ctype)
+        thumb_url = put_url(f'thumbs/{thumb}')
+        print(f'Multipart upload started for clip={clip}')
+        return reply(200, {'upload_id': mpu['UploadId'], 'thumb_url': thumb_url})
+
+    if action == 'mp_thumb':
+        thumb = params.get('thumb')
+        if not thumb or '/' in thumb:
+            return reply(400, {'error': 'Missing thumb parameter'})
+        return reply(200, {'thumb_url': put_url(f'thumbs/{thumb}')})
+
+    if action == 'mp_part':
+        try:
+            part = int(params.get('part', ''))
+        except ValueError:
+            part = 0
+        if not 1 <= part <= 10000:
+            return reply(400, {'error': 'part must be 1..10000'})
+        part_url = s3.generate_presigned_url(
+            'upload_part',
+            Params={'Bucket': BUCKET, 'Key': key, 'UploadId': upload_id, 'PartNumber': part},
+            ExpiresIn=PUT_EXPIRY,
+        )
+        return reply(200, {'part_url': part_url})
+
+    if action == 'mp_complete':
+        try:
+            expected = int(params.get('parts', ''))
+        except ValueError:
+            return reply(400, {'error': 'Missing parts parameter'})
+        parts = []
+        for page in s3.get_paginator('list_parts').paginate(
+                Bucket=BUCKET, Key=key, UploadId=upload_id):
+            parts += [{'PartNumber': p['PartNumber'], 'ETag': p['ETag']}
+                      for p in page.get('Parts', [])]
+        numbers = sorted(p['PartNumber'] for p in parts)
+        if numbers != list(range(1, expected + 1)):
+            print(f'Multipart complete refused for clip={clip}: have parts {numbers}')
+            return reply(409, {'error': 'parts missing', 'have': numbers})
+        s3.complete_multipart_upload(
+            Bucket=BUCKET, Key=key, UploadId=upload_id,
+            MultipartUpload={'Parts': sorted(parts, key=lambda p: p['PartNumber'])},
+        )
+        print(f'Multipart upload completed for clip={clip} ({expected} parts)')
+        return reply(200, {'ok': True})
+
+    if action == 'mp_abort':
+        s3.abort_multipart_upload(Bucket=BUCKET, Key=key, UploadId=upload_id)
+        print(f'Multipart upload aborted for clip={clip}')
+        return reply(200, {'ok': True})
+
+    return reply(400, {'error': f'Unknown action {action}'})
+
+
+def batch(clips_param):
+    """Presigned PUT URL pairs for a comma-separated list of clip file names."""
+    names = [n for n in clips_param.split(',') if n]
+    if not 1 <= len(names) <= BATCH_MAX:
+        return reply(400, {'error': f'clips must list 1..{BATCH_MAX} names'})
+    for name in names:
+        base, ext = os.path.splitext(name)
+        if '/' in name or not base or ext not in CONTENT_TYPES:
+            return reply(400, {'error': f'Bad clip name {name}'})
+
+    urls = {}
+    for name in names:
+        base = os.path.splitext(name)[0]
+        urls[name] = {
+            'clip_url':  put_url(f'clips/{name}'),
+            'thumb_url': put_url(f'thumbs/{base}_thumb.jpg'),
+        }
+    print(f'Presigned URLs generated for {len(names)} clips: {",".join(names)}')
+    return reply(200, {'urls': urls, 'expires_in': PUT_EXPIRY})
+
 
 def handler(event, context):
     headers = event.get('headers') or {}
@@ -32,6 +165,27 @@ def handler(event, context):
         }
 
     params = event.get('queryStringParameters') or {}
+    action = params.get('action')
+    if action:
+        try:
+            return multipart(action, params)
+        except ClientError as e:
+            print(f'{action} failed: {e}')
+            code = e.response['Error']['Code']
+            # 404 tells the device its resume journal is stale (upload
+            # aborted by the lifecycle rule) so it starts over
+            return reply(404 if code == 'NoSuchUpload' else 502, {'error': code})
+
+    if 'clips' in params:
+        return batch(params['clips'])
+
+    if 'trace' in params:
+        name = params['trace']
+        if '/' in name or not name.endswith('_trace.json') or name == '_trace.json':
+            return reply(400, {'error': f'Bad trace name {name}'})
+        print(f'Presigned URL generated for trace={name}')
+        return reply(200, {'trace_url': put_url(f'traces/{name}')})
+
     clip   = params.get('clip')
     thumb  = params.get('thumb')
 
@@ -42,16 +196,8 @@ def handler(event, context):
             'body': json.dumps({'error': 'Missing clip or thumb parameter'}),
         }
 
-    clip_url = s3.generate_presigned_url(
-        'put_object',
-        Params={'Bucket': BUCKET, 'Key': f'clips/{clip}'},
-        ExpiresIn=PUT_EXPIRY,
-    )
-    thumb_url = s3.generate_presigned_url(
-        'put_object',
-        Params={'Bucket': BUCKET, 'Key': f'thumbs/{thumb}'},
-        ExpiresIn=PUT_EXPIRY,
-    )
+    clip_url  = put_url(f'clips/{clip}')
+    thumb_url = put_url(f'thumbs/{thumb}')
 
     print(f'Presigned URLs generated for clip={clip} thumb={thumb}')
 
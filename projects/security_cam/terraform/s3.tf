@@ -27,10 +27,20 @@ resource "aws_s3_bucket_public_access_block" "clips" {
 #                  Clips tagged keep=true are exempt (preserved indefinitely).
 #                  New clips are tagged keep=false by the notify Lambda at upload.
 #
+#  abort-live-uploads — drop multipart uploads a device never completed
+#                  (reset or WiFi loss mid-clip; the clip is re-uploaded
+#                  whole from SD). Their parts are billed until aborted.
+#
 #  expire-thumbs — delete all thumbnails after 30 days (no tag filter).
 #                  Thumbnails are not tagged; they always expire on schedule.
 #                  Thumbnails of kept clips will show as "no thumbnail" after
 #                  30 days, but the clip download link continues to work.
+#
+#  expire-alert-markers — delete the empty alerts/<name> objects the notify
+#                  Lambda uses to send one alert per clip, after 30 days.
+#
+#  expire-traces — delete latency trace sidecars after 30 days. They are
+#                  diagnostics only; nothing links to them.
 resource "aws_s3_bucket_lifecycle_configuration" "clips" {
   bucket = aws_s3_bucket.clips.id
 
@@ -52,6 +62,19 @@ resource "aws_s3_bucket_lifecycle_configuration" "clips" {
     }
   }
 
+  rule {
+    id     = "abort-live-uploads"
+    status = "Enabled"
+
+    filter {
+      prefix = "clips/"
+    }
+
+    abort_incomplete_multipart_upload {
+      days_after_initiation = 1
+    }
+  }
+
   rule {
     id     = "expire-thumbs"
     status = "Enabled"
@@ -64,6 +87,32 @@ resource "aws_s3_bucket_lifecycle_configuration" "clips" {
       days = 30
     }
   }
+
+  rule {
+    id     = "expire-alert-markers"
+    status = "Enabled"
+
+    filter {
+      prefix = "alerts/"
+    }
+
+    expiration {
+      days = 30
+    }
+  }
+
+  rule {
+    id     = "expire-traces"
+    status = "Enabled"
+
+    filter {
+      prefix = "traces/"
+    }
+
+    expiration {
+      days = 30
+    }
+  }
 }
 
 # One-time migration: tag any clips that existed before keep support was added.
@@ -76,7 +125,7 @@ resource "null_resource" "tag_existing_clips" {
       aws s3api list-objects-v2 \
         --bucket ${aws_s3_bucket.clips.bucket} \
         --prefix clips/ \
-        --query 'Contents[?ends_with(Key, `.avi`)].Key' \
+        --query 'Contents[?ends_with(Key, `.avi`) || ends_with(Key, `.mp4`) || ends_with(Key, `.h264`)].Key' \
         --output text \
         --region ${var.aws_region} | \
       tr '\t' '\n' | \
@@ -107,7 +156,9 @@ resource "null_resource" "tag_existing_clips" {
   depends_on = [aws_s3_bucket_lifecycle_configuration.clips]
 }
 
-# S3 → Lambda notification: fire notify Lambda when a new .avi is uploaded
+# S3 → Lambda notification: fire notify Lambda when a new .avi, .mp4 or .h264
+# (ESP32-P4 H.264 pipeline) clip is uploaded, and when a thumbnail is — a
+# live (multipart) upload alerts on its thumbnail, before the clip completes
 resource "aws_s3_bucket_notification" "clips" {
   bucket = aws_s3_bucket.clips.id
 
@@ -118,5 +169,26 @@ resource "aws_s3_bucket_notification" "clips" {
     filter_suffix       = ".avi"
   }
 
+  lambda_function {
+    lambda_function_arn = aws_lambda_function.notify.arn
+    events              = ["s3:ObjectCreated:*"]
+    filter_prefix       = "clips/"
+    filter_suffix       = ".mp4"
+  }
+
+  lambda_function {
+    lambda_function_arn = aws_lambda_function.notify.arn
+    events              = ["s3:ObjectCreated:*"]
+    filter_prefix       = "clips/"
+    filter_suffix       = ".h264"
+  }
+
+  lambda_function {
+    lambda_function_arn = aws_lambda_function.notify.arn
+    events              = ["s3:ObjectCreated:*"]
+    filter_prefix       = "thumbs/"
+    filter_suffix       = "_thumb.jpg"
+  }
+
   depends_on = [aws_lambda_permission.s3_invoke_notify]
 }
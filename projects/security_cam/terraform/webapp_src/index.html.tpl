@@ -57,7 +57,7 @@
     /* Kept clips get a coloured border so they stand out */
     .card.kept { border-color: #4caf50; }
 
-    .card img {
+    .card img, .card video {
       width: 100%;
       aspect-ratio: 4/3;
       object-fit: cover;
@@ -89,7 +89,9 @@
 
     .sz { font-size: 0.72rem; color: #555; }
 
-    /* Bottom action bar: download | keep | delete */
+    .no-play { color: #a66; }
+
+    /* Bottom action bar: [play |] download | keep | delete */
     .actions {
       display: flex;
       border-top: 1px solid #1e2130;
@@ -227,6 +229,11 @@ function renderGallery(clips) {
       ? "<img src='" + c.thumb_url + "' alt='thumbnail' loading='lazy'>"
       : "<div class='no-thumb'>no thumbnail</div>";
 
+    // MP4 clips are fragmented — the browser streams them with range requests
+    const play = /\.mp4$/.test(c.clip_key)
+      ? "<button class='btn-play' onclick='onPlay(this)' data-url='" + c.clip_url + "'>play</button>"
+      : "";
+
     const keptClass  = c.kept ? " kept" : "";
     const keepLabel  = c.kept ? "unkeep" : "keep";
     const keepActive = c.kept ? " active" : "";
@@ -240,6 +247,7 @@ function renderGallery(clips) {
          + (c.kept ? " &nbsp;<span style='color:#4caf50'>&#128274; kept</span>" : "") + "</div>"
          + "</div>"
          + "<div class='actions'>"
+         + play
          + "<a href='" + c.clip_url + "' download>download</a>"
          + "<button class='btn-keep" + keepActive + "' onclick='onKeep(this)'>" + keepLabel + "</button>"
          + "<button class='btn-del' onclick='onDelete(this)'>delete</button>"
@@ -274,6 +282,28 @@ async function onKeep(btn) {
   card.classList.remove("busy");
 }
 
+// Play button handler — swaps the thumbnail for an inline player.
+// MJPEG MP4s are not decodable by browsers; the player then says so and
+// the clip is still available through download.
+function onPlay(btn) {
+  const card  = btn.closest(".card");
+  const thumb = card.querySelector("img, .no-thumb");
+  const video = document.createElement("video");
+  video.controls = true;
+  video.autoplay = true;
+  video.preload  = "metadata";
+  if (thumb && thumb.tagName === "IMG") video.poster = thumb.src;
+  video.src = btn.dataset.url;
+  video.onerror = function() {
+    const msg = document.createElement("div");
+    msg.className = "no-thumb no-play";
+    msg.textContent = "not playable in browser — download";
+    video.replaceWith(msg);
+  };
+  if (thumb) thumb.replaceWith(video);
+  btn.remove();
+}
+
 // Delete button handler — asks for confirmation, then removes the card
 async function onDelete(btn) {
   const card    = btn.closest(".card");